@@ -0,0 +1,171 @@
+/*
+ * main_collector.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * This program is the collector of the connection_stats library.
+ * It serves a Unix domain socket that runners (connstat_runner -c) stream
+ * their samples to, and merges them per URL in memory until it is stopped
+ * (Ctrl-C). The same program queries a running collector (-q).
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h> /* Parsing using getopt */
+#include <../libconnstat/inc/connection_stats.h>
+
+/******************
+**    Defines    **
+******************/
+#define DEFAULT_COLLECTOR_SOCKET    "/tmp/connstat.sock"
+
+/******************
+**  Global Vars  **
+******************/
+/* Set by SIGINT/SIGTERM */
+static volatile int g_stop = 0;
+
+/******************
+**    Methods    **
+******************/
+/**
+* @func:  on_signal
+* @desc:  Stop serving (SIGINT/SIGTERM)
+*/
+static void on_signal(int sig) {
+	(void)sig;
+	g_stop = 1;
+}
+
+/**
+* @func:  parse_args
+* @desc:  Parse user (console) inputs
+* @param  argc	according to program arguments as received by the user
+* @param  argv	according to program arguments as received by the user
+* @param  p_path         Set to the socket of the collector
+* @param  p_query_url    Set to the URL to be queried (NULL to serve)
+* @return 0 if success, 1 otherwise
+*/
+static int parse_args(int argc, char *argv[], const char **p_path,
+					  const char **p_query_url) {
+	int opt;
+
+	*p_path = DEFAULT_COLLECTOR_SOCKET;
+	*p_query_url = NULL;
+	while ((opt = getopt (argc, argv, "l:q:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'l':
+				*p_path = optarg;
+				break;
+
+			case 'q':
+				/* Print the aggregate of a URL from a running collector */
+				*p_query_url = optarg;
+				break;
+
+			case '?':
+				return RC_PARSING_ERROR;
+		}
+	}
+	return RC_OK;
+}
+
+/**
+* @func:  query
+* @desc:  Print the aggregate of a URL from a running collector
+* @param  path    Socket of the collector
+* @param  url     URL to be queried
+* @return Return Code (taken from RC enum)
+*/
+static RC query(const char *path, const char *url) {
+	ConnStatSummary summary;
+
+	RC rc = connection_stats_collector_query(path, url, &summary);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	printf("collector: url=%s success=%d/%d (%.2f%%) connections=%d timeouts=%d\n",
+			url, summary.num_of_success, summary.num_of_samples,
+			summary.success_ratio * 100, summary.num_of_connects,
+			summary.num_of_timeouts);
+	for (int i=0; i<summary.num_of_error_classes; i++) {
+		printf("collector:   error curl_code=%d response_code=%ld count=%d\n",
+				summary.error_classes[i].curl_code,
+				summary.error_classes[i].response_code,
+				summary.error_classes[i].count);
+	}
+	if (summary.num_of_success == 0) {
+		return RC_OK;
+	}
+	printf("collector: median name_lookup=%.6f connect=%.6f start_transfer=%.6f "
+		   "total=%.6f\n", summary.name_lookup.median, summary.connect.median,
+			summary.start_transfer.median, summary.total.median);
+	printf("collector: total_time mean=%.6f stddev=%.6f min=%.6f max=%.6f\n",
+			summary.total.mean, summary.total.stddev, summary.total.min,
+			summary.total.max);
+	return RC_OK;
+}
+
+/**
+* @func:  main
+* @desc:  The main function of the program.
+*         It parses user input, then either serves as the collector
+*         (Init->Serve->Close) or queries a running one
+* @param  argc	according to program arguments as received by the user
+* @param  argv	according to program arguments as received by the user
+* @return 0 if success, 1 otherwise
+*/
+int main(int argc, char *argv[]){
+	const char *path;
+	const char *query_url;
+	int rc;
+
+	rc = parse_args(argc, argv, &path, &query_url);
+	if (rc != RC_OK) {
+		printf ("parse_args() failed: (rc=%d) \n", rc);
+		return 1;
+	}
+
+	/* Only query a running collector */
+	if (query_url != NULL) {
+		rc = query(path, query_url);
+		if (rc != RC_OK) {
+			printf ("query() failed: (rc=%d) \n", rc);
+			return 1;
+		}
+		return 0;
+	}
+
+	/* Initialize the library (the aggregate lives in it) */
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf ("connection_stats_init() failed: (rc=%d) \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	rc = connection_stats_collector_serve(path, &g_stop);
+	if (rc != RC_OK) {
+		printf ("connection_stats_collector_serve() failed: (rc=%d) \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+
+	/* Close the library */
+	rc = connection_stats_close();
+	if (rc != RC_OK) {
+		printf ("connection_stats_close() failed: (rc=%d) \n", rc);
+		return 1;
+	}
+	return 0;
+}
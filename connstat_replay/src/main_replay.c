@@ -0,0 +1,186 @@
+/*
+ * main_replay.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * This program replays a trace of the connection_stats library (written by
+ * its debug variant) from a local server, with the recorded server side
+ * timing, so a run can be measured again offline.
+ * It serves until it is stopped (Ctrl-C), or measures the replay itself (-n)
+ * and prints the statistics.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h> /* Parsing using getopt */
+#include <../libconnstat/inc/connection_stats.h>
+
+/******************
+**    Defines    **
+******************/
+#define DEFAULT_TRACE_FILE      "trace/trace.out"
+#define DEFAULT_REPLAY_PORT     8080
+
+/******************
+**  Global Vars  **
+******************/
+/* Set by SIGINT/SIGTERM (or once measured) */
+static volatile int g_stop = 0;
+
+static const char *g_trace_path = DEFAULT_TRACE_FILE;
+static int g_port = DEFAULT_REPLAY_PORT;
+static RC g_serve_rc = RC_OK;
+
+/******************
+**    Methods    **
+******************/
+/**
+* @func:  on_signal
+* @desc:  Stop serving (SIGINT/SIGTERM)
+*/
+static void on_signal(int sig) {
+	(void)sig;
+	g_stop = 1;
+}
+
+/**
+* @func:  parse_args
+* @desc:  Parse user (console) inputs
+* @param  argc	according to program arguments as received by the user
+* @param  argv	according to program arguments as received by the user
+* @param  p_num_of_http_req   Set to the samples to measure (0 to serve only)
+* @return 0 if success, 1 otherwise
+*/
+static int parse_args(int argc, char *argv[], int *p_num_of_http_req) {
+	int opt;
+
+	*p_num_of_http_req = 0;
+	while ((opt = getopt (argc, argv, "f:p:n:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f':
+				g_trace_path = optarg;
+				break;
+
+			case 'p':
+				g_port = atoi(optarg);
+				break;
+
+			case 'n':
+				/* Measure the replay (up to MAX_NUM_OF_SUPPORTED_CURL_OPER) */
+				*p_num_of_http_req = atoi(optarg);
+				break;
+
+			case '?':
+				return RC_PARSING_ERROR;
+		}
+	}
+	return RC_OK;
+}
+
+/**
+* @func:  serve_thread
+* @desc:  Replay the trace until stopped
+*/
+static void* serve_thread(void *arg) {
+	(void)arg;
+	g_serve_rc = connection_stats_replay_serve(g_trace_path, g_port, &g_stop);
+	g_stop = 1;
+	return NULL;
+}
+
+/**
+* @func:  measure
+* @desc:  Measure the replay and print the statistics
+* @param  num_of_http_req    Samples to measure
+* @return Return Code (taken from RC enum)
+*/
+static RC measure(int num_of_http_req) {
+	HttpReqData http_req_data;
+	char statistics_result[MAX_SIZE_OF_PROG_OUTPUT];
+	size_t str_len;
+
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	http_req_data.num_of_http_req = num_of_http_req;
+	snprintf(http_req_data.url, sizeof(http_req_data.url), "http://127.0.0.1:%d/", g_port);
+
+	RC rc = connection_stats_trigger(&http_req_data);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	rc = connection_stats_get_statistics(statistics_result, &str_len);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	printf("replay: %s\n", statistics_result);
+	return RC_OK;
+}
+
+/**
+* @func:  main
+* @desc:  The main function of the program.
+*         It parses user input, then replays the trace
+*         (Init->Serve[->Trigger]->Close)
+* @param  argc	according to program arguments as received by the user
+* @param  argv	according to program arguments as received by the user
+* @return 0 if success, 1 otherwise
+*/
+int main(int argc, char *argv[]){
+	int num_of_http_req;
+	pthread_t thread;
+	int rc;
+
+	rc = parse_args(argc, argv, &num_of_http_req);
+	if (rc != RC_OK) {
+		printf ("parse_args() failed: (rc=%d) \n", rc);
+		return 1;
+	}
+
+	/* Initialize the library */
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf ("connection_stats_init() failed: (rc=%d) \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (pthread_create(&thread, NULL, serve_thread, NULL) != 0) {
+		printf ("pthread_create() failed \n");
+		connection_stats_close();
+		return 1;
+	}
+
+	/* Measure once serving (give the server a moment to listen) */
+	if (num_of_http_req > 0) {
+		usleep(200000);
+		if (!g_stop) {
+			rc = measure(num_of_http_req);
+			if (rc != RC_OK) {
+				printf ("measure() failed: (rc=%d) \n", rc);
+			}
+		}
+		g_stop = 1;
+	}
+	pthread_join(thread, NULL);
+	if (g_serve_rc != RC_OK) {
+		printf ("connection_stats_replay_serve() failed: (rc=%d) \n", g_serve_rc);
+		rc = g_serve_rc;
+	}
+
+	/* Close the library */
+	if (connection_stats_close() != RC_OK) {
+		printf ("connection_stats_close() failed \n");
+		return 1;
+	}
+	return (rc == RC_OK) ? 0 : 1;
+}
@@ -18,9 +18,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h> /* Parsing using getopt */
 #include <../libconnstat/inc/connection_stats.h>
 
+/******************
+**    Defines    **
+******************/
+#define HISTORY_RANGE_SEC   3600    /* History printed when storing (-s) */
+#define HISTORY_STEP_SEC    300
+#define HISTORY_MAX_POINTS  (HISTORY_RANGE_SEC / HISTORY_STEP_SEC)
+#define MAX_NUM_OF_VARIANT_HEADERS  16
+#define VARIANT_B_PROFILE   "variant-b"
+
+/******************
+**  Structures   **
+******************/
+/* Variant B of a comparison (-x/-X), otherwise the same as the run's target */
+typedef struct {
+	int         enabled;
+	const char *url;       /* NULL for the URL of the target */
+	const char *headers[MAX_NUM_OF_VARIANT_HEADERS]; /* Sent instead of -H's */
+	int         num_of_headers;
+} CompareArgs;
+
 /******************
 **    Methods    **
 ******************/
@@ -31,16 +52,27 @@
 * @param  argc	according to program arguments as received by the user 
 * @param  argv	according to program arguments as received by the user 
 * @param  p_http_req_data    Pointer to HttpReqData to be filled by the parser 
+* @param  p_resolve          Set if a DNS resolution stage was requested
+* @param  p_read_snapshot    Set if only the published result is to be read
+* @param  p_store_dir        Set to the store directory (if storing)
+* @param  p_compare          Set to variant B (if comparing)
 * @return 0 if success, 1 otherwise
 */
-static int parse_args(int argc, char *argv[], HttpReqData *p_http_req_data) {
+static int parse_args(int argc, char *argv[], HttpReqData *p_http_req_data,
+					  int *p_resolve, int *p_read_snapshot, const char **p_store_dir,
+					  CompareArgs *p_compare) {
 	int opt;
 
 	/* Set default values before parsing */
+	memset(p_http_req_data, 0, sizeof(HttpReqData));
 	p_http_req_data->num_of_http_req = DEFAULT_NUM_OF_HTTP_REQ;
 	memcpy(p_http_req_data->url, DEFAULT_URL, DEFAULT_URL_SIZE); 
 	
-	while ((opt = getopt (argc, argv, "n:u:H:")) != -1)
+	*p_resolve = 0;
+	*p_read_snapshot = 0;
+	*p_store_dir = NULL;
+	memset(p_compare, 0, sizeof(CompareArgs));
+	while ((opt = getopt (argc, argv, "n:u:H:dr:p:mt:b:a:q:P:R:s:T:C:D:A:N:B:w:c:L:x:X:")) != -1)
 	{
 		switch (opt)
 		{
@@ -61,6 +93,159 @@ static int parse_args(int argc, char *argv[], HttpReqData *p_http_req_data) {
 				connection_stats_add_http_hdr(optarg);
 				break;
 				
+			case 'd':
+				*p_resolve = 1;
+				break;
+				
+			case 'p':
+				/* HTTP version: 1.1, 2 or 3 */
+				if (strcmp(optarg, "1.1") == 0) {
+					p_http_req_data->http_version = CONNSTAT_HTTP_VERSION_1_1;
+				} else if (strcmp(optarg, "2") == 0) {
+					p_http_req_data->http_version = CONNSTAT_HTTP_VERSION_2;
+				} else if (strcmp(optarg, "3") == 0) {
+					p_http_req_data->http_version = CONNSTAT_HTTP_VERSION_3;
+				} else {
+					printf("Unknown HTTP version %s (expected 1.1, 2 or 3) \n", optarg);
+					return RC_PARSING_ERROR;
+				}
+				break;
+				
+			case 'm':
+				p_http_req_data->multiplex = 1;
+				break;
+				
+			case 't':
+				/* Throughput mode with the given number of parallel streams */
+				p_http_req_data->mode = CONNSTAT_MODE_THROUGHPUT;
+				p_http_req_data->num_of_streams = atoi(optarg);
+				break;
+				
+			case 'b':
+				/* Throughput mode: bytes to download per request */
+				p_http_req_data->payload_bytes = atol(optarg);
+				break;
+				
+			case 'a':
+				/* Adaptive run: target CI width (sec), -n is then the budget */
+				p_http_req_data->ci_width = atof(optarg);
+				break;
+				
+			case 'q':
+				/* Adaptive run: percentile to converge (e.g. 0.9) */
+				p_http_req_data->percentile = atof(optarg);
+				break;
+				
+			case 'P':
+				/* Publish the result into a shared memory region */
+				if (connection_stats_publish(optarg) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				break;
+				
+			case 'R':
+				/* Read the result published into a shared memory region */
+				if (connection_stats_snapshot_attach(optarg) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				*p_read_snapshot = 1;
+				break;
+				
+			case 's':
+				/* Append the samples to a persistent store (directory) */
+				if (connection_stats_store_open(optarg) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				*p_store_dir = optarg;
+				break;
+				
+			case 'T':
+				/* Timeout of a single sample (ms) */
+				p_http_req_data->timeout_ms = atol(optarg);
+				break;
+				
+			case 'C':
+				/* Timeout of the connect phase of a sample (ms) */
+				p_http_req_data->connect_timeout_ms = atol(optarg);
+				break;
+				
+			case 'D':
+				/* Deadline of the whole run (ms) */
+				p_http_req_data->deadline_ms = atol(optarg);
+				break;
+				
+			case 'A':
+				/* Pin the measuring (main) thread to cores (e.g. 2,4-6) */
+				if (connection_stats_set_affinity(optarg, -1) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				break;
+				
+			case 'N':
+				/* Pin the measuring (main) thread to the cores of a NUMA node */
+				if (connection_stats_set_affinity(NULL, atoi(optarg)) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				break;
+				
+			case 'B':
+				/* Busy poll the probe sockets (usec) */
+				if (connection_stats_set_busy_poll(atoi(optarg)) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				break;
+				
+			case 'w':
+				/* Warm start from a cache file (updated when the run ends) */
+				if (connection_stats_set_cache_file(optarg) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				break;
+				
+			case 'c':
+				/* Stream the samples to a collector (see connstat_collector) */
+				if (connection_stats_collector_connect(optarg) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				break;
+				
+			case 'L':
+				/* Keep the traces of outliers only (debug variant, e.g. 0.99) */
+				if (connection_stats_set_tail_tracing(atof(optarg)) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				break;
+				
+			case 'x':
+				/* Compare against another URL (variant B, -n is the budget) */
+				if (strlen(optarg) >= URL_MAX_LEN) {
+					printf("Requested URL is too long (%d>%d) \n", 
+							(int)strlen(optarg), URL_MAX_LEN);
+					return RC_PARSING_ERROR;
+				}
+				p_compare->url = optarg;
+				p_compare->enabled = 1;
+				break;
+				
+			case 'X':
+				/* Compare against the same target sending other headers */
+				if (p_compare->num_of_headers == MAX_NUM_OF_VARIANT_HEADERS) {
+					printf("Too many headers of variant B (max %d) \n", 
+							MAX_NUM_OF_VARIANT_HEADERS);
+					return RC_PARSING_ERROR;
+				}
+				p_compare->headers[p_compare->num_of_headers++] = optarg;
+				p_compare->enabled = 1;
+				break;
+				
+			case 'r':
+				/* Resolver to be measured (implies the resolution stage) */
+				if (connection_stats_add_resolver(optarg) != RC_OK) {
+					return RC_PARSING_ERROR;
+				}
+				*p_resolve = 1;
+				break;
+				
 			case '?':
 				return RC_PARSING_ERROR;
 		}
@@ -68,6 +253,195 @@ static int parse_args(int argc, char *argv[], HttpReqData *p_http_req_data) {
 	return RC_OK;
 }
 
+/**
+* @func:  print_summary
+* @desc:  Print the full summary of the last run (success ratio, errors,
+*         and per phase statistics)
+*/
+static void print_summary() {
+	ConnStatSummary summary;
+	int i;
+	
+	if (connection_stats_get_summary(&summary) != RC_OK) {
+		return;
+	}
+	
+	printf("runner: success=%d/%d (%.2f%%) connections=%d timeouts=%d\n", 
+			summary.num_of_success, summary.num_of_samples, 
+			summary.success_ratio * 100, summary.num_of_connects, 
+			summary.num_of_timeouts);
+	printf("runner: preempted samples=%d involuntary context switches=%ld\n",
+			summary.num_of_preempted_samples, summary.involuntary_ctx_switches);
+	for (i=0; i<summary.num_of_error_classes; i++) {
+		printf("runner:   error curl_code=%d response_code=%ld count=%d\n",
+				summary.error_classes[i].curl_code,
+				summary.error_classes[i].response_code,
+				summary.error_classes[i].count);
+	}
+	for (i=0; i<summary.num_of_groups; i++) {
+		printf("runner:   group ip=%s response_code=%ld count=%d total_time median=%.6f\n",
+				summary.groups[i].ip, summary.groups[i].response_code,
+				summary.groups[i].num_of_samples, summary.groups[i].total.median);
+	}
+	if (summary.estimate.percentile > 0) {
+		printf("runner:   adaptive p%.0f=%.6f ci=[%.6f:%.6f] %s\n",
+				summary.estimate.percentile * 100, summary.estimate.value,
+				summary.estimate.ci_low, summary.estimate.ci_high,
+				summary.estimate.converged ? "converged" : "not converged");
+	}
+	if (summary.num_of_success == 0) {
+		return;
+	}
+	printf("runner: total_time mean=%.6f stddev=%.6f jitter=%.6f min=%.6f max=%.6f\n",
+			summary.total.mean, summary.total.stddev, summary.total.jitter,
+			summary.total.min, summary.total.max);
+}
+
+/**
+* @func:  print_throughput
+* @desc:  Print the throughput (goodput and curve) of the last run
+*/
+static void print_throughput() {
+	ConnStatThroughput throughput;
+	int i;
+	
+	if (connection_stats_get_throughput(&throughput) != RC_OK) {
+		return;
+	}
+	
+	printf("runner: throughput streams=%d bytes=%lld failed_bytes=%lld duration=%.6f "
+		   "goodput=%.0f B/s\n",
+			throughput.num_of_streams, throughput.total_bytes, throughput.failed_bytes,
+			throughput.duration, throughput.goodput);
+	printf("runner:   per download speed median=%.0f min=%.0f max=%.0f B/s\n",
+			throughput.speed.median, throughput.speed.min, throughput.speed.max);
+	printf("runner:   curve (%d ms slices) B/s:", throughput.slice_ms);
+	for (i=0; i<throughput.num_of_slices; i++) {
+		printf(" %.0f", throughput.curve[i]);
+	}
+	printf("\n");
+}
+
+/**
+* @func:  read_snapshot
+* @desc:  Print the latest result published for the URL (no measurement)
+* @param  p_http_req_data    Target to be read
+* @return Return Code (taken from RC enum)
+*/
+static RC read_snapshot(HttpReqData *p_http_req_data) {
+	ConnStatSnapshot snapshot;
+	
+	RC rc = connection_stats_snapshot_read(p_http_req_data->url, &snapshot);
+	connection_stats_snapshot_detach();
+	if (rc != RC_OK) {
+		return rc;
+	}
+	printf("runner: snapshot generation=%llu published_ns=%lld rc=%d success=%d/%d\n",
+			snapshot.generation, snapshot.published_ns, snapshot.rc,
+			snapshot.summary.num_of_success, snapshot.summary.num_of_samples);
+	printf("runner: %s\n", snapshot.stat_str);
+	return RC_OK;
+}
+
+/**
+* @func:  print_history
+* @desc:  Print the stored median of the URL over the last hour
+* @param  store_dir          Store directory
+* @param  p_http_req_data    Target to be queried
+*/
+static void print_history(const char *store_dir, HttpReqData *p_http_req_data) {
+	ConnStatSeriesPoint points[HISTORY_MAX_POINTS];
+	long long now_us = (long long)time(NULL) * 1000000 + 1000000;
+	int num_of_points;
+	int i;
+	
+	if (connection_stats_store_query(store_dir, p_http_req_data->url,
+									 now_us - HISTORY_RANGE_SEC * 1000000LL, now_us,
+									 HISTORY_STEP_SEC * 1000000LL, 0.5, points,
+									 HISTORY_MAX_POINTS, &num_of_points) != RC_OK) {
+		return;
+	}
+	for (i=0; i<num_of_points; i++) {
+		printf("runner: history start_us=%lld samples=%d median name_lookup=%.6f "
+			   "connect=%.6f start_transfer=%.6f total=%.6f\n",
+				points[i].start_us, points[i].num_of_samples, points[i].name_lookup,
+				points[i].connect, points[i].start_transfer, points[i].total);
+	}
+}
+
+/**
+* @func:  resolve
+* @desc:  Run the DNS resolution stage and print the statistics per resolver
+* @param  p_http_req_data    Target to be resolved
+* @return Return Code (taken from RC enum)
+*/
+static RC resolve(HttpReqData *p_http_req_data) {
+	ConnStatResolverStats stats_arr[MAX_NUM_OF_RESOLVERS];
+	int num_of_resolvers;
+	int i;
+	
+	RC rc = connection_stats_resolve(p_http_req_data, 1);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	rc = connection_stats_get_resolver_stats(stats_arr, &num_of_resolvers);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	for (i=0; i<num_of_resolvers; i++) {
+		printf("runner: resolver=%s queries=%d failures=%d latency median=%.6f max=%.6f\n",
+				(stats_arr[i].resolver[0] != '\0') ? stats_arr[i].resolver : "system",
+				stats_arr[i].num_of_queries, stats_arr[i].num_of_failures,
+				stats_arr[i].latency.median, stats_arr[i].latency.max);
+	}
+	return RC_OK;
+}
+
+/**
+* @func:  compare
+* @desc:  Compare the target (variant A) with variant B and print the result
+* @param  p_http_req_data    Target (variant A), -n is the budget of each variant
+* @param  p_compare          Variant B
+* @return Return Code (taken from RC enum)
+*/
+static RC compare(HttpReqData *p_http_req_data, CompareArgs *p_compare) {
+	ConnStatCompareResult result;
+	HttpReqData variants[2];
+	int v;
+	
+	variants[0] = *p_http_req_data;
+	variants[1] = *p_http_req_data;
+	if (p_compare->url != NULL) {
+		memset(variants[1].url, 0, sizeof(variants[1].url));
+		memcpy(variants[1].url, p_compare->url, strlen(p_compare->url));
+	}
+	if (p_compare->num_of_headers > 0) {
+		RC rc = connection_stats_add_header_profile(VARIANT_B_PROFILE, p_compare->headers,
+													p_compare->num_of_headers);
+		if (rc != RC_OK) {
+			return rc;
+		}
+		strcpy(variants[1].header_profile, VARIANT_B_PROFILE);
+	}
+	
+	/* The run's deadline (-D) is the deadline of the whole comparison */
+	RC rc = connection_stats_compare(variants, 0, p_http_req_data->deadline_ms, &result);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	for (v=0; v<2; v++) {
+		ConnStatSummary *summary = &result.variants[v].summary;
+		printf("runner: variant %c url=%s success=%d/%d total_time median=%.6f "
+			   "mean=%.6f\n", 'A' + v, variants[v].url, summary->num_of_success,
+				summary->num_of_samples, summary->total.median, summary->total.mean);
+	}
+	printf("runner: compare P(A faster)=%.3f z=%.3f p=%.5f looks=%d -> %s\n",
+			result.prob_a_faster, result.z, result.p_value, result.num_of_looks,
+			(result.faster == 0) ? "A is faster" : 
+			(result.faster == 1) ? "B is faster" : "no significant difference");
+	return RC_OK;
+}
+
 /**
 * @func:  main
 * @desc:  The main function of the program.
@@ -79,6 +453,10 @@ static int parse_args(int argc, char *argv[], HttpReqData *p_http_req_data) {
 */
 int main(int argc, char *argv[]){	
 	HttpReqData http_req_data;	
+	int resolve_stage;
+	int read_only;
+	const char *store_dir;
+	CompareArgs compare_args;
 	int rc;
 		
 	/* Initialize the library (include init for the lib CURL) */
@@ -90,15 +468,55 @@ int main(int argc, char *argv[]){
 	}
 	
 	/* Parse user's args and build data to later forward to the library */
-	rc = parse_args(argc, argv, &http_req_data);
+	rc = parse_args(argc, argv, &http_req_data, &resolve_stage, &read_only, &store_dir,
+					&compare_args);
 	if (rc != RC_OK) {
 		printf ("parse_args() failed: (rc=%d) \n", rc);
 		connection_stats_close();
 		return 1;
 	}
 	
+	/* Only read the result published by another runner (no measurement) */
+	if (read_only) {
+		rc = read_snapshot(&http_req_data);
+		connection_stats_close();
+		if (rc != RC_OK) {
+			printf ("read_snapshot() failed: (rc=%d) \n", rc);
+			return 1;
+		}
+		return 0;
+	}
+	
+	/* Resolve up front, so DNS is measured separately from HTTP */
+	if (resolve_stage) {
+		rc = resolve(&http_req_data);
+		if (rc != RC_OK) {
+			printf ("resolve() failed: (rc=%d) \n", rc);
+			connection_stats_close();
+			return 1;
+		}
+	}
+	
+	/* Only compare the target with variant B (-x/-X) */
+	if (compare_args.enabled) {
+		rc = compare(&http_req_data, &compare_args);
+		connection_stats_close();
+		if (rc != RC_OK) {
+			printf ("compare() failed: (rc=%d) \n", rc);
+			return 1;
+		}
+		return 0;
+	}
+	
 	/* Trigger the library to collect and analyze data */
 	rc = connection_stats_trigger(&http_req_data);
+	print_summary();
+	if (http_req_data.mode == CONNSTAT_MODE_THROUGHPUT) {
+		print_throughput();
+	}
+	if (store_dir != NULL) {
+		print_history(store_dir, &http_req_data);
+	}
 	if (rc != RC_OK) {
 		printf ("connection_stats_trigger() failed: (rc=%d) \n", rc);
 		connection_stats_close();
@@ -14,8 +14,19 @@
 
  */
 
+#define _GNU_SOURCE     // sched_getcpu
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
 #include <../libconnstat/inc/connection_stats.h>
 
 /*
@@ -29,8 +40,6 @@ Black Box:
 
 UT:
 - Trigger before init should fail
-- simulate as if libcurl returned error (in some places) - program shall not crash and report it
-- simulate as if libcurl edge-case values when using curl_easy_getinfo
 - fail to open files
 - Validate getMedian for odd/even/empty arrays
 */
@@ -38,6 +47,29 @@ UT:
 static int test_num_of_http_req();
 static int test_invalid_url();
 static int test_invalid_http_header();
+static int test_snapshot();
+static int test_store();
+static int test_store_concurrent();
+static int test_aggregate();
+static int test_timeouts();
+static int test_affinity();
+static int test_header_profiles();
+static int test_fake_transport();
+static int test_probe();
+static int test_cache();
+static int test_collector();
+static int test_tail_tracing();
+static int test_replay();
+static int test_samples();
+static int test_compare();
+static int test_async();
+static int test_error_stats();
+static int test_ip_table();
+static int test_resolve();
+static int test_mux();
+static int test_throughput();
+static int test_adaptive();
+static void remove_dir(const char *dir);
 
 /**
 * @func:  main
@@ -67,6 +99,138 @@ int main() {
 		return 1;
 	}	
 	
+	rc = test_snapshot();
+	if (rc != 0) {
+		printf("test_snapshot() failed \n");
+		return 1;
+	}
+	
+	rc = test_store();
+	if (rc != 0) {
+		printf("test_store() failed \n");
+		return 1;
+	}
+	
+	rc = test_store_concurrent();
+	if (rc != 0) {
+		printf("test_store_concurrent() failed \n");
+		return 1;
+	}
+	
+	rc = test_aggregate();
+	if (rc != 0) {
+		printf("test_aggregate() failed \n");
+		return 1;
+	}
+	
+	rc = test_timeouts();
+	if (rc != 0) {
+		printf("test_timeouts() failed \n");
+		return 1;
+	}
+	
+	rc = test_affinity();
+	if (rc != 0) {
+		printf("test_affinity() failed \n");
+		return 1;
+	}
+	
+	rc = test_header_profiles();
+	if (rc != 0) {
+		printf("test_header_profiles() failed \n");
+		return 1;
+	}
+	
+	rc = test_fake_transport();
+	if (rc != 0) {
+		printf("test_fake_transport() failed \n");
+		return 1;
+	}
+	
+	rc = test_probe();
+	if (rc != 0) {
+		printf("test_probe() failed \n");
+		return 1;
+	}
+	
+	rc = test_cache();
+	if (rc != 0) {
+		printf("test_cache() failed \n");
+		return 1;
+	}
+	
+	rc = test_collector();
+	if (rc != 0) {
+		printf("test_collector() failed \n");
+		return 1;
+	}
+	
+	rc = test_tail_tracing();
+	if (rc != 0) {
+		printf("test_tail_tracing() failed \n");
+		return 1;
+	}
+	
+	rc = test_replay();
+	if (rc != 0) {
+		printf("test_replay() failed \n");
+		return 1;
+	}
+	
+	rc = test_samples();
+	if (rc != 0) {
+		printf("test_samples() failed \n");
+		return 1;
+	}
+	
+	rc = test_compare();
+	if (rc != 0) {
+		printf("test_compare() failed \n");
+		return 1;
+	}
+	
+	rc = test_async();
+	if (rc != 0) {
+		printf("test_async() failed \n");
+		return 1;
+	}
+	
+	rc = test_error_stats();
+	if (rc != 0) {
+		printf("test_error_stats() failed \n");
+		return 1;
+	}
+	
+	rc = test_ip_table();
+	if (rc != 0) {
+		printf("test_ip_table() failed \n");
+		return 1;
+	}
+	
+	rc = test_resolve();
+	if (rc != 0) {
+		printf("test_resolve() failed \n");
+		return 1;
+	}
+	
+	rc = test_mux();
+	if (rc != 0) {
+		printf("test_mux() failed \n");
+		return 1;
+	}
+	
+	rc = test_throughput();
+	if (rc != 0) {
+		printf("test_throughput() failed \n");
+		return 1;
+	}
+	
+	rc = test_adaptive();
+	if (rc != 0) {
+		printf("test_adaptive() failed \n");
+		return 1;
+	}
+	
 	printf("\n\n##### All tests pass! \n");
 	return 0;
 }
@@ -87,7 +251,18 @@ static int test_num_of_http_req() {
 		return 1;
 	}
 	
+	/* Samples are faked (no network), see test_fake_transport */
+	ConnStatFakeConfig fake_config;
+	ConnStatFakeTransport fake;
+	memset(&fake_config, 0, sizeof(fake_config));
+	fake_config.name_lookup.a = 0.001;
+	fake_config.connect.a     = 0.002;
+	fake_config.transfer.a    = 0.004;
+	connection_stats_fake_transport_init(&fake, &fake_config);
+	connection_stats_set_transport(&fake.transport);
+	
 	HttpReqData http_req_data;
+	memset(&http_req_data, 0, sizeof(http_req_data));
 	memcpy(http_req_data.url, DEFAULT_URL, DEFAULT_URL_SIZE);
 	
 	/* Expect failure when num of requests is 0 */
@@ -138,6 +313,7 @@ static int test_invalid_url() {
 		return 1;
 	}
 	HttpReqData http_req_data;
+	memset(&http_req_data, 0, sizeof(http_req_data));
 	http_req_data.num_of_http_req = 1;
 
 	/* Intentioally set URL to "" */
@@ -209,3 +385,2134 @@ static int test_invalid_http_header() {
 	
 	return 0;
 }
+
+/**
+* @func:  test_snapshot
+* @desc:  Validate that published results are read back by a snapshot reader
+*         (a refused connection is published as well, with its rc)
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_snapshot() {
+	static const char *region_name = "/connstat_tests";
+	static const char *url = "http://127.0.0.1:1/";
+	ConnStatSnapshot snapshot;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_snapshot fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	rc = connection_stats_publish(region_name);
+	if (rc != RC_OK) {
+		printf("test_snapshot fail: connection_stats_publish() returned rc=%d \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+	rc = connection_stats_snapshot_attach(region_name);
+	if (rc != RC_OK) {
+		printf("test_snapshot fail: connection_stats_snapshot_attach() returned rc=%d \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect nothing to read before the first run */
+	rc = connection_stats_snapshot_read("http://never.published/", &snapshot);
+	if (rc != RC_RESULT_REQUESTED_BEFORE_TRIGGER) {
+		printf("test_snapshot fail: Expected no snapshot for an unknown URL (rc=%d)\n", rc);
+		connection_stats_snapshot_detach();
+		connection_stats_close();
+		return 1;
+	}
+	
+	HttpReqData http_req_data;
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	memcpy(http_req_data.url, url, strlen(url));
+	http_req_data.num_of_http_req = 2;
+	
+	/* Expect every run to be published as the next generation */
+	for (int generation=1; generation<=2; generation++) {
+		RC trigger_rc = connection_stats_trigger(&http_req_data);
+		rc = connection_stats_snapshot_read(url, &snapshot);
+		if ((rc != RC_OK) || (snapshot.generation != generation) || 
+			(snapshot.rc != trigger_rc) || (strcmp(snapshot.url, url) != 0) ||
+			(snapshot.summary.num_of_samples != 2)) {
+			printf("test_snapshot fail: Unexpected snapshot (rc=%d generation=%llu) \n", 
+					rc, snapshot.generation);
+			connection_stats_snapshot_detach();
+			connection_stats_close();
+			return 1;
+		}
+	}
+	
+	printf("test_snapshot  ..........  test PASS\n");
+
+	/* Close library, here and in every failure above */
+	connection_stats_snapshot_detach();
+	connection_stats_close();
+	return 0;
+}
+
+/**
+* @func:  test_store
+* @desc:  Validate the store API: runs are appended, failed samples are not
+*         reported by queries and invalid queries are rejected
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_store() {
+	static const char *url = "http://127.0.0.1:1/";
+	char store_dir[] = "/tmp/connstat_tests_XXXXXX";
+	ConnStatSeriesPoint points[4];
+	int num_of_points;
+	RC rc;
+	
+	if (mkdtemp(store_dir) == NULL) {
+		printf("test_store fail: mkdtemp() failed \n");
+		return 1;
+	}
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_store fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	
+	/* Expect a missing store directory to be rejected */
+	rc = connection_stats_store_open("/tmp/connstat_tests_no_such_dir");
+	if (rc == RC_OK) {
+		printf("test_store fail: Expected a missing directory to fail \n");
+		connection_stats_close();
+		return 1;
+	}
+	rc = connection_stats_store_open(store_dir);
+	if (rc != RC_OK) {
+		printf("test_store fail: connection_stats_store_open() returned rc=%d \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+	
+	HttpReqData http_req_data;
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	memcpy(http_req_data.url, url, strlen(url));
+	http_req_data.num_of_http_req = 2;
+	connection_stats_trigger(&http_req_data);
+	connection_stats_trigger(&http_req_data);
+	connection_stats_close();
+	
+	/* Expect the (failed) samples to be kept, but not reported */
+	rc = connection_stats_store_query(store_dir, url, 0, 1LL << 62, 0, 0.5,
+									  points, 4, &num_of_points);
+	if ((rc != RC_OK) || (num_of_points != 0)) {
+		printf("test_store fail: Unexpected query result (rc=%d num_of_points=%d) \n",
+				rc, num_of_points);
+		remove_dir(store_dir);
+		return 1;
+	}
+	
+	/* Expect a range of more steps than an int holds to be cut at max_points */
+	rc = connection_stats_store_query(store_dir, url, 0, 1LL << 62, 1, 0.5,
+									  points, 4, &num_of_points);
+	if ((rc != RC_OK) || (num_of_points != 0)) {
+		printf("test_store fail: Unexpected long range query (rc=%d num_of_points=%d) \n",
+				rc, num_of_points);
+		remove_dir(store_dir);
+		return 1;
+	}
+	
+	/* Expect an empty range to be rejected */
+	rc = connection_stats_store_query(store_dir, url, 10, 10, 0, 0.5,
+									  points, 4, &num_of_points);
+	if (rc == RC_OK) {
+		printf("test_store fail: Expected an empty range to fail \n");
+		remove_dir(store_dir);
+		return 1;
+	}
+	
+	printf("test_store  ..........  test PASS\n");
+	remove_dir(store_dir);
+	return 0;
+}
+
+#define STORE_URL                   "http://store.test/"
+#define STORE_NUM_OF_RUNS           1000
+
+static volatile int g_store_appended = 0;
+
+/*
+ * Append STORE_NUM_OF_RUNS runs (of fake, constant samples) to the open store
+ */
+static void* store_append_thread(void *arg) {
+	HttpReqData *http_req_data = arg;
+	
+	for (int i=0; i<STORE_NUM_OF_RUNS; i++) {
+		connection_stats_trigger(http_req_data);
+	}
+	g_store_appended = 1;
+	return NULL;
+}
+
+/**
+* @func:  test_store_concurrent
+* @desc:  Validate store queries while samples are appended: every query 
+*         reports the samples appended before it, and only those (records 
+*         appended between its passes are not)
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_store_concurrent() {
+	char store_dir[] = "/tmp/connstat_tests_XXXXXX";
+	ConnStatFakeConfig config;
+	ConnStatFakeTransport fake;
+	HttpReqData http_req_data;
+	ConnStatSeriesPoint point;
+	pthread_t thread;
+	int num_of_points;
+	int prev_num_of_samples = 0;
+	int num_of_queries = 0;
+	RC rc = RC_OK;
+	
+	if (mkdtemp(store_dir) == NULL) {
+		printf("test_store_concurrent fail: mkdtemp() failed \n");
+		return 1;
+	}
+	if ((connection_stats_init() != RC_OK) || 
+		(connection_stats_store_open(store_dir) != RC_OK)) {
+		printf("test_store_concurrent fail: Failed to open the store \n");
+		connection_stats_close();
+		remove_dir(store_dir);
+		return 1;
+	}
+	memset(&config, 0, sizeof(config));
+	config.name_lookup.a = 0.001;
+	config.transfer.a    = 0.002;
+	connection_stats_fake_transport_init(&fake, &config);
+	connection_stats_set_transport(&fake.transport);
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	strcpy(http_req_data.url, STORE_URL);
+	http_req_data.num_of_http_req = MAX_NUM_OF_SUPPORTED_CURL_OPER;
+	
+	g_store_appended = 0;
+	pthread_create(&thread, NULL, store_append_thread, &http_req_data);
+	while ((rc == RC_OK) && !g_store_appended) {
+		rc = connection_stats_store_query(store_dir, STORE_URL, 0, 1LL << 62, 0, 0.5,
+										  &point, 1, &num_of_points);
+		if (num_of_points == 0) {
+			continue;
+		}
+		num_of_queries++;
+		if ((point.num_of_samples < prev_num_of_samples) ||
+			(fabs(point.name_lookup - 0.001) > 1e-9)) {
+			printf("test_store_concurrent fail: Unexpected point (num_of_samples=%d "
+				   "name_lookup=%f) \n", point.num_of_samples, point.name_lookup);
+			rc = RC_ERROR;
+		}
+		prev_num_of_samples = point.num_of_samples;
+	}
+	pthread_join(thread, NULL);
+	connection_stats_close();
+	
+	/* Expect every sample once appending is done */
+	if (rc == RC_OK) {
+		rc = connection_stats_store_query(store_dir, STORE_URL, 0, 1LL << 62, 0, 0.5,
+										  &point, 1, &num_of_points);
+	}
+	remove_dir(store_dir);
+	if ((rc != RC_OK) || (num_of_points != 1) ||
+		(point.num_of_samples != STORE_NUM_OF_RUNS * MAX_NUM_OF_SUPPORTED_CURL_OPER)) {
+		printf("test_store_concurrent fail: Unexpected query (rc=%d num_of_points=%d) \n",
+				rc, num_of_points);
+		return 1;
+	}
+	
+	printf("test_store_concurrent: %d queries while appending \n", num_of_queries);
+	printf("test_store_concurrent  ..........  test PASS\n");
+	return 0;
+}
+
+#define AGGREGATE_NUM_OF_THREADS    8
+#define AGGREGATE_NUM_OF_SAMPLES    1000
+#define AGGREGATE_URL               "http://aggregate.test/"
+
+/*
+ * Record AGGREGATE_NUM_OF_SAMPLES samples (every 10th one failed), the total
+ * time of sample i of thread t is (t * AGGREGATE_NUM_OF_SAMPLES + i + 1) usec
+ */
+static void* aggregate_thread(void *arg) {
+	int thread_idx = *(int *)arg;
+	CurlInfo curl_info;
+	
+	for (int i=0; i<AGGREGATE_NUM_OF_SAMPLES; i++) {
+		memset(&curl_info, 0, sizeof(curl_info));
+		curl_info.response_code = 200;
+		curl_info.total_time = (thread_idx * AGGREGATE_NUM_OF_SAMPLES + i + 1) / 1e6;
+		if (i % 10 == 0) {
+			curl_info.curl_code = 7; /* CURLE_COULDNT_CONNECT */
+		}
+		connection_stats_record(AGGREGATE_URL, &curl_info);
+	}
+	return NULL;
+}
+
+/**
+* @func:  test_aggregate
+* @desc:  Validate that samples recorded concurrently by several threads
+*         are all merged (while another thread reads the aggregate)
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_aggregate() {
+	pthread_t threads[AGGREGATE_NUM_OF_THREADS];
+	int thread_idx[AGGREGATE_NUM_OF_THREADS];
+	int num_of_samples = AGGREGATE_NUM_OF_THREADS * AGGREGATE_NUM_OF_SAMPLES;
+	ConnStatSummary summary;
+	int prev_num_of_samples = 0;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_aggregate fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	
+	for (int t=0; t<AGGREGATE_NUM_OF_THREADS; t++) {
+		thread_idx[t] = t;
+		pthread_create(&threads[t], NULL, aggregate_thread, &thread_idx[t]);
+	}
+	
+	/* Expect a consistent (growing) aggregate while threads record */
+	for (int i=0; i<100; i++) {
+		rc = connection_stats_get_aggregate(AGGREGATE_URL, &summary);
+		if (rc == RC_RESULT_REQUESTED_BEFORE_TRIGGER) {
+			continue;
+		}
+		if ((rc != RC_OK) || (summary.num_of_samples < prev_num_of_samples) ||
+			(summary.num_of_samples > num_of_samples)) {
+			printf("test_aggregate fail: Unexpected aggregate (rc=%d num_of_samples=%d) \n",
+					rc, summary.num_of_samples);
+			connection_stats_close();
+			return 1;
+		}
+		prev_num_of_samples = summary.num_of_samples;
+	}
+	
+	for (int t=0; t<AGGREGATE_NUM_OF_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	
+	/* Expect every sample, and only them, in the final aggregate */
+	rc = connection_stats_get_aggregate(AGGREGATE_URL, &summary);
+	if ((rc != RC_OK) || (summary.num_of_samples != num_of_samples) ||
+		(summary.num_of_success != num_of_samples * 9 / 10) ||
+		(summary.num_of_error_classes != 1) || 
+		(summary.error_classes[0].count != num_of_samples / 10) ||
+		(fabs(summary.total.min - 2 / 1e6) > 1e-12) ||
+		(fabs(summary.total.max - num_of_samples / 1e6) > 1e-12)) {
+		printf("test_aggregate fail: Unexpected aggregate (rc=%d num_of_samples=%d "
+			   "num_of_success=%d) \n", rc, summary.num_of_samples, summary.num_of_success);
+		connection_stats_close();
+		return 1;
+	}
+	
+	printf("test_aggregate  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+/*
+ * Listen on a local port without ever accepting, so requests hang.
+ * Returns the socket (-1 on failure) and sets the URL to request
+ */
+static int open_hung_server(char *url, size_t url_size) {
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int sock = socket(AF_INET, SOCK_STREAM, 0);
+	
+	if (sock == -1) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) ||
+		(listen(sock, 16) == -1) ||
+		(getsockname(sock, (struct sockaddr *)&addr, &addr_len) == -1)) {
+		close(sock);
+		return -1;
+	}
+	snprintf(url, url_size, "http://127.0.0.1:%d/", ntohs(addr.sin_port));
+	return sock;
+}
+
+/**
+* @func:  test_timeouts
+* @desc:  Validate that a hung target times out (instead of blocking the run),
+*         that the run deadline is kept and that a sweep still completes its
+*         other targets
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_timeouts() {
+	char hung_url[URL_MAX_LEN];
+	static const char *refused_url = "http://127.0.0.1:1/";
+	ConnStatSummary summary;
+	HttpReqData targets[2];
+	ConnStatSweepResult results[2];
+	struct timespec start, end;
+	double run_ms;
+	int sock;
+	RC rc;
+	
+	sock = open_hung_server(hung_url, sizeof(hung_url));
+	if (sock == -1) {
+		printf("test_timeouts fail: Failed to open a local server \n");
+		return 1;
+	}
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_timeouts fail: connection_stats_init() returned rc=%d \n", rc);
+		close(sock);
+		return 1;
+	}
+	
+	/* Expect every sample to time out, within the deadline */
+	memset(targets, 0, sizeof(targets));
+	memcpy(targets[0].url, hung_url, strlen(hung_url));
+	targets[0].num_of_http_req = 4;
+	targets[0].timeout_ms      = 100;
+	targets[0].deadline_ms     = 250;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rc = connection_stats_trigger(&targets[0]);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	run_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+	if ((rc != RC_ERROR_IN_CURL) || (run_ms > 1000) ||
+		(connection_stats_get_summary(&summary) != RC_OK) ||
+		(summary.num_of_timeouts != 4)) {
+		printf("test_timeouts fail: Unexpected run (rc=%d run_ms=%.0f timeouts=%d) \n",
+				rc, run_ms, summary.num_of_timeouts);
+		connection_stats_close();
+		close(sock);
+		return 1;
+	}
+	
+	/* Expect a sweep to complete the target that answers (refuses) */
+	targets[0].deadline_ms = 0;
+	memcpy(targets[1].url, refused_url, strlen(refused_url));
+	targets[1].num_of_http_req = 4;
+	rc = connection_stats_sweep(targets, 2, 300, results);
+	if ((rc != RC_OK) || (results[0].summary.num_of_timeouts != 4) ||
+		(results[1].summary.num_of_samples != 4) ||
+		(results[1].summary.num_of_timeouts != 0) ||
+		(results[1].summary.error_classes[0].count != 4)) {
+		printf("test_timeouts fail: Unexpected sweep (rc=%d timeouts=%d,%d) \n",
+				rc, results[0].summary.num_of_timeouts, results[1].summary.num_of_timeouts);
+		connection_stats_close();
+		close(sock);
+		return 1;
+	}
+	
+	printf("test_timeouts  ..........  test PASS\n");
+	connection_stats_close();
+	close(sock);
+	return 0;
+}
+
+/**
+* @func:  test_affinity
+* @desc:  Validate the low jitter options: pinning (by cpu list and by NUMA
+*         node), busy polling and the scheduling noise of samples.
+*         The calling thread is pinned to the first core it may run on, and
+*         restored to all of them at the end
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_affinity() {
+	static const char *url = "http://127.0.0.1:1/";
+	ConnStatSummary summary;
+	cpu_set_t orig_set;
+	char cpu_list[16];
+	int cpu = 0;
+	RC rc;
+	
+	if (sched_getaffinity(0, sizeof(orig_set), &orig_set) == -1) {
+		printf("test_affinity fail: sched_getaffinity() failed \n");
+		return 1;
+	}
+	while (!CPU_ISSET(cpu, &orig_set)) {
+		cpu++;
+	}
+	snprintf(cpu_list, sizeof(cpu_list), "%d", cpu);
+	
+	/* Expect invalid cores and NUMA nodes to be rejected */
+	if ((connection_stats_set_affinity("1-0", -1) == RC_OK) ||
+		(connection_stats_set_affinity("x", -1) == RC_OK) ||
+		(connection_stats_set_affinity(NULL, 100000) == RC_OK) ||
+		(connection_stats_set_busy_poll(-1) == RC_OK)) {
+		printf("test_affinity fail: Expected invalid options to fail \n");
+		return 1;
+	}
+	
+	/* Expect the thread to run on the first core only */
+	rc = connection_stats_set_affinity(cpu_list, -1);
+	if ((rc != RC_OK) || (sched_getcpu() != cpu)) {
+		printf("test_affinity fail: Unexpected pinning (rc=%d cpu=%d, expected %d) \n", 
+				rc, sched_getcpu(), cpu);
+		sched_setaffinity(0, sizeof(orig_set), &orig_set);
+		return 1;
+	}
+	
+	/* Expect a busy polled run to report its samples' scheduling noise */
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_affinity fail: connection_stats_init() returned rc=%d \n", rc);
+		sched_setaffinity(0, sizeof(orig_set), &orig_set);
+		return 1;
+	}
+	connection_stats_set_busy_poll(50);
+	HttpReqData http_req_data;
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	memcpy(http_req_data.url, url, strlen(url));
+	http_req_data.num_of_http_req = 2;
+	connection_stats_trigger(&http_req_data);
+	if ((connection_stats_get_summary(&summary) != RC_OK) ||
+		(summary.num_of_samples != 2) || (summary.involuntary_ctx_switches < 0) ||
+		(summary.num_of_preempted_samples > 2)) {
+		printf("test_affinity fail: Unexpected summary \n");
+		connection_stats_close();
+		sched_setaffinity(0, sizeof(orig_set), &orig_set);
+		return 1;
+	}
+	
+	printf("test_affinity  ..........  test PASS\n");
+	connection_stats_close();
+	
+	/* Later tests (and their threads) run on every core again */
+	sched_setaffinity(0, sizeof(orig_set), &orig_set);
+	return 0;
+}
+
+/*
+ * Answer a single request with 200 and keep the request (see test_header_profiles)
+ */
+static char g_request[8192];
+
+static void* answer_once_thread(void *arg) {
+	static const char *response = 
+		"HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	int sock = accept(*(int *)arg, NULL, NULL);
+	size_t len = 0;
+	ssize_t n;
+	
+	if (sock == -1) {
+		return NULL;
+	}
+	while ((len < sizeof(g_request) - 1) && (strstr(g_request, "\r\n\r\n") == NULL)) {
+		n = recv(sock, g_request + len, sizeof(g_request) - 1 - len, 0);
+		if (n <= 0) {
+			break;
+		}
+		len += n;
+	}
+	send(sock, response, strlen(response), 0);
+	close(sock);
+	return NULL;
+}
+
+/**
+* @func:  test_header_profiles
+* @desc:  Validate header profiles: validation (long and malformed headers),
+*         that a target sends its profile's headers, and removal
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_header_profiles() {
+	static char long_header[4096];
+	const char *tenant_headers[] = { "X-Tenant: a", long_header };
+	const char *injected[] = { "X-Tenant: a\r\nX-Admin: 1" };
+	const char *no_name[]  = { ": value" };
+	HttpReqData http_req_data;
+	pthread_t thread;
+	int sock;
+	RC rc;
+	
+	snprintf(long_header, sizeof(long_header), "Authorization: Bearer %0*d",
+			 (int)sizeof(long_header) - 32, 7);
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_header_profiles fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	
+	/* Expect malformed headers and taken names to be rejected */
+	if ((connection_stats_add_header_profile("bad", injected, 1) != RC_INVALID_HTTP_HEADER) ||
+		(connection_stats_add_header_profile("bad", no_name, 1) != RC_INVALID_HTTP_HEADER) ||
+		(connection_stats_add_header_profile("tenant-a", tenant_headers, 2) != RC_OK) ||
+		(connection_stats_add_header_profile("tenant-a", tenant_headers, 1) != RC_ERROR)) {
+		printf("test_header_profiles fail: Unexpected profile validation \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect the target to send the profile's headers */
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	sock = open_hung_server(http_req_data.url, sizeof(http_req_data.url));
+	if ((sock == -1) || (pthread_create(&thread, NULL, answer_once_thread, &sock) != 0)) {
+		printf("test_header_profiles fail: Failed to open a local server \n");
+		connection_stats_close();
+		return 1;
+	}
+	http_req_data.num_of_http_req = 1;
+	strcpy(http_req_data.header_profile, "tenant-a");
+	rc = connection_stats_trigger(&http_req_data);
+	pthread_join(thread, NULL);
+	close(sock);
+	if ((rc != RC_OK) || (strstr(g_request, "\r\nX-Tenant: a\r\n") == NULL) ||
+		(strstr(g_request, long_header) == NULL)) {
+		printf("test_header_profiles fail: Profile headers were not sent (rc=%d) \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect a removed profile to be unknown */
+	if ((connection_stats_remove_header_profile("tenant-a") != RC_OK) ||
+		(connection_stats_trigger(&http_req_data) != RC_INVALID_HTTP_HEADER)) {
+		printf("test_header_profiles fail: Expected removed profile to fail \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	printf("test_header_profiles  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+#define FAKE_NUM_OF_SAMPLES     1000000
+#define FAKE_NUM_OF_RUNS        2000
+#define FAKE_URL                "http://fake.test/"
+
+/**
+* @func:  test_fake_transport
+* @desc:  Validate the fake transport: its distributions (through the 
+*         aggregate, at full speed), and failures and timeouts of runs
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_fake_transport() {
+	ConnStatFakeConfig config;
+	ConnStatFakeTransport fake;
+	HttpReqData http_req_data;
+	ConnStatSummary summary;
+	CurlInfo curl_info;
+	struct timespec start, end;
+	double run_sec;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_fake_transport fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	memcpy(http_req_data.url, FAKE_URL, strlen(FAKE_URL));
+	
+	/* Expect invalid distributions to be rejected */
+	memset(&config, 0, sizeof(config));
+	config.connect.type = CONNSTAT_DIST_UNIFORM;
+	config.connect.a    = 0.002;
+	config.connect.b    = 0.001;
+	if (connection_stats_fake_transport_init(&fake, &config) == RC_OK) {
+		printf("test_fake_transport fail: Expected invalid distribution to fail \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect the aggregate of a million samples to match the distributions */
+	memset(&config, 0, sizeof(config));
+	config.connect.type  = CONNSTAT_DIST_UNIFORM;
+	config.connect.a     = 0.010;
+	config.connect.b     = 0.020;
+	config.transfer.type = CONNSTAT_DIST_NORMAL;
+	config.transfer.a    = 0.050;
+	config.transfer.b    = 0.005;
+	config.seed          = 1;
+	connection_stats_fake_transport_init(&fake, &config);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i=0; i<FAKE_NUM_OF_SAMPLES; i++) {
+		fake.transport.perform(&http_req_data, &curl_info, fake.transport.transport_data);
+		connection_stats_record(FAKE_URL, &curl_info);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	run_sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	rc = connection_stats_get_aggregate(FAKE_URL, &summary);
+	if ((rc != RC_OK) || (summary.num_of_success != FAKE_NUM_OF_SAMPLES) ||
+		(fabs(summary.connect.mean - 0.015) > 0.0001) ||
+		(summary.connect.min < 0.010) || (summary.connect.max > 0.020) ||
+		(fabs(summary.total.mean - 0.065) > 0.0001) ||
+		(fabs(summary.total.stddev - sqrt(0.005 * 0.005 + 0.01 * 0.01 / 12)) > 0.0001)) {
+		printf("test_fake_transport fail: Unexpected aggregate (rc=%d connect=%f total=%f/%f) \n",
+				rc, summary.connect.mean, summary.total.mean, summary.total.stddev);
+		connection_stats_close();
+		return 1;
+	}
+	printf("test_fake_transport: %.1fM samples/sec (generated and aggregated) \n",
+		   FAKE_NUM_OF_SAMPLES / run_sec / 1e6);
+	
+	/* Benchmark whole runs: generated, analyzed, aggregated and reported */
+	connection_stats_set_transport(&fake.transport);
+	http_req_data.num_of_http_req = MAX_NUM_OF_SUPPORTED_CURL_OPER;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i=0; i<FAKE_NUM_OF_RUNS; i++) {
+		connection_stats_trigger(&http_req_data);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	run_sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("test_fake_transport: %.1fM samples/sec (in runs of %d) \n",
+		   FAKE_NUM_OF_RUNS * MAX_NUM_OF_SUPPORTED_CURL_OPER / run_sec / 1e6,
+		   MAX_NUM_OF_SUPPORTED_CURL_OPER);
+	
+	/* Expect failed samples to be classified */
+	config.failure_ratio     = 0.5;
+	config.failure_curl_code = 6; /* CURLE_COULDNT_RESOLVE_HOST */
+	connection_stats_fake_transport_init(&fake, &config);
+	connection_stats_set_transport(&fake.transport);
+	http_req_data.num_of_http_req = MAX_NUM_OF_SUPPORTED_CURL_OPER;
+	rc = connection_stats_trigger(&http_req_data);
+	connection_stats_get_summary(&summary);
+	if ((summary.num_of_samples != MAX_NUM_OF_SUPPORTED_CURL_OPER) ||
+		(summary.num_of_success == 0) || (summary.num_of_error_classes != 1) ||
+		(summary.error_classes[0].curl_code != 6) ||
+		(summary.num_of_success + summary.error_classes[0].count != 
+		 MAX_NUM_OF_SUPPORTED_CURL_OPER)) {
+		printf("test_fake_transport fail: Unexpected failures (rc=%d num_of_success=%d) \n",
+				rc, summary.num_of_success);
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect samples over the timeout to time out (and concurrent runs to fail) */
+	http_req_data.timeout_ms = 40;
+	config.failure_ratio     = 0;
+	connection_stats_fake_transport_init(&fake, &config);
+	rc = connection_stats_trigger(&http_req_data);
+	if ((rc != RC_ERROR_IN_CURL) || (connection_stats_get_summary(&summary) != RC_OK) ||
+		(summary.num_of_timeouts != MAX_NUM_OF_SUPPORTED_CURL_OPER)) {
+		printf("test_fake_transport fail: Expected all samples to time out (rc=%d) \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+	http_req_data.multiplex    = 1;
+	http_req_data.http_version = CONNSTAT_HTTP_VERSION_2;
+	if (connection_stats_trigger(&http_req_data) != RC_NOT_SUPPORTED) {
+		printf("test_fake_transport fail: Expected multiplexed run to fail \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	printf("test_fake_transport  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+#define PROBE_NUM_OF_TARGETS    16
+
+/**
+* @func:  test_probe
+* @desc:  Validate the probe engine (io_uring, and the epoll fallback): 
+*         connects to a listener (by address or by hostname) succeed, 
+*         connects to a closed port are refused and handshakes with a peer
+*         that never answers time out
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_probe() {
+	static const char *refused_url = "http://127.0.0.1:1/";
+	static const ConnStatProbeEngine engines[] = { CONNSTAT_PROBE_ENGINE_AUTO,
+												   CONNSTAT_PROBE_ENGINE_EPOLL };
+	HttpReqData targets[PROBE_NUM_OF_TARGETS + 2];
+	CurlInfo results[PROBE_NUM_OF_TARGETS + 2];
+	HttpReqData *refused = &targets[PROBE_NUM_OF_TARGETS];
+	HttpReqData *hung_tls = &targets[PROBE_NUM_OF_TARGETS + 1];
+	char url[URL_MAX_LEN];
+	int sock;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_probe fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	
+	for (int e=0; e<2; e++) {
+		/* The kernel completes the connects of a listener (up to its backlog,
+		   hence a listener per engine), and its TLS handshakes never end */
+		sock = open_hung_server(url, sizeof(url));
+		if (sock == -1) {
+			printf("test_probe fail: Failed to open a local server \n");
+			connection_stats_close();
+			return 1;
+		}
+		memset(targets, 0, sizeof(targets));
+		/* Half of the targets by hostname (a single lookup for all of them) */
+		for (int i=0; i<PROBE_NUM_OF_TARGETS; i++) {
+			if (i % 2 == 0) {
+				memcpy(targets[i].url, url, strlen(url));
+			} else {
+				snprintf(targets[i].url, sizeof(targets[i].url), "http://localhost%s",
+						 strrchr(url, ':'));
+			}
+		}
+		memcpy(refused->url, refused_url, strlen(refused_url));
+		strcpy(hung_tls->url, "https");
+		strcat(hung_tls->url, url + strlen("http"));
+		hung_tls->connect_timeout_ms = 200;
+		
+		rc = connection_stats_probe(targets, PROBE_NUM_OF_TARGETS + 2, 4, engines[e], results);
+		close(sock);
+		if (rc != RC_OK) {
+			printf("test_probe fail: connection_stats_probe() returned rc=%d (engine %d) \n",
+					rc, engines[e]);
+			connection_stats_close();
+			return 1;
+		}
+		for (int i=0; i<PROBE_NUM_OF_TARGETS; i++) {
+			if ((results[i].curl_code != 0) || (results[i].connect_time <= 0) ||
+				(results[i].total_time < results[i].connect_time)) {
+				printf("test_probe fail: Unexpected probe (engine %d, curl_code=%d) \n",
+						engines[e], results[i].curl_code);
+				connection_stats_close();
+				return 1;
+			}
+		}
+		/* 7 is CURLE_COULDNT_CONNECT, 28 CURLE_OPERATION_TIMEDOUT (and 4 
+		   CURLE_NOT_BUILT_IN, after the connect, for a library built without TLS) */
+		if ((results[PROBE_NUM_OF_TARGETS].curl_code != 7) ||
+			((results[PROBE_NUM_OF_TARGETS + 1].curl_code != 28) &&
+			 ((results[PROBE_NUM_OF_TARGETS + 1].curl_code != 4) ||
+			  (results[PROBE_NUM_OF_TARGETS + 1].connect_time <= 0))) ||
+			(results[PROBE_NUM_OF_TARGETS + 1].total_time > 1)) {
+			printf("test_probe fail: Expected refused and timed out probes (engine %d, "
+				   "curl_code=%d,%d) \n", engines[e], results[PROBE_NUM_OF_TARGETS].curl_code,
+					results[PROBE_NUM_OF_TARGETS + 1].curl_code);
+			connection_stats_close();
+			return 1;
+		}
+	}
+	
+	printf("test_probe  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+#define CACHE_FILE_NAME     "connstat_test.cache"
+
+/**
+* @func:  test_cache
+* @desc:  Validate the warm start cache: a damaged file is a cold start, 
+*         addresses resolved by one session are used by the next one (instead
+*         of resolving again) and a cache that can not be written fails close
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_cache() {
+	HttpReqData target;
+	CurlInfo results[2];
+	char url[URL_MAX_LEN];
+	FILE *file;
+	int sock;
+	RC rc;
+	
+	/* Start from a damaged cache */
+	file = fopen(CACHE_FILE_NAME, "wb");
+	if (file == NULL) {
+		printf("test_cache fail: Failed to create %s \n", CACHE_FILE_NAME);
+		return 1;
+	}
+	fputs("not a cache file", file);
+	fclose(file);
+	sock = open_hung_server(url, sizeof(url));
+	if (sock == -1) {
+		printf("test_cache fail: Failed to open a local server \n");
+		unlink(CACHE_FILE_NAME);
+		return 1;
+	}
+	
+	/* A cold session (resolving localhost), then a warm one */
+	memset(&target, 0, sizeof(target));
+	snprintf(target.url, sizeof(target.url), "http://localhost%s", strrchr(url, ':'));
+	for (int i=0; i<2; i++) {
+		if ((connection_stats_init() != RC_OK) ||
+			(connection_stats_set_cache_file(CACHE_FILE_NAME) != RC_OK) ||
+			(connection_stats_probe(&target, 1, 1, CONNSTAT_PROBE_ENGINE_AUTO,
+									&results[i]) != RC_OK) ||
+			(connection_stats_close() != RC_OK) || (results[i].curl_code != 0)) {
+			printf("test_cache fail: Unexpected session %d (curl_code=%d) \n",
+					i, results[i].curl_code);
+			close(sock);
+			unlink(CACHE_FILE_NAME);
+			return 1;
+		}
+	}
+	close(sock);
+	unlink(CACHE_FILE_NAME);
+	if (results[1].name_lookup_time >= results[0].name_lookup_time) {
+		printf("test_cache fail: Expected a warm lookup (cold=%f warm=%f) \n",
+				results[0].name_lookup_time, results[1].name_lookup_time);
+		return 1;
+	}
+	
+	/* Expect a cache that can not be written to fail close */
+	rc = connection_stats_init();
+	if ((rc != RC_OK) || 
+		(connection_stats_set_cache_file("no_such_dir/" CACHE_FILE_NAME) != RC_OK) ||
+		(connection_stats_close() != RC_ERROR_IN_FILE_OR_FOLDER)) {
+		printf("test_cache fail: Expected to fail writing the cache \n");
+		return 1;
+	}
+	
+	printf("test_cache  ..........  test PASS\n");
+	return 0;
+}
+
+#define COLLECTOR_SOCKET_NAME       "connstat_test.sock"
+#define COLLECTOR_URL               "http://collector.test/"
+#define COLLECTOR_NUM_OF_SAMPLES    100000
+#define COLLECTOR_RUN_SIZE          1000  /* Samples per send (as a run would) */
+
+static volatile int g_collector_stop = 0;
+
+/*
+ * Serve as the collector until g_collector_stop is set
+ */
+static void* collector_thread(void *arg) {
+	(void)arg;
+	connection_stats_collector_serve(COLLECTOR_SOCKET_NAME, &g_collector_stop);
+	return NULL;
+}
+
+/**
+* @func:  test_collector
+* @desc:  Validate the collector: samples streamed in batches are all merged
+*         into its aggregate, and served on query, and a sender streams again
+*         to a restarted collector
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_collector() {
+	static CurlInfo curl_info_arr[COLLECTOR_RUN_SIZE];
+	ConnStatSummary summary, restarted;
+	struct timespec start, end;
+	pthread_t thread;
+	double run_sec;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_collector fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	g_collector_stop = 0;
+	pthread_create(&thread, NULL, collector_thread, NULL);
+	
+	/* Connect once the collector is up (every 10th sample failed) */
+	for (int i=0; i<100; i++) {
+		rc = connection_stats_collector_connect(COLLECTOR_SOCKET_NAME);
+		if (rc == RC_OK) {
+			break;
+		}
+		usleep(10000);
+	}
+	for (int i=0; i<COLLECTOR_RUN_SIZE; i++) {
+		curl_info_arr[i].response_code = 200;
+		curl_info_arr[i].total_time = (i + 1) / 1e6;
+		if (i % 10 == 0) {
+			curl_info_arr[i].curl_code = 7; /* CURLE_COULDNT_CONNECT */
+		}
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i=0; (rc == RC_OK) && (i<COLLECTOR_NUM_OF_SAMPLES/COLLECTOR_RUN_SIZE); i++) {
+		rc = connection_stats_collector_send(COLLECTOR_URL, curl_info_arr,
+											 COLLECTOR_RUN_SIZE);
+	}
+	
+	/* The query is served after every sample sent before it */
+	if (rc == RC_OK) {
+		rc = connection_stats_collector_query(COLLECTOR_SOCKET_NAME, COLLECTOR_URL,
+											  &summary);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	run_sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	g_collector_stop = 1;
+	pthread_join(thread, NULL);
+	
+	/* Restart the collector - a send is lost while it is gone, then the sender
+	   reconnects (backing off) and the samples reach the new collector */
+	if ((rc == RC_OK) &&
+		(connection_stats_collector_send(COLLECTOR_URL, curl_info_arr, 1) == RC_OK)) {
+		printf("test_collector fail: Expected a send without a collector to fail \n");
+		rc = RC_ERROR;
+	}
+	g_collector_stop = 0;
+	pthread_create(&thread, NULL, collector_thread, NULL);
+	for (int i=0; (rc == RC_OK) && (i<300); i++) {
+		if (connection_stats_collector_send(COLLECTOR_URL, curl_info_arr,
+											COLLECTOR_RUN_SIZE) == RC_OK) {
+			rc = connection_stats_collector_query(COLLECTOR_SOCKET_NAME, COLLECTOR_URL,
+												  &restarted);
+			break;
+		}
+		usleep(10000);
+	}
+	g_collector_stop = 1;
+	pthread_join(thread, NULL);
+	connection_stats_close();
+	
+	if ((rc != RC_OK) || (restarted.num_of_samples != COLLECTOR_NUM_OF_SAMPLES +
+											  COLLECTOR_RUN_SIZE)) {
+		printf("test_collector fail: Samples did not reach a restarted collector "
+			   "(rc=%d num_of_samples=%d) \n", rc, restarted.num_of_samples);
+		return 1;
+	}
+	if ((summary.num_of_samples != COLLECTOR_NUM_OF_SAMPLES) ||
+		(summary.num_of_success != COLLECTOR_NUM_OF_SAMPLES * 9 / 10) ||
+		(summary.num_of_error_classes != 1) ||
+		(fabs(summary.total.min - 2 / 1e6) > 1e-12) ||
+		(fabs(summary.total.max - COLLECTOR_RUN_SIZE / 1e6) > 1e-12)) {
+		printf("test_collector fail: Unexpected aggregate (rc=%d num_of_samples=%d "
+			   "num_of_success=%d) \n", rc, summary.num_of_samples, summary.num_of_success);
+		return 1;
+	}
+	printf("test_collector: %.0fK samples/sec (streamed and aggregated) \n",
+		   COLLECTOR_NUM_OF_SAMPLES / run_sec / 1e3);
+	
+	/* Expect no answer once the collector is gone */
+	if (connection_stats_collector_query(COLLECTOR_SOCKET_NAME, COLLECTOR_URL,
+										 &summary) == RC_OK) {
+		printf("test_collector fail: Expected a query without a collector to fail \n");
+		return 1;
+	}
+	
+	printf("test_collector  ..........  test PASS\n");
+	return 0;
+}
+
+#define TAIL_FILE_NAME          "trace/tail.out"
+#define TAIL_NUM_OF_RUNS        2
+#define TAIL_SLOW_SAMPLE        25    /* Answered after TAIL_SLOW_DELAY_US */
+#define TAIL_SLOW_DELAY_US      50000
+
+/*
+ * Answer TAIL_NUM_OF_RUNS runs of requests with 200 (one of them slowly)
+ */
+static void* answer_tail_thread(void *arg) {
+	static const char *response = 
+		"HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	char request[1024];
+	
+	for (int i=0; i<TAIL_NUM_OF_RUNS * MAX_NUM_OF_SUPPORTED_CURL_OPER; i++) {
+		int sock = accept(*(int *)arg, NULL, NULL);
+		if (sock == -1) {
+			return NULL;
+		}
+		recv(sock, request, sizeof(request), 0);
+		if (i == TAIL_SLOW_SAMPLE) {
+			usleep(TAIL_SLOW_DELAY_US);
+		}
+		send(sock, response, strlen(response), 0);
+		close(sock);
+	}
+	return NULL;
+}
+
+/**
+* @func:  test_tail_tracing
+* @desc:  Validate tail tracing: only the traces of the slow sample and of the
+*         failed one are kept (the debug variant only)
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_tail_tracing() {
+	HttpReqData http_req_data;
+	char line[1024];
+	int num_of_kept = 0;
+	int slow_kept = 0;
+	int failed_kept = 0;
+	pthread_t thread;
+	FILE *file;
+	int sock;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_tail_tracing fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	unlink(TAIL_FILE_NAME);
+	rc = connection_stats_set_tail_tracing(0.99);
+	if (rc == RC_NOT_SUPPORTED) {
+		printf("test_tail_tracing  ..........  test PASS (lean variant, not traced)\n");
+		connection_stats_close();
+		return 0;
+	}
+	if ((rc != RC_OK) || (connection_stats_set_tail_tracing(1) == RC_OK)) {
+		printf("test_tail_tracing fail: Unexpected connection_stats_set_tail_tracing() \n");
+		connection_stats_close();
+		return 1;
+	}
+	connection_stats_set_tail_tracing(0.99);
+	
+	/* Fast samples (one of them slow), then a failed one */
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	sock = open_hung_server(http_req_data.url, sizeof(http_req_data.url));
+	if ((sock == -1) || (pthread_create(&thread, NULL, answer_tail_thread, &sock) != 0)) {
+		printf("test_tail_tracing fail: Failed to open a local server \n");
+		connection_stats_close();
+		return 1;
+	}
+	http_req_data.num_of_http_req = MAX_NUM_OF_SUPPORTED_CURL_OPER;
+	for (int i=0; i<TAIL_NUM_OF_RUNS; i++) {
+		connection_stats_trigger(&http_req_data);
+	}
+	pthread_join(thread, NULL);
+	close(sock);
+	http_req_data.num_of_http_req = 1;
+	strcpy(http_req_data.url, "http://127.0.0.1:1/");
+	connection_stats_trigger(&http_req_data);
+	connection_stats_close();
+	
+	file = fopen(TAIL_FILE_NAME, "r");
+	if (file == NULL) {
+		printf("test_tail_tracing fail: %s was not written \n", TAIL_FILE_NAME);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		const char *total_time = strstr(line, "total_time=");
+		if (strncmp(line, "==== Sample slow", 16) == 0) {
+			num_of_kept++;
+			if ((total_time != NULL) && (atof(total_time + 11) * 1e6 >= TAIL_SLOW_DELAY_US)) {
+				slow_kept = 1;
+			}
+		} else if (strncmp(line, "==== Sample failed", 18) == 0) {
+			num_of_kept++;
+			failed_kept = 1;
+		}
+	}
+	fclose(file);
+	
+	/* Expect a tail: the outliers, with a few fast samples at most */
+	if (!slow_kept || !failed_kept || (num_of_kept > 6)) {
+		printf("test_tail_tracing fail: Unexpected traces kept (slow=%d failed=%d kept=%d) \n",
+				slow_kept, failed_kept, num_of_kept);
+		return 1;
+	}
+	printf("test_tail_tracing  ..........  test PASS\n");
+	return 0;
+}
+
+#define REPLAY_TRACE_NAME       "connstat_test_replay.out"
+#define REPLAY_SLOW_DELAY_US    30000
+
+/* A trace of 2 exchanges (as dumped by the debug variant): a fast one, and
+   one answered after REPLAY_SLOW_DELAY_US whose data is sent in 2 chunks */
+static const char *g_replay_trace =
+	"== Info:   Trying 10.0.0.1:80...\n"
+	"=> Send header, 0000000040 bytes (0x00000028) at=1000000000000000\n"
+	"0000: GET / HTTP/1.1\n"
+	"0010: Host: 10.0.0.1\n"
+	"0020: \n"
+	"<= Recv header, 0000000017 bytes (0x00000011) at=1000000000000100\n"
+	"0000: HTTP/1.1 200 OK\n"
+	"<= Recv header, 0000000028 bytes (0x0000001c) at=1000000000000110\n"
+	"0000: Transfer-Encoding: chunked\n"
+	"<= Recv header, 0000000002 bytes (0x00000002) at=1000000000000120\n"
+	"0000: \n"
+	"<= Recv data, 0000000100 bytes (0x00000064) at=1000000000000130\n"
+	"0000: ......\n"
+	"=> Send header, 0000000040 bytes (0x00000028) at=1000000001000000\n"
+	"0000: GET / HTTP/1.1\n"
+	"<= Recv header, 0000000019 bytes (0x00000013) at=1000000001030000\n"
+	"0000: HTTP/2 404 Nope\n"
+	"<= Recv header, 0000000002 bytes (0x00000002) at=1000000001030010\n"
+	"0000: \n"
+	"<= Recv data, 0000001000 bytes (0x000003e8) at=1000000001030020\n"
+	"<= Recv data, 0000003000 bytes (0x00000bb8) at=1000000001040020\n";
+
+static volatile int g_replay_stop = 0;
+static int g_replay_port = 0;
+
+/*
+ * Replay the test trace until g_replay_stop is set
+ */
+static void* replay_thread(void *arg) {
+	(void)arg;
+	connection_stats_replay_serve(REPLAY_TRACE_NAME, g_replay_port, &g_replay_stop);
+	return NULL;
+}
+
+/*
+ * Start replaying the test trace on a free port, and get its URL
+ * Return 0 on success, -1 otherwise
+ */
+static int start_replay(char *url, size_t url_size, pthread_t *p_thread) {
+	FILE *file = fopen(REPLAY_TRACE_NAME, "w");
+	int sock = open_hung_server(url, url_size);
+	
+	if ((file == NULL) || (sock == -1)) {
+		if (file != NULL) {
+			fclose(file);
+		}
+		return -1;
+	}
+	fputs(g_replay_trace, file);
+	fclose(file);
+	g_replay_port = atoi(strrchr(url, ':') + 1);
+	close(sock);
+	g_replay_stop = 0;
+	if (pthread_create(p_thread, NULL, replay_thread, NULL) != 0) {
+		return -1;
+	}
+	usleep(100000);
+	return 0;
+}
+
+/*
+ * Stop the replay started by start_replay
+ */
+static void stop_replay(pthread_t thread) {
+	g_replay_stop = 1;
+	pthread_join(thread, NULL);
+	unlink(REPLAY_TRACE_NAME);
+}
+
+/**
+* @func:  test_replay
+* @desc:  Validate trace replay: the recorded responses are served in their
+*         order (round robin), with their recorded timing and sizes
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_replay() {
+	HttpReqData http_req_data;
+	ConnStatSummary summary;
+	pthread_t thread;
+	volatile int stop = 1;
+	char url[URL_MAX_LEN];
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_replay fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	
+	/* Expect a missing trace to fail */
+	if (connection_stats_replay_serve("no_such_trace.out", 8080, &stop) !=
+		RC_ERROR_IN_FILE_OR_FOLDER) {
+		printf("test_replay fail: Expected a missing trace to fail \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Replay on a free port */
+	if (start_replay(url, sizeof(url), &thread) != 0) {
+		printf("test_replay fail: Failed to prepare the replay \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect the responses in turn: fast 200s, and 404s that take their time */
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	strcpy(http_req_data.url, url);
+	http_req_data.num_of_http_req = 4;
+	rc = connection_stats_trigger(&http_req_data);
+	if (rc == RC_OK) {
+		rc = connection_stats_get_summary(&summary);
+	}
+	stop_replay(thread);
+	connection_stats_close();
+	if ((rc != RC_OK) || (summary.num_of_groups != 2) ||
+		(summary.groups[0].response_code != 200) || (summary.groups[0].num_of_samples != 2) ||
+		(summary.groups[1].response_code != 404) || (summary.groups[1].num_of_samples != 2) ||
+		(summary.groups[0].total.max * 1e6 >= REPLAY_SLOW_DELAY_US) ||
+		(summary.groups[1].start_transfer.min * 1e6 < REPLAY_SLOW_DELAY_US) ||
+		(summary.groups[1].total.min * 1e6 < REPLAY_SLOW_DELAY_US + 10000)) {
+		printf("test_replay fail: Unexpected replay (rc=%d num_of_groups=%d) \n",
+				rc, summary.num_of_groups);
+		return 1;
+	}
+	printf("test_replay  ..........  test PASS\n");
+	return 0;
+}
+
+/* Samples seen by sample_callback (see test_samples) */
+static const CurlInfo *g_seen_samples[MAX_NUM_OF_SUPPORTED_CURL_OPER];
+static int g_num_of_seen_samples = 0;
+
+/*
+ * Keep every sample handed to the callback (in order)
+ */
+static void sample_callback(const HttpReqData *http_req_data, int sample_idx,
+							const CurlInfo *curl_info, void *user_data) {
+	(void)user_data;
+	if ((strcmp(http_req_data->url, FAKE_URL) == 0) &&
+		(sample_idx == g_num_of_seen_samples) &&
+		(g_num_of_seen_samples < MAX_NUM_OF_SUPPORTED_CURL_OPER)) {
+		g_seen_samples[g_num_of_seen_samples++] = curl_info;
+	}
+}
+
+/**
+* @func:  test_samples
+* @desc:  Validate the per sample callback and the samples view: every sample
+*         is handed over as it is collected, in place, and the view of the
+*         last run is the very same storage (never an array the caller
+*         analyzed)
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_samples() {
+	ConnStatFakeConfig config;
+	ConnStatFakeTransport fake;
+	HttpReqData http_req_data;
+	CurlInfo caller_arr[2];
+	const CurlInfo *samples, *analyzed;
+	int num_of_samples;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_samples fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	if (connection_stats_get_samples(&samples, &num_of_samples) !=
+		RC_RESULT_REQUESTED_BEFORE_TRIGGER) {
+		printf("test_samples fail: Expected no samples before a run \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	memset(&config, 0, sizeof(config));
+	config.transfer.type = CONNSTAT_DIST_UNIFORM;
+	config.transfer.a    = 0.001;
+	config.transfer.b    = 0.002;
+	config.seed          = 7;
+	connection_stats_fake_transport_init(&fake, &config);
+	connection_stats_set_transport(&fake.transport);
+	connection_stats_set_sample_callback(sample_callback, NULL);
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	strcpy(http_req_data.url, FAKE_URL);
+	http_req_data.num_of_http_req = MAX_NUM_OF_SUPPORTED_CURL_OPER;
+	g_num_of_seen_samples = 0;
+	rc = connection_stats_trigger(&http_req_data);
+	if (rc == RC_OK) {
+		rc = connection_stats_get_samples(&samples, &num_of_samples);
+	}
+	if ((rc != RC_OK) || (num_of_samples != MAX_NUM_OF_SUPPORTED_CURL_OPER) ||
+		(g_num_of_seen_samples != num_of_samples)) {
+		printf("test_samples fail: Unexpected samples (rc=%d num_of_samples=%d seen=%d) \n",
+				rc, num_of_samples, g_num_of_seen_samples);
+		connection_stats_close();
+		return 1;
+	}
+	for (int i=0; i<num_of_samples; i++) {
+		if ((g_seen_samples[i] != &samples[i]) || (samples[i].total_time < 0.001)) {
+			printf("test_samples fail: Sample %d was copied or not filled \n", i);
+			connection_stats_close();
+			return 1;
+		}
+	}
+	
+	/* Expect no more calls once the callback is removed */
+	connection_stats_set_sample_callback(NULL, NULL);
+	g_num_of_seen_samples = 0;
+	connection_stats_trigger(&http_req_data);
+	if (g_num_of_seen_samples != 0) {
+		printf("test_samples fail: Callback called after removal \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Samples the caller analyzes are not kept as the view (its array may be
+	   gone by the time the view is read) */
+	memcpy(caller_arr, samples, sizeof(caller_arr));
+	connection_stats_analyze(caller_arr, 2);
+	if ((connection_stats_get_samples(&analyzed, &num_of_samples) != RC_OK) ||
+		(analyzed != samples) || (num_of_samples != MAX_NUM_OF_SUPPORTED_CURL_OPER)) {
+		printf("test_samples fail: The view is the caller's array \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	printf("test_samples  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+#define COMPARE_URL_A           "http://a.fake.test/"
+#define COMPARE_URL_B           "http://b.fake.test/"
+#define COMPARE_BUDGET          MAX_NUM_OF_COMPARE_SAMPLES
+
+/* Fake transports of the variants of a comparison (by URL) */
+static ConnStatFakeTransport g_compare_fakes[2];
+
+/*
+ * Transport of test_compare: sample the fake transport of the variant
+ */
+static RC compare_perform(const HttpReqData *http_req_data, CurlInfo *curl_info,
+						  void *transport_data) {
+	ConnStatFakeTransport *fake = &g_compare_fakes[
+		(strcmp(http_req_data->url, COMPARE_URL_B) == 0) ? 1 : 0];
+	
+	(void)transport_data;
+	return fake->transport.perform(http_req_data, curl_info, fake->transport.transport_data);
+}
+
+/**
+* @func:  test_compare
+* @desc:  Validate the A/B comparison: samples are interleaved, a clear 
+*         difference is found (the faster variant) long before the budget 
+*         is used, and equal variants are not found to differ
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_compare() {
+	ConnStatTransport transport = { compare_perform, NULL };
+	ConnStatFakeConfig config;
+	ConnStatCompareResult result;
+	HttpReqData variants[2];
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_compare fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	memset(variants, 0, sizeof(variants));
+	strcpy(variants[0].url, COMPARE_URL_A);
+	strcpy(variants[1].url, COMPARE_URL_B);
+	variants[0].num_of_http_req = COMPARE_BUDGET;
+	variants[1].num_of_http_req = COMPARE_BUDGET;
+	
+	/* Expect budgets over the limit and other modes to be rejected */
+	variants[1].num_of_http_req = COMPARE_BUDGET + 1;
+	rc = connection_stats_compare(variants, 0, 0, &result);
+	variants[1].num_of_http_req = COMPARE_BUDGET;
+	variants[1].ci_width = 0.001;
+	if ((rc != RC_INVALID_NUM_OF_HTTP_REQ) ||
+		(connection_stats_compare(variants, 0, 0, &result) != RC_NOT_SUPPORTED)) {
+		printf("test_compare fail: Expected invalid variants to fail (rc=%d) \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+	variants[1].ci_width = 0;
+	
+	/* Expect B (2ms faster, with 5ms jitter and failures) to be found faster early */
+	memset(&config, 0, sizeof(config));
+	config.transfer.type  = CONNSTAT_DIST_NORMAL;
+	config.transfer.a     = 0.030;
+	config.transfer.b     = 0.005;
+	config.failure_ratio  = 0.1;
+	config.seed           = 11;
+	connection_stats_fake_transport_init(&g_compare_fakes[0], &config);
+	config.transfer.a     = 0.028;
+	config.seed           = 12;
+	connection_stats_fake_transport_init(&g_compare_fakes[1], &config);
+	connection_stats_set_transport(&transport);
+	rc = connection_stats_compare(variants, 0, 0, &result);
+	if ((rc != RC_OK) || !result.significant || (result.faster != 1) ||
+		(result.prob_a_faster > 0.5) || (result.p_value >= 0.05) ||
+		(result.variants[0].summary.num_of_samples >= COMPARE_BUDGET / 2) ||
+		(abs(result.variants[0].summary.num_of_samples - 
+			 result.variants[1].summary.num_of_samples) > 1) ||
+		(result.variants[1].summary.total.median >= result.variants[0].summary.total.median)) {
+		printf("test_compare fail: Expected B to be faster (rc=%d p=%f samples=%d) \n",
+				rc, result.p_value, result.variants[0].summary.num_of_samples);
+		connection_stats_close();
+		return 1;
+	}
+	printf("test_compare: 2ms found in %d+%d samples (%d looks, p=%.5f, P(A<B)=%.2f) \n",
+		   result.variants[0].summary.num_of_samples,
+		   result.variants[1].summary.num_of_samples, result.num_of_looks,
+		   result.p_value, result.prob_a_faster);
+	
+	/* Expect equal variants to use the whole budget without a difference */
+	config.transfer.a     = 0.030;
+	connection_stats_fake_transport_init(&g_compare_fakes[1], &config);
+	rc = connection_stats_compare(variants, 0, 0, &result);
+	if ((rc != RC_OK) || result.significant || (result.faster != -1) ||
+		(result.variants[0].summary.num_of_samples != COMPARE_BUDGET) ||
+		(result.variants[1].summary.num_of_samples != COMPARE_BUDGET)) {
+		printf("test_compare fail: Expected no difference (rc=%d p=%f) \n",
+				rc, result.p_value);
+		connection_stats_close();
+		return 1;
+	}
+	
+	printf("test_compare  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+/* Event loop of test_async: an epoll set and the single timer of the library */
+static int g_async_epfd = -1;
+static long g_async_timer_ms = -1;
+static int g_async_num_of_samples = 0;
+static RC g_async_rc[2];
+static ConnStatSummary g_async_summary[2];
+
+/*
+ * Watch (or stop watching) a socket of the library
+ */
+static void async_socket_cb(int sockfd, ConnStatPollEvent what, void *loop_data) {
+	struct epoll_event event;
+	
+	(void)loop_data;
+	if (what == CONNSTAT_POLL_REMOVE) {
+		epoll_ctl(g_async_epfd, EPOLL_CTL_DEL, sockfd, NULL);
+		return;
+	}
+	memset(&event, 0, sizeof(event));
+	event.events  = ((what & CONNSTAT_POLL_IN) ? EPOLLIN : 0) |
+					((what & CONNSTAT_POLL_OUT) ? EPOLLOUT : 0);
+	event.data.fd = sockfd;
+	if (epoll_ctl(g_async_epfd, EPOLL_CTL_MOD, sockfd, &event) == -1) {
+		epoll_ctl(g_async_epfd, EPOLL_CTL_ADD, sockfd, &event);
+	}
+}
+
+/*
+ * (Re)arm the timer of the library
+ */
+static void async_timer_cb(long timeout_ms, void *loop_data) {
+	(void)loop_data;
+	g_async_timer_ms = timeout_ms;
+}
+
+/*
+ * Count the samples of all runs
+ */
+static void async_sample_cb(const HttpReqData *http_req_data, int sample_idx,
+							const CurlInfo *curl_info, void *user_data) {
+	(void)http_req_data;
+	(void)sample_idx;
+	(void)curl_info;
+	(void)user_data;
+	g_async_num_of_samples++;
+}
+
+/*
+ * Keep the result of a run (user_data is its index)
+ */
+static void async_run_cb(const HttpReqData *http_req_data, RC rc, const char *stat_str,
+						 size_t strLen, const ConnStatSummary *summary, void *user_data) {
+	int run = (int)(long)user_data;
+	
+	(void)http_req_data;
+	(void)stat_str;
+	(void)strLen;
+	g_async_rc[run] = rc;
+	g_async_summary[run] = *summary;
+}
+
+/**
+* @func:  test_async
+* @desc:  Validate the async API, driven by an epoll loop: runs are submitted 
+*         without blocking, and a refused run (socket events) and a hung run 
+*         (timer) both complete with all of their samples classified, and
+*         are published as any run. The hung run ends at its deadline (its
+*         samples that could not start are timed out)
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_async() {
+	ConnStatLoopCallbacks loop_cbs = { async_socket_cb, async_timer_cb, NULL };
+	ConnStatRunCallbacks run_cbs = { async_sample_cb, async_run_cb, NULL };
+	static const char *refused_url = "http://127.0.0.1:1/";
+	HttpReqData http_req_data[2];
+	struct epoll_event events[16];
+	struct timespec start, now;
+	ConnStatSnapshot snapshot;
+	double run_ms;
+	int num_of_runs = 0;
+	int sock, i, n;
+	RC rc;
+	
+	memset(http_req_data, 0, sizeof(http_req_data));
+	sock = open_hung_server(http_req_data[1].url, sizeof(http_req_data[1].url));
+	g_async_epfd = epoll_create1(0);
+	rc = connection_stats_init();
+	if (rc == RC_OK) {
+		rc = connection_stats_async_init(&loop_cbs);
+	}
+	if (rc == RC_OK) {
+		rc = connection_stats_publish("/connstat_tests_async");
+	}
+	if (rc == RC_OK) {
+		rc = connection_stats_snapshot_attach("/connstat_tests_async");
+	}
+	if ((rc != RC_OK) || (g_async_epfd == -1) || (sock == -1)) {
+		printf("test_async fail: Failed to initialize (rc=%d) \n", rc);
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect both runs to be in progress once submitted */
+	memset(g_async_summary, 0, sizeof(g_async_summary));
+	g_async_rc[0] = g_async_rc[1] = RC_OK;
+	g_async_num_of_samples = 0;
+	memcpy(http_req_data[0].url, refused_url, strlen(refused_url));
+	http_req_data[0].num_of_http_req = 3;
+	http_req_data[1].num_of_http_req = 4;
+	http_req_data[1].timeout_ms      = 100;
+	http_req_data[1].deadline_ms     = 150;
+	for (i=0; i<2; i++) {
+		run_cbs.user_data = (void *)(long)i;
+		rc = connection_stats_async_submit(&http_req_data[i], &run_cbs);
+		if (rc != RC_OK) {
+			break;
+		}
+	}
+	connection_stats_async_runs_in_progress(&num_of_runs);
+	if ((rc != RC_OK) || (num_of_runs != 2) || (g_async_num_of_samples != 0)) {
+		printf("test_async fail: Unexpected submit (rc=%d runs=%d) \n", rc, num_of_runs);
+		connection_stats_async_close();
+		connection_stats_close();
+		close(sock);
+		close(g_async_epfd);
+		return 1;
+	}
+	
+	/* Drive the runs until they complete (2 seconds at most) */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (num_of_runs > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec - start.tv_sec > 2) {
+			break;
+		}
+		n = epoll_wait(g_async_epfd, events, 16,
+					   (g_async_timer_ms < 0) ? 100 : (int)g_async_timer_ms);
+		if (n == 0) {
+			if (g_async_timer_ms >= 0) {
+				connection_stats_async_timeout();
+			}
+		}
+		for (i=0; i<n; i++) {
+			connection_stats_async_socket_action(events[i].data.fd,
+				((events[i].events & EPOLLIN) ? CONNSTAT_EV_IN : 0) |
+				((events[i].events & EPOLLOUT) ? CONNSTAT_EV_OUT : 0) |
+				((events[i].events & (EPOLLERR | EPOLLHUP)) ? CONNSTAT_EV_ERR : 0));
+		}
+		connection_stats_async_runs_in_progress(&num_of_runs);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	run_ms = (now.tv_sec - start.tv_sec) * 1e3 + (now.tv_nsec - start.tv_nsec) / 1e6;
+	memset(&snapshot, 0, sizeof(snapshot));
+	connection_stats_snapshot_read(refused_url, &snapshot);
+	connection_stats_async_close();
+	connection_stats_snapshot_detach();
+	connection_stats_close();
+	close(sock);
+	close(g_async_epfd);
+	if ((snapshot.generation != 1) || (snapshot.rc != RC_ERROR_IN_CURL) ||
+		(snapshot.summary.num_of_samples != 3)) {
+		printf("test_async fail: Unexpected snapshot (generation=%llu rc=%d) \n",
+				snapshot.generation, snapshot.rc);
+		return 1;
+	}
+	if ((num_of_runs != 0) || (g_async_num_of_samples != 7) || (run_ms > 300) ||
+		(g_async_rc[0] != RC_ERROR_IN_CURL) || (g_async_rc[1] != RC_ERROR_IN_CURL) ||
+		(g_async_summary[0].num_of_samples != 3) ||
+		(g_async_summary[0].num_of_error_classes != 1) ||
+		(g_async_summary[0].error_classes[0].curl_code != 7) || /* CURLE_COULDNT_CONNECT */
+		(g_async_summary[1].num_of_samples != 4) ||
+		(g_async_summary[1].num_of_timeouts != 4)) {
+		printf("test_async fail: Unexpected runs (runs=%d samples=%d rc=%d,%d timeouts=%d "
+			   "run_ms=%.0f) \n", num_of_runs, g_async_num_of_samples, g_async_rc[0],
+				g_async_rc[1], g_async_summary[1].num_of_timeouts, run_ms);
+		return 1;
+	}
+	
+	printf("test_async  ..........  test PASS\n");
+	return 0;
+}
+
+/* Samples of test_error_stats, taken in turn (total_time, curl_code, response_code) */
+static const struct { double total_time; int curl_code; long response_code; } g_seq_samples[] = {
+	{ 0.010, 0, 200 }, { 0.030, 0, 200 }, { 0.005, 7, 0 }, { 0.020, 0, 200 },
+	{ 0.040, 0, 404 }, { 0.050, 28, 0 }, { 0.015, 0, 200 }, { 0.035, 0, 200 }
+};
+static int g_seq_idx = 0;
+
+/*
+ * Transport of test_error_stats: the next sample of g_seq_samples
+ */
+static RC seq_perform(const HttpReqData *http_req_data, CurlInfo *curl_info,
+					  void *transport_data) {
+	int idx = g_seq_idx++ % (int)(sizeof(g_seq_samples) / sizeof(g_seq_samples[0]));
+	
+	(void)http_req_data;
+	(void)transport_data;
+	memset(curl_info, 0, sizeof(CurlInfo));
+	curl_info->total_time    = g_seq_samples[idx].total_time;
+	curl_info->curl_code     = g_seq_samples[idx].curl_code;
+	curl_info->response_code = g_seq_samples[idx].response_code;
+	return RC_OK;
+}
+
+/*
+ * Comparison function between 2 doubles (reference medians of test_error_stats)
+ */
+static int test_double_comp(const void* elem1, const void* elem2) {
+	if (*(const double*)elem1 < *(const double*)elem2) {
+		return -1;
+	}
+	return *(const double*)elem1 > *(const double*)elem2;
+}
+
+/**
+* @func:  test_error_stats
+* @desc:  Validate the statistics of a run with failures: the run goes on, 
+*         failures are classified, and success ratio, median, mean, stddev and
+*         jitter are those of the successful samples (medians of odd and even
+*         numbers of random samples are checked against a sort)
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_error_stats() {
+	ConnStatTransport transport = { seq_perform, NULL };
+	ConnStatFakeConfig config;
+	ConnStatFakeTransport fake;
+	HttpReqData http_req_data;
+	ConnStatSummary summary;
+	const CurlInfo *samples;
+	double totals[MAX_NUM_OF_SUPPORTED_CURL_OPER];
+	double median;
+	int num_of_samples, n;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_error_stats fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	strcpy(http_req_data.url, FAKE_URL);
+	
+	/* Successful: 0.010 0.030 0.020 0.015 0.035 (in this order) */
+	connection_stats_set_transport(&transport);
+	g_seq_idx = 0;
+	http_req_data.num_of_http_req = 8;
+	rc = connection_stats_trigger(&http_req_data);
+	connection_stats_get_summary(&summary);
+	if ((rc != RC_OK) || (summary.num_of_samples != 8) || (summary.num_of_success != 5) ||
+		(fabs(summary.success_ratio - 5.0 / 8) > 1e-9) ||
+		(summary.num_of_error_classes != 3) || (summary.num_of_timeouts != 1) ||
+		(summary.error_classes[0].curl_code != 7) ||
+		(summary.error_classes[1].response_code != 404) ||
+		(summary.error_classes[2].curl_code != 28) ||
+		(fabs(summary.total.median - 0.020) > 1e-9) ||
+		(fabs(summary.total.mean - 0.022) > 1e-9) ||
+		(fabs(summary.total.stddev - sqrt(0.00043 / 4)) > 1e-9) ||
+		(fabs(summary.total.jitter - 0.055 / 4) > 1e-9) ||
+		(summary.total.min != 0.010) || (summary.total.max != 0.035)) {
+		printf("test_error_stats fail: Unexpected summary (rc=%d success=%d median=%f "
+			   "mean=%f stddev=%f jitter=%f) \n", rc, summary.num_of_success,
+				summary.total.median, summary.total.mean, summary.total.stddev,
+				summary.total.jitter);
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect exact medians of random samples (odd and even numbers) */
+	memset(&config, 0, sizeof(config));
+	config.transfer.type = CONNSTAT_DIST_LOGNORMAL;
+	config.transfer.a    = -4;
+	config.transfer.b    = 1;
+	config.seed          = 5;
+	connection_stats_fake_transport_init(&fake, &config);
+	connection_stats_set_transport(&fake.transport);
+	for (n=MAX_NUM_OF_SUPPORTED_CURL_OPER - 1; n<=MAX_NUM_OF_SUPPORTED_CURL_OPER; n++) {
+		http_req_data.num_of_http_req = n;
+		rc = connection_stats_trigger(&http_req_data);
+		connection_stats_get_summary(&summary);
+		connection_stats_get_samples(&samples, &num_of_samples);
+		for (int i=0; i<num_of_samples; i++) {
+			totals[i] = samples[i].total_time;
+		}
+		qsort(totals, num_of_samples, sizeof(double), test_double_comp);
+		median = (n % 2) ? totals[n / 2] : (totals[n / 2 - 1] + totals[n / 2]) / 2;
+		if ((rc != RC_OK) || (num_of_samples != n) || (summary.total.median != median)) {
+			printf("test_error_stats fail: Unexpected median of %d samples (%f, expected %f) \n",
+					n, summary.total.median, median);
+			connection_stats_close();
+			return 1;
+		}
+	}
+	
+	printf("test_error_stats  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+#define IP_TABLE_NUM_OF_IPS     1000
+
+/**
+* @func:  test_ip_table
+* @desc:  Validate per sample IPs: samples of many backends (far more than the
+*         initial size of the intern table) all keep their own IP, and the 
+*         indexes given out earlier stay valid as the table grows
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_ip_table() {
+	ConnStatFakeConfig config;
+	ConnStatFakeTransport fake;
+	HttpReqData http_req_data;
+	const CurlInfo *samples;
+	unsigned short first_ip_idx = IP_IDX_UNKNOWN;
+	char ip[MAX_SIZE_OF_IP_ADD];
+	int num_of_samples;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_ip_table fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	strcpy(http_req_data.url, FAKE_URL);
+	http_req_data.num_of_http_req = 1;
+	memset(&config, 0, sizeof(config));
+	
+	/* A sample per backend (10.0.x.y), then the first backend again */
+	for (int i=0; i<=IP_TABLE_NUM_OF_IPS; i++) {
+		snprintf(config.ip, sizeof(config.ip), "10.0.%d.%d",
+				 (i % IP_TABLE_NUM_OF_IPS) / 256, (i % IP_TABLE_NUM_OF_IPS) % 256);
+		connection_stats_fake_transport_init(&fake, &config);
+		connection_stats_set_transport(&fake.transport);
+		rc = connection_stats_trigger(&http_req_data);
+		connection_stats_get_samples(&samples, &num_of_samples);
+		if ((rc != RC_OK) || (num_of_samples != 1) || 
+			(connection_stats_get_ip(samples[0].ip_idx, ip) != RC_OK) ||
+			(strcmp(ip, config.ip) != 0)) {
+			printf("test_ip_table fail: Sample of %s has IP %s (rc=%d) \n",
+					config.ip, ip, rc);
+			connection_stats_close();
+			return 1;
+		}
+		if (i == 0) {
+			first_ip_idx = samples[0].ip_idx;
+		}
+	}
+	if ((samples[0].ip_idx != first_ip_idx) ||
+		(connection_stats_get_ip(IP_TABLE_NUM_OF_IPS + 1, ip) != RC_ERROR)) {
+		printf("test_ip_table fail: Unexpected indexes (first=%d last=%d) \n",
+				first_ip_idx, samples[0].ip_idx);
+		connection_stats_close();
+		return 1;
+	}
+	
+	printf("test_ip_table  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+#define DNS_TIMEOUT_MS          200
+
+/**
+* @func:  test_resolve
+* @desc:  Validate the resolution stage against failing resolvers: one that 
+*         refuses every query (nothing listens on its port) fails promptly, 
+*         one that never answers times out by the connect timeout, and both
+*         count the query as a failure of that resolver
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_resolve() {
+	ConnStatResolverStats stats_arr[MAX_NUM_OF_RESOLVERS];
+	HttpReqData http_req_data;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	char resolver[MAX_SIZE_OF_IP_ADD];
+	struct timespec start, end;
+	int sock;
+	int num_of_resolvers = 0;
+	double run_ms;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_resolve fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	if ((connection_stats_get_resolver_stats(stats_arr, &num_of_resolvers) !=
+		 RC_RESULT_REQUESTED_BEFORE_TRIGGER) ||
+		(connection_stats_add_resolver("") != RC_ERROR_IN_DNS)) {
+		printf("test_resolve fail: Expected stats before resolving to fail \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	strcpy(http_req_data.url, "http://connstat.test/");
+	http_req_data.num_of_http_req = 1;
+	connection_stats_add_resolver("127.0.0.1:1");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rc = connection_stats_resolve(&http_req_data, 1);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	run_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+	if (rc == RC_OK) {
+		rc = connection_stats_get_resolver_stats(stats_arr, &num_of_resolvers);
+	}
+	if ((rc != RC_OK) || (num_of_resolvers != 1) || (run_ms > 5000) ||
+		(strcmp(stats_arr[0].resolver, "127.0.0.1:1") != 0) ||
+		(stats_arr[0].num_of_queries != 1) || (stats_arr[0].num_of_failures != 1) ||
+		(stats_arr[0].latency.median != 0)) {
+		printf("test_resolve fail: Unexpected resolution (rc=%d run_ms=%.0f failures=%d) \n",
+				rc, run_ms, stats_arr[0].num_of_failures);
+		connection_stats_close();
+		return 1;
+	}
+	printf("test_resolve: refused resolver failed in %.0f ms \n", run_ms);
+	
+	/* Expect a resolver that never answers to time out (in a second library
+	   session, c-ares is initialized once per session) */
+	connection_stats_close();
+	rc = connection_stats_init();
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((rc != RC_OK) || (sock == -1) ||
+		(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) ||
+		(getsockname(sock, (struct sockaddr *)&addr, &addr_len) == -1)) {
+		printf("test_resolve fail: Failed to open a local resolver \n");
+		connection_stats_close();
+		return 1;
+	}
+	snprintf(resolver, sizeof(resolver), "127.0.0.1:%d", ntohs(addr.sin_port));
+	connection_stats_add_resolver(resolver);
+	http_req_data.connect_timeout_ms = DNS_TIMEOUT_MS;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rc = connection_stats_resolve(&http_req_data, 1);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	run_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+	close(sock);
+	if ((rc != RC_OK) || (run_ms < DNS_TIMEOUT_MS) || (run_ms > 5 * DNS_TIMEOUT_MS) ||
+		(connection_stats_get_resolver_stats(stats_arr, &num_of_resolvers) != RC_OK) ||
+		(stats_arr[0].num_of_queries != 1) || (stats_arr[0].num_of_failures != 1)) {
+		printf("test_resolve fail: Expected the query to time out (rc=%d run_ms=%.0f) \n",
+				rc, run_ms);
+		connection_stats_close();
+		return 1;
+	}
+	
+	printf("test_resolve  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+/**
+* @func:  test_mux
+* @desc:  Validate multiplexed runs over cleartext HTTP/2: every URL that 
+*         libcurl reads as http (any case of the scheme, or none) is probed
+*         with prior knowledge. The replay server speaks HTTP/1.1 only, so
+*         the streams fail on its answer to the HTTP/2 preface - where an 
+*         HTTP/1.1 request would have been served a recorded response
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_mux() {
+	const char *schemes[] = { "http://", "HTTP://", "" };
+	HttpReqData http_req_data;
+	ConnStatSummary summary;
+	pthread_t thread;
+	char url[URL_MAX_LEN];
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_mux fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	if (start_replay(url, sizeof(url), &thread) != 0) {
+		printf("test_mux fail: Failed to prepare the replay \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	for (int i=0; i<3; i++) {
+		memset(&http_req_data, 0, sizeof(http_req_data));
+		snprintf(http_req_data.url, sizeof(http_req_data.url), "%s%s", schemes[i],
+				 strstr(url, "://") + 3);
+		http_req_data.num_of_http_req = 4;
+		
+		/* Expect HTTP/1.1 to be served (the URL is read as http) */
+		http_req_data.http_version = CONNSTAT_HTTP_VERSION_1_1;
+		rc = connection_stats_trigger(&http_req_data);
+		if ((rc != RC_OK) || (connection_stats_get_summary(&summary) != RC_OK) ||
+			(summary.num_of_samples != 4) || (summary.num_of_groups != 2)) {
+			printf("test_mux fail: Expected %s to be served over HTTP/1.1 (rc=%d) \n",
+				   http_req_data.url, rc);
+			stop_replay(thread);
+			connection_stats_close();
+			return 1;
+		}
+		
+		/* Expect multiplexed streams to start with the HTTP/2 preface */
+		http_req_data.http_version = CONNSTAT_HTTP_VERSION_2;
+		http_req_data.multiplex = 1;
+		rc = connection_stats_trigger(&http_req_data);
+		if ((rc == RC_OK) || (connection_stats_get_summary(&summary) != RC_OK) ||
+			(summary.num_of_samples != 4) || (summary.num_of_success != 0) ||
+			(summary.num_of_groups != 0)) {
+			printf("test_mux fail: Expected %s to be multiplexed with prior knowledge "
+				   "(rc=%d num_of_groups=%d) \n", http_req_data.url, rc,
+				   summary.num_of_groups);
+			stop_replay(thread);
+			connection_stats_close();
+			return 1;
+		}
+	}
+	stop_replay(thread);
+	
+	printf("test_mux  ..........  test PASS\n");
+	connection_stats_close();
+	return 0;
+}
+
+/**
+* @func:  test_throughput
+* @desc:  Validate throughput runs against the replay server: only the bytes
+*         of successful downloads count as goodput, the body of the recorded
+*         404 is accounted as failed bytes
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_throughput() {
+	HttpReqData http_req_data;
+	ConnStatThroughput throughput;
+	pthread_t thread;
+	char url[URL_MAX_LEN];
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_throughput fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	if (start_replay(url, sizeof(url), &thread) != 0) {
+		printf("test_throughput fail: Failed to prepare the replay \n");
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* The trace is replayed in turn: 200 with 100 bytes, 404 with 4000 bytes */
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	strcpy(http_req_data.url, url);
+	http_req_data.num_of_http_req = 4;
+	http_req_data.mode = CONNSTAT_MODE_THROUGHPUT;
+	http_req_data.num_of_streams = 2;
+	rc = connection_stats_trigger(&http_req_data);
+	if (rc == RC_OK) {
+		rc = connection_stats_get_throughput(&throughput);
+	}
+	stop_replay(thread);
+	connection_stats_close();
+	if ((rc != RC_OK) || (throughput.total_bytes != 2 * 100) ||
+		(throughput.failed_bytes != 2 * 4000) || (throughput.size.max != 100) ||
+		(throughput.goodput <= 0) ||
+		(throughput.goodput > throughput.total_bytes / throughput.duration + 1)) {
+		printf("test_throughput fail: Unexpected throughput (rc=%d total_bytes=%lld "
+			   "failed_bytes=%lld) \n", rc, throughput.total_bytes, throughput.failed_bytes);
+		return 1;
+	}
+	printf("test_throughput  ..........  test PASS\n");
+	return 0;
+}
+
+#define ADAPTIVE_BUDGET         1000
+
+/**
+* @func:  test_adaptive
+* @desc:  Validate adaptive runs through the fake transport: a percentile 
+*         converges within the budget and its interval holds the true value,
+*         and an interval narrower than a histogram bucket never converges
+* @return 0 if test pass, 1 otherwise
+*/
+static int test_adaptive() {
+	ConnStatFakeConfig config;
+	ConnStatFakeTransport fake;
+	HttpReqData http_req_data;
+	ConnStatSummary summary;
+	RC rc;
+	
+	rc = connection_stats_init();
+	if (rc != RC_OK) {
+		printf("test_adaptive fail: connection_stats_init() returned rc=%d \n", rc);
+		return 1;
+	}
+	memset(&http_req_data, 0, sizeof(http_req_data));
+	memcpy(http_req_data.url, FAKE_URL, strlen(FAKE_URL));
+	http_req_data.num_of_http_req = ADAPTIVE_BUDGET;
+	
+	/* Expect the median of N(50ms, 5ms) to converge to 5ms before the budget */
+	memset(&config, 0, sizeof(config));
+	config.transfer.type = CONNSTAT_DIST_NORMAL;
+	config.transfer.a    = 0.050;
+	config.transfer.b    = 0.005;
+	config.seed          = 1;
+	connection_stats_fake_transport_init(&fake, &config);
+	connection_stats_set_transport(&fake.transport);
+	http_req_data.ci_width = 0.005;
+	rc = connection_stats_trigger(&http_req_data);
+	if (rc == RC_OK) {
+		rc = connection_stats_get_summary(&summary);
+	}
+	if ((rc != RC_OK) || !summary.estimate.converged ||
+		(summary.num_of_samples >= ADAPTIVE_BUDGET) ||
+		(summary.estimate.ci_high - summary.estimate.ci_low > 0.005) ||
+		(summary.estimate.ci_low > 0.050) || (summary.estimate.ci_high < 0.050)) {
+		printf("test_adaptive fail: Expected the median to converge (rc=%d samples=%d "
+			   "ci=%f:%f) \n", rc, summary.num_of_samples, summary.estimate.ci_low,
+			   summary.estimate.ci_high);
+		connection_stats_close();
+		return 1;
+	}
+	
+	/* Expect identical samples to be bounded by their bucket (2048us wide at 50ms): 
+	   a narrower interval uses the budget, a wider one converges once the
+	   interval has both ranks (at 8 samples) */
+	memset(&config, 0, sizeof(config));
+	config.transfer.a = 0.050;
+	connection_stats_fake_transport_init(&fake, &config);
+	http_req_data.ci_width = 0.001;
+	rc = connection_stats_trigger(&http_req_data);
+	if (rc == RC_OK) {
+		rc = connection_stats_get_summary(&summary);
+	}
+	if ((rc != RC_OK) || summary.estimate.converged ||
+		(summary.num_of_samples != ADAPTIVE_BUDGET) ||
+		(fabs(summary.estimate.ci_high - summary.estimate.ci_low - 0.002048) > 1e-9)) {
+		printf("test_adaptive fail: Expected a sub bucket interval not to converge "
+			   "(rc=%d samples=%d ci=%f:%f) \n", rc, summary.num_of_samples,
+			   summary.estimate.ci_low, summary.estimate.ci_high);
+		connection_stats_close();
+		return 1;
+	}
+	http_req_data.ci_width = 0.003;
+	rc = connection_stats_trigger(&http_req_data);
+	if (rc == RC_OK) {
+		rc = connection_stats_get_summary(&summary);
+	}
+	connection_stats_close();
+	if ((rc != RC_OK) || !summary.estimate.converged || (summary.num_of_samples != 8) ||
+		(summary.estimate.ci_low > 0.050) || (summary.estimate.ci_high < 0.050)) {
+		printf("test_adaptive fail: Expected a bucket wide interval to converge "
+			   "(rc=%d samples=%d) \n", rc, summary.num_of_samples);
+		return 1;
+	}
+	printf("test_adaptive  ..........  test PASS\n");
+	return 0;
+}
+
+/*
+ * Remove a (flat) directory created by a test
+ */
+static void remove_dir(const char *dir) {
+	char path[512];
+	struct dirent *entry;
+	DIR *p_dir = opendir(dir);
+	
+	if (p_dir == NULL) {
+		return;
+	}
+	while ((entry = readdir(p_dir)) != NULL) {
+		if (entry->d_name[0] != '.') {
+			snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+			unlink(path);
+		}
+	}
+	closedir(p_dir);
+	rmdir(dir);
+}
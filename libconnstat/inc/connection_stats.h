@@ -18,10 +18,21 @@
 /******************
 **   Includes    **
 ******************/
+#include <stddef.h> /* size_t */
 
 /******************
 **    Defines    **
 ******************/
+/* Marks the functions exported by the library (all other symbols are hidden,
+   the library is built with -fvisibility=hidden) */
+#if defined(_WIN32) && defined(CONNSTAT_BUILD)
+#define CONNSTAT_API                    __declspec(dllexport)
+#elif defined(__GNUC__) && (__GNUC__ >= 4)
+#define CONNSTAT_API                    __attribute__((visibility("default")))
+#else
+#define CONNSTAT_API
+#endif
+
 #define MAX_NUM_OF_SUPPORTED_CURL_OPER  16 /* This can be easily extendded
                                              and in case it is most likely to 
 											 be extendded we can use vector */
@@ -31,8 +42,28 @@
 #define MAX_SIZE_OF_PROG_OUTPUT         128
 #define URL_MAX_LEN                     64
 #define URL_MIN_LEN                     5
-#define HTTP_HEADER_MAX_LEN             64
+#define HTTP_HEADER_MAX_LEN             8192 // e.g. bearer tokens (common server limit)
 #define HTTP_HEADER_MIN_LEN             2
+#define MAX_NUM_OF_ERROR_CLASSES        16
+#define MAX_NUM_OF_GROUPS               16
+#define MAX_SIZE_OF_IP_ADD              46 // IPv4=15, IPv6=45 (+1 for null terminating char)
+#define MAX_NUM_OF_INTERNED_IPS         65535 // Indexes of CurlInfo.ip_idx (0 is IP_IDX_UNKNOWN)
+#define IP_IDX_UNKNOWN                  0  // No IP (e.g. failed before connecting)
+#define MAX_NUM_OF_RESOLVERS            4
+#define MAX_NUM_OF_THROUGHPUT_STREAMS   16
+#define MAX_NUM_OF_THROUGHPUT_SLICES    64
+#define DEFAULT_THROUGHPUT_SLICE_MS     100
+#define MAX_NUM_OF_ADAPTIVE_SAMPLES     1024 // Budget limit of adaptive runs
+#define MAX_NUM_OF_SNAPSHOT_TARGETS     64   // URLs published in a snapshot region
+#define MAX_NUM_OF_STORE_TARGETS        64   // URLs appended by a process to a store
+#define STORE_DIR_MAX_LEN               256
+#define MAX_NUM_OF_AGGREGATE_TARGETS    64   // URLs aggregated by connection_stats_record
+#define MAX_NUM_OF_SWEEP_TARGETS        64   // Targets of a single sweep
+#define MAX_NUM_OF_COMPARE_SAMPLES      1024 // Budget limit of each variant of a comparison
+#define DEFAULT_COMPARE_ALPHA           0.05
+#define MAX_NUM_OF_HEADER_PROFILES      256
+#define HEADER_PROFILE_NAME_MAX_LEN     32
+#define MAX_NUM_OF_CACHE_ENTRIES        4096 // Addresses and TLS sessions of a warm start cache
 
 
 
@@ -52,21 +83,376 @@ typedef enum
 	RC_ERROR_IN_CURL,
 	RC_RESULT_REQUESTED_BEFORE_TRIGGER,
 	RC_ERROR_IN_FILE_OR_FOLDER,
-	RC_PARSING_ERROR
+	RC_PARSING_ERROR,
+	RC_ERROR_IN_DNS,
+	RC_INVALID_HTTP_VERSION,
+	RC_NOT_SUPPORTED,
+	RC_INVALID_MODE,
+	RC_INVALID_TIMEOUT
 } RC;
 
+/**
+* HTTP protocol version to probe with
+*/
+typedef enum
+{
+	CONNSTAT_HTTP_VERSION_DEFAULT = 0, /* Whatever libcurl prefers */
+	CONNSTAT_HTTP_VERSION_1_1,
+	CONNSTAT_HTTP_VERSION_2,           /* ALPN over TLS, prior knowledge (h2c) over http:// */
+	CONNSTAT_HTTP_VERSION_3            /* Only if libcurl was built with HTTP/3 */
+} ConnStatHttpVersion;
+
+/**
+* Measurement mode
+*/
+typedef enum
+{
+	CONNSTAT_MODE_LATENCY = 0,   /* Timing phases of each request */
+	CONNSTAT_MODE_THROUGHPUT     /* Download speed (goodput), body is discarded */
+} ConnStatMode;
+
+/**
+* Socket events the library wants to be notified about (see ConnStatSocketCb)
+*/
+typedef enum
+{
+	CONNSTAT_POLL_NONE   = 0,
+	CONNSTAT_POLL_IN     = 1,  /* Wait for the socket to be readable */
+	CONNSTAT_POLL_OUT    = 2,  /* Wait for the socket to be writable */
+	CONNSTAT_POLL_INOUT  = 3,  /* Wait for both */
+	CONNSTAT_POLL_REMOVE = 4   /* Stop watching the socket */
+} ConnStatPollEvent;
+
+/**
+* Engine of connection_stats_probe
+*/
+typedef enum
+{
+	CONNSTAT_PROBE_ENGINE_AUTO = 0,  /* io_uring if the kernel allows it, epoll otherwise */
+	CONNSTAT_PROBE_ENGINE_IO_URING,
+	CONNSTAT_PROBE_ENGINE_EPOLL
+} ConnStatProbeEngine;
+
+/**
+* Distributions of the fake transport (see ConnStatDistribution)
+*/
+typedef enum
+{
+	CONNSTAT_DIST_CONSTANT = 0,  /* a */
+	CONNSTAT_DIST_UNIFORM,       /* In [a:b] */
+	CONNSTAT_DIST_NORMAL,        /* Mean a, standard deviation b */
+	CONNSTAT_DIST_LOGNORMAL,     /* exp() of a normal with mean a and standard deviation b */
+	CONNSTAT_DIST_EXPONENTIAL    /* a plus an exponential with mean b (heavy latency tails) */
+} ConnStatDistType;
+
+/**
+* Socket events reported back to the library by the event loop 
+* (bitmask, see connection_stats_async_socket_action)
+*/
+#define CONNSTAT_EV_IN                  1
+#define CONNSTAT_EV_OUT                 2
+#define CONNSTAT_EV_ERR                 4
+
 
 /******************
 **  Structures   **
 ******************/
 /**
 * HTTP data - the connection_stats library will operate accordingly
+* Zero the whole struct (memset) before setting the fields of interest: 
+* every field beyond num_of_http_req and url has its default at 0, and fields
+* added in later versions are read as well, so a struct that is not zeroed 
+* turns on modes its caller does not know about
 */
  typedef struct {
   int 		num_of_http_req;  /* Number of HTTP requests to make */
   char 		url[URL_MAX_LEN]; /* Target URL */
+  ConnStatHttpVersion http_version; /* Protocol to probe with */
+  int 		multiplex;        /* Non zero: all requests run concurrently as streams
+                                 over a single connection (HTTP/2 and HTTP/3 only) */
+  ConnStatMode mode;          /* Measurement mode */
+  int 		num_of_streams;   /* Throughput mode: parallel downloads (0 means 1) */
+  long 		payload_bytes;    /* Throughput mode: bytes to download per request
+                                 (HTTP range, 0 means the whole resource) */
+  int 		slice_ms;         /* Throughput mode: curve resolution (0 means
+                                 DEFAULT_THROUGHPUT_SLICE_MS) */
+  double 	ci_width;         /* Non zero: adaptive run - keep sampling until the 95%
+                                 confidence interval of the percentile of total_time
+                                 is narrower than ci_width (sec). num_of_http_req is
+                                 then the budget (up to MAX_NUM_OF_ADAPTIVE_SAMPLES) */
+  double 	percentile;       /* Adaptive run: percentile to converge, in (0:1)
+                                 (0 means the median) */
+  /* Timeouts (0 means none). A sample that times out is classified as timed 
+     out (CURLE_OPERATION_TIMEDOUT) and the run goes on */
+  long 		timeout_ms;         /* Whole sample */
+  long 		connect_timeout_ms; /* Connect phase (name lookup, connect and TLS) */
+  long 		low_speed_limit;    /* Transfer phase: abort a sample transferring slower
+                                   than low_speed_limit (bytes/sec) ... */
+  long 		low_speed_time;     /* ... for low_speed_time (sec) */
+  long 		deadline_ms;        /* Whole run: samples are cut at the deadline and
+                                   samples that could not start are timed out */
+  char 		header_profile[HEADER_PROFILE_NAME_MAX_LEN]; /* Headers to send (see 
+                                 connection_stats_add_header_profile), empty for 
+                                 the headers of connection_stats_add_http_hdr */
 } HttpReqData;
 
+/**
+* Timing info (in seconds) of a single HTTP request (a sample)
+*/
+typedef struct {
+	double name_lookup_time;
+	double connect_time;
+	double start_transfer_time;
+	double total_time;
+	int    curl_code;      /* Result of the transfer (CURLcode, 0 is OK) */
+	long   response_code;  /* HTTP response code (0 if none was received) */
+	unsigned short ip_idx; /* IP of the (last) server, see connection_stats_get_ip */
+	unsigned short redirect_count; /* Number of redirects that were followed */
+	unsigned short num_of_connects; /* New connections opened for this sample */
+	long long timestamp_us; /* CLOCK_REALTIME (usec) when the sample was collected */
+	long   involuntary_ctx_switches; /* Times the measuring thread was preempted
+	                                    during the sample (sequential runs only) */
+} CurlInfo;
+
+/**
+* A single class of failed samples (by CURLcode and HTTP response code)
+*/
+typedef struct {
+	int    curl_code;      /* CURLcode of the failed samples */
+	long   response_code;  /* HTTP response code (>=400 on HTTP errors) */
+	int    count;          /* Number of samples failed with this class */
+} ConnStatErrorClass;
+
+/**
+* Statistics (in seconds) of a single timing phase over the successful samples
+*/
+typedef struct {
+	double median;
+	double mean;
+	double stddev;
+	double jitter;  /* Mean absolute difference between consecutive samples */
+	double min;
+	double max;
+} ConnStatPhaseStats;
+
+/**
+* Statistics of all samples served by the same IP with the same HTTP 
+* response code (e.g. a single backend behind DNS round-robin)
+*/
+typedef struct {
+	char               ip[MAX_SIZE_OF_IP_ADD];
+	long               response_code;
+	int                num_of_samples;
+	ConnStatPhaseStats name_lookup;
+	ConnStatPhaseStats connect;
+	ConnStatPhaseStats start_transfer;
+	ConnStatPhaseStats total;
+} ConnStatGroup;
+
+/**
+* Streaming estimate (in seconds) of a percentile of total_time in an adaptive
+* run. Values are taken from a log-linear histogram (up to 1/16 relative error)
+*/
+typedef struct {
+	double             percentile;  /* Tracked percentile (0.5 is the median) */
+	double             value;
+	double             ci_low;      /* 95% confidence interval of value (edges of 
+	                                   histogram buckets, so never narrower than
+	                                   a bucket - 1/16 of the value) */
+	double             ci_high;
+	int                converged;   /* Interval got narrower than ci_width within
+	                                   the budget */
+} ConnStatEstimate;
+
+/**
+* Full summary of a run. A sample is successful if the transfer completed 
+* (CURLE_OK) with an HTTP response code below 400
+*/
+typedef struct {
+	int                num_of_samples;
+	int                num_of_success;
+	double             success_ratio;  /* num_of_success / num_of_samples */
+	int                num_of_connects; /* New connections opened by all samples */
+	ConnStatPhaseStats name_lookup;
+	ConnStatPhaseStats connect;
+	ConnStatPhaseStats start_transfer;
+	ConnStatPhaseStats total;
+	int                num_of_error_classes;
+	ConnStatErrorClass error_classes[MAX_NUM_OF_ERROR_CLASSES];
+	int                num_of_unclassified_errors; /* error_classes overflow */
+	int                num_of_groups;   /* Per IP & response code statistics */
+	ConnStatGroup      groups[MAX_NUM_OF_GROUPS]; /* Samples that got a response */
+	int                num_of_ungrouped_samples;  /* groups overflow */
+	ConnStatEstimate   estimate;        /* Adaptive runs only */
+	int                num_of_timeouts; /* Failed samples that timed out (or could
+	                                       not start before the deadline) */
+	int                num_of_preempted_samples; /* Samples with scheduling noise 
+	                                                (see involuntary_ctx_switches) */
+	long               involuntary_ctx_switches; /* Over all samples */
+} ConnStatSummary;
+
+/**
+* Result of a single target of a sweep (see connection_stats_sweep)
+*/
+typedef struct {
+	RC                 rc;          /* As connection_stats_trigger would return */
+	char               stat_str[MAX_SIZE_OF_PROG_OUTPUT]; /* Empty if no sample succeeded */
+	ConnStatSummary    summary;
+} ConnStatSweepResult;
+
+/**
+* Result of an A/B comparison of total_time (see connection_stats_compare)
+*/
+typedef struct {
+	ConnStatSweepResult variants[2];  /* Samples taken of A and of B */
+	double             prob_a_faster; /* Estimated P(a sample of A is faster than 
+	                                     one of B), 0.5 means no difference */
+	double             z;             /* Mann-Whitney statistic (positive if A is slower) */
+	double             p_value;       /* Two sided, at the last look */
+	int                num_of_looks;  /* Tests performed during the comparison */
+	int                significant;   /* p_value got below the alpha of its look */
+	int                faster;        /* 0 (A) or 1 (B) if significant, -1 otherwise */
+} ConnStatCompareResult;
+
+/**
+* Published result of the last run of a single URL (see 
+* connection_stats_publish and connection_stats_snapshot_read)
+*/
+typedef struct {
+	unsigned long long generation;  /* Publication number of this URL (1 is the first) */
+	long long          published_ns; /* CLOCK_REALTIME of the publication */
+	char               url[URL_MAX_LEN];
+	RC                 rc;          /* Result of connection_stats_trigger */
+	char               stat_str[MAX_SIZE_OF_PROG_OUTPUT]; /* Empty if no sample succeeded */
+	ConnStatSummary    summary;
+} ConnStatSnapshot;
+
+/**
+* A single point of a series returned by connection_stats_store_query: the
+* requested percentile (in seconds) of every phase over the successful 
+* samples of a time bucket
+*/
+typedef struct {
+	long long          start_us;        /* Start of the time bucket (CLOCK_REALTIME) */
+	int                num_of_samples;  /* Successful samples in the bucket */
+	double             name_lookup;
+	double             connect;
+	double             start_transfer;
+	double             total;
+} ConnStatSeriesPoint;
+
+/**
+* Throughput (goodput) of a run in throughput mode. Speeds are in bytes/sec
+*/
+typedef struct {
+	int                num_of_streams;  /* Parallel downloads */
+	long long          total_bytes;     /* Body bytes of the successful downloads */
+	long long          failed_bytes;    /* Body bytes received by failed downloads */
+	double             duration;        /* First start to last completion (sec) */
+	double             goodput;         /* total_bytes / duration */
+	ConnStatPhaseStats speed;           /* CURLINFO_SPEED_DOWNLOAD_T of the downloads */
+	ConnStatPhaseStats size;            /* CURLINFO_SIZE_DOWNLOAD_T of the downloads */
+	int                slice_ms;        /* Width of a curve slice (grows for long runs) */
+	int                num_of_slices;
+	double             curve[MAX_NUM_OF_THROUGHPUT_SLICES]; /* Aggregated speed per slice
+	                                       (of all bytes received, as the link saw them) */
+} ConnStatThroughput;
+
+/**
+* Statistics (in seconds) of a single resolver over the resolution stage
+*/
+typedef struct {
+	char               resolver[MAX_SIZE_OF_IP_ADD]; /* Empty for the system resolver */
+	int                num_of_queries;
+	int                num_of_failures;
+	ConnStatPhaseStats latency;  /* Over the successful queries */
+} ConnStatResolverStats;
+
+/**
+* Async API callbacks towards the caller's event loop
+*/
+/* Start/modify/stop watching sockfd for the given events */
+typedef void (*ConnStatSocketCb)(int sockfd, ConnStatPollEvent what, 
+								 void *loop_data);
+/* (Re)arm a single timer: call connection_stats_async_timeout() once 
+   timeout_ms expires. timeout_ms of -1 means the timer should be deleted */
+typedef void (*ConnStatTimerCb)(long timeout_ms, void *loop_data);
+
+typedef struct {
+	ConnStatSocketCb socket_cb;
+	ConnStatTimerCb  timer_cb;
+	void*            loop_data; /* Passed as is to socket_cb and timer_cb */
+} ConnStatLoopCallbacks;
+
+/**
+* Async API completion callbacks of a single run (num_of_http_req samples)
+*/
+/* Called once per completed sample (sample_idx in [0:num_of_http_req-1]) */
+typedef void (*ConnStatSampleCb)(const HttpReqData *http_req_data, 
+								 int sample_idx, const CurlInfo *curl_info, 
+								 void *user_data);
+/* Called once per run. On RC_OK stat_str holds the statistics string 
+   (see connection_stats_get_statistics), otherwise it is empty.
+   summary is valid whenever at least one sample was performed */
+typedef void (*ConnStatRunCb)(const HttpReqData *http_req_data, RC rc, 
+							  const char *stat_str, size_t strLen, 
+							  const ConnStatSummary *summary, 
+							  void *user_data);
+
+typedef struct {
+	ConnStatSampleCb sample_cb; /* Optional (may be NULL) */
+	ConnStatRunCb    run_cb;
+	void*            user_data; /* Passed as is to sample_cb and run_cb */
+} ConnStatRunCallbacks;
+
+/**
+* Transport of sequential runs (see connection_stats_set_transport)
+*/
+/* Take a single sample of http_req_data: fill curl_info as libCURL would 
+   (timings are cumulative, curl_code and response_code classify failures) */
+typedef RC (*ConnStatPerformCb)(const HttpReqData *http_req_data, 
+								CurlInfo *curl_info, void *transport_data);
+
+typedef struct {
+	ConnStatPerformCb perform;
+	void*             transport_data; /* Passed as is to perform */
+} ConnStatTransport;
+
+/**
+* A distribution (in seconds) of the fake transport. Negative draws count as 0
+*/
+typedef struct {
+	ConnStatDistType   type;
+	double             a;
+	double             b;
+} ConnStatDistribution;
+
+/**
+* Samples of the fake transport. Every phase gets its own duration, so the 
+* timings of a sample are the cumulative sums of the durations (as libCURL's)
+*/
+typedef struct {
+	ConnStatDistribution name_lookup;
+	ConnStatDistribution connect;
+	ConnStatDistribution start_transfer;
+	ConnStatDistribution transfer;       /* Start transfer to total */
+	double             failure_ratio;    /* Samples failing with failure_curl_code */
+	int                failure_curl_code; /* 0 means CURLE_COULDNT_CONNECT */
+	long               response_code;    /* Of the other samples (0 means 200) */
+	char               ip[MAX_SIZE_OF_IP_ADD]; /* Empty means 127.0.0.1 */
+	unsigned long long seed;             /* The same seed draws the same samples */
+} ConnStatFakeConfig;
+
+/**
+* Fake transport (see connection_stats_fake_transport_init). Samples over 
+* the timeouts of the target are timed out, as with libCURL
+*/
+typedef struct {
+	ConnStatTransport  transport;  /* To be set, or called directly */
+	ConnStatFakeConfig config;
+	unsigned long long rng[4];     /* Generator state */
+} ConnStatFakeTransport;
+
 
 /******************
 **    Methods    **
@@ -76,7 +462,7 @@ typedef enum
 * @desc   Initialize the library (including initialization of libCURL)
 * @return Return Code (taken from RC enum)
 */
-RC connection_stats_init();
+CONNSTAT_API RC connection_stats_init();
 
 /**
 * @desc   Add an extra HTTP header to the request
@@ -84,27 +470,94 @@ RC connection_stats_init();
 *                       (In format: "Header-name: Header-value")
 * @return Return Code (taken from RC enum)
 */
-RC connection_stats_add_http_hdr(char* http_header);
+CONNSTAT_API RC connection_stats_add_http_hdr(char* http_header);
+
+/**
+* @desc   Add a named set of HTTP headers (e.g. the auth headers of a tenant),
+*         sent by every target that names it in header_profile instead of
+*         the headers of connection_stats_add_http_hdr. The headers are 
+*         validated and turned into a libCURL list once, and the list is 
+*         shared as is by all those targets
+* @param  name				Profile name (shorter than HEADER_PROFILE_NAME_MAX_LEN)
+* @param  http_headers		Headers of the profile (In format: "Header-name: Header-value")
+* @param  num_of_headers	Number of headers in http_headers
+* @return Return Code (taken from RC enum). RC_ERROR if the name is taken
+*/
+CONNSTAT_API RC connection_stats_add_header_profile(const char* name, 
+													const char** http_headers,
+													int num_of_headers);
+
+/**
+* @desc   Remove a named set of HTTP headers (async runs in progress keep
+*         sending it)
+* @param  name		Profile name
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_remove_header_profile(const char* name);
 
 /**
 * @desc   Trigger for the library to execute HTTP request
 *         According to the previously provided arguments.
+*         Failed samples do not abort the run, they are classified and 
+*         reported by connection_stats_get_summary()
+*         In multiplexed mode start_transfer_time of each sample is the 
+*         time to first byte of its stream
 * @param  http_req_data	Data as received by the user 
-* @return Return Code (taken from RC enum)
+* @return Return Code (taken from RC enum). RC_ERROR_IN_CURL if no sample
+*         succeeded
+*/
+CONNSTAT_API RC connection_stats_trigger(HttpReqData* http_req_data);
+
+/**
+* @desc   Sample several targets within a single time budget. Samples of all
+*         targets are interleaved, the target that is the furthest behind 
+*         (relative to its num_of_http_req) first, and a sample is only 
+*         started if its expected duration fits the remaining budget, so 
+*         every target gets its share and the sweep ends in time. Samples 
+*         left at the deadline are timed out. Sequential latency targets only
+*         (each target's own timeouts apply, its deadline_ms is ignored)
+* @param  targets			Targets to be sampled
+* @param  num_of_targets	Number of targets (up to MAX_NUM_OF_SWEEP_TARGETS)
+* @param  deadline_ms		Time budget of the whole sweep (0 means none)
+* @param  results			Result per target (num_of_targets entries)
+* @return Return Code (taken from RC enum). RC_OK if all targets were swept,
+*         even if some of their samples failed (see results)
+*/
+CONNSTAT_API RC connection_stats_sweep(HttpReqData* targets, int num_of_targets,
+									   long deadline_ms, ConnStatSweepResult* results);
+
+/**
+* @desc   Compare total_time of two variants (e.g. two URLs, or the same URL 
+*         with two header profiles). Each variant has its own handle, and 
+*         their samples are interleaved in pairs (A,B then B,A, ...), so both 
+*         see the same network conditions. A Mann-Whitney test runs over the 
+*         successful samples as they come, at 10, 20, 40, ... samples per 
+*         variant, and the comparison stops at the first significant look 
+*         (look k is tested at alpha/2^k, so alpha holds over all looks).
+*         Sequential latency variants only (each variant's own timeouts 
+*         apply, its deadline_ms is ignored)
+* @param  variants		The two variants (A, B). num_of_http_req is the budget 
+*						of each (up to MAX_NUM_OF_COMPARE_SAMPLES)
+* @param  alpha			Significance level (0 means DEFAULT_COMPARE_ALPHA)
+* @param  deadline_ms	Time budget of the whole comparison (0 means none)
+* @param  result		Result of the comparison
+* @return Return Code (taken from RC enum). RC_OK if the comparison ran, 
+*         even if it is not significant (see result)
 */
-RC connection_stats_trigger(HttpReqData* http_req_data);
+CONNSTAT_API RC connection_stats_compare(HttpReqData* variants, double alpha,
+										 long deadline_ms, ConnStatCompareResult* result);
 
 /**
 * @desc   Collect all required info about the connection and generate statistics 
 * @return Return Code (taken from RC enum)
 */
-RC connection_stats_analyze();
+CONNSTAT_API RC connection_stats_analyze();
 
 /**
 * @desc   Close the library gracefully (including closing files and libCURL insstance) 
 * @return Return Code (taken from RC enum)
 */
-RC connection_stats_close();
+CONNSTAT_API RC connection_stats_close();
 
 /**
 * @func   connection_stats_get_statistics
@@ -120,6 +573,478 @@ RC connection_stats_close();
 * @param  strLen      Len of the returned string
 * @return Return Code (taken from RC enum)
 */
-RC connection_stats_get_statistics(char* stat_str, size_t* strLen);
+CONNSTAT_API RC connection_stats_get_statistics(char* stat_str, size_t* strLen);
+
+/**
+* @desc   Get the throughput of the last run (throughput mode only)
+* @param  throughput    Throughput to be filled
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_get_throughput(ConnStatThroughput* throughput);
+
+/**
+* @desc   Get the IP string of an interned IP index (see CurlInfo.ip_idx)
+* @param  ip_idx     Interned IP index
+* @param  ip         IP string (allocated with at least MAX_SIZE_OF_IP_ADD),
+*                    empty for IP_IDX_UNKNOWN
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_get_ip(unsigned short ip_idx, char* ip);
+
+/**
+* @desc   Get the full summary of the last run: success ratio, per error 
+*         class counts and per phase median/mean/stddev/jitter/min/max
+* @param  summary    Summary to be filled
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_get_summary(ConnStatSummary* summary);
+
+/**
+* @desc   Get the samples of the last run (connection_stats_trigger), as a
+*         read only view of the library's own storage - nothing is copied or
+*         formatted. The view is valid until the next run or
+*         connection_stats_close()
+* @param  p_samples          Set to the samples (in the order they were taken)
+* @param  p_num_of_samples   Set to the number of samples
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_get_samples(const CurlInfo** p_samples,
+											 int* p_num_of_samples);
+
+/**
+* @desc   Call sample_cb with every sample as soon as it is collected, by all
+*         runs (sequential, adaptive, multiplexed, throughput, sweeps and
+*         async runs). curl_info points into the library's own storage and is
+*         valid during the call only. sample_cb must not start a run.
+*         Until connection_stats_close()
+* @param  sample_cb    Callback (see ConnStatSampleCb), NULL to stop calling
+* @param  user_data    Passed as is to sample_cb
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_set_sample_callback(ConnStatSampleCb sample_cb,
+													 void* user_data);
+
+/******************
+** Low Jitter API **
+******************/
+/* Runs measure on the calling thread, so its timings absorb any scheduling
+   noise: migrations between cores and preemptions by other tasks. Pin the 
+   measuring thread to dedicated cores (or to the cores of the NIC's NUMA 
+   node), busy poll the probe sockets, and check involuntary_ctx_switches
+   of the samples (and the summary) for the noise that is left. */
+
+/**
+* @desc   Pin the calling thread to a set of cores
+* @param  cpu_list		Cores in sysfs cpulist format (e.g. "2,4-6"), NULL for all
+* @param  numa_node		Only the cores of this NUMA node, -1 for any node
+* @return Return Code (taken from RC enum). RC_ERROR if no core is left
+*/
+CONNSTAT_API RC connection_stats_set_affinity(const char* cpu_list, int numa_node);
+
+/**
+* @desc   Busy poll the sockets of following runs for incoming data
+*         (SO_BUSY_POLL) instead of sleeping on interrupts. Values above
+*         net.core.busy_poll require CAP_NET_ADMIN (a warning is printed and 
+*         the socket is used without busy polling)
+* @param  busy_poll_us	Busy poll time (usec), 0 to stop
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_set_busy_poll(int busy_poll_us);
+
+/******************
+** Transport API **
+******************/
+/* Samples of sequential runs (including adaptive runs and sweeps) are taken
+   through a transport: libCURL by default, or a caller set one, e.g. the fake
+   transport, which draws synthetic timings without any network. */
+
+/**
+* @desc   Take the samples of following runs through a transport (kept by
+*         reference). Multiplexed, throughput and async runs are performed 
+*         by libCURL only, and fail with RC_NOT_SUPPORTED while it is set
+* @param  transport		Transport to be used, NULL for libCURL
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_set_transport(const ConnStatTransport* transport);
+
+/**
+* @desc   Initialize a fake transport: no I/O, every sample is drawn from the
+*         distributions of config (millions of samples per second)
+* @param  fake		Fake transport to be initialized (fake->transport is then
+*                   ready for connection_stats_set_transport)
+* @param  config	Distributions and failures of the samples
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_fake_transport_init(ConnStatFakeTransport* fake,
+													 const ConnStatFakeConfig* config);
+
+/******************
+**   Probe API   **
+******************/
+/* Connect latency only: a probe opens a TCP connection to a target (and 
+   completes a TLS handshake with https:// targets), without any HTTP 
+   transfer. Probes are issued in large batches by a single thread, through
+   io_uring (or epoll), so many thousands of endpoints can be probed per 
+   second. Results are samples as of runs (CurlInfo): name_lookup_time, 
+   connect_time and total_time (end of the connect, or of the handshake), 
+   so connection_stats_build_output style statistics apply as is. */
+
+/**
+* @desc   Probe the connect (and TLS handshake) latency of many targets.
+*         Only the url and the timeouts of a target are used: connect_timeout_ms
+*         (or timeout_ms) caps the whole probe, 1 second if neither is set.
+*         Hostnames are resolved before probing, concurrently and each 
+*         hostname once, by the system resolver configuration (IP literals
+*         are not resolved at all). The TLS peer is not verified.
+*         A failed probe is classified by curl_code (CURLE_COULDNT_RESOLVE_HOST, 
+*         CURLE_COULDNT_CONNECT, CURLE_OPERATION_TIMEDOUT or 
+*         CURLE_SSL_CONNECT_ERROR). A library built without TLS (PROBE_TLS=0)
+*         fails https:// probes after the connect with CURLE_NOT_BUILT_IN
+* @param  targets			Targets to be probed (http:// or https:// URLs)
+* @param  num_of_targets	Number of targets
+* @param  max_in_flight		Probes in flight at once (0 means 1024), limited
+*                           by the open files limit
+* @param  engine			Engine to use (RC_NOT_SUPPORTED if io_uring is 
+*                           required but not available)
+* @param  results			Result per target (num_of_targets entries)
+* @return Return Code (taken from RC enum). RC_OK if all targets were probed,
+*         even if some of the probes failed (see results)
+*/
+CONNSTAT_API RC connection_stats_probe(HttpReqData* targets, int num_of_targets,
+									   int max_in_flight, ConnStatProbeEngine engine,
+									   CurlInfo* results);
+
+/******************
+**    DNS API    **
+******************/
+/* Optional resolution stage: resolve all targets concurrently up front 
+   (measuring every resolver separately), then every following transfer 
+   uses the resolved addresses instead of resolving by itself. */
+
+/**
+* @desc   Add a DNS server to be used (and measured) by connection_stats_resolve.
+*         If none is added the system resolver is used
+* @param  resolver	IPv4/IPv6 address of the DNS server
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_add_resolver(char* resolver);
+
+/**
+* @desc   Resolve the hostnames of all targets concurrently, against all 
+*         resolvers at once. Following transfers to these hosts use the 
+*         addresses of the first resolver that answered (CURLOPT_RESOLVE).
+*         A query fails once the longest connect_timeout_ms (or timeout_ms) 
+*         of the targets passes, c-ares' own timeouts and retries apply if 
+*         none is set
+* @param  http_req_data_arr	Targets to be resolved
+* @param  num_of_targets		Number of targets in http_req_data_arr
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_resolve(HttpReqData* http_req_data_arr, int num_of_targets);
+
+/**
+* @desc   Get the statistics of every resolver used by the last resolution stage
+* @param  stats_arr         Statistics (allocated with MAX_NUM_OF_RESOLVERS entries)
+* @param  num_of_resolvers  Number of entries filled in stats_arr
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_get_resolver_stats(ConnStatResolverStats* stats_arr, 
+									   int* num_of_resolvers);
+
+/******************
+** Warm Start API **
+******************/
+/* Opt-in cache file, for short processes (e.g. cron style probing) that 
+   would otherwise pay the full DNS (and TLS) cost on their first samples.
+   The file keeps resolved addresses (until their TTL) and the TLS sessions
+   of the probe engine, and is shared by all processes that name it. */
+
+/**
+* @desc   Warm start from a cache file, and keep it updated. Its live entries
+*         are loaded right away (a missing or damaged file is a cold start):
+*         following transfers and probes use the cached addresses instead of
+*         resolving, and probes resume the cached TLS sessions.
+*         connection_stats_close() replaces the file atomically (temporary 
+*         file + rename) with what this process has learned.
+*         Must be called after connection_stats_init()
+* @param  path		Cache file, NULL to stop caching (without writing)
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_set_cache_file(const char* path);
+
+/******************
+**  Tracing API  **
+******************/
+/* The debug variant traces every transfer to trace/trace.out (rewritten by
+   every process). Tail tracing keeps the traces that matter only: the events
+   of a sample are buffered in memory (up to 64KB per sample), and written
+   only if the sample turns out to be an outlier. */
+
+/**
+* @desc   Keep the traces of outliers only: failed samples, and samples whose
+*         total time is above the given percentile of the successful samples
+*         so far (of all targets, once 20 samples were seen). Their traces are
+*         appended to trace/tail.out, each after a line with the sample and
+*         the threshold it crossed. The debug variant only (RC_NOT_SUPPORTED
+*         otherwise). Must be called after connection_stats_init()
+* @param  percentile	Percentile of the threshold (e.g. 0.99), 0 for full
+*                       tracing
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_set_tail_tracing(double percentile);
+
+/**
+* @desc   Replay the responses of a trace (trace.out or tail.out, of any
+*         variant's debug build) from a local HTTP/1.1 server, keeping their
+*         recorded server side timing: the gap from the end of each request
+*         to its response headers, and the gaps between the chunks of data.
+*         Every request (on any connection) gets the next recorded response,
+*         round robin. Data is replayed by size (its content is not traced),
+*         framed by Content-Length. Serves until *stop is set
+* @param  trace_path	Trace to be replayed
+* @param  port			Port to be served on 127.0.0.1
+* @param  stop			Serving ends (within 100 ms) once *stop is set
+* @return Return Code (taken from RC enum), RC_ERROR_IN_FILE_OR_FOLDER if
+*         the trace can not be read or has no responses
+*/
+CONNSTAT_API RC connection_stats_replay_serve(const char* trace_path, int port,
+											  volatile int* stop);
+
+/******************
+** Collector API **
+******************/
+/* Many measuring processes on a host stream their samples to a single
+   collector over a Unix domain socket, and the collector merges them per
+   URL into its aggregate (see Aggregation API), served on request.
+   Samples travel as batched binary records, a run costs a single send.
+   Typical flow:
+     collector:  connection_stats_init() -> connection_stats_collector_serve()
+     runners:    connection_stats_init() -> connection_stats_collector_connect()
+                 -> runs (streamed automatically) -> connection_stats_close()
+     anyone:     connection_stats_collector_query() */
+
+/**
+* @desc   Stream the samples of following runs (sequential, async and sweeps)
+*         to a collector. A collector that falls behind slows the sender down
+*         (briefly) rather than losing samples, and a collector that is gone
+*         is reported once - runs go on regardless, and are streamed again
+*         once the collector is back (reconnecting with backoff, up to 5
+*         seconds apart).
+*         Must be called after connection_stats_init()
+* @param  path		Socket of the collector, NULL to stop streaming
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_collector_connect(const char* path);
+
+/**
+* @desc   Stream samples of a URL to the collector (e.g. samples taken by
+*         other means). Requires connection_stats_collector_connect()
+* @param  url				URL the samples were taken of
+* @param  curl_info_arr		Samples
+* @param  arr_size			Number of samples in curl_info_arr
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_collector_send(const char* url,
+												const CurlInfo* curl_info_arr,
+												int arr_size);
+
+/**
+* @desc   Get the aggregate of a URL from a collector (see
+*         connection_stats_get_aggregate)
+* @param  path		Socket of the collector
+* @param  url		URL as streamed
+* @param  summary	Summary to be filled
+* @return Return Code (taken from RC enum), RC_ERROR if the collector does
+*         not answer
+*/
+CONNSTAT_API RC connection_stats_collector_query(const char* path, const char* url,
+												 ConnStatSummary* summary);
+
+/**
+* @desc   Serve as the collector: receive streamed samples into the aggregate
+*         of this process and answer queries, until *stop is set.
+*         Up to MAX_NUM_OF_AGGREGATE_TARGETS URLs are aggregated.
+*         Must be called after connection_stats_init()
+* @param  path		Socket to be served (an existing socket file is replaced,
+*                   and removed when serving ends)
+* @param  stop		Serving ends (within 100 ms) once *stop is set, e.g. by a
+*                   signal handler or another thread
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_collector_serve(const char* path, volatile int* stop);
+
+/******************
+**   Async API   **
+******************/
+/* Non blocking flavor of connection_stats_trigger(), to be embedded in an 
+   external (e.g. epoll based) event loop. Typical flow:
+     connection_stats_init() -> connection_stats_async_init() ->
+     connection_stats_async_submit() (any number of runs) ->
+     loop { connection_stats_async_socket_action() / 
+            connection_stats_async_timeout() } ->
+     connection_stats_async_close() -> connection_stats_close()
+   All calls must be made from the event loop thread. */
+
+/**
+* @desc   Initialize the async engine (connection_stats_init() must be called first)
+* @param  loop_cbs	Callbacks towards the caller's event loop (copied)
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_async_init(ConnStatLoopCallbacks* loop_cbs);
+
+/**
+* @desc   Submit a run of num_of_http_req samples. Returns immediately, results
+*         are delivered through run_cbs once the event loop drives the run.
+*         Multiplexed, throughput and adaptive runs are not supported 
+*         (RC_NOT_SUPPORTED). deadline_ms counts from the submit, as for a
+*         blocking run.
+* @param  http_req_data	Data as received by the user (copied)
+* @param  run_cbs		Completion callbacks of this run (copied)
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_async_submit(HttpReqData* http_req_data, 
+								 ConnStatRunCallbacks* run_cbs);
+
+/**
+* @desc   Notify the library about activity on one of its sockets
+* @param  sockfd	Socket as received by ConnStatSocketCb
+* @param  events	Bitmask of CONNSTAT_EV_IN/OUT/ERR (0 if unknown)
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_async_socket_action(int sockfd, int events);
+
+/**
+* @desc   Notify the library that the timer armed by ConnStatTimerCb expired
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_async_timeout();
+
+/**
+* @desc   Get the number of submitted runs that were not completed yet
+* @param  num_of_runs	Number of runs in progress
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_async_runs_in_progress(int* num_of_runs);
+
+/**
+* @desc   Close the async engine. Runs in progress are aborted (their 
+*         run_cb is called with RC_ERROR)
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_async_close();
+
+/******************
+**  Snapshot API **
+******************/
+/* Fan-out of results to local readers: the measuring process publishes the
+   result of every run (per URL) into a named shared memory region, and any 
+   number of readers (in any process) read the latest result of a URL 
+   without triggering a measurement. Every URL is double buffered and guarded
+   by a sequence counter, so the writer never waits for readers and readers 
+   never take a lock (they retry if the buffer was overwritten while read).
+     Writer: connection_stats_publish("/name") -> connection_stats_trigger()...
+     Reader: connection_stats_snapshot_attach("/name") -> 
+             connection_stats_snapshot_read(url)... -> 
+             connection_stats_snapshot_detach() */
+
+/**
+* @desc   Publish the result of every following run into a shared memory 
+*         region (created if needed, results of a previous publisher are 
+*         dropped). Only one process may publish to a region
+* @param  name	Region name (shm_open style, e.g. "/connstat"), NULL to stop
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_publish(const char* name);
+
+/**
+* @desc   Attach (read only) to a region published by connection_stats_publish
+* @param  name	Region name
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_snapshot_attach(const char* name);
+
+/**
+* @desc   Get a consistent copy of the latest result published for a URL
+*         (lock free, never blocks the writer)
+* @param  url		URL as given in HttpReqData
+* @param  snapshot	Snapshot to be filled
+* @return Return Code (taken from RC enum). RC_RESULT_REQUESTED_BEFORE_TRIGGER
+*         if nothing was published for url yet
+*/
+CONNSTAT_API RC connection_stats_snapshot_read(const char* url, ConnStatSnapshot* snapshot);
+
+/**
+* @desc   Detach from the region attached by connection_stats_snapshot_attach
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_snapshot_detach();
+
+/******************
+**   Store API   **
+******************/
+/* Persistent history: the samples of every run (and the run's medians) are 
+   appended per URL to compressed segment files (delta-of-delta timestamps 
+   and XOR compressed timings, ~2-4 bytes per value), which are memory 
+   mapped, so appending costs no system call. Any process can query them.
+     Writer: connection_stats_store_open(dir) -> connection_stats_trigger()...
+     Reader: connection_stats_store_query(dir, url, ...) */
+
+/**
+* @desc   Append the samples of every following run to the store in dir
+*         (dir must exist). Only one process may append to a store
+* @param  dir	Store directory, NULL to stop appending
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_store_open(const char* dir);
+
+/**
+* @desc   Get the percentile series of a URL over a time range: the samples 
+*         in [from_us:to_us) are split into buckets of step_us
+* @param  dir				Store directory
+* @param  url				URL as given in HttpReqData
+* @param  from_us			Start of the range (CLOCK_REALTIME usec)
+* @param  to_us				End of the range (excluded)
+* @param  step_us			Width of a bucket (the whole range if 0)
+* @param  percentile		Percentile in (0:1] (0 means the median)
+* @param  points			Series to be filled, a point per non empty bucket
+* @param  max_points		Number of entries allocated in points
+* @param  num_of_points		Number of points filled
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_store_query(const char* dir, const char* url,
+								long long from_us, long long to_us, 
+								long long step_us, double percentile,
+								ConnStatSeriesPoint* points, int max_points, 
+								int* num_of_points);
+
+/******************
+** Aggregate API **
+******************/
+/* Samples of every run (connection_stats_trigger and async runs), and of any
+   thread calling connection_stats_record, are aggregated per URL until 
+   connection_stats_close. Every thread records into its own cache line 
+   aligned shard (no lock, no cache line shared with other threads) and the
+   shards are merged only when the aggregate is requested */
+
+/**
+* @desc   Record a sample of a URL. Thread safe and lock free, may be called
+*         concurrently by any number of threads (but not with 
+*         connection_stats_close)
+* @param  url			URL the sample was taken of
+* @param  curl_info		Sample (failed samples are classified)
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_record(const char* url, const CurlInfo* curl_info);
+
+/**
+* @desc   Get the summary of all samples recorded for a URL (by all threads).
+*         Medians are taken out of a histogram (~3% resolution), jitter is
+*         between consecutive samples of the same thread and groups are not
+*         filled. May be called while other threads record
+* @param  url		URL as recorded
+* @param  summary	Summary to be filled
+* @return Return Code (taken from RC enum)
+*/
+CONNSTAT_API RC connection_stats_get_aggregate(const char* url, ConnStatSummary* summary);
 
 #endif /* CONNECTIONSTATS_H_ */
@@ -18,37 +18,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>  // strcasecmp
+#include <time.h>
 #include <dirent.h>   // opendir()
 #include <sys/stat.h> // mkdir
 #include <curl/curl.h>
 #include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
 
 
 /******************
 **   Defines     **
 ******************/
-#define MAX_SIZE_OF_IP_ADD      46 // IPv4=15, IPv6=45 (+1 for null terminating char) // TODO: verify the +1
-#define TRACE_ENA               1  // TODO: should I deliver where it is defined or not?
-#define USE_BODY_HEADER_FILES   1  // TODO: rethink if required
+/* Note: TRACE_ENA (libCURL verbose trace to trace/trace.out) and 
+         USE_BODY_HEADER_FILES (bodies and headers to trace/body.out and
+         trace/head.out) are not defined here but by the Makefile, per library
+         variant ('make' builds the lean variant, 'make debug' the tracing one).
+         In the lean variant none of the tracing code is compiled in. */
+#if defined(TRACE_ENA) || defined(USE_BODY_HEADER_FILES)
+#define TRACE_FILES_USED
+#endif
 
 
 /******************
 **  Structures   **
 ******************/
-/* Info attributes to be retrieved from the CURL lib */
-typedef struct  {
-	double name_lookup_time;
-	double connect_time;
-	double start_transfer_time;
-	double total_time;
-} CurlInfo;
-
-#ifdef TRACE_ENA
-struct data {
-  char trace_ascii; /* 1 or 0 */ 
-};
-#endif
-
 struct url_data {
   char *ptr;
   size_t len;
@@ -67,6 +61,23 @@ static struct curl_slist *g_http_headers_curl_list = NULL;
 /* Prog/Lib output string */
 static char g_prog_output[MAX_SIZE_OF_PROG_OUTPUT];
 
+/* Full summary of the last run */
+static ConnStatSummary g_summary;
+
+// URL of the run being triggered (samples analyzed meanwhile are stored)
+static const char *g_run_url = NULL;
+
+/* Samples of the last run (see connection_stats_get_samples). Adaptive runs
+   keep their (allocated) samples until the next run */
+static CurlInfo g_curl_info_arr[MAX_NUM_OF_SUPPORTED_CURL_OPER];
+static CurlInfo *g_adaptive_arr = NULL;
+static const CurlInfo *g_run_samples = NULL;
+static int g_num_of_run_samples = 0;
+
+/* Called per sample (see connection_stats_set_sample_callback) */
+static ConnStatSampleCb g_sample_cb = NULL;
+static void *g_sample_cb_data = NULL;
+
 #ifdef USE_BODY_HEADER_FILES
 FILE *g_header_file;
 FILE *g_body_file;
@@ -81,77 +92,161 @@ FILE *g_trace_file;
 *************************/
 #ifdef TRACE_ENA
 static void dump(const char *text, FILE *stream, unsigned char *ptr, 
-				size_t size, char nohex);
+				size_t size, char nohex, long long at_us);
 static int trace_func(CURL *handle, curl_infotype type, char *data, 
 					  size_t size, void *userp);
 #endif // TRACE_ENA
-static void init_string(struct url_data *url_data);
 #ifdef WRITEFUNC_USED
+static void init_string(struct url_data *url_data);
 static size_t write_func(void *ptr, size_t size, size_t nmemb, struct url_data *url_data);
 #endif // WRITEFUNC_USED
 static size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream);
-static int double_comp(const void* elem1, const void* elem2);
-static double get_median(double arr[], int arr_size);
+static double select_nth(double arr[], int arr_size, int k);
+#ifdef TRACE_FILES_USED
 static RC open_trace_files();
-static RC is_valid_http_data_req(HttpReqData *p_http_req_data);
-static RC is_valid_http_header(char* http_header);
+#endif
+static long get_curl_http_version(HttpReqData *p_http_req_data);
+static int is_cleartext_url(const char *url);
+static RC trigger_run(HttpReqData *p_http_req_data);
+static RC analyze_run(CurlInfo *curl_info_arr, int arr_size);
 
 /******************
 **    Methods    **
 ******************/
 /**
 * @desc   Collect all required info about the connection  
+*         (failed transfers are collected as well, for classification)
 * @return Return Code (taken from RC enum)
 */
-static RC connection_stats_collect(CurlInfo* curl_info) {	
+RC connection_stats_collect(CURL *curl, CURLcode result, CurlInfo* curl_info) {	
 	CURLcode res;
+	struct timespec now;
+	RC rc = RC_OK;
+	
+	memset(curl_info, 0, sizeof(CurlInfo));
+	curl_info->curl_code = result;
+	clock_gettime(CLOCK_REALTIME, &now);
+	curl_info->timestamp_us = (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
 	
 	// Get Name Lookup Time
-	res = curl_easy_getinfo(g_curl, CURLINFO_NAMELOOKUP_TIME, 
+	res = curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, 
 							&curl_info->name_lookup_time);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_NAMELOOKUP_TIME: %s\n",	
 				curl_easy_strerror(res));
-		return RC_ERROR_IN_CURL;
+		curl_info->curl_code = res;
+		rc = RC_ERROR_IN_CURL;
+		goto done;
 	}
 	
 	// Get Connet Time
-	res = curl_easy_getinfo(g_curl, CURLINFO_CONNECT_TIME, 
+	res = curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, 
 							&curl_info->connect_time);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_CONNECT_TIME: %s\n",	
 				curl_easy_strerror(res));
-		return RC_ERROR_IN_CURL;
+		curl_info->curl_code = res;
+		rc = RC_ERROR_IN_CURL;
+		goto done;
 	}
 	
 	// Get Start Transfer Time
-	res = curl_easy_getinfo(g_curl, CURLINFO_STARTTRANSFER_TIME, 
+	res = curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, 
 							&curl_info->start_transfer_time);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_STARTTRANSFER_TIME: %s\n",	
 				curl_easy_strerror(res));
-		return RC_ERROR_IN_CURL;
+		curl_info->curl_code = res;
+		rc = RC_ERROR_IN_CURL;
+		goto done;
 	}
 	
 	// Get Total Time
-	res = curl_easy_getinfo(g_curl, CURLINFO_TOTAL_TIME, 
+	res = curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, 
 							&curl_info->total_time);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_TOTAL_TIME: %s\n",	
 				curl_easy_strerror(res));
-		return RC_ERROR_IN_CURL;
+		curl_info->curl_code = res;
+		rc = RC_ERROR_IN_CURL;
+		goto done;
 	}
 	
-	return RC_OK;
+	// Get IP Adress (of the last server in case redirections were followed)
+	char *ip = NULL;
+	res = curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip);
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_PRIMARY_IP: %s\n",	
+				curl_easy_strerror(res));
+		curl_info->curl_code = res;
+		rc = RC_ERROR_IN_CURL;
+		goto done;
+	}
+	/* Note that we get a pointer to a memory area that will be re-used
+	        at next request, so we intern the string to keep it. */
+	curl_info->ip_idx = ip_table_intern(ip);
+	
+	// Get Redirect Count
+	long redirect_count = 0;
+	res = curl_easy_getinfo(curl, CURLINFO_REDIRECT_COUNT, &redirect_count);
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_REDIRECT_COUNT: %s\n",	
+				curl_easy_strerror(res));
+		curl_info->curl_code = res;
+		rc = RC_ERROR_IN_CURL;
+		goto done;
+	}
+	curl_info->redirect_count = (unsigned short)redirect_count;
+	
+	// Get Number of new connections (0 if an existing connection was reused)
+	long num_of_connects = 0;
+	res = curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &num_of_connects);
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_NUM_CONNECTS: %s\n",	
+				curl_easy_strerror(res));
+		curl_info->curl_code = res;
+		rc = RC_ERROR_IN_CURL;
+		goto done;
+	}
+	curl_info->num_of_connects = (unsigned short)num_of_connects;
+	
+	// Get Response Code (stays 0 if no response was received)
+	res = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, 
+							&curl_info->response_code);
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_RESPONSE_CODE: %s\n",	
+				curl_easy_strerror(res));
+		curl_info->curl_code = res;
+		rc = RC_ERROR_IN_CURL;
+		goto done;
+	}
+	
+	// Keep the addresses of new connections for the next process (if caching)
+	if ((result == CURLE_OK) && (num_of_connects > 0) && cache_is_enabled()) {
+		cache_note_transfer(curl);
+	}
+	
+done:
+#ifdef TRACE_ENA
+	// Keep the trace of the sample only if it is an outlier (if tail tracing),
+	// even if it could not be fully collected
+	if (trace_tail_is_enabled()) {
+		trace_tail_sample_done(curl, curl_info);
+	}
+#endif
+	
+	return rc;
 }
 
 /**
-* @desc   Collect all required info about the connection and generate statistics 
+* @desc   Build the program's output string and the run's summary out of the 
+*         gathered samples (single pass over the samples)
 * @return Return Code (taken from RC enum)
 */
-RC connection_stats_analyze(CurlInfo* curl_info_arr, int arr_size) {
-	CURLcode res;
+RC connection_stats_build_output(CurlInfo *curl_info_arr, int arr_size, 
+								 char *output, ConnStatSummary *summary) {
 	int i=0;
+	int num_of_success=0;
 	/* Note: As always, we have a tradeoff here, between time and complexity.
 	         We can create an array per each of the statistics
 			    O(n*m) where 
@@ -164,66 +259,129 @@ RC connection_stats_analyze(CurlInfo* curl_info_arr, int arr_size) {
 	double connect_time_arr[arr_size];
 	double start_transfer_time_arr[arr_size];
 	double total_time_arr[arr_size];
+	RunningStats name_lookup_stats;
+	RunningStats connect_stats;
+	RunningStats start_transfer_stats;
+	RunningStats total_stats;
+	long response_code = 0;
+	unsigned short ip_idx = IP_IDX_UNKNOWN;
+	
+	memset(summary, 0, sizeof(ConnStatSummary));
+	running_stats_reset(&name_lookup_stats);
+	running_stats_reset(&connect_stats);
+	running_stats_reset(&start_transfer_stats);
+	running_stats_reset(&total_stats);
 	
-	// Copy to temporal arrays
+	/* Single pass: classify failed samples, feed the running statistics and 
+	   copy successful samples to temporal arrays (for the medians) */
 	for (i=0; i<arr_size; i++) {
-		name_lookup_time_arr[i]    = curl_info_arr[i].name_lookup_time;
-		connect_time_arr[i]        = curl_info_arr[i].connect_time;
-		start_transfer_time_arr[i] = curl_info_arr[i].start_transfer_time;
-		total_time_arr[i]          = curl_info_arr[i].total_time;
+		CurlInfo *curl_info = &curl_info_arr[i];
+		summary->num_of_connects += curl_info->num_of_connects;
+		summary->involuntary_ctx_switches += curl_info->involuntary_ctx_switches;
+		if (curl_info->involuntary_ctx_switches > 0) {
+			summary->num_of_preempted_samples++;
+		}
+		if (!connection_stats_is_success(curl_info)) {
+			connection_stats_add_error(summary, curl_info);
+			if (curl_info->curl_code == CURLE_OPERATION_TIMEDOUT) {
+				summary->num_of_timeouts++;
+			}
+			continue;
+		}
 		
-		// TODO: Log this..
-		printf("   # %d:  ", i);
-		printf("name_lookup_time=%.6f ;; ",   curl_info_arr[i].name_lookup_time);
-		printf("connect_time=%.6f ;; ",       curl_info_arr[i].connect_time);
-		printf("start_transfer_time=%.6f ;; ",curl_info_arr[i].start_transfer_time);
-		printf("total_time=%.6f ;; ",         curl_info_arr[i].total_time);
-		printf("\n");	
+		name_lookup_time_arr[num_of_success]    = curl_info->name_lookup_time;
+		connect_time_arr[num_of_success]        = curl_info->connect_time;
+		start_transfer_time_arr[num_of_success] = curl_info->start_transfer_time;
+		total_time_arr[num_of_success]          = curl_info->total_time;
+		num_of_success++;
+		
+		running_stats_add(&name_lookup_stats,    curl_info->name_lookup_time);
+		running_stats_add(&connect_stats,        curl_info->connect_time);
+		running_stats_add(&start_transfer_stats, curl_info->start_transfer_time);
+		running_stats_add(&total_stats,          curl_info->total_time);
+		response_code = curl_info->response_code;
+		ip_idx        = curl_info->ip_idx;
 	}
 	
-	// Get Median per each array
-	double name_lookup_time_median    = get_median(name_lookup_time_arr, arr_size);
-	double connect_time_median        = get_median(connect_time_arr, arr_size);
-	double start_transfer_time_median = get_median(start_transfer_time_arr, arr_size);
-	double total_time_median          = get_median(total_time_arr, arr_size);
-	
-	// Get IP Adress
-	char *ip;
-	res = curl_easy_getinfo(g_curl, CURLINFO_PRIMARY_IP, &ip) && ip;
-	if ((res != CURLE_OK) || (ip==NULL)){
-		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_PRIMARY_IP: %s\n",	
-		curl_easy_strerror(res));
+	summary->num_of_samples = arr_size;
+	summary->num_of_success = num_of_success;
+	summary->success_ratio  = (arr_size > 0) ? 
+		(double)num_of_success / arr_size : 0;
+	connection_stats_build_groups(curl_info_arr, arr_size, summary);
+	if (num_of_success == 0) {
+		fprintf(stderr, "All %d samples failed \n", arr_size);
 		return RC_ERROR_IN_CURL;
 	}
-	// printf("IP: %s \n", ip);
-	/* Note that we get a pointer to a memory area that will be re-used
-	        at next request, so we need to copy the string if we want to 
-	        keep the information. */
-	//memcpy(curl_info->ip, ip, MAX_SIZE_OF_IP_ADD);
 	
-	long response_code;
-	res = curl_easy_getinfo(g_curl, CURLINFO_RESPONSE_CODE, &response_code);
-	if (res != CURLE_OK) {
-		fprintf(stderr, "curl_easy_getinfo() failed CURLINFO_RESPONSE_CODE: %s\n",	
-				curl_easy_strerror(res));
-		return RC_ERROR_IN_CURL;
-	}
+	running_stats_finalize(&name_lookup_stats,    &summary->name_lookup);
+	running_stats_finalize(&connect_stats,        &summary->connect);
+	running_stats_finalize(&start_transfer_stats, &summary->start_transfer);
+	running_stats_finalize(&total_stats,          &summary->total);
 	
+	// Get Median per each array
+	summary->name_lookup.median    = get_median(name_lookup_time_arr, num_of_success);
+	summary->connect.median        = get_median(connect_time_arr, num_of_success);
+	summary->start_transfer.median = get_median(start_transfer_time_arr, num_of_success);
+	summary->total.median          = get_median(total_time_arr, num_of_success);
+	
+	/* IP and response code are taken from the last successful sample
+	   (see summary->groups for the per IP & response code break down) */
 	/* Print program's output in the following format:
 	   SKTEST;<IP address of HTTP server>;<HTTP response code>;
 	          <median of CURLINFO_NAMELOOKUP_TIME>;
 	  		  <median of CURLINFO_CONNECT_TIME>;
 	          <median of CURLINFO_STARTTRANSFER_TIME>;
 	  		  <median of CURLINFO_TOTAL_TIME>   */
-	sprintf(g_prog_output, "SKTEST;%s;%ld;%.6f;%.6f;%.6f;%.6f", 
-			ip, response_code, 
-			name_lookup_time_median, connect_time_median, 
-			start_transfer_time_median, total_time_median);
-	//printf("%s \n", g_prog_output);
+	snprintf(output, MAX_SIZE_OF_PROG_OUTPUT, "SKTEST;%s;%ld;%.6f;%.6f;%.6f;%.6f", 
+			 ip_table_get(ip_idx), response_code, 
+			 summary->name_lookup.median, summary->connect.median, 
+			 summary->start_transfer.median, summary->total.median);
 	
 	return RC_OK;
 }
 
+/**
+* @desc   Collect all required info about the connection and generate statistics 
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_analyze(CurlInfo* curl_info_arr, int arr_size) {
+	int i=0;
+	RC rc;
+	
+#ifdef TRACE_ENA
+	/* Every sample is printed in the debug variant only (printing a run costs
+	   far more than analyzing it) */
+	for (i=0; i<arr_size; i++) {
+		printf("   # %d:  ", i);
+		printf("name_lookup_time=%.6f ;; ",   curl_info_arr[i].name_lookup_time);
+		printf("connect_time=%.6f ;; ",       curl_info_arr[i].connect_time);
+		printf("start_transfer_time=%.6f ;; ",curl_info_arr[i].start_transfer_time);
+		printf("total_time=%.6f ;; ",         curl_info_arr[i].total_time);
+		printf("ip=%s ;; response_code=%ld ;; ", 
+			   ip_table_get(curl_info_arr[i].ip_idx), curl_info_arr[i].response_code);
+		if (!connection_stats_is_success(&curl_info_arr[i])) {
+			printf("FAILED (curl_code=%d, response_code=%ld) ;; ", 
+				   curl_info_arr[i].curl_code, curl_info_arr[i].response_code);
+		}
+		printf("\n");	
+	}
+#endif // TRACE_ENA
+	
+	rc = connection_stats_build_output(curl_info_arr, arr_size, 
+									   g_prog_output, &g_summary);
+	
+	/* Keep the samples for the per URL aggregate, for historical queries 
+	   (if storing) and for the collector (if streaming) */
+	if (g_run_url != NULL) {
+		for (i=0; i<arr_size; i++) {
+			connection_stats_record(g_run_url, &curl_info_arr[i]);
+		}
+		store_append(g_run_url, curl_info_arr, arr_size, &g_summary);
+		collector_send_run(g_run_url, curl_info_arr, arr_size);
+	}
+	return rc;
+}
+
 /**
 * @func   connection_stats_get_statistics
 * @desc   String with the statistics according to the following format:
@@ -252,6 +410,64 @@ RC connection_stats_get_statistics(char* stat_str, size_t* strLen) {
 	return RC_OK;
 }
 
+/**
+* @desc   Get the full summary of the last run
+* @param  summary    Summary to be filled
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_get_summary(ConnStatSummary* summary) {
+	if (g_summary.num_of_samples == 0) {
+		printf("ERROR: Summary requested before triggereing \n");
+		return RC_RESULT_REQUESTED_BEFORE_TRIGGER;
+	}
+	*summary = g_summary;
+	
+	return RC_OK;
+}
+
+/**
+* @desc   Get the samples of the last run (read only, not copied)
+* @param  p_samples          Set to the samples
+* @param  p_num_of_samples   Set to the number of samples
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_get_samples(const CurlInfo** p_samples, int* p_num_of_samples) {
+	if ((p_samples == NULL) || (p_num_of_samples == NULL)) {
+		return RC_ERROR;
+	}
+	if (g_run_samples == NULL) {
+		printf("ERROR: Samples requested before triggereing \n");
+		*p_samples = NULL;
+		*p_num_of_samples = 0;
+		return RC_RESULT_REQUESTED_BEFORE_TRIGGER;
+	}
+	*p_samples = g_run_samples;
+	*p_num_of_samples = g_num_of_run_samples;
+	return RC_OK;
+}
+
+/**
+* @desc   Call sample_cb with every sample as soon as it is collected
+* @param  sample_cb    Callback (NULL to stop calling)
+* @param  user_data    Passed as is to sample_cb
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_set_sample_callback(ConnStatSampleCb sample_cb, void* user_data) {
+	g_sample_cb = sample_cb;
+	g_sample_cb_data = user_data;
+	return RC_OK;
+}
+
+/*
+ * Hand a collected sample to the caller's callback (if any)
+ */
+void samples_notify(const HttpReqData *p_http_req_data, int sample_idx,
+					const CurlInfo *curl_info) {
+	if (g_sample_cb != NULL) {
+		g_sample_cb(p_http_req_data, sample_idx, curl_info, g_sample_cb_data);
+	}
+}
+
 /**
 * @desc   Initialize the library (including initialization of libCURL)
 * @return Return Code (taken from RC enum)
@@ -276,15 +492,24 @@ RC connection_stats_init() {
 		return RC_ERROR_IN_CURL;
 	}
 	
+	/* Global init of c-ares (the resolution stage) */
+	RC dns_rc = dns_init();
+	if (dns_rc != RC_OK) {
+		return dns_rc;
+	}
+	
+#ifdef TRACE_FILES_USED
 	/* Open files for traces */
 	RC rc = open_trace_files();
 	if (rc != RC_OK) {
 		printf("connection_stats_init() fail with open_trace_files() \n");
 		return rc;
 	}
+#endif
 	
 	/* Initialize program's output */
 	memset(g_prog_output,'\0',sizeof(g_prog_output));
+	memset(&g_summary, 0, sizeof(g_summary));
 	
 	return RC_OK;
 }
@@ -294,6 +519,9 @@ RC connection_stats_init() {
 * @return Return Code (taken from RC enum)
 */
 RC connection_stats_close() {
+	/* Keep the warm start cache (if any) for the next process */
+	RC rc = cache_save();
+
 #ifdef USE_BODY_HEADER_FILES
 	/* close the header file */ 
 	fclose(g_header_file);
@@ -309,11 +537,29 @@ RC connection_stats_close() {
 	
 	/* Cleanup CURL before leaving the program*/
 	curl_slist_free_all(g_http_headers_curl_list);
+	g_http_headers_curl_list = NULL;
 	curl_easy_cleanup(g_curl);
 	curl_global_cleanup();
+	ip_table_reset();
+	dns_reset();
+	throughput_reset();
+	snapshot_reset();
+	store_reset();
+	aggregate_reset();
+	affinity_reset();
+	headers_reset();
+	transport_reset();
+	cache_reset();
+	collector_reset();
+	trace_tail_reset();
+	free(g_adaptive_arr);
+	g_adaptive_arr = NULL;
+	g_run_samples = NULL;
+	g_num_of_run_samples = 0;
+	g_sample_cb = NULL;
+	g_sample_cb_data = NULL;
 	
-	// TODO: does any of the above return RC? use it..
-	return RC_OK;
+	return rc;
 }
 
 /**
@@ -324,7 +570,7 @@ RC connection_stats_close() {
 */
 RC connection_stats_add_http_hdr(char* http_header) {	
 	/* Validate that HTTP Header is legit */
-	RC rc = is_valid_http_header(http_header);
+	RC rc = headers_validate(http_header);
 	if (rc != RC_OK) {
 		return rc;
 	}	
@@ -337,30 +583,18 @@ RC connection_stats_add_http_hdr(char* http_header) {
 }
 
 /**
-* @desc   Trigger for the library to execute HTTP request
-*         According to the previously provided arguments.
-* @param  http_req_data	Data as received by the user 
+* @desc   Set all easy curl options required for a measurement on a handle
+* @param  curl             CURL easy handle to be configured
+* @param  p_http_req_data  Data as received by the user 
 * @return Return Code (taken from RC enum)
 */
-RC connection_stats_trigger(HttpReqData *p_http_req_data) {
+RC connection_stats_setup_handle(CURL *curl, HttpReqData *p_http_req_data) {
 	CURLcode res;
-	CurlInfo curl_info_arr[MAX_NUM_OF_SUPPORTED_CURL_OPER];
-	
-	/* Validate that HTTP data request is legit */
-	RC rc = is_valid_http_data_req(p_http_req_data);
-	if (rc != RC_OK) {
-		return rc;
-	}
-	
-	printf("connection_stats_trigger() called [num_of_http_req=%d, url=%s]\n",
-			p_http_req_data->num_of_http_req, p_http_req_data->url);
-
-	/* Initialize program's output */
-	memset(g_prog_output,'\0',sizeof(g_prog_output));
+	RC rc;
 	
 #ifdef TRACE_ENA
 	/* the DEBUGFUNCTION has no effect until we enable VERBOSE */ 
-	res = curl_easy_setopt(g_curl, CURLOPT_VERBOSE, 1L);
+	res = curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_VERBOSE: %s\n", 
 				curl_easy_strerror(res));
@@ -368,45 +602,61 @@ RC connection_stats_trigger(HttpReqData *p_http_req_data) {
 	}
 #endif
 	
-	/* Set all easy curl options */
-	
 	/* Set lib CURL option for URL */
-	res = curl_easy_setopt(g_curl, CURLOPT_URL, p_http_req_data->url);
+	res = curl_easy_setopt(curl, CURLOPT_URL, p_http_req_data->url);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_URL: %s\n", 
 				curl_easy_strerror(res));
 		return RC_ERROR_IN_CURL;
 	}
 	
+	/* Set lib CURL option for using pre-resolved addresses (if any) */
+	res = curl_easy_setopt(curl, CURLOPT_RESOLVE, dns_get_resolve_list());
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_RESOLVE: %s\n", 
+				curl_easy_strerror(res));
+		return RC_ERROR_IN_CURL;
+	}
+	
+	/* Set lib CURL option for the requested HTTP version */
+	res = curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, 
+						   get_curl_http_version(p_http_req_data));
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_HTTP_VERSION: %s\n", 
+				curl_easy_strerror(res));
+		return RC_ERROR_IN_CURL;
+	}
+	
 	/* Set lib CURL option for following redirection */
-    res = curl_easy_setopt(g_curl, CURLOPT_FOLLOWLOCATION, 1L);
+    res = curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_FOLLOWLOCATION: %s\n", 
 				curl_easy_strerror(res));
 		return RC_ERROR_IN_CURL;
 	}
 
-	/* Set lib CURL option for adding list of previously configured HTTP headers */
-	res = curl_easy_setopt(g_curl, CURLOPT_HTTPHEADER, g_http_headers_curl_list);	
+	/* Set lib CURL option for adding list of previously configured HTTP headers 
+	   (the profile's list is shared as is, see connection_stats_headers.c) */
+	res = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, 
+						   (p_http_req_data->header_profile[0] != '\0') ?
+						   headers_get_list(p_http_req_data->header_profile) :
+						   g_http_headers_curl_list);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_HTTPHEADER: %s\n", 
 				curl_easy_strerror(res));
 		return RC_ERROR_IN_CURL;
 	}
 	
-	struct url_data url_data;
-	init_string(&url_data);
-
 #ifdef USE_BODY_HEADER_FILES
-	res = curl_easy_setopt(g_curl, CURLOPT_HEADERDATA, g_header_file);
+	res = curl_easy_setopt(curl, CURLOPT_HEADERDATA, g_header_file);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_HEADERDATA: %s\n", 
 				curl_easy_strerror(res));
 		return RC_ERROR_IN_CURL;
 	}
 	
-	//res = curl_easy_setopt(g_curl, CURLOPT_WRITEDATA, &url_data);
-	res = curl_easy_setopt(g_curl, CURLOPT_WRITEDATA, g_body_file);
+	//res = curl_easy_setopt(curl, CURLOPT_WRITEDATA, &url_data);
+	res = curl_easy_setopt(curl, CURLOPT_WRITEDATA, g_body_file);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_WRITEDATA: %s\n", 
 				curl_easy_strerror(res));
@@ -415,9 +665,9 @@ RC connection_stats_trigger(HttpReqData *p_http_req_data) {
 #endif  // USE_BODY_HEADER_FILES
 
 	
-	//res = curl_easy_setopt(g_curl, CURLOPT_WRITEFUNCTION, write_func);
+	//res = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_func);
 	/* send all data to this function  */ 
-	res = curl_easy_setopt(g_curl, CURLOPT_WRITEFUNCTION, write_data);
+	res = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_WRITEFUNCTION: %s\n", 
 				curl_easy_strerror(res));
@@ -425,53 +675,170 @@ RC connection_stats_trigger(HttpReqData *p_http_req_data) {
 	}
 
 #ifdef TRACE_ENA
-	struct data config;
-	config.trace_ascii = 1; /* enable ascii tracing */ 
-	res = curl_easy_setopt(g_curl, CURLOPT_DEBUGFUNCTION, trace_func);
+	res = curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, trace_func);
 	if (res != CURLE_OK) {
 		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_DEBUGFUNCTION: %s\n", 
 				curl_easy_strerror(res));
 		return RC_ERROR_IN_CURL;
 	}
-	res = curl_easy_setopt(g_curl, CURLOPT_DEBUGDATA, &config);
-	if (res != CURLE_OK) {
-		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_DEBUGDATA: %s\n", 
-				curl_easy_strerror(res));
-		return RC_ERROR_IN_CURL;
-	}
 #endif
 
+	/* Set lib CURL option for busy polling (if requested) */
+	rc = affinity_setup_handle(curl);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	
+	/* Set lib CURL options for the timeouts of the target */
+	return timeouts_setup(curl, p_http_req_data);
+}
+
+/**
+* @desc   Trigger for the library to execute HTTP request
+*         According to the previously provided arguments.
+* @param  http_req_data	Data as received by the user 
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_trigger(HttpReqData *p_http_req_data) {
+	RC rc;
+	
+	g_run_url = p_http_req_data->url;
+	rc = trigger_run(p_http_req_data);
+	g_run_url = NULL;
+	
+	/* Fan-out the result of the run to local readers (if publishing) */
+	if (g_summary.num_of_samples > 0) {
+		snapshot_publish(p_http_req_data->url, rc, g_prog_output, &g_summary);
+	}
+	return rc;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Execute a run (see connection_stats_trigger)
+ */
+static RC trigger_run(HttpReqData *p_http_req_data) {
+	struct timespec start;
+	CurlInfo *curl_info_arr = g_curl_info_arr;
+	
+	/* Validate that HTTP data request is legit */
+	RC rc = is_valid_http_data_req(p_http_req_data);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	
+	printf("connection_stats_trigger() called [num_of_http_req=%d, url=%s]\n",
+			p_http_req_data->num_of_http_req, p_http_req_data->url);
+
+	/* Initialize program's output */
+	memset(g_prog_output,'\0',sizeof(g_prog_output));
+	memset(&g_summary, 0, sizeof(g_summary));
+	throughput_reset();
+	g_run_samples = NULL;
+	g_num_of_run_samples = 0;
+	free(g_adaptive_arr);
+	g_adaptive_arr = NULL;
+
+	/* Concurrent modes are libCURL (multi interface) only */
+	if (transport_is_custom() && 
+		((p_http_req_data->mode == CONNSTAT_MODE_THROUGHPUT) || p_http_req_data->multiplex)) {
+		printf("connection_stats_trigger() concurrent runs require the libCURL transport \n");
+		return RC_NOT_SUPPORTED;
+	}
+
+	/* Throughput mode - parallel downloads into a discard sink */
+	if (p_http_req_data->mode == CONNSTAT_MODE_THROUGHPUT) {
+		rc = connection_stats_throughput_perform(p_http_req_data, curl_info_arr);
+		if (rc != RC_OK) {
+			return rc;
+		}
+		return analyze_run(curl_info_arr, p_http_req_data->num_of_http_req);
+	}
+
+	/* Multiplexed mode - all samples run concurrently over a single connection */
+	if (p_http_req_data->multiplex) {
+		rc = connection_stats_mux_perform(p_http_req_data, curl_info_arr);
+		if (rc != RC_OK) {
+			return rc;
+		}
+		return analyze_run(curl_info_arr, p_http_req_data->num_of_http_req);
+	}
+
+	/* Set all easy curl options */
+	rc = connection_stats_setup_handle(g_curl, p_http_req_data);
+	if (rc != RC_OK) {
+		return rc;
+	}
+
+	/* Adaptive mode - sample until the estimate converges (or the budget is
+	   used). Samples are allocated, as the budget may be large */
+	if (p_http_req_data->ci_width > 0) {
+		ConnStatEstimate estimate;
+		int num_of_samples = 0;
+		CurlInfo *adaptive_arr = malloc(p_http_req_data->num_of_http_req * 
+										sizeof(CurlInfo));
+		if (adaptive_arr == NULL) {
+			fprintf(stderr, "malloc() failed\n");
+			return RC_ERROR;
+		}
+		rc = connection_stats_adaptive_perform(g_curl, p_http_req_data, adaptive_arr,
+											   &num_of_samples, &estimate);
+		if (rc == RC_OK) {
+			rc = analyze_run(adaptive_arr, num_of_samples);
+			g_summary.estimate = estimate;
+		}
+		g_adaptive_arr = adaptive_arr;  /* Freed by the next run */
+		return rc;
+	}
+
 	/* Perform the operation (using curl) multiple times (as requested by user) */
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	for (int i=0; i<p_http_req_data->num_of_http_req; i++) {
-		/* Perform the curl request */
-		res = curl_easy_perform(g_curl);
-		if(res != CURLE_OK) {
-			fprintf(stderr, "curl_easy_perform() failed: %s\n",	
-					curl_easy_strerror(res));
-			return RC_ERROR_IN_CURL;
+		/* Samples that can not start before the deadline are timed out */
+		long remaining_ms = deadline_remaining_ms(&start, p_http_req_data->deadline_ms);
+		if (remaining_ms <= 0) {
+			timeouts_mark_skipped(&curl_info_arr[i]);
+			samples_notify(p_http_req_data, i, &curl_info_arr[i]);
+			continue;
 		}
+		timeouts_arm(g_curl, p_http_req_data->timeout_ms, remaining_ms);
 		
-		/* Collect statistics */
-		connection_stats_collect(&curl_info_arr[i]);
+		/* Perform the request and collect statistics 
+		   (a failure marks the sample as failed) */
+		long nivcsw = affinity_get_nivcsw();
+		rc = transport_perform(g_curl, p_http_req_data, &curl_info_arr[i]);
+		if (rc != RC_OK) {
+			fprintf(stderr, "connection_stats_collect() failed for sample %d \n", i);
+		}
+		curl_info_arr[i].involuntary_ctx_switches = affinity_get_nivcsw() - nivcsw;
+		samples_notify(p_http_req_data, i, &curl_info_arr[i]);
 	} // End of FOR loop
 
 	/* Analyze all gathered information - find requested medians
 	   Note: This call will also print the program's output */
-	connection_stats_analyze(curl_info_arr, p_http_req_data->num_of_http_req);
-
-	//printf("%s\n", url_data.ptr);
-	free(url_data.ptr);
-	
-	return RC_OK;
+	return analyze_run(curl_info_arr, p_http_req_data->num_of_http_req);
 }
 
-/***********************
-** Supporting Methods **
-***********************/
+/*
+ * Analyze the samples of a run triggered by the library, and make them the
+ * samples of the last run (see connection_stats_get_samples). Only the
+ * library's own storage becomes that view - an array the caller passes to
+ * connection_stats_analyze() is not kept
+ */
+static RC analyze_run(CurlInfo *curl_info_arr, int arr_size) {
+	RC rc = connection_stats_analyze(curl_info_arr, arr_size);
+
+	g_run_samples = curl_info_arr;
+	g_num_of_run_samples = arr_size;
+	return rc;
+}
 
 #ifdef TRACE_ENA
 static void dump(const char *text, FILE *stream, unsigned char *ptr, 
-				size_t size, char nohex)
+				size_t size, char nohex, long long at_us)
 {
 	size_t i;
 	size_t c;
@@ -482,8 +849,9 @@ static void dump(const char *text, FILE *stream, unsigned char *ptr,
 	/* without the hex output, we can fit more on screen */ 
 	width = 0x40;
 	
-	fprintf(stream, "%s, %10.10ld bytes (0x%8.8lx)\n",
-			text, (long)size, (long)size);
+	/* at= (usec since the epoch) keeps the timing of the exchange for replay */
+	fprintf(stream, "%s, %10.10ld bytes (0x%8.8lx) at=%lld\n",
+			text, (long)size, (long)size, at_us);
 
 	for(i = 0; i<size; i += width) {
 		fprintf(stream, "%4.4lx: ", (long)i);
@@ -521,17 +889,37 @@ static void dump(const char *text, FILE *stream, unsigned char *ptr,
 static int trace_func(CURL *handle, curl_infotype type, char *data, 
 					  size_t size, void *userp)
 {
-	struct data *config = (struct data *)userp;
+	struct timespec now;
+	long long at_us;
+	(void)userp; /* prevent compiler warning */ 
+	
+	clock_gettime(CLOCK_REALTIME, &now);
+	at_us = (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+	
+	/* Tail tracing keeps the events until the sample is known to be an outlier */
+	if (trace_tail_is_enabled()) {
+		trace_tail_append(handle, type, data, size, at_us);
+		return 0;
+	}
+	trace_write(g_trace_file, type, data, size, at_us);
+	return 0;
+}
+
+/*
+ * Write a single trace event (libCURL debug callback format) to a stream
+ */
+void trace_write(FILE *stream, curl_infotype type, char *data, size_t size,
+				 long long at_us)
+{
 	const char *text;
-	(void)handle; /* prevent compiler warning */ 
 	
 	switch(type) {
 		case CURLINFO_TEXT:
 			//fprintf(stderr, "== Info: %s", data);
-			fprintf(g_trace_file, "== Info: %s", data);
+			fprintf(stream, "== Info: %.*s", (int)size, data);
 			/* FALLTHROUGH */ 
 		default: /* in case a new one is introduced to shock us */ 
-			return 0;
+			return;
 	
 		case CURLINFO_HEADER_OUT:
 			text = "=> Send header";
@@ -553,13 +941,13 @@ static int trace_func(CURL *handle, curl_infotype type, char *data,
 			break;
 	}
 	
-	//dump(text, stderr, (unsigned char *)data, size, config->trace_ascii);
-	dump(text, g_trace_file, (unsigned char *)data, size, config->trace_ascii);
-	return 0;
+	//dump(text, stderr, (unsigned char *)data, size, 1, at_us);
+	dump(text, stream, (unsigned char *)data, size, 1, at_us); /* ascii tracing */ 
 }
 #endif
 
 
+#ifdef WRITEFUNC_USED
 static void init_string(struct url_data *url_data) {
 	url_data->len = 0;
 	url_data->ptr = malloc(url_data->len+1);
@@ -569,7 +957,7 @@ static void init_string(struct url_data *url_data) {
 	}
 	url_data->ptr[0] = '\0';
 }
-#ifdef WRITEFUNC_USED
+
 static size_t write_func(void *ptr, size_t size, size_t nmemb, struct url_data *url_data)
 {
 	size_t new_len = url_data->len + size*nmemb;
@@ -586,26 +974,28 @@ static size_t write_func(void *ptr, size_t size, size_t nmemb, struct url_data *
 }
 #endif // WRITEFUNC_USED
 
+#ifdef USE_BODY_HEADER_FILES
 static size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream)
 {
 	size_t written = fwrite(ptr, size, nmemb, (FILE *)stream);
 	return written;
 }
-
-/*
- * Comparison function between 2 doubles 
- */
-static int double_comp(const void* elem1, const void* elem2)
+#else
+/* Lean variant - the body is discarded (only its timing matters) */
+static size_t write_data(void *ptr, size_t size, size_t nmemb, void *stream)
 {
-    if (*(const double*)elem1 < *(const double*)elem2)
-        return -1;
-    return *(const double*)elem1 > *(const double*)elem2;
+	(void)ptr;    /* prevent compiler warning */
+	(void)stream; /* prevent compiler warning */
+	return size * nmemb;
 }
+#endif  // USE_BODY_HEADER_FILES
 
 /*
- * Get median of given arr (sized arr_size) 
+ * Get median of given arr (sized arr_size). The median is exact (it is the
+ * program's output), but arr is only reordered around it by a selection
+ * (O(n) on average) rather than sorted
  */
-static double get_median(double arr[], int arr_size) {
+double get_median(double arr[], int arr_size) {
 	double median = 0.0;
 	int mid = 0;
 	
@@ -614,26 +1004,72 @@ static double get_median(double arr[], int arr_size) {
 		return 0;
 	}
 
-	// Sort the array using qsort standart library
-	qsort(arr, arr_size, sizeof(double), double_comp);
-
 	// If the array has odd number of elements - median is the middle element
 	if((arr_size % 2) != 0)
 	{
 		mid = (int)(arr_size / 2);
-		median = arr[mid];
+		median = select_nth(arr, arr_size, mid);
 	}
 	else
 	{
 		// If the array has even number of elements - median is the average
-		// of 2 most median
+		// of 2 most median (the upper one is the smallest value above mid)
 		mid = (arr_size / 2) - 1; // Subtract 1 because array is zero index
-		median = (arr[mid] + arr[mid + 1]) / 2;
+		median = select_nth(arr, arr_size, mid);
+		double upper = arr[mid + 1];
+		for (int i=mid + 2; i<arr_size; i++) {
+			if (arr[i] < upper) {
+				upper = arr[i];
+			}
+		}
+		median = (median + upper) / 2;
 	}
 	
 	return median;
 }
 
+/*
+ * Reorder arr so that arr[k] holds the value of rank k (0 based), smaller or
+ * equal values before it and greater or equal values after it (Hoare's
+ * selection). Returns arr[k]
+ */
+static double select_nth(double arr[], int arr_size, int k) {
+	int low = 0;
+	int high = arr_size - 1;
+	
+	while (low < high) {
+		double pivot = arr[low + (high - low) / 2];
+		int i = low;
+		int j = high;
+		
+		while (i <= j) {
+			while (arr[i] < pivot) {
+				i++;
+			}
+			while (arr[j] > pivot) {
+				j--;
+			}
+			if (i <= j) {
+				double tmp = arr[i];
+				arr[i] = arr[j];
+				arr[j] = tmp;
+				i++;
+				j--;
+			}
+		}
+		/* [low:j] <= pivot <= [i:high], and values in between equal the pivot */
+		if (k <= j) {
+			high = j;
+		} else if (k >= i) {
+			low = i;
+		} else {
+			break;
+		}
+	}
+	return arr[k];
+}
+
+#ifdef TRACE_FILES_USED
 /*
  * Open the trace files (create trace dir if not opened yet) 
  */
@@ -646,6 +1082,8 @@ static RC open_trace_files() {
 			printf("open_trace_files() fail to create trace dir\n");
 			return RC_ERROR_IN_FILE_OR_FOLDER;
 		}
+	} else {
+		closedir(dir);
 	}
 	
 #ifdef USE_BODY_HEADER_FILES
@@ -685,16 +1123,19 @@ static RC open_trace_files() {
 #endif
 	return RC_OK;
 }
+#endif  // TRACE_FILES_USED
 
 /*
  * Validate that HTTP data request is legit 
  */
-static RC is_valid_http_data_req(HttpReqData *p_http_req_data) {
-	/* Validate num_of_http_req */
-	if ((p_http_req_data->num_of_http_req > MAX_NUM_OF_SUPPORTED_CURL_OPER) ||
-		(p_http_req_data->num_of_http_req == 0)) {
+RC is_valid_http_data_req(HttpReqData *p_http_req_data) {
+	/* Validate num_of_http_req (the budget of adaptive runs may be larger) */
+	int max_num_of_http_req = (p_http_req_data->ci_width > 0) ?
+		MAX_NUM_OF_ADAPTIVE_SAMPLES : MAX_NUM_OF_SUPPORTED_CURL_OPER;
+	if ((p_http_req_data->num_of_http_req > max_num_of_http_req) ||
+		(p_http_req_data->num_of_http_req <= 0)) {
 		printf("Requested number of HTTP requests (%d) must be in range [1:%d] \n", 
-				p_http_req_data->num_of_http_req, MAX_NUM_OF_SUPPORTED_CURL_OPER);
+				p_http_req_data->num_of_http_req, max_num_of_http_req);
 		return RC_INVALID_NUM_OF_HTTP_REQ;
 	}
 	
@@ -708,37 +1149,123 @@ static RC is_valid_http_data_req(HttpReqData *p_http_req_data) {
 				p_http_req_data->url);
 		return RC_INVALID_URL;
 	}
+	
+	/* Validate HTTP version (and that multiplexing is possible with it) */
+	if ((p_http_req_data->http_version < CONNSTAT_HTTP_VERSION_DEFAULT) ||
+		(p_http_req_data->http_version > CONNSTAT_HTTP_VERSION_3)) {
+		printf("connection_stats_trigger() fail with invalid http_version %d\n", 
+				p_http_req_data->http_version);
+		return RC_INVALID_HTTP_VERSION;
+	}
+	if (p_http_req_data->multiplex && 
+		(p_http_req_data->http_version != CONNSTAT_HTTP_VERSION_2) &&
+		(p_http_req_data->http_version != CONNSTAT_HTTP_VERSION_3)) {
+		printf("connection_stats_trigger() multiplexing requires HTTP/2 or HTTP/3 \n");
+		return RC_INVALID_HTTP_VERSION;
+	}
+	if (p_http_req_data->http_version == CONNSTAT_HTTP_VERSION_3) {
+		curl_version_info_data *version_info = curl_version_info(CURLVERSION_NOW);
+		if (!(version_info->features & CURL_VERSION_HTTP3)) {
+			printf("connection_stats_trigger() libcurl %s has no HTTP/3 support \n", 
+					version_info->version);
+			return RC_NOT_SUPPORTED;
+		}
+	}
+
+	/* Validate measurement mode (and its parameters) */
+	if ((p_http_req_data->mode < CONNSTAT_MODE_LATENCY) ||
+		(p_http_req_data->mode > CONNSTAT_MODE_THROUGHPUT)) {
+		printf("connection_stats_trigger() fail with invalid mode %d\n",
+				p_http_req_data->mode);
+		return RC_INVALID_MODE;
+	}
+	if ((p_http_req_data->num_of_streams < 0) ||
+		(p_http_req_data->num_of_streams > MAX_NUM_OF_THROUGHPUT_STREAMS) ||
+		(p_http_req_data->payload_bytes < 0) || (p_http_req_data->slice_ms < 0)) {
+		printf("connection_stats_trigger() fail with invalid throughput parameters "
+			   "[num_of_streams=%d (max %d), payload_bytes=%ld, slice_ms=%d]\n",
+				p_http_req_data->num_of_streams, MAX_NUM_OF_THROUGHPUT_STREAMS,
+				p_http_req_data->payload_bytes, p_http_req_data->slice_ms);
+		return RC_INVALID_MODE;
+	}
+	if (p_http_req_data->multiplex &&
+		(p_http_req_data->mode == CONNSTAT_MODE_THROUGHPUT)) {
+		printf("connection_stats_trigger() throughput runs can not be multiplexed \n");
+		return RC_INVALID_MODE;
+	}
+	if ((p_http_req_data->ci_width < 0) || (p_http_req_data->percentile < 0) ||
+		(p_http_req_data->percentile >= 1)) {
+		printf("connection_stats_trigger() fail with invalid adaptive parameters "
+			   "[ci_width=%f, percentile=%f]\n",
+				p_http_req_data->ci_width, p_http_req_data->percentile);
+		return RC_INVALID_MODE;
+	}
+	if ((p_http_req_data->ci_width > 0) && (p_http_req_data->multiplex ||
+		(p_http_req_data->mode == CONNSTAT_MODE_THROUGHPUT))) {
+		printf("connection_stats_trigger() adaptive runs are sequential latency runs \n");
+		return RC_INVALID_MODE;
+	}
+
+	/* Validate timeouts */
+	if ((p_http_req_data->timeout_ms < 0) || (p_http_req_data->connect_timeout_ms < 0) ||
+		(p_http_req_data->low_speed_limit < 0) || (p_http_req_data->low_speed_time < 0) ||
+		(p_http_req_data->deadline_ms < 0)) {
+		printf("connection_stats_trigger() fail with negative timeouts \n");
+		return RC_INVALID_TIMEOUT;
+	}
+
+	/* Validate header profile (if any) */
+	if ((p_http_req_data->header_profile[0] != '\0') &&
+		((strnlen(p_http_req_data->header_profile, HEADER_PROFILE_NAME_MAX_LEN) ==
+		  HEADER_PROFILE_NAME_MAX_LEN) ||
+		 (headers_get_list(p_http_req_data->header_profile) == NULL))) {
+		printf("connection_stats_trigger() fail with unknown header profile %.*s\n",
+				HEADER_PROFILE_NAME_MAX_LEN, p_http_req_data->header_profile);
+		return RC_INVALID_HTTP_HEADER;
+	}
 	return RC_OK;
 }
 
 /*
- * Validate that HTTP Header is legit 
+ * Check if a URL is of cleartext HTTP, the way libcurl reads it (the scheme
+ * is case insensitive, and a URL without one is guessed - "http" for any
+ * host that is not named after another protocol)
  */
-static RC is_valid_http_header(char* http_header) {
-	/* Validate HTTP address is legit */
-	if ((http_header == NULL) || (http_header[0] == '\0') || 
-		(strlen(http_header) > HTTP_HEADER_MAX_LEN) ||
-		(strlen(http_header) < HTTP_HEADER_MIN_LEN) ){
-		printf("is_valid_http_header() fail with invalid HTTP header %s\n", 
-				http_header);
-		return RC_INVALID_HTTP_HEADER;
+static int is_cleartext_url(const char *url) {
+	CURLU *parsed = curl_url();
+	char *scheme = NULL;
+	int is_cleartext = 0;
+
+	if (parsed == NULL) {
+		return 0;
 	}
-	
-	int foundColon = 0;
-	char* c = http_header;
-	while (*c)
-	{
-		if (c[0] == ':')
-		{
-			/* Found ':' char - great */
-			foundColon = 1;
-		}
-		c++;
+	if ((curl_url_set(parsed, CURLUPART_URL, url, CURLU_GUESS_SCHEME) == CURLUE_OK) &&
+		(curl_url_get(parsed, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK)) {
+		is_cleartext = (strcasecmp(scheme, "http") == 0);
+		curl_free(scheme);
 	}
-	if (!foundColon) {
-		printf("is_valid_http_header() fail with missing ':' %s\n", 
-				http_header);
-		return RC_INVALID_HTTP_HEADER;
+	curl_url_cleanup(parsed);
+	return is_cleartext;
+}
+
+/*
+ * Translate the requested HTTP version to CURLOPT_HTTP_VERSION
+ */
+static long get_curl_http_version(HttpReqData *p_http_req_data) {
+	switch (p_http_req_data->http_version) {
+		case CONNSTAT_HTTP_VERSION_1_1:
+			return CURL_HTTP_VERSION_1_1;
+		case CONNSTAT_HTTP_VERSION_2:
+			/* Cleartext HTTP/2 must be known in advance to be multiplexed
+			   (an h2c upgrade only happens after the first request) */
+			if (is_cleartext_url(p_http_req_data->url)) {
+				return CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+			}
+			return CURL_HTTP_VERSION_2TLS;
+		case CONNSTAT_HTTP_VERSION_3:
+			return CURL_HTTP_VERSION_3;
+		default:
+			return CURL_HTTP_VERSION_NONE;
 	}
-	return RC_OK;
 }
+
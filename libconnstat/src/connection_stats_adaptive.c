@@ -0,0 +1,242 @@
+/*
+ * connection_stats_adaptive.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Adaptive sample count mode of the libconnstat library.
+ * Instead of a fixed number of samples, samples are taken (sequentially) until
+ * the 95% confidence interval of a percentile of total_time is narrower than
+ * requested, or until the budget (num_of_http_req) is used.
+ * The percentile and its interval are estimated on the fly out of a streaming
+ * log-linear histogram (O(1) per sample, fixed memory), and the interval is
+ * the distribution free order statistics interval:
+ *    ranks n*p -/+ 1.96*sqrt(n*p*(1-p))
+ * The histogram only knows the bucket of a sample, so the interval spans
+ * from the lower edge of the bucket of the low rank to the upper edge of
+ * the bucket of the high rank - it is never narrower than a bucket, and a
+ * ci_width below the resolution of the histogram (1/16 of the value) is
+ * never reported as converged.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define DEFAULT_PERCENTILE      0.5
+#define CI_Z_95                 1.96
+#define ADAPTIVE_MIN_SAMPLES    5
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static int bucket_of(uint64_t usec);
+static int bucket_at_rank(const LatencyHistogram *hist, int rank);
+static double bucket_low(int bucket);
+static double bucket_mid(int bucket);
+static int update_estimate(const LatencyHistogram *hist, double ci_width,
+						   ConnStatEstimate *estimate);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Perform samples (on the given configured handle) until the estimate
+*         of the requested percentile converges or the budget is used
+* @param  curl              CURL easy handle, already set up for the request
+* @param  p_http_req_data   Data as received by the user (ci_width is set)
+* @param  curl_info_arr     Samples to be filled (num_of_http_req entries)
+* @param  p_num_of_samples  Number of samples taken
+* @param  estimate          Estimate of the percentile of total_time
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_adaptive_perform(CURL *curl, HttpReqData *p_http_req_data,
+									 CurlInfo *curl_info_arr, int *p_num_of_samples,
+									 ConnStatEstimate *estimate) {
+	LatencyHistogram hist;
+	struct timespec start;
+	RC rc;
+	int i;
+
+	memset(&hist, 0, sizeof(hist));
+	memset(estimate, 0, sizeof(ConnStatEstimate));
+	estimate->percentile = (p_http_req_data->percentile > 0) ?
+						   p_http_req_data->percentile : DEFAULT_PERCENTILE;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i=0; i<p_http_req_data->num_of_http_req; i++) {
+		/* The deadline ends the run as the budget does */
+		long remaining_ms = deadline_remaining_ms(&start, p_http_req_data->deadline_ms);
+		if (remaining_ms <= 0) {
+			break;
+		}
+		timeouts_arm(curl, p_http_req_data->timeout_ms, remaining_ms);
+		
+		/* Perform the request and collect statistics 
+		   (a failure marks the sample as failed) */
+		long nivcsw = affinity_get_nivcsw();
+		rc = transport_perform(curl, p_http_req_data, &curl_info_arr[i]);
+		if (rc != RC_OK) {
+			fprintf(stderr, "connection_stats_collect() failed for sample %d \n", i);
+		}
+		curl_info_arr[i].involuntary_ctx_switches = affinity_get_nivcsw() - nivcsw;
+		samples_notify(p_http_req_data, i, &curl_info_arr[i]);
+
+		/* Only successful samples are estimated */
+		if (!connection_stats_is_success(&curl_info_arr[i])) {
+			continue;
+		}
+		histogram_add(&hist, curl_info_arr[i].total_time);
+		if (update_estimate(&hist, p_http_req_data->ci_width, estimate)) {
+			i++;
+			break;
+		}
+	}
+
+	printf("connection_stats_adaptive_perform() %s after %d samples "
+		   "[p%.0f=%.6f, ci=%.6f:%.6f]\n",
+		   estimate->converged ? "converged" : "budget used", i,
+		   estimate->percentile * 100, estimate->value,
+		   estimate->ci_low, estimate->ci_high);
+
+	*p_num_of_samples = i;
+	return RC_OK;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Re-estimate the percentile and its interval. Returns non zero once the
+ * interval is narrower than ci_width
+ */
+static int update_estimate(const LatencyHistogram *hist, double ci_width,
+						   ConnStatEstimate *estimate) {
+	int n = hist->count;
+	double p = estimate->percentile;
+	double half_width = CI_Z_95 * sqrt(n * p * (1 - p));
+	int rank    = (int)ceil(n * p);
+	int rank_lo = (int)floor(n * p - half_width);
+	int rank_hi = (int)ceil(n * p + half_width);
+
+	estimate->value = histogram_value_at_rank(hist, (rank < 1) ? 1 : rank);
+
+	/* Too few samples to bound the percentile on both sides */
+	if ((rank_lo < 1) || (rank_hi > n)) {
+		estimate->ci_low  = bucket_low(bucket_at_rank(hist, 1)) / 1e6;
+		estimate->ci_high = bucket_low(bucket_at_rank(hist, n) + 1) / 1e6;
+		return 0;
+	}
+
+	/* Edges of the buckets (the bucket above starts where a bucket ends) */
+	estimate->ci_low  = bucket_low(bucket_at_rank(hist, rank_lo)) / 1e6;
+	estimate->ci_high = bucket_low(bucket_at_rank(hist, rank_hi) + 1) / 1e6;
+	estimate->converged = (n >= ADAPTIVE_MIN_SAMPLES) &&
+						  ((estimate->ci_high - estimate->ci_low) <= ci_width);
+	return estimate->converged;
+}
+
+/*
+ * Add a value (in seconds) to the histogram
+ */
+void histogram_add(LatencyHistogram *hist, double value) {
+	hist->buckets[histogram_bucket(value)]++;
+	hist->count++;
+}
+
+/*
+ * Get the bucket of a value (in seconds)
+ */
+int histogram_bucket(double value) {
+	return bucket_of((value > 0) ? (uint64_t)(value * 1e6) : 0);
+}
+
+/*
+ * Get the value (in seconds) of the sample in the given rank (1 based, in
+ * ascending order). The value is the middle of the sample's bucket
+ */
+double histogram_value_at_rank(const LatencyHistogram *hist, int rank) {
+	int bucket = bucket_at_rank(hist, rank);
+
+	return (bucket < 0) ? 0 : bucket_mid(bucket) / 1e6;
+}
+
+/*
+ * Get the bucket of a value (in microseconds)
+ */
+static int bucket_of(uint64_t usec) {
+	int exponent;
+
+	if (usec < HIST_SUB_BUCKETS) {
+		return (int)usec;
+	}
+	/* usec >> exponent is in [HIST_SUB_BUCKETS:2*HIST_SUB_BUCKETS) */
+	exponent = 63 - __builtin_clzll(usec) - HIST_SUB_BUCKET_BITS;
+	if (exponent > HIST_MAX_EXPONENT) {
+		return HIST_NUM_OF_BUCKETS - 1;
+	}
+	return HIST_SUB_BUCKETS * exponent + (int)(usec >> exponent);
+}
+
+/*
+ * Get the bucket of the sample in the given rank (1 based, in ascending
+ * order), -1 if there are fewer samples
+ */
+static int bucket_at_rank(const LatencyHistogram *hist, int rank) {
+	int cumulative = 0;
+	int i;
+
+	for (i=0; i<HIST_NUM_OF_BUCKETS; i++) {
+		cumulative += hist->buckets[i];
+		if (cumulative >= rank) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Get the lower edge (in microseconds) of a bucket. The lower edge of 
+ * bucket+1 is the (exclusive) upper edge of bucket
+ */
+static double bucket_low(int bucket) {
+	int exponent;
+	uint64_t sub_bucket;
+
+	if (bucket < HIST_SUB_BUCKETS) {
+		return bucket;
+	}
+	exponent   = bucket / HIST_SUB_BUCKETS - 1;
+	sub_bucket = bucket % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS;
+	return (double)(sub_bucket << exponent);
+}
+
+/*
+ * Get the middle value (in microseconds) of a bucket
+ */
+static double bucket_mid(int bucket) {
+	int exponent;
+	uint64_t sub_bucket;
+
+	if (bucket < HIST_SUB_BUCKETS) {
+		return bucket;
+	}
+	exponent   = bucket / HIST_SUB_BUCKETS - 1;
+	sub_bucket = bucket % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS;
+	return (double)(sub_bucket << exponent) + ((1ULL << exponent) - 1) / 2.0;
+}
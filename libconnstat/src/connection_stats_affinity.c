@@ -0,0 +1,252 @@
+/*
+ * connection_stats_affinity.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Low jitter options of the libconnstat library.
+ * Pinning the measuring thread (to cores, or to the cores of a NUMA node as
+ * listed by sysfs) keeps it from migrating between cores mid sample, busy
+ * polling (SO_BUSY_POLL, set on every probe socket through libCURL's
+ * sockopt callback) saves the interrupt and wake up latency of incoming
+ * data, and the involuntary context switches of the thread (getrusage) tell
+ * the samples that were preempted anyway.
+ */
+
+/******************
+**   Includes    **
+******************/
+#define _GNU_SOURCE         // pthread_setaffinity_np, RUSAGE_THREAD
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL            46
+#endif
+#define NUMA_CPULIST_PATH       "/sys/devices/system/node/node%d/cpulist"
+#define MAX_SIZE_OF_CPULIST     1024
+
+
+/******************
+**  Global Vars  **
+******************/
+/* SO_BUSY_POLL of probe sockets (0 for none) */
+static int g_busy_poll_us = 0;
+
+/* A failure to busy poll is only reported once */
+static int g_busy_poll_warned = 0;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC parse_cpu_list(const char *cpu_list, cpu_set_t *cpu_set);
+static RC get_numa_cpus(int numa_node, cpu_set_t *cpu_set);
+static int sockopt_func(void *clientp, curl_socket_t curlfd, curlsocktype purpose);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Pin the calling thread to a set of cores
+* @param  cpu_list		Cores in sysfs cpulist format, NULL for all
+* @param  numa_node		Only the cores of this NUMA node, -1 for any node
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_set_affinity(const char* cpu_list, int numa_node) {
+	cpu_set_t cpu_set;
+	cpu_set_t numa_set;
+	int err;
+	RC rc;
+
+	if ((cpu_list == NULL) && (numa_node < 0)) {
+		return RC_OK;   /* Nothing to pin to */
+	}
+	if (cpu_list != NULL) {
+		rc = parse_cpu_list(cpu_list, &cpu_set);
+		if (rc != RC_OK) {
+			return rc;
+		}
+	} else {
+		CPU_ZERO(&cpu_set);
+		for (int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+			CPU_SET(cpu, &cpu_set);
+		}
+	}
+
+	if (numa_node >= 0) {
+		rc = get_numa_cpus(numa_node, &numa_set);
+		if (rc != RC_OK) {
+			return rc;
+		}
+		CPU_AND(&cpu_set, &cpu_set, &numa_set);
+	}
+
+	if (CPU_COUNT(&cpu_set) == 0) {
+		printf("connection_stats_set_affinity() no core is left [cpu_list=%s, numa_node=%d]\n",
+				(cpu_list != NULL) ? cpu_list : "all", numa_node);
+		return RC_ERROR;
+	}
+
+	err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+	if (err != 0) {
+		printf("connection_stats_set_affinity() failed: %s \n", strerror(err));
+		return RC_ERROR;
+	}
+	return RC_OK;
+}
+
+/**
+* @desc   Busy poll the sockets of following runs (SO_BUSY_POLL)
+* @param  busy_poll_us	Busy poll time (usec), 0 to stop
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_set_busy_poll(int busy_poll_us) {
+	if (busy_poll_us < 0) {
+		printf("connection_stats_set_busy_poll() fail with invalid busy_poll_us %d \n",
+				busy_poll_us);
+		return RC_ERROR;
+	}
+	g_busy_poll_us = busy_poll_us;
+	g_busy_poll_warned = 0;
+	return RC_OK;
+}
+
+/*
+ * Set the low jitter options on a handle
+ */
+RC affinity_setup_handle(CURL *curl) {
+	CURLcode res;
+
+	/* NULL restores libCURL's default (for a handle reused by a later run) */
+	res = curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION,
+						   (g_busy_poll_us > 0) ? sockopt_func : NULL);
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_SOCKOPTFUNCTION: %s\n",
+				curl_easy_strerror(res));
+		return RC_ERROR_IN_CURL;
+	}
+	return RC_OK;
+}
+
+/*
+ * Get the involuntary context switches of the calling thread so far
+ */
+long affinity_get_nivcsw() {
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage) == -1) {
+		return 0;
+	}
+	return usage.ru_nivcsw;
+}
+
+/*
+ * Stop busy polling
+ */
+void affinity_reset() {
+	g_busy_poll_us = 0;
+	g_busy_poll_warned = 0;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Parse a sysfs cpulist ("0-3,8,10-11")
+ */
+static RC parse_cpu_list(const char *cpu_list, cpu_set_t *cpu_set) {
+	const char *p = cpu_list;
+	char *end;
+
+	CPU_ZERO(cpu_set);
+	while (*p != '\0') {
+		long first, last;
+
+		if (!isdigit((unsigned char)*p)) {
+			break;
+		}
+		first = strtol(p, &end, 10);
+		last  = first;
+		p = end;
+		if (*p == '-') {
+			p++;
+			if (!isdigit((unsigned char)*p)) {
+				break;
+			}
+			last = strtol(p, &end, 10);
+			p = end;
+		}
+		if ((last < first) || (last >= CPU_SETSIZE)) {
+			break;
+		}
+		for (long cpu=first; cpu<=last; cpu++) {
+			CPU_SET(cpu, cpu_set);
+		}
+		if (*p == ',') {
+			p++;
+		} else if ((*p != '\0') && (*p != '\n')) {
+			break;
+		} else {
+			return RC_OK;
+		}
+	}
+
+	printf("Invalid cpu list %s (expected e.g. 0-3,8) \n", cpu_list);
+	return RC_PARSING_ERROR;
+}
+
+/*
+ * Get the cores of a NUMA node (from sysfs)
+ */
+static RC get_numa_cpus(int numa_node, cpu_set_t *cpu_set) {
+	char path[sizeof(NUMA_CPULIST_PATH) + 16];
+	char cpu_list[MAX_SIZE_OF_CPULIST];
+	FILE *file;
+
+	snprintf(path, sizeof(path), NUMA_CPULIST_PATH, numa_node);
+	file = fopen(path, "r");
+	if (file == NULL) {
+		printf("connection_stats_set_affinity() unknown NUMA node %d \n", numa_node);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	if (fgets(cpu_list, sizeof(cpu_list), file) == NULL) {
+		fclose(file);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	fclose(file);
+	return parse_cpu_list(cpu_list, cpu_set);
+}
+
+/*
+ * Called by libCURL for every new socket - set SO_BUSY_POLL on connections
+ */
+static int sockopt_func(void *clientp, curl_socket_t curlfd, curlsocktype purpose) {
+	(void)clientp; /* prevent compiler warning */
+
+	if (purpose != CURLSOCKTYPE_IPCXN) {
+		return CURL_SOCKOPT_OK;
+	}
+	if ((setsockopt(curlfd, SOL_SOCKET, SO_BUSY_POLL, &g_busy_poll_us,
+					sizeof(g_busy_poll_us)) == -1) && !g_busy_poll_warned) {
+		/* Measure anyway, just without busy polling */
+		perror("setsockopt(SO_BUSY_POLL)");
+		g_busy_poll_warned = 1;
+	}
+	return CURL_SOCKOPT_OK;
+}
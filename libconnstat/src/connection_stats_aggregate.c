@@ -0,0 +1,477 @@
+/*
+ * connection_stats_aggregate.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Multi producer aggregation of the libconnstat library.
+ * Every recording thread owns a shard, registered once (lock free push to a
+ * global list) and handed over to a later thread when its owner exits.
+ * A shard holds a slot per URL, allocated on the thread's first sample of the
+ * URL and aligned to a cache line, so a thread only ever writes cache lines
+ * no other thread writes. Recording is therefore a plain update of the
+ * thread's own slot, guarded by a sequence counter (seqlock): readers
+ * merging the aggregate copy every slot and retry if it changed meanwhile,
+ * so recording threads never wait for readers (nor for each other). A reader
+ * backs off while a slot is written (spinning briefly, then yielding the CPU
+ * to the writer), and retries until it gets a consistent copy.
+ * URLs are interned once into a fixed table (lock free, no duplicates), so
+ * a slot is found by the URL's index.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>      // sched_yield
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define CACHE_LINE_SIZE             64
+#define AGGREGATE_SPIN_RETRIES      64  /* Read retries before yielding */
+#define NUM_OF_PHASES               4
+
+/* States of a URL table entry */
+#define TARGET_EMPTY                0
+#define TARGET_WRITING              1
+#define TARGET_READY                2
+
+
+/******************
+**  Structures   **
+******************/
+/* Statistics of the samples of a URL recorded by a single thread */
+typedef struct {
+	int                num_of_samples;
+	int                num_of_success;
+	int                num_of_connects;
+	RunningStats       phases[NUM_OF_PHASES];
+	LatencyHistogram   hists[NUM_OF_PHASES];
+	int                num_of_error_classes;
+	ConnStatErrorClass error_classes[MAX_NUM_OF_ERROR_CLASSES];
+	int                num_of_unclassified_errors;
+	int                num_of_timeouts;
+} AggregateStats;
+
+/* Slot of a URL in a shard (written by the owning thread only) */
+typedef struct {
+	_Atomic uint64_t seq;       /* Odd while the owner updates the stats */
+	AggregateStats   stats;
+} __attribute__((aligned(CACHE_LINE_SIZE))) AggregateSlot;
+
+/* Shard of a thread */
+typedef struct AggregateShard {
+	_Atomic(AggregateSlot *) slots[MAX_NUM_OF_AGGREGATE_TARGETS];
+	_Atomic int              in_use;  /* Owned by a (live) thread */
+	struct AggregateShard   *next;    /* Set once, before the shard is listed */
+} __attribute__((aligned(CACHE_LINE_SIZE))) AggregateShard;
+
+/* Entry of the URL table */
+typedef struct {
+	_Atomic int state;
+	char        url[URL_MAX_LEN];  /* Set once, before state is TARGET_READY */
+} AggregateTarget;
+
+
+/******************
+**  Global Vars  **
+******************/
+/* All shards ever registered (never freed, reused once their owner exits) */
+static _Atomic(AggregateShard *) g_shards = NULL;
+
+/* Shard of the calling thread */
+static __thread AggregateShard *t_shard = NULL;
+
+/* Releases the shard of an exiting thread */
+static pthread_key_t  g_shard_key;
+static pthread_once_t g_shard_key_once = PTHREAD_ONCE_INIT;
+
+/* Interned URLs */
+static AggregateTarget g_targets[MAX_NUM_OF_AGGREGATE_TARGETS];
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static AggregateShard* get_shard();
+static void create_shard_key();
+static void release_shard(void *shard);
+static int intern_url(const char *url, int insert);
+static void read_slot(AggregateSlot *slot, AggregateStats *copy);
+static void cpu_relax();
+static void stats_add(AggregateStats *stats, const CurlInfo *curl_info);
+static void stats_merge(AggregateStats *dst, const AggregateStats *src);
+static void add_error_class(AggregateStats *stats, int curl_code,
+							long response_code, int count);
+static void phase_finalize(const RunningStats *running_stats, int num_of_shards,
+						   const LatencyHistogram *hist, ConnStatPhaseStats *phase_stats);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Record a sample of a URL (lock free, see connection_stats.h)
+* @param  url			URL the sample was taken of
+* @param  curl_info		Sample
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_record(const char* url, const CurlInfo* curl_info) {
+	AggregateShard *shard;
+	AggregateSlot *slot;
+	uint64_t seq;
+	int idx;
+
+	if ((url == NULL) || (curl_info == NULL)) {
+		return RC_ERROR;
+	}
+	idx = intern_url(url, 1);
+	if (idx < 0) {
+		printf("connection_stats_record() too many URLs, %s is not recorded \n", url);
+		return RC_ERROR;
+	}
+	shard = get_shard();
+	if (shard == NULL) {
+		return RC_ERROR;
+	}
+
+	/* Only this thread writes its slots, so no ordering is needed to read */
+	slot = atomic_load_explicit(&shard->slots[idx], memory_order_relaxed);
+	if (slot == NULL) {
+		slot = aligned_alloc(CACHE_LINE_SIZE, sizeof(AggregateSlot));
+		if (slot == NULL) {
+			fprintf(stderr, "aligned_alloc() failed\n");
+			return RC_ERROR;
+		}
+		memset(slot, 0, sizeof(AggregateSlot));
+		atomic_store_explicit(&shard->slots[idx], slot, memory_order_release);
+	}
+
+	seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	stats_add(&slot->stats, curl_info);
+	atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+	return RC_OK;
+}
+
+/**
+* @desc   Merge the samples recorded for a URL by all threads
+* @param  url		URL as recorded
+* @param  summary	Summary to be filled
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_get_aggregate(const char* url, ConnStatSummary* summary) {
+	AggregateStats copy;
+	AggregateStats total;
+	AggregateShard *shard;
+	int num_of_shards = 0;
+	int idx, p;
+
+	if ((url == NULL) || (summary == NULL)) {
+		return RC_ERROR;
+	}
+	idx = intern_url(url, 0);
+	if (idx < 0) {
+		return RC_RESULT_REQUESTED_BEFORE_TRIGGER;
+	}
+
+	memset(&total, 0, sizeof(total));
+	for (shard = atomic_load_explicit(&g_shards, memory_order_acquire);
+		 shard != NULL; shard = shard->next) {
+		AggregateSlot *slot = atomic_load_explicit(&shard->slots[idx],
+												   memory_order_acquire);
+
+		if (slot == NULL) {
+			continue;
+		}
+		read_slot(slot, &copy);
+		if (copy.num_of_success > 0) {
+			num_of_shards++;
+		}
+		stats_merge(&total, &copy);
+	}
+
+	if (total.num_of_samples == 0) {
+		return RC_RESULT_REQUESTED_BEFORE_TRIGGER;
+	}
+
+	memset(summary, 0, sizeof(ConnStatSummary));
+	summary->num_of_samples  = total.num_of_samples;
+	summary->num_of_success  = total.num_of_success;
+	summary->success_ratio   = (double)total.num_of_success / total.num_of_samples;
+	summary->num_of_connects = total.num_of_connects;
+	summary->num_of_error_classes = total.num_of_error_classes;
+	memcpy(summary->error_classes, total.error_classes, sizeof(total.error_classes));
+	summary->num_of_unclassified_errors = total.num_of_unclassified_errors;
+	summary->num_of_timeouts = total.num_of_timeouts;
+	if (total.num_of_success == 0) {
+		return RC_OK;
+	}
+
+	ConnStatPhaseStats *phase_stats[NUM_OF_PHASES] = {
+		&summary->name_lookup, &summary->connect,
+		&summary->start_transfer, &summary->total
+	};
+	for (p=0; p<NUM_OF_PHASES; p++) {
+		phase_finalize(&total.phases[p], num_of_shards, &total.hists[p], phase_stats[p]);
+	}
+	return RC_OK;
+}
+
+/*
+ * Drop all recorded samples. Shards stay registered to their threads
+ * (must not run concurrently with connection_stats_record)
+ */
+void aggregate_reset() {
+	AggregateShard *shard;
+	int i;
+
+	for (shard = atomic_load_explicit(&g_shards, memory_order_acquire);
+		 shard != NULL; shard = shard->next) {
+		for (i=0; i<MAX_NUM_OF_AGGREGATE_TARGETS; i++) {
+			AggregateSlot *slot = atomic_load_explicit(&shard->slots[i],
+													   memory_order_relaxed);
+			if (slot != NULL) {
+				memset(&slot->stats, 0, sizeof(AggregateStats));
+			}
+		}
+	}
+	for (i=0; i<MAX_NUM_OF_AGGREGATE_TARGETS; i++) {
+		atomic_store_explicit(&g_targets[i].state, TARGET_EMPTY, memory_order_relaxed);
+	}
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Get the shard of the calling thread (registered on its first sample)
+ */
+static AggregateShard* get_shard() {
+	AggregateShard *shard;
+	AggregateShard *head;
+
+	if (t_shard != NULL) {
+		return t_shard;
+	}
+	pthread_once(&g_shard_key_once, create_shard_key);
+
+	/* Take over the shard of a thread that exited */
+	for (shard = atomic_load_explicit(&g_shards, memory_order_acquire);
+		 shard != NULL; shard = shard->next) {
+		int in_use = 0;
+		if (atomic_compare_exchange_strong(&shard->in_use, &in_use, 1)) {
+			break;
+		}
+	}
+
+	/* Or register a new one */
+	if (shard == NULL) {
+		shard = aligned_alloc(CACHE_LINE_SIZE, sizeof(AggregateShard));
+		if (shard == NULL) {
+			fprintf(stderr, "aligned_alloc() failed\n");
+			return NULL;
+		}
+		memset(shard, 0, sizeof(AggregateShard));
+		atomic_store_explicit(&shard->in_use, 1, memory_order_relaxed);
+		head = atomic_load_explicit(&g_shards, memory_order_relaxed);
+		do {
+			shard->next = head;
+		} while (!atomic_compare_exchange_weak_explicit(&g_shards, &head, shard,
+														 memory_order_release,
+														 memory_order_relaxed));
+	}
+
+	pthread_setspecific(g_shard_key, shard);
+	t_shard = shard;
+	return shard;
+}
+
+/*
+ * Create the key releasing shards of exiting threads
+ */
+static void create_shard_key() {
+	pthread_key_create(&g_shard_key, release_shard);
+}
+
+/*
+ * Release the shard of an exiting thread (its samples are kept)
+ */
+static void release_shard(void *shard) {
+	atomic_store_explicit(&((AggregateShard *)shard)->in_use, 0, memory_order_release);
+}
+
+/*
+ * Get the index of a URL, interning it if requested.
+ * Returns -1 if the URL is unknown (or the table is full)
+ */
+static int intern_url(const char *url, int insert) {
+	int i;
+
+	for (i=0; i<MAX_NUM_OF_AGGREGATE_TARGETS; i++) {
+		AggregateTarget *target = &g_targets[i];
+		int state = atomic_load_explicit(&target->state, memory_order_acquire);
+
+		if ((state == TARGET_EMPTY) && insert) {
+			/* Entries are claimed in order, so a URL is never interned twice */
+			if (atomic_compare_exchange_strong(&target->state, &state, TARGET_WRITING)) {
+				strncpy(target->url, url, URL_MAX_LEN - 1);
+				target->url[URL_MAX_LEN - 1] = '\0';
+				atomic_store_explicit(&target->state, TARGET_READY, memory_order_release);
+				return i;
+			}
+		}
+		if (state == TARGET_EMPTY) {
+			return -1;  /* End of the table */
+		}
+		/* Wait for a concurrent interning of this entry */
+		while (state == TARGET_WRITING) {
+			state = atomic_load_explicit(&target->state, memory_order_acquire);
+		}
+		if (strncmp(target->url, url, URL_MAX_LEN - 1) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Copy the statistics of a slot (seqlock read). The writer of a slot holds
+ * it for a single sample only, so the copy is retried until consistent:
+ * spinning first, then yielding in case the writer is not running
+ */
+static void read_slot(AggregateSlot *slot, AggregateStats *copy) {
+	int retries;
+
+	for (retries=0; ; retries++) {
+		uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		if (!(seq & 1)) {
+			memcpy(copy, &slot->stats, sizeof(AggregateStats));
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) {
+				return;
+			}
+		}
+		if (retries < AGGREGATE_SPIN_RETRIES) {
+			cpu_relax();
+		} else {
+			sched_yield();
+		}
+	}
+}
+
+/*
+ * Hint the CPU that this is a spin-wait loop (frees the core's resources
+ * for its sibling hyper-thread)
+ */
+static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/*
+ * Add a sample to statistics
+ */
+static void stats_add(AggregateStats *stats, const CurlInfo *curl_info) {
+	stats->num_of_samples++;
+	stats->num_of_connects += curl_info->num_of_connects;
+	if (!connection_stats_is_success(curl_info)) {
+		add_error_class(stats, curl_info->curl_code, curl_info->response_code, 1);
+		if (curl_info->curl_code == CURLE_OPERATION_TIMEDOUT) {
+			stats->num_of_timeouts++;
+		}
+		return;
+	}
+
+	stats->num_of_success++;
+	running_stats_add(&stats->phases[0], curl_info->name_lookup_time);
+	running_stats_add(&stats->phases[1], curl_info->connect_time);
+	running_stats_add(&stats->phases[2], curl_info->start_transfer_time);
+	running_stats_add(&stats->phases[3], curl_info->total_time);
+	histogram_add(&stats->hists[0], curl_info->name_lookup_time);
+	histogram_add(&stats->hists[1], curl_info->connect_time);
+	histogram_add(&stats->hists[2], curl_info->start_transfer_time);
+	histogram_add(&stats->hists[3], curl_info->total_time);
+}
+
+/*
+ * Merge statistics of disjoint samples into dst
+ */
+static void stats_merge(AggregateStats *dst, const AggregateStats *src) {
+	int i, p;
+
+	dst->num_of_samples  += src->num_of_samples;
+	dst->num_of_success  += src->num_of_success;
+	dst->num_of_connects += src->num_of_connects;
+	for (p=0; p<NUM_OF_PHASES; p++) {
+		running_stats_merge(&dst->phases[p], &src->phases[p]);
+		dst->hists[p].count += src->hists[p].count;
+		for (i=0; i<HIST_NUM_OF_BUCKETS; i++) {
+			dst->hists[p].buckets[i] += src->hists[p].buckets[i];
+		}
+	}
+	for (i=0; i<src->num_of_error_classes; i++) {
+		add_error_class(dst, src->error_classes[i].curl_code,
+						src->error_classes[i].response_code, src->error_classes[i].count);
+	}
+	dst->num_of_unclassified_errors += src->num_of_unclassified_errors;
+	dst->num_of_timeouts += src->num_of_timeouts;
+}
+
+/*
+ * Classify failed samples by CURLcode and HTTP response code
+ */
+static void add_error_class(AggregateStats *stats, int curl_code,
+							long response_code, int count) {
+	int i;
+
+	for (i=0; i<stats->num_of_error_classes; i++) {
+		if ((stats->error_classes[i].curl_code == curl_code) &&
+			(stats->error_classes[i].response_code == response_code)) {
+			stats->error_classes[i].count += count;
+			return;
+		}
+	}
+
+	if (stats->num_of_error_classes == MAX_NUM_OF_ERROR_CLASSES) {
+		stats->num_of_unclassified_errors += count;
+		return;
+	}
+
+	ConnStatErrorClass *error_class = &stats->error_classes[stats->num_of_error_classes++];
+	error_class->curl_code     = curl_code;
+	error_class->response_code = response_code;
+	error_class->count         = count;
+}
+
+/*
+ * Fill phase statistics out of merged statistics of num_of_shards threads
+ */
+static void phase_finalize(const RunningStats *running_stats, int num_of_shards,
+						   const LatencyHistogram *hist, ConnStatPhaseStats *phase_stats) {
+	RunningStats merged = *running_stats;
+
+	/* Every thread contributed count-1 consecutive differences, while the
+	   jitter is finalized as if all samples were consecutive */
+	if (merged.count > num_of_shards) {
+		merged.jitter_sum *= (double)(merged.count - 1) / (merged.count - num_of_shards);
+	}
+	running_stats_finalize(&merged, phase_stats);
+	phase_stats->median = histogram_value_at_rank(hist, (hist->count + 1) / 2);
+}
@@ -0,0 +1,438 @@
+/*
+ * connection_stats_async.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Async (non blocking) API of the libconnstat library.
+ * It is using the libCURL 'multi socket' interface
+ * (see https://curl.haxx.se/libcurl/c/curl_multi_socket_action.html)
+ * so the library can be driven by an external event loop (epoll, libev, etc.)
+ * Each submitted run owns a single easy handle that is re-added to the multi
+ * handle per sample, so the samples of a run stay sequential while any
+ * number of runs progress concurrently. Every sample is cut at the run's
+ * deadline, and the samples that could not start before it are timed out.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**  Structures   **
+******************/
+/* A single submitted run (num_of_http_req samples of a single URL) */
+typedef struct AsyncRun {
+	HttpReqData          http_req_data;
+	ConnStatRunCallbacks run_cbs;
+	CURL                *curl;
+	CurlInfo             curl_info_arr[MAX_NUM_OF_SUPPORTED_CURL_OPER];
+	int                  num_of_samples;
+	struct timespec      start;          /* Of the run (its deadline) */
+	HeaderProfile       *header_profile; /* Keeps the profile's list (if any) alive */
+	struct AsyncRun     *prev;
+	struct AsyncRun     *next;
+} AsyncRun;
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Multi handle driving all runs */
+static CURLM *g_multi = NULL;
+
+/* Callbacks towards the caller's event loop */
+static ConnStatLoopCallbacks g_loop_cbs;
+
+/* List of all runs in progress */
+static AsyncRun *g_runs = NULL;
+static int g_num_of_runs = 0;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static int socket_func(CURL *easy, curl_socket_t s, int what,
+					   void *userp, void *socketp);
+static int timer_func(CURLM *multi, long timeout_ms, void *userp);
+static void check_multi_info();
+static void start_next_sample(AsyncRun *run, CURL *curl);
+static void finish_run(AsyncRun *run, RC rc);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Initialize the async engine (connection_stats_init() must be called first)
+* @param  loop_cbs	Callbacks towards the caller's event loop (copied)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_async_init(ConnStatLoopCallbacks* loop_cbs) {
+	CURLMcode mres;
+
+	if ((loop_cbs == NULL) || (loop_cbs->socket_cb == NULL) ||
+		(loop_cbs->timer_cb == NULL)) {
+		printf("connection_stats_async_init() fail with missing callbacks \n");
+		return RC_ERROR;
+	}
+	if (g_multi != NULL) {
+		printf("connection_stats_async_init() called twice \n");
+		return RC_ERROR;
+	}
+
+	g_multi = curl_multi_init();
+	if (g_multi == NULL) {
+		printf("connection_stats_async_init() fail with curl_multi_init() \n");
+		return RC_ERROR_IN_CURL;
+	}
+	g_loop_cbs = *loop_cbs;
+
+	/* Expose our socket and timeout needs to the caller's event loop */
+	mres = curl_multi_setopt(g_multi, CURLMOPT_SOCKETFUNCTION, socket_func);
+	if (mres == CURLM_OK) {
+		mres = curl_multi_setopt(g_multi, CURLMOPT_TIMERFUNCTION, timer_func);
+	}
+	if (mres != CURLM_OK) {
+		fprintf(stderr, "curl_multi_setopt() failed: %s\n",
+				curl_multi_strerror(mres));
+		curl_multi_cleanup(g_multi);
+		g_multi = NULL;
+		return RC_ERROR_IN_CURL;
+	}
+
+	return RC_OK;
+}
+
+/**
+* @desc   Submit a run of num_of_http_req samples
+* @param  http_req_data	Data as received by the user (copied)
+* @param  run_cbs		Completion callbacks of this run (copied)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_async_submit(HttpReqData* http_req_data,
+								 ConnStatRunCallbacks* run_cbs) {
+	CURLcode res;
+	CURLMcode mres;
+	RC rc;
+
+	if (g_multi == NULL) {
+		printf("connection_stats_async_submit() called before init \n");
+		return RC_ERROR;
+	}
+	if ((run_cbs == NULL) || (run_cbs->run_cb == NULL)) {
+		printf("connection_stats_async_submit() fail with missing run_cb \n");
+		return RC_ERROR;
+	}
+
+	/* Validate that HTTP data request is legit */
+	rc = is_valid_http_data_req(http_req_data);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	if (transport_is_custom()) {
+		printf("connection_stats_async_submit() runs require the libCURL transport \n");
+		return RC_NOT_SUPPORTED;
+	}
+	if (http_req_data->multiplex) {
+		printf("connection_stats_async_submit() multiplexed runs are not supported \n");
+		return RC_NOT_SUPPORTED;
+	}
+	if (http_req_data->mode == CONNSTAT_MODE_THROUGHPUT) {
+		printf("connection_stats_async_submit() throughput runs are not supported \n");
+		return RC_NOT_SUPPORTED;
+	}
+	if (http_req_data->ci_width > 0) {
+		printf("connection_stats_async_submit() adaptive runs are not supported \n");
+		return RC_NOT_SUPPORTED;
+	}
+
+	AsyncRun *run = calloc(1, sizeof(AsyncRun));
+	if (run == NULL) {
+		fprintf(stderr, "calloc() failed\n");
+		return RC_ERROR;
+	}
+	run->http_req_data = *http_req_data;
+	run->run_cbs       = *run_cbs;
+
+	run->curl = curl_easy_init();
+	if (run->curl == NULL) {
+		printf("connection_stats_async_submit() fail with curl_easy_init() \n");
+		free(run);
+		return RC_ERROR_IN_CURL;
+	}
+
+	/* Set all easy curl options (same as the blocking API) */
+	rc = connection_stats_setup_handle(run->curl, &run->http_req_data);
+	if (rc != RC_OK) {
+		trace_tail_release(run->curl);
+		curl_easy_cleanup(run->curl);
+		free(run);
+		return rc;
+	}
+
+	/* Allows finding the run out of the easy handle on completion */
+	res = curl_easy_setopt(run->curl, CURLOPT_PRIVATE, run);
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_PRIVATE: %s\n",
+				curl_easy_strerror(res));
+		trace_tail_release(run->curl);
+		curl_easy_cleanup(run->curl);
+		free(run);
+		return RC_ERROR_IN_CURL;
+	}
+
+	/* Start the first sample (the timer callback kicks the event loop) */
+	clock_gettime(CLOCK_MONOTONIC, &run->start);
+	mres = curl_multi_add_handle(g_multi, run->curl);
+	if (mres != CURLM_OK) {
+		fprintf(stderr, "curl_multi_add_handle() failed: %s\n",
+				curl_multi_strerror(mres));
+		trace_tail_release(run->curl);
+		curl_easy_cleanup(run->curl);
+		free(run);
+		return RC_ERROR_IN_CURL;
+	}
+
+	/* The handle sends the profile's list until the run is done */
+	if (run->http_req_data.header_profile[0] != '\0') {
+		run->header_profile = headers_acquire(run->http_req_data.header_profile);
+	}
+
+	/* Link the run to the list of runs in progress */
+	run->next = g_runs;
+	if (g_runs != NULL) {
+		g_runs->prev = run;
+	}
+	g_runs = run;
+	g_num_of_runs++;
+
+	return RC_OK;
+}
+
+/**
+* @desc   Notify the library about activity on one of its sockets
+* @param  sockfd	Socket as received by ConnStatSocketCb
+* @param  events	Bitmask of CONNSTAT_EV_IN/OUT/ERR (0 if unknown)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_async_socket_action(int sockfd, int events) {
+	CURLMcode mres;
+	int running_handles;
+
+	if (g_multi == NULL) {
+		printf("connection_stats_async_socket_action() called before init \n");
+		return RC_ERROR;
+	}
+
+	/* Note: CONNSTAT_EV_* values are identical to CURL_CSELECT_* */
+	mres = curl_multi_socket_action(g_multi, (curl_socket_t)sockfd, events,
+									&running_handles);
+	if (mres != CURLM_OK) {
+		fprintf(stderr, "curl_multi_socket_action() failed: %s\n",
+				curl_multi_strerror(mres));
+		return RC_ERROR_IN_CURL;
+	}
+
+	check_multi_info();
+	return RC_OK;
+}
+
+/**
+* @desc   Notify the library that the timer armed by ConnStatTimerCb expired
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_async_timeout() {
+	return connection_stats_async_socket_action(CURL_SOCKET_TIMEOUT, 0);
+}
+
+/**
+* @desc   Get the number of submitted runs that were not completed yet
+* @param  num_of_runs	Number of runs in progress
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_async_runs_in_progress(int* num_of_runs) {
+	*num_of_runs = g_num_of_runs;
+	return RC_OK;
+}
+
+/**
+* @desc   Close the async engine. Runs in progress are aborted
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_async_close() {
+	if (g_multi == NULL) {
+		return RC_OK;
+	}
+
+	while (g_runs != NULL) {
+		curl_multi_remove_handle(g_multi, g_runs->curl);
+		finish_run(g_runs, RC_ERROR);
+	}
+
+	curl_multi_cleanup(g_multi);
+	g_multi = NULL;
+
+	return RC_OK;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * libCURL socket callback - forward to the caller's event loop
+ */
+static int socket_func(CURL *easy, curl_socket_t s, int what,
+					   void *userp, void *socketp) {
+	(void)easy;    /* prevent compiler warning */
+	(void)userp;   /* prevent compiler warning */
+	(void)socketp; /* prevent compiler warning */
+
+	/* Note: ConnStatPollEvent values are identical to CURL_POLL_* */
+	g_loop_cbs.socket_cb((int)s, (ConnStatPollEvent)what, g_loop_cbs.loop_data);
+	return 0;
+}
+
+/*
+ * libCURL timer callback - forward to the caller's event loop
+ */
+static int timer_func(CURLM *multi, long timeout_ms, void *userp) {
+	(void)multi; /* prevent compiler warning */
+	(void)userp; /* prevent compiler warning */
+
+	g_loop_cbs.timer_cb(timeout_ms, g_loop_cbs.loop_data);
+	return 0;
+}
+
+/*
+ * Handle all completed transfers: collect the sample and either start the
+ * next sample of the run or complete the run
+ */
+static void check_multi_info() {
+	CURLMsg *msg;
+	int msgs_left;
+
+	while ((msg = curl_multi_info_read(g_multi, &msgs_left)) != NULL) {
+		if (msg->msg != CURLMSG_DONE) {
+			continue;
+		}
+
+		/* Note: msg is not valid anymore once the handle is removed */
+		CURL *curl   = msg->easy_handle;
+		CURLcode res = msg->data.result;
+		AsyncRun *run;
+		curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&run);
+		curl_multi_remove_handle(g_multi, curl);
+
+		if (res != CURLE_OK) {
+			/* Keep going - failures are classified by the analysis */
+			fprintf(stderr, "async transfer failed: %s\n",
+					curl_easy_strerror(res));
+		}
+
+		/* Collect statistics (a failure marks the sample as failed) */
+		CurlInfo *curl_info = &run->curl_info_arr[run->num_of_samples];
+		connection_stats_collect(curl, res, curl_info);
+		if (run->run_cbs.sample_cb != NULL) {
+			run->run_cbs.sample_cb(&run->http_req_data, run->num_of_samples,
+								   curl_info, run->run_cbs.user_data);
+		}
+		samples_notify(&run->http_req_data, run->num_of_samples, curl_info);
+		run->num_of_samples++;
+
+		if (run->num_of_samples < run->http_req_data.num_of_http_req) {
+			start_next_sample(run, curl);
+			continue;
+		}
+
+		finish_run(run, RC_OK);
+	}
+}
+
+/*
+ * Start the next sample of a run, limited to the time left to its deadline.
+ * If the deadline passed, the samples left are timed out and the run is done
+ */
+static void start_next_sample(AsyncRun *run, CURL *curl) {
+	long remaining_ms = deadline_remaining_ms(&run->start, run->http_req_data.deadline_ms);
+
+	if (remaining_ms <= 0) {
+		while (run->num_of_samples < run->http_req_data.num_of_http_req) {
+			CurlInfo *curl_info = &run->curl_info_arr[run->num_of_samples];
+			timeouts_mark_skipped(curl_info);
+			if (run->run_cbs.sample_cb != NULL) {
+				run->run_cbs.sample_cb(&run->http_req_data, run->num_of_samples,
+									   curl_info, run->run_cbs.user_data);
+			}
+			samples_notify(&run->http_req_data, run->num_of_samples, curl_info);
+			run->num_of_samples++;
+		}
+		finish_run(run, RC_OK);
+		return;
+	}
+
+	/* Re-adding the same easy handle restarts the transfer */
+	if ((timeouts_arm(curl, run->http_req_data.timeout_ms, remaining_ms) != RC_OK) ||
+		(curl_multi_add_handle(g_multi, curl) != CURLM_OK)) {
+		finish_run(run, RC_ERROR_IN_CURL);
+	}
+}
+
+/*
+ * Report the run's result to the caller and release it
+ * (the run's easy handle must not be attached to the multi handle)
+ */
+static void finish_run(AsyncRun *run, RC rc) {
+	char output[MAX_SIZE_OF_PROG_OUTPUT];
+	ConnStatSummary summary;
+	RC output_rc;
+
+	memset(output, '\0', sizeof(output));
+	memset(&summary, 0, sizeof(summary));
+	if (run->num_of_samples > 0) {
+		output_rc = connection_stats_build_output(run->curl_info_arr,
+												  run->num_of_samples, output,
+												  &summary);
+		if (rc == RC_OK) {
+			rc = output_rc;
+		}
+		/* Handed on as any run's (aggregate, store, collector and snapshot) */
+		for (int i=0; i<run->num_of_samples; i++) {
+			connection_stats_record(run->http_req_data.url, &run->curl_info_arr[i]);
+		}
+		store_append(run->http_req_data.url, run->curl_info_arr, run->num_of_samples,
+					 &summary);
+		collector_send_run(run->http_req_data.url, run->curl_info_arr,
+						   run->num_of_samples);
+		snapshot_publish(run->http_req_data.url, rc, output, &summary);
+	}
+
+	/* Unlink from the list of runs in progress before calling the user,
+	   so the callback is allowed to submit new runs */
+	if (run->prev != NULL) {
+		run->prev->next = run->next;
+	} else {
+		g_runs = run->next;
+	}
+	if (run->next != NULL) {
+		run->next->prev = run->prev;
+	}
+	g_num_of_runs--;
+
+	run->run_cbs.run_cb(&run->http_req_data, rc, output, strlen(output),
+						&summary, run->run_cbs.user_data);
+
+	trace_tail_release(run->curl);
+	curl_easy_cleanup(run->curl);
+	headers_release(run->header_profile);
+	free(run);
+}
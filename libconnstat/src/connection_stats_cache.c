@@ -0,0 +1,526 @@
+/*
+ * connection_stats_cache.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Warm start cache of the libconnstat library.
+ * A short (e.g. cron style) process pays the full DNS (and TLS) cost on
+ * the first sample of every target. The cache file keeps what a process
+ * learned - resolved addresses (with their TTL) and TLS sessions of the
+ * probe engine - for the processes that follow:
+ *   - At connection_stats_set_cache_file() the file is memory mapped, and
+ *     its live (not expired) entries are loaded. Addresses are fed to every
+ *     transfer through CURLOPT_RESOLVE (and to the probe engine), so the
+ *     first sample starts warm.
+ *   - At connection_stats_close() the live entries are written to a
+ *     temporary file that is renamed over the cache file, so a concurrent
+ *     process maps either the old or the new file, never a torn one.
+ * A missing or damaged file is simply a cold start.
+ * Note: libCURL (7.x) can not import TLS sessions, so sessions are kept for
+ * the probe engine only.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define CACHE_FILE_MAGIC        "CSTCACHE"
+#define CACHE_FILE_VERSION      1
+#define CACHE_DEFAULT_TTL_SEC   60    /* Of addresses resolved without a TTL */
+#define CACHE_MAX_DATA_LEN      (16 * 1024)
+#define CACHE_PATH_MAX_LEN      256
+/* Open addressing hash of entry indexes, must be a power of 2 (2 x the table) */
+#define CACHE_NUM_OF_SLOTS      (2 * MAX_NUM_OF_CACHE_ENTRIES)
+#define CACHE_ALIGN(len)        (((len) + 7) & ~(size_t)7)
+
+
+/******************
+**  Structures   **
+******************/
+typedef enum {
+	CACHE_ENTRY_DNS = 1,   /* host:port -> addresses (CURLOPT_RESOLVE format) */
+	CACHE_ENTRY_TLS        /* ip:port -> TLS session (DER) */
+} CacheEntryType;
+
+/* A single cached entry */
+typedef struct {
+	CacheEntryType type;
+	char           host[URL_MAX_LEN];  /* Hostname (DNS) or IP (TLS) */
+	long           port;
+	long long      expires;            /* Wall clock (seconds since epoch) */
+	size_t         data_len;
+	unsigned char *data;               /* Addresses string (with its '\0') or DER */
+} CacheEntry;
+
+/* Header of the cache file */
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t num_of_records;
+} CacheFileHeader;
+
+/* A record of the cache file, followed by data_len bytes (padded to 8) */
+typedef struct {
+	uint32_t type;
+	uint32_t data_len;
+	int64_t  port;
+	int64_t  expires;
+	char     host[URL_MAX_LEN];
+} CacheFileRecord;
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Path of the cache file (empty if there is no cache) */
+static char g_cache_path[CACHE_PATH_MAX_LEN];
+
+/* Cached entries (allocated once a cache file is set) */
+static CacheEntry *g_entries = NULL;
+static int g_num_of_entries = 0;
+
+/* Hash slots holding indexes + 1 into g_entries (0 means empty slot) */
+static int *g_slots = NULL;
+
+/* A full cache is only reported once */
+static int g_full_warned = 0;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC load_file(const char *path);
+static CacheEntry* find_entry(CacheEntryType type, const char *host, long port,
+							  int *p_slot);
+static void store_entry(CacheEntryType type, const char *host, long port,
+						long long expires, const void *data, size_t data_len);
+static uint32_t hash_key(CacheEntryType type, const char *host, long port);
+static long long wall_sec();
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Keep a warm start cache in a file (see connection_stats.h)
+* @param  path		Cache file, NULL to stop caching
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_set_cache_file(const char* path) {
+	RC rc;
+
+	cache_reset();
+	if (path == NULL) {
+		return RC_OK;
+	}
+	if ((path[0] == '\0') || (strlen(path) >= CACHE_PATH_MAX_LEN)) {
+		printf("connection_stats_set_cache_file() fail with invalid path \n");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+
+	g_entries = calloc(MAX_NUM_OF_CACHE_ENTRIES, sizeof(CacheEntry));
+	g_slots   = calloc(CACHE_NUM_OF_SLOTS, sizeof(int));
+	if ((g_entries == NULL) || (g_slots == NULL)) {
+		fprintf(stderr, "calloc() failed\n");
+		cache_reset();
+		return RC_ERROR;
+	}
+	strcpy(g_cache_path, path);
+
+	rc = load_file(path);
+	if (rc != RC_OK) {
+		cache_reset();
+		return rc;
+	}
+
+	/* Following transfers start with the cached addresses */
+	return dns_feed_cached();
+}
+
+/*
+ * Non zero if a cache file is set
+ */
+int cache_is_enabled() {
+	return (g_entries != NULL);
+}
+
+/*
+ * Keep the addresses of host:port. ttl_sec 0 means an unknown TTL: a live
+ * entry is then kept as is (so reusing cached addresses never extends them)
+ */
+void cache_note_dns(const char *host, long port, const char *addrs, long ttl_sec) {
+	CacheEntry *entry;
+
+	if (!cache_is_enabled() || (addrs == NULL) || (addrs[0] == '\0')) {
+		return;
+	}
+	if (ttl_sec <= 0) {
+		entry = find_entry(CACHE_ENTRY_DNS, host, port, NULL);
+		if ((entry != NULL) && (entry->expires > wall_sec())) {
+			return;
+		}
+		ttl_sec = CACHE_DEFAULT_TTL_SEC;
+	}
+	store_entry(CACHE_ENTRY_DNS, host, port, wall_sec() + ttl_sec, addrs, strlen(addrs) + 1);
+}
+
+/*
+ * Keep the addresses that the last transfer of a handle connected to (its
+ * TTL is unknown). Only called for transfers that made a new connection
+ */
+void cache_note_transfer(CURL *curl) {
+	char *url = NULL;
+	char *ip = NULL;
+	char *host = NULL;
+	char addrs[MAX_SIZE_OF_IP_ADD + 2];
+	struct in6_addr addr;
+	long port = 0;
+	CURLU *curlu;
+
+	if ((curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url) != CURLE_OK) ||
+		(curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip) != CURLE_OK) ||
+		(curl_easy_getinfo(curl, CURLINFO_PRIMARY_PORT, &port) != CURLE_OK) ||
+		(url == NULL) || (ip == NULL) || (ip[0] == '\0')) {
+		return;
+	}
+	curlu = curl_url();
+	if (curlu == NULL) {
+		return;
+	}
+	if ((curl_url_set(curlu, CURLUPART_URL, url, 0) == CURLUE_OK) &&
+		(curl_url_get(curlu, CURLUPART_HOST, &host, 0) == CURLUE_OK) &&
+		(strlen(host) < URL_MAX_LEN) && (host[0] != '[') &&
+		(inet_pton(AF_INET, host, &addr) != 1)) {
+		/* IPv6 addresses are bracketed in CURLOPT_RESOLVE format */
+		snprintf(addrs, sizeof(addrs), (strchr(ip, ':') != NULL) ? "[%s]" : "%s", ip);
+		cache_note_dns(host, port, addrs, 0);
+	}
+	curl_free(host);
+	curl_url_cleanup(curlu);
+}
+
+/*
+ * Get the live addresses of host:port (CURLOPT_RESOLVE format), NULL if none
+ */
+const char* cache_get_dns(const char *host, long port) {
+	CacheEntry *entry;
+
+	if (!cache_is_enabled()) {
+		return NULL;
+	}
+	entry = find_entry(CACHE_ENTRY_DNS, host, port, NULL);
+	if ((entry == NULL) || (entry->expires <= wall_sec())) {
+		return NULL;
+	}
+	return (const char *)entry->data;
+}
+
+/*
+ * Call cb for every live host:port -> addresses entry
+ */
+RC cache_for_each_dns(RC (*cb)(const char *host, long port, const char *addrs)) {
+	long long now = wall_sec();
+
+	for (int i=0; i<g_num_of_entries; i++) {
+		CacheEntry *entry = &g_entries[i];
+		if ((entry->type == CACHE_ENTRY_DNS) && (entry->expires > now)) {
+			RC rc = cb(entry->host, entry->port, (const char *)entry->data);
+			if (rc != RC_OK) {
+				return rc;
+			}
+		}
+	}
+	return RC_OK;
+}
+
+/*
+ * Keep the TLS session (DER) of ip:port
+ */
+void cache_note_tls(const char *ip, long port, const unsigned char *session,
+					size_t session_len, long ttl_sec) {
+	if (!cache_is_enabled() || (session_len == 0) || (ttl_sec <= 0)) {
+		return;
+	}
+	store_entry(CACHE_ENTRY_TLS, ip, port, wall_sec() + ttl_sec, session, session_len);
+}
+
+/*
+ * Get the live TLS session (DER) of ip:port, NULL if none
+ */
+const unsigned char* cache_get_tls(const char *ip, long port, size_t *p_session_len) {
+	CacheEntry *entry;
+
+	if (!cache_is_enabled()) {
+		return NULL;
+	}
+	entry = find_entry(CACHE_ENTRY_TLS, ip, port, NULL);
+	if ((entry == NULL) || (entry->expires <= wall_sec())) {
+		return NULL;
+	}
+	*p_session_len = entry->data_len;
+	return entry->data;
+}
+
+/*
+ * Write the live entries to the cache file (atomically - to a temporary
+ * file first, that is then renamed over it)
+ */
+RC cache_save() {
+	char tmp_path[CACHE_PATH_MAX_LEN + 16];
+	static const char padding[8];
+	CacheFileHeader header;
+	long long now = wall_sec();
+	FILE *file;
+	int ok;
+
+	if (!cache_is_enabled()) {
+		return RC_OK;
+	}
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", g_cache_path, (int)getpid());
+	file = fopen(tmp_path, "wb");
+	if (file == NULL) {
+		printf("cache_save() fail to open %s \n", tmp_path);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_FILE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_FILE_VERSION;
+	for (int i=0; i<g_num_of_entries; i++) {
+		header.num_of_records += (g_entries[i].expires > now);
+	}
+	ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+	for (int i=0; ok && (i<g_num_of_entries); i++) {
+		CacheEntry *entry = &g_entries[i];
+		CacheFileRecord record;
+		size_t padding_len = CACHE_ALIGN(entry->data_len) - entry->data_len;
+
+		if (entry->expires <= now) {
+			continue;
+		}
+		memset(&record, 0, sizeof(record));
+		record.type     = entry->type;
+		record.data_len = (uint32_t)entry->data_len;
+		record.port     = entry->port;
+		record.expires  = entry->expires;
+		strcpy(record.host, entry->host);
+		ok = (fwrite(&record, sizeof(record), 1, file) == 1) &&
+			 (fwrite(entry->data, entry->data_len, 1, file) == 1) &&
+			 ((padding_len == 0) || (fwrite(padding, padding_len, 1, file) == 1));
+	}
+
+	/* The data must be on disk before the rename makes it the cache file */
+	ok = ok && (fflush(file) == 0) && (fsync(fileno(file)) == 0);
+	ok = (fclose(file) == 0) && ok;
+	if (!ok || (rename(tmp_path, g_cache_path) == -1)) {
+		printf("cache_save() fail to write %s \n", g_cache_path);
+		unlink(tmp_path);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	return RC_OK;
+}
+
+/*
+ * Forget the cache (without writing it)
+ */
+void cache_reset() {
+	if (g_entries != NULL) {
+		for (int i=0; i<g_num_of_entries; i++) {
+			free(g_entries[i].data);
+		}
+	}
+	free(g_entries);
+	free(g_slots);
+	g_entries = NULL;
+	g_slots = NULL;
+	g_num_of_entries = 0;
+	g_full_warned = 0;
+	g_cache_path[0] = '\0';
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Load the live entries of a cache file (a missing or damaged file is a
+ * cold start)
+ */
+static RC load_file(const char *path) {
+	const CacheFileHeader *header;
+	const unsigned char *map;
+	long long now = wall_sec();
+	struct stat st;
+	size_t offset;
+	int num_of_loaded = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		if (errno == ENOENT) {
+			return RC_OK;
+		}
+		perror("open() cache file");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	if ((fstat(fd, &st) == -1) || ((size_t)st.st_size < sizeof(CacheFileHeader))) {
+		printf("connection_stats_set_cache_file() ignores damaged cache %s \n", path);
+		close(fd);
+		return RC_OK;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap() cache file");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+
+	header = (const CacheFileHeader *)map;
+	if ((memcmp(header->magic, CACHE_FILE_MAGIC, sizeof(header->magic)) != 0) ||
+		(header->version != CACHE_FILE_VERSION)) {
+		printf("connection_stats_set_cache_file() ignores damaged cache %s \n", path);
+		munmap((void *)map, st.st_size);
+		return RC_OK;
+	}
+
+	offset = sizeof(CacheFileHeader);
+	for (uint32_t i=0; i<header->num_of_records; i++) {
+		const CacheFileRecord *record = (const CacheFileRecord *)(map + offset);
+
+		if ((offset + sizeof(CacheFileRecord) > (size_t)st.st_size) ||
+			(record->data_len == 0) || (record->data_len > CACHE_MAX_DATA_LEN) ||
+			(offset + sizeof(CacheFileRecord) + record->data_len > (size_t)st.st_size) ||
+			((record->type != CACHE_ENTRY_DNS) && (record->type != CACHE_ENTRY_TLS)) ||
+			(memchr(record->host, '\0', URL_MAX_LEN) == NULL) ||
+			((record->type == CACHE_ENTRY_DNS) &&
+			 (map[offset + sizeof(CacheFileRecord) + record->data_len - 1] != '\0'))) {
+			printf("connection_stats_set_cache_file() ignores the damaged end of cache %s \n",
+					path);
+			break;
+		}
+		if (record->expires > now) {
+			store_entry(record->type, record->host, record->port, record->expires,
+						map + offset + sizeof(CacheFileRecord), record->data_len);
+			num_of_loaded++;
+		}
+		offset += sizeof(CacheFileRecord) + CACHE_ALIGN(record->data_len);
+	}
+	munmap((void *)map, st.st_size);
+
+	printf("connection_stats_set_cache_file() loaded %d entries of %s \n",
+		   num_of_loaded, path);
+	return RC_OK;
+}
+
+/*
+ * Find an entry by its key (NULL if none). p_slot (if set) is set to the
+ * hash slot of the entry, or to the empty slot it would take
+ */
+static CacheEntry* find_entry(CacheEntryType type, const char *host, long port,
+							  int *p_slot) {
+	uint32_t hash = hash_key(type, host, port);
+
+	for (int i=0; i<CACHE_NUM_OF_SLOTS; i++) {
+		int slot = (hash + i) & (CACHE_NUM_OF_SLOTS - 1);
+		CacheEntry *entry;
+
+		if (g_slots[slot] == 0) {
+			if (p_slot != NULL) {
+				*p_slot = slot;
+			}
+			return NULL;
+		}
+		entry = &g_entries[g_slots[slot] - 1];
+		if ((entry->type == type) && (entry->port == port) &&
+			(strcmp(entry->host, host) == 0)) {
+			if (p_slot != NULL) {
+				*p_slot = slot;
+			}
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add an entry, or replace the data of an existing one
+ */
+static void store_entry(CacheEntryType type, const char *host, long port,
+						long long expires, const void *data, size_t data_len) {
+	CacheEntry *entry;
+	unsigned char *copy;
+	int slot = -1;
+
+	if ((host == NULL) || (host[0] == '\0') || (strlen(host) >= URL_MAX_LEN) ||
+		(data_len > CACHE_MAX_DATA_LEN)) {
+		return;
+	}
+	copy = malloc(data_len);
+	if (copy == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		return;
+	}
+	memcpy(copy, data, data_len);
+
+	entry = find_entry(type, host, port, &slot);
+	if (entry == NULL) {
+		if ((slot == -1) || (g_num_of_entries == MAX_NUM_OF_CACHE_ENTRIES)) {
+			if (!g_full_warned) {
+				printf("cache is full, %s:%ld (and further entries) is not cached \n",
+						host, port);
+				g_full_warned = 1;
+			}
+			free(copy);
+			return;
+		}
+		entry = &g_entries[g_num_of_entries++];
+		g_slots[slot] = g_num_of_entries;
+		entry->type = type;
+		strcpy(entry->host, host);
+		entry->port = port;
+	}
+	free(entry->data);
+	entry->data     = copy;
+	entry->data_len = data_len;
+	entry->expires  = expires;
+}
+
+/*
+ * FNV-1a of a key
+ */
+static uint32_t hash_key(CacheEntryType type, const char *host, long port) {
+	uint32_t hash = 2166136261u;
+
+	for (const unsigned char *p = (const unsigned char *)host; *p != '\0'; p++) {
+		hash = (hash ^ *p) * 16777619u;
+	}
+	hash = (hash ^ (uint32_t)port) * 16777619u;
+	return (hash ^ (uint32_t)type) * 16777619u;
+}
+
+/*
+ * Wall clock, in seconds (cache entries outlive the process)
+ */
+static long long wall_sec() {
+	return (long long)time(NULL);
+}
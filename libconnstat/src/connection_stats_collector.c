@@ -0,0 +1,572 @@
+/*
+ * connection_stats_collector.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Collector of the libconnstat library.
+ * Many (short lived) measuring processes on a host stream the samples of
+ * their runs to a single collector over a Unix domain datagram socket, and
+ * the collector merges them per URL into its aggregate (see
+ * connection_stats_aggregate.c), which it serves on request.
+ * Samples travel as fixed size binary records, batched per URL (a datagram
+ * carries up to COLLECTOR_MAX_BATCH of them), so a run costs a single
+ * system call. The collector receives a burst of datagrams per system call
+ * (recvmmsg) into buffers allocated once, and records every sample out of
+ * the receive buffer - its fields are copied into a single CurlInfo on the
+ * stack (nothing is allocated nor parsed as text).
+ * Datagrams keep message boundaries and are reliable on a Unix socket: a
+ * sender whose collector falls behind waits (up to COLLECTOR_SEND_TIMEOUT_MS)
+ * instead of losing samples.
+ * A restarted collector binds a new socket, which the connected socket of a
+ * sender does not reach. A sender whose collector is gone reconnects, at
+ * most once per backoff (COLLECTOR_RECONNECT_MIN_MS, doubled up to
+ * COLLECTOR_RECONNECT_MAX_MS while the collector stays gone), and the
+ * samples of the runs in between are lost.
+ */
+
+/******************
+**   Includes    **
+******************/
+#define _GNU_SOURCE         // recvmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/un.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define COLLECTOR_MAGIC             0x434E5343  /* "CSNC" */
+#define COLLECTOR_VERSION           1
+#define COLLECTOR_MAX_BATCH         256   /* Records per datagram */
+#define COLLECTOR_RECV_BURST        64    /* Datagrams per recvmmsg */
+#define COLLECTOR_SEND_TIMEOUT_MS   100
+#define COLLECTOR_QUERY_TIMEOUT_MS  1000
+#define COLLECTOR_POLL_MS           100   /* Serving loop checks stop this often */
+#define COLLECTOR_RECONNECT_MIN_MS  100
+#define COLLECTOR_RECONNECT_MAX_MS  5000
+
+
+/******************
+**  Structures   **
+******************/
+typedef enum {
+	COLLECTOR_MSG_SAMPLES = 1,  /* Header + num_of_records CollectorRecord */
+	COLLECTOR_MSG_QUERY,        /* Header only (the URL to be queried) */
+	COLLECTOR_MSG_SUMMARY       /* Header + CollectorSummary (answer to a query) */
+} CollectorMsgType;
+
+/* Header of every datagram */
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t type;
+	uint32_t num_of_records;
+	uint32_t reserved;
+	char     url[URL_MAX_LEN];
+} CollectorHeader;
+
+/* A single sample on the wire */
+typedef struct {
+	int64_t  timestamp_us;
+	double   name_lookup_time;
+	double   connect_time;
+	double   start_transfer_time;
+	double   total_time;
+	int32_t  curl_code;
+	int32_t  response_code;
+	uint16_t redirect_count;
+	uint16_t num_of_connects;
+	uint32_t reserved;
+} CollectorRecord;
+
+/* Answer to a query */
+typedef struct {
+	int32_t         rc;
+	uint32_t        reserved;
+	ConnStatSummary summary;
+} CollectorSummary;
+
+/* Largest datagram (of either kind) */
+#define COLLECTOR_MAX_DGRAM_SIZE  (sizeof(CollectorHeader) + \
+	((COLLECTOR_MAX_BATCH * sizeof(CollectorRecord) > sizeof(CollectorSummary)) ? \
+	 COLLECTOR_MAX_BATCH * sizeof(CollectorRecord) : sizeof(CollectorSummary)))
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Collector streamed to (sun_family 0 if not streaming) */
+static struct sockaddr_un g_collector_addr;
+
+/* Socket connected to the collector (-1 if not streaming, or disconnected) */
+static int g_collector_sock = -1;
+
+/* No reconnect before (monotonic ms), and the backoff after the next failure */
+static long long g_reconnect_at_ms = 0;
+static long g_reconnect_backoff_ms = COLLECTOR_RECONNECT_MIN_MS;
+
+/* A failure to stream is reported once per disconnection */
+static int g_send_warned = 0;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC set_address(const char *path, struct sockaddr_un *addr);
+static int open_socket(long timeout_ms, int is_send);
+static int send_datagram(const void *dgram, size_t len);
+static int connect_collector();
+static int is_disconnected(int err);
+static long long now_ms();
+static void header_init(CollectorHeader *header, CollectorMsgType type, const char *url,
+						uint32_t num_of_records);
+static int header_is_valid(const CollectorHeader *header, size_t len);
+static void handle_datagram(int sock, unsigned char *buf, size_t len,
+							const struct sockaddr_un *from, socklen_t from_len,
+							long long *p_num_of_records);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Stream the samples of following runs to a collector
+*         (see connection_stats.h)
+* @param  path		Socket of the collector, NULL to stop streaming
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_collector_connect(const char* path) {
+	RC rc;
+
+	collector_reset();
+	if (path == NULL) {
+		return RC_OK;
+	}
+	rc = set_address(path, &g_collector_addr);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	if (!connect_collector()) {
+		perror("connect() to collector");
+		memset(&g_collector_addr, 0, sizeof(g_collector_addr));
+		return RC_ERROR;
+	}
+	return RC_OK;
+}
+
+/**
+* @desc   Stream samples of a URL to the collector (see connection_stats.h)
+* @param  url				URL the samples were taken of
+* @param  curl_info_arr		Samples
+* @param  arr_size			Number of samples in curl_info_arr
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_collector_send(const char* url, const CurlInfo* curl_info_arr,
+								   int arr_size) {
+	struct {
+		CollectorHeader header;
+		CollectorRecord records[COLLECTOR_MAX_BATCH];
+	} dgram;
+
+	if ((url == NULL) || (curl_info_arr == NULL) || (arr_size < 0)) {
+		return RC_ERROR;
+	}
+	if (g_collector_addr.sun_family != AF_UNIX) {
+		printf("connection_stats_collector_send() called before connecting \n");
+		return RC_ERROR;
+	}
+
+	for (int first=0; first<arr_size; first+=COLLECTOR_MAX_BATCH) {
+		int num_of_records = arr_size - first;
+		size_t len;
+
+		if (num_of_records > COLLECTOR_MAX_BATCH) {
+			num_of_records = COLLECTOR_MAX_BATCH;
+		}
+		header_init(&dgram.header, COLLECTOR_MSG_SAMPLES, url, num_of_records);
+		for (int i=0; i<num_of_records; i++) {
+			const CurlInfo *curl_info = &curl_info_arr[first + i];
+			CollectorRecord *record = &dgram.records[i];
+
+			record->timestamp_us        = curl_info->timestamp_us;
+			record->name_lookup_time    = curl_info->name_lookup_time;
+			record->connect_time        = curl_info->connect_time;
+			record->start_transfer_time = curl_info->start_transfer_time;
+			record->total_time          = curl_info->total_time;
+			record->curl_code           = curl_info->curl_code;
+			record->response_code       = (int32_t)curl_info->response_code;
+			record->redirect_count      = curl_info->redirect_count;
+			record->num_of_connects     = curl_info->num_of_connects;
+			record->reserved            = 0;
+		}
+
+		len = sizeof(CollectorHeader) + num_of_records * sizeof(CollectorRecord);
+		if (!send_datagram(&dgram, len)) {
+			return RC_ERROR;
+		}
+	}
+	return RC_OK;
+}
+
+/**
+* @desc   Get the aggregate of a URL from a collector (see connection_stats.h)
+* @param  path		Socket of the collector
+* @param  url		URL as streamed
+* @param  summary	Summary to be filled
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_collector_query(const char* path, const char* url,
+									ConnStatSummary* summary) {
+	struct {
+		CollectorHeader  header;
+		CollectorSummary answer;
+	} dgram;
+	struct sockaddr_un addr;
+	sa_family_t autobind = AF_UNIX;
+	ssize_t len;
+	int sock;
+	RC rc;
+
+	if ((url == NULL) || (summary == NULL)) {
+		return RC_ERROR;
+	}
+	rc = set_address(path, &addr);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	sock = open_socket(COLLECTOR_QUERY_TIMEOUT_MS, 0);
+	if (sock == -1) {
+		return RC_ERROR;
+	}
+
+	/* The collector answers to the (abstract, auto bound) address of the query */
+	header_init(&dgram.header, COLLECTOR_MSG_QUERY, url, 0);
+	if ((bind(sock, (struct sockaddr *)&autobind, sizeof(autobind)) == -1) ||
+		(sendto(sock, &dgram.header, sizeof(CollectorHeader), 0,
+				(struct sockaddr *)&addr, sizeof(addr)) == -1)) {
+		perror("connection_stats_collector_query()");
+		close(sock);
+		return RC_ERROR;
+	}
+	len = recv(sock, &dgram, sizeof(dgram), 0);
+	close(sock);
+	if ((len != (ssize_t)sizeof(dgram)) || !header_is_valid(&dgram.header, len) ||
+		(dgram.header.type != COLLECTOR_MSG_SUMMARY)) {
+		printf("connection_stats_collector_query() no answer from %s \n", path);
+		return RC_ERROR;
+	}
+	if (dgram.answer.rc == RC_OK) {
+		*summary = dgram.answer.summary;
+	}
+	return dgram.answer.rc;
+}
+
+/**
+* @desc   Serve as the collector (see connection_stats.h)
+* @param  path		Socket to be served (replaced if it exists)
+* @param  stop		Serving ends once *stop is set (e.g. by a signal handler)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_collector_serve(const char* path, volatile int* stop) {
+	struct mmsghdr msgs[COLLECTOR_RECV_BURST];
+	struct iovec iovs[COLLECTOR_RECV_BURST];
+	struct sockaddr_un froms[COLLECTOR_RECV_BURST];
+	struct sockaddr_un addr;
+	unsigned char *bufs;
+	long long num_of_records = 0;
+	long long num_of_dgrams = 0;
+	int sock;
+	RC rc;
+
+	if (stop == NULL) {
+		return RC_ERROR;
+	}
+	rc = set_address(path, &addr);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	bufs = malloc((size_t)COLLECTOR_RECV_BURST * COLLECTOR_MAX_DGRAM_SIZE);
+	if (bufs == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		return RC_ERROR;
+	}
+	sock = open_socket(COLLECTOR_POLL_MS, 0);
+	if (sock == -1) {
+		free(bufs);
+		return RC_ERROR;
+	}
+	unlink(path);  /* Left by a previous collector */
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		perror("bind() collector");
+		close(sock);
+		free(bufs);
+		return RC_ERROR;
+	}
+	printf("connection_stats_collector_serve() serving %s \n", path);
+
+	while (!*stop) {
+		int num_of_msgs;
+
+		/* The receive buffers are set up once, recvmmsg only resets lengths */
+		for (int i=0; i<COLLECTOR_RECV_BURST; i++) {
+			iovs[i].iov_base = bufs + (size_t)i * COLLECTOR_MAX_DGRAM_SIZE;
+			iovs[i].iov_len  = COLLECTOR_MAX_DGRAM_SIZE;
+			memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+			msgs[i].msg_hdr.msg_iov     = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen  = 1;
+			msgs[i].msg_hdr.msg_name    = &froms[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(froms[i]);
+		}
+		num_of_msgs = recvmmsg(sock, msgs, COLLECTOR_RECV_BURST, MSG_WAITFORONE, NULL);
+		if (num_of_msgs == -1) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+				continue;  /* Idle - check stop */
+			}
+			perror("recvmmsg() collector");
+			rc = RC_ERROR;
+			break;
+		}
+		for (int i=0; i<num_of_msgs; i++) {
+			handle_datagram(sock, iovs[i].iov_base, msgs[i].msg_len, &froms[i],
+							msgs[i].msg_hdr.msg_namelen, &num_of_records);
+		}
+		num_of_dgrams += num_of_msgs;
+	}
+
+	printf("connection_stats_collector_serve() collected %lld samples (%lld datagrams) \n",
+		   num_of_records, num_of_dgrams);
+	close(sock);
+	unlink(path);
+	free(bufs);
+	return rc;
+}
+
+/*
+ * Stream the samples of a run (if streaming)
+ */
+void collector_send_run(const char *url, const CurlInfo *curl_info_arr, int arr_size) {
+	if (g_collector_addr.sun_family == AF_UNIX) {
+		connection_stats_collector_send(url, curl_info_arr, arr_size);
+	}
+}
+
+/*
+ * Stop streaming
+ */
+void collector_reset() {
+	if (g_collector_sock != -1) {
+		close(g_collector_sock);
+		g_collector_sock = -1;
+	}
+	memset(&g_collector_addr, 0, sizeof(g_collector_addr));
+	g_reconnect_at_ms = 0;
+	g_reconnect_backoff_ms = COLLECTOR_RECONNECT_MIN_MS;
+	g_send_warned = 0;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Build the address of a collector socket
+ */
+static RC set_address(const char *path, struct sockaddr_un *addr) {
+	if ((path == NULL) || (path[0] == '\0') || (strlen(path) >= sizeof(addr->sun_path))) {
+		printf("Invalid collector socket %s \n", (path != NULL) ? path : "NULL");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return RC_OK;
+}
+
+/*
+ * Open a datagram socket whose sends (or receives) time out after timeout_ms
+ */
+static int open_socket(long timeout_ms, int is_send) {
+	struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+	int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+	if (sock == -1) {
+		perror("socket() collector");
+		return -1;
+	}
+	if (setsockopt(sock, SOL_SOCKET, is_send ? SO_SNDTIMEO : SO_RCVTIMEO,
+				   &tv, sizeof(tv)) == -1) {
+		perror("setsockopt() collector");
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+/*
+ * Send a datagram to the collector streamed to. A collector that is gone
+ * (e.g. restarted) is reconnected, unless backing off, and the datagram is
+ * sent once more
+ * @return non zero if sent
+ */
+static int send_datagram(const void *dgram, size_t len) {
+	ssize_t sent;
+
+	for (int attempt=0; attempt<2; attempt++) {
+		if ((g_collector_sock == -1) &&
+			((now_ms() < g_reconnect_at_ms) || !connect_collector())) {
+			return 0;  /* The collector misses the samples until reconnected */
+		}
+		do {
+			sent = send(g_collector_sock, dgram, len, 0);
+		} while ((sent == -1) && (errno == EINTR));  /* Interrupted while waiting */
+		if (sent == (ssize_t)len) {
+			return 1;
+		}
+		int err = errno;
+		if (!g_send_warned) {
+			/* Measure anyway, the collector just misses these samples */
+			perror("send() to collector");
+			g_send_warned = 1;
+		}
+		if (!is_disconnected(err)) {
+			return 0;
+		}
+		close(g_collector_sock);
+		g_collector_sock = -1;
+	}
+	return 0;
+}
+
+/*
+ * Connect a socket to the collector streamed to (g_collector_addr). A failure
+ * backs the next attempt off, and leaves errno as set by the failure
+ * @return non zero if connected
+ */
+static int connect_collector() {
+	int sock = open_socket(COLLECTOR_SEND_TIMEOUT_MS, 1);
+
+	if ((sock != -1) &&
+		(connect(sock, (struct sockaddr *)&g_collector_addr, sizeof(g_collector_addr)) == 0)) {
+		if (g_send_warned) {
+			printf("Reconnected to collector %s \n", g_collector_addr.sun_path);
+			g_send_warned = 0;
+		}
+		g_collector_sock = sock;
+		g_reconnect_backoff_ms = COLLECTOR_RECONNECT_MIN_MS;
+		return 1;
+	}
+	if (sock != -1) {
+		int err = errno;
+
+		close(sock);
+		errno = err;
+	}
+	g_reconnect_at_ms = now_ms() + g_reconnect_backoff_ms;
+	g_reconnect_backoff_ms *= 2;
+	if (g_reconnect_backoff_ms > COLLECTOR_RECONNECT_MAX_MS) {
+		g_reconnect_backoff_ms = COLLECTOR_RECONNECT_MAX_MS;
+	}
+	return 0;
+}
+
+/*
+ * Non zero if a send failed since the collector it was connected to is gone
+ */
+static int is_disconnected(int err) {
+	return (err == ECONNREFUSED) || (err == ENOTCONN) || (err == EPIPE) ||
+		   (err == ENOENT);
+}
+
+/*
+ * Monotonic clock in milliseconds
+ */
+static long long now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Fill the header of a datagram
+ */
+static void header_init(CollectorHeader *header, CollectorMsgType type, const char *url,
+						uint32_t num_of_records) {
+	memset(header, 0, sizeof(CollectorHeader));
+	header->magic          = COLLECTOR_MAGIC;
+	header->version        = COLLECTOR_VERSION;
+	header->type           = type;
+	header->num_of_records = num_of_records;
+	strncpy(header->url, url, URL_MAX_LEN - 1);
+}
+
+/*
+ * Non zero if a received datagram (len bytes) starts with a valid header
+ */
+static int header_is_valid(const CollectorHeader *header, size_t len) {
+	return (len >= sizeof(CollectorHeader)) && (header->magic == COLLECTOR_MAGIC) &&
+		   (header->version == COLLECTOR_VERSION) &&
+		   (memchr(header->url, '\0', URL_MAX_LEN) != NULL);
+}
+
+/*
+ * Handle a single datagram received by the collector: record its samples
+ * (through a CurlInfo on the stack), or answer its query
+ */
+static void handle_datagram(int sock, unsigned char *buf, size_t len,
+							const struct sockaddr_un *from, socklen_t from_len,
+							long long *p_num_of_records) {
+	const CollectorHeader *header = (const CollectorHeader *)buf;
+
+	if (!header_is_valid(header, len)) {
+		return;  /* Not ours */
+	}
+
+	if (header->type == COLLECTOR_MSG_SAMPLES) {
+		const CollectorRecord *records = (const CollectorRecord *)(header + 1);
+		CurlInfo curl_info;
+
+		if ((header->num_of_records > COLLECTOR_MAX_BATCH) ||
+			(len != sizeof(CollectorHeader) + header->num_of_records * sizeof(CollectorRecord))) {
+			return;
+		}
+		memset(&curl_info, 0, sizeof(curl_info));
+		for (uint32_t i=0; i<header->num_of_records; i++) {
+			curl_info.timestamp_us        = records[i].timestamp_us;
+			curl_info.name_lookup_time    = records[i].name_lookup_time;
+			curl_info.connect_time        = records[i].connect_time;
+			curl_info.start_transfer_time = records[i].start_transfer_time;
+			curl_info.total_time          = records[i].total_time;
+			curl_info.curl_code           = records[i].curl_code;
+			curl_info.response_code       = records[i].response_code;
+			curl_info.redirect_count      = records[i].redirect_count;
+			curl_info.num_of_connects     = records[i].num_of_connects;
+			connection_stats_record(header->url, &curl_info);
+		}
+		*p_num_of_records += header->num_of_records;
+
+	} else if ((header->type == COLLECTOR_MSG_QUERY) && (from_len > sizeof(sa_family_t))) {
+		/* The answer reuses the receive buffer (the query is no longer needed) */
+		CollectorHeader *answer_header = (CollectorHeader *)buf;
+		CollectorSummary *answer = (CollectorSummary *)(answer_header + 1);
+		char url[URL_MAX_LEN];
+
+		strcpy(url, header->url);
+		memset(answer, 0, sizeof(CollectorSummary));
+		answer->rc = connection_stats_get_aggregate(url, &answer->summary);
+		header_init(answer_header, COLLECTOR_MSG_SUMMARY, url, 0);
+		sendto(sock, buf, sizeof(CollectorHeader) + sizeof(CollectorSummary), MSG_DONTWAIT,
+			   (const struct sockaddr *)from, from_len);
+	}
+}
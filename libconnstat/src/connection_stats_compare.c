@@ -0,0 +1,298 @@
+/*
+ * connection_stats_compare.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * A/B comparison mode of the libconnstat library.
+ * Two separate runs are taken at different times, so network drift easily
+ * dominates the difference between them. Here the samples of both variants
+ * are interleaved in pairs, each variant on its own (warm) handle, and the
+ * order within a pair alternates (A,B then B,A) so neither variant always
+ * goes first.
+ * The variants are compared with a Mann-Whitney U test on total_time, kept
+ * up to date as samples come: the successful samples of each variant are in
+ * a log-linear histogram, a new sample adds the samples of the other variant
+ * below its bucket (and half of those in its bucket) to U, and samples in
+ * the same bucket are ties. The test is looked at after 10, 20, 40, ...
+ * samples of each variant, look k at alpha/2^k (the looks spend alpha/2 +
+ * alpha/4 + ... < alpha), so the comparison can stop at the first
+ * significant look without inflating the false positive rate.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define COMPARE_FIRST_LOOK      10  /* Samples of each variant at the first look */
+#define COMPARE_MIN_SAMPLES     5   /* Before the test is looked at all */
+
+
+/******************
+**  Structures   **
+******************/
+/* A single variant of a comparison */
+typedef struct {
+	HttpReqData      *p_http_req_data;
+	CURL             *curl;
+	CurlInfo         *curl_info_arr;  /* num_of_http_req entries */
+	int               num_of_samples; /* Samples taken so far */
+	LatencyHistogram  hist;           /* total_time of the successful samples */
+} CompareVariant;
+
+/* Streaming Mann-Whitney test of A against B */
+typedef struct {
+	double u_a;      /* Pairs (a,b) where a is slower than b, ties count half */
+	double tie_sum;  /* Sum of t^3-t over the buckets (t samples of both) */
+} MannWhitney;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static void mann_whitney_add(MannWhitney *test, CompareVariant *variants, int v,
+							 double value);
+static double mann_whitney_look(const MannWhitney *test, const CompareVariant *variants,
+								ConnStatCompareResult *result);
+static void finish_variant(CompareVariant *variant, ConnStatSweepResult *result);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Compare total_time of two variants (see connection_stats.h)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_compare(HttpReqData* variants, double alpha,
+							long deadline_ms, ConnStatCompareResult* result) {
+	CompareVariant compare_variants[2];
+	MannWhitney test;
+	struct timespec start;
+	double look_alpha;
+	int next_look = COMPARE_FIRST_LOOK;
+	int looked_at = 0;
+	RC rc = RC_OK;
+	int v, j;
+
+	if (alpha == 0) {
+		alpha = DEFAULT_COMPARE_ALPHA;
+	}
+	if ((variants == NULL) || (result == NULL) || (alpha < 0) || (alpha >= 1) ||
+		(deadline_ms < 0)) {
+		printf("connection_stats_compare() fail with invalid arguments [alpha=%f, "
+			   "deadline_ms=%ld]\n", alpha, deadline_ms);
+		return RC_ERROR;
+	}
+	for (v=0; v<2; v++) {
+		HttpReqData http_req_data = variants[v];
+
+		if ((variants[v].num_of_http_req <= 0) ||
+			(variants[v].num_of_http_req > MAX_NUM_OF_COMPARE_SAMPLES)) {
+			printf("Requested number of HTTP requests (%d) must be in range [1:%d] \n",
+				   variants[v].num_of_http_req, MAX_NUM_OF_COMPARE_SAMPLES);
+			return RC_INVALID_NUM_OF_HTTP_REQ;
+		}
+		/* The budget is validated above, the rest as any target */
+		http_req_data.num_of_http_req = 1;
+		rc = is_valid_http_data_req(&http_req_data);
+		if (rc != RC_OK) {
+			return rc;
+		}
+		if (variants[v].multiplex || (variants[v].mode != CONNSTAT_MODE_LATENCY) ||
+			(variants[v].ci_width > 0)) {
+			printf("connection_stats_compare() supports sequential latency variants only \n");
+			return RC_NOT_SUPPORTED;
+		}
+	}
+
+	memset(compare_variants, 0, sizeof(compare_variants));
+	memset(&test, 0, sizeof(test));
+	memset(result, 0, sizeof(ConnStatCompareResult));
+	result->p_value = 1;
+	result->faster = -1;
+
+	/* A handle per variant, so neither reuses the connections of the other */
+	for (v=0; v<2; v++) {
+		compare_variants[v].p_http_req_data = &variants[v];
+		compare_variants[v].curl_info_arr = calloc(variants[v].num_of_http_req,
+												   sizeof(CurlInfo));
+		if (compare_variants[v].curl_info_arr == NULL) {
+			fprintf(stderr, "calloc() failed\n");
+			rc = RC_ERROR;
+			goto cleanup;
+		}
+		compare_variants[v].curl = curl_easy_init();
+		if (compare_variants[v].curl == NULL) {
+			printf("connection_stats_compare() fail with curl_easy_init() \n");
+			rc = RC_ERROR_IN_CURL;
+			goto cleanup;
+		}
+		rc = connection_stats_setup_handle(compare_variants[v].curl, &variants[v]);
+		if (rc != RC_OK) {
+			goto cleanup;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int pair=0; !result->significant; pair++) {
+		int num_of_taken = 0;
+
+		for (j=0; j<2; j++) {
+			CompareVariant *variant = &compare_variants[(pair % 2 == 0) ? j : 1 - j];
+			long remaining_ms = deadline_remaining_ms(&start, deadline_ms);
+
+			if ((variant->num_of_samples == variant->p_http_req_data->num_of_http_req) ||
+				(remaining_ms <= 0)) {
+				continue;
+			}
+			timeouts_arm(variant->curl, variant->p_http_req_data->timeout_ms, remaining_ms);
+			long nivcsw = affinity_get_nivcsw();
+			CurlInfo *curl_info = &variant->curl_info_arr[variant->num_of_samples++];
+			transport_perform(variant->curl, variant->p_http_req_data, curl_info);
+			curl_info->involuntary_ctx_switches = affinity_get_nivcsw() - nivcsw;
+			samples_notify(variant->p_http_req_data, variant->num_of_samples - 1, curl_info);
+			num_of_taken++;
+
+			if (connection_stats_is_success(curl_info)) {
+				mann_whitney_add(&test, compare_variants, (int)(variant - compare_variants),
+								 curl_info->total_time);
+			}
+		}
+		if (num_of_taken == 0) {
+			break;  /* Both budgets are used, or the deadline passed */
+		}
+
+		/* Look k (1 based) is tested at alpha/2^k */
+		int n = (compare_variants[0].hist.count < compare_variants[1].hist.count) ?
+				 compare_variants[0].hist.count : compare_variants[1].hist.count;
+		if (n >= next_look) {
+			look_alpha = alpha / (double)(2 << result->num_of_looks);
+			result->significant = (mann_whitney_look(&test, compare_variants, result) <
+								   look_alpha);
+			looked_at = n;
+			next_look *= 2;
+		}
+	}
+
+	/* A last look at the samples taken since the last one */
+	int n = (compare_variants[0].hist.count < compare_variants[1].hist.count) ?
+			 compare_variants[0].hist.count : compare_variants[1].hist.count;
+	if (!result->significant && (n > looked_at) && (n >= COMPARE_MIN_SAMPLES)) {
+		look_alpha = alpha / (double)(2 << result->num_of_looks);
+		result->significant = (mann_whitney_look(&test, compare_variants, result) <
+							   look_alpha);
+	}
+	if (result->significant) {
+		result->faster = (result->z > 0) ? 1 : 0;
+	}
+
+	for (v=0; v<2; v++) {
+		finish_variant(&compare_variants[v], &result->variants[v]);
+	}
+	printf("connection_stats_compare() took %d+%d samples, %d looks (p=%.4f, %s) \n",
+		   compare_variants[0].num_of_samples, compare_variants[1].num_of_samples,
+		   result->num_of_looks, result->p_value,
+		   result->significant ? "significant" : "not significant");
+
+cleanup:
+	for (v=0; v<2; v++) {
+		if (compare_variants[v].curl != NULL) {
+			trace_tail_release(compare_variants[v].curl);
+			curl_easy_cleanup(compare_variants[v].curl);
+		}
+		free(compare_variants[v].curl_info_arr);
+	}
+	return rc;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Add a successful sample (total_time) of variant v to the test
+ */
+static void mann_whitney_add(MannWhitney *test, CompareVariant *variants, int v,
+							 double value) {
+	const LatencyHistogram *other = &variants[1 - v].hist;
+	int bucket = histogram_bucket(value);
+	int below = 0;
+	int ties = other->buckets[bucket];
+	double t;
+
+	for (int i=0; i<bucket; i++) {
+		below += other->buckets[i];
+	}
+	if (v == 0) {
+		test->u_a += below + 0.5 * ties;
+	} else {
+		test->u_a += (other->count - below - ties) + 0.5 * ties;
+	}
+
+	/* The bucket grows from t to t+1 samples: t^3-t grows by 3t^2+3t */
+	t = ties + variants[v].hist.buckets[bucket];
+	test->tie_sum += 3 * t * t + 3 * t;
+	histogram_add(&variants[v].hist, value);
+}
+
+/*
+ * Perform a look: fill the statistic of the result out of the samples so
+ * far (normal approximation with tie and continuity corrections) and get
+ * its two sided p-value
+ */
+static double mann_whitney_look(const MannWhitney *test, const CompareVariant *variants,
+								ConnStatCompareResult *result) {
+	double n1 = variants[0].hist.count;
+	double n2 = variants[1].hist.count;
+	double n = n1 + n2;
+	double variance, diff;
+
+	result->num_of_looks++;
+	result->prob_a_faster = 1 - test->u_a / (n1 * n2);
+	variance = n1 * n2 / 12 * ((n + 1) - test->tie_sum / (n * (n - 1)));
+	if (variance <= 0) {
+		/* All samples are ties */
+		result->z = 0;
+		result->p_value = 1;
+		return result->p_value;
+	}
+	diff = test->u_a - n1 * n2 / 2;
+	diff = (diff > 0) ? fmax(diff - 0.5, 0) : fmin(diff + 0.5, 0);
+	result->z = diff / sqrt(variance);
+	result->p_value = erfc(fabs(result->z) / sqrt(2));
+	return result->p_value;
+}
+
+/*
+ * Analyze the samples taken of a variant, and hand them on as any run's
+ */
+static void finish_variant(CompareVariant *variant, ConnStatSweepResult *result) {
+	const char *url = variant->p_http_req_data->url;
+	int num_of_samples = variant->num_of_samples;
+
+	if (num_of_samples == 0) {
+		result->rc = RC_ERROR_IN_CURL;  /* The deadline passed before the first */
+		return;
+	}
+	result->rc = connection_stats_build_output(variant->curl_info_arr, num_of_samples,
+											   result->stat_str, &result->summary);
+	for (int i=0; i<num_of_samples; i++) {
+		connection_stats_record(url, &variant->curl_info_arr[i]);
+	}
+	store_append(url, variant->curl_info_arr, num_of_samples, &result->summary);
+	collector_send_run(url, variant->curl_info_arr, num_of_samples);
+	snapshot_publish(url, result->rc, result->stat_str, &result->summary);
+}
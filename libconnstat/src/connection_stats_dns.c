@@ -0,0 +1,614 @@
+/*
+ * connection_stats_dns.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * DNS resolution stage of the libconnstat library.
+ * All target hostnames are resolved up front and concurrently (against every
+ * configured resolver at once) using the c-ares async resolver
+ * (see https://c-ares.org), so DNS performance is measured and reported per
+ * resolver, separately from HTTP performance.
+ * The results are fed to every transfer through CURLOPT_RESOLVE, which
+ * removes name resolution from the critical path of the HTTP samples.
+ * Addresses of the warm start cache (see connection_stats_cache.c) are fed
+ * the same way.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <ares.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define MAX_SIZE_OF_RESOLVED_ADDRS  256 /* Comma separated list of addresses */
+#define MAX_SIZE_OF_RESOLVE_ENTRY   (URL_MAX_LEN + MAX_SIZE_OF_RESOLVED_ADDRS + 8)
+#define MAX_NUM_OF_POLL_FDS         (MAX_NUM_OF_RESOLVERS * ARES_GETSOCK_MAXNUM)
+
+
+/******************
+**  Structures   **
+******************/
+/* A single hostname to be resolved */
+typedef struct {
+	char  host[URL_MAX_LEN];
+	long  port;
+	char  addrs[MAX_SIZE_OF_RESOLVED_ADDRS]; /* In CURLOPT_RESOLVE format */
+	int   addrs_resolver_idx;  /* Resolver that provided addrs (-1 if none) */
+	int   ttl;                 /* Minimal TTL of addrs (seconds) */
+} ResolveTarget;
+
+/* A single resolver (one c-ares channel) */
+typedef struct {
+	ares_channel channel;
+	int          num_of_pending;
+	int          num_of_success;
+	double      *latency_arr;  /* Latency of the successful queries */
+	RunningStats latency_stats;
+	ConnStatResolverStats stats;
+} Resolver;
+
+/* A single in-flight query */
+typedef struct {
+	ResolveTarget  *target;
+	Resolver       *resolver;
+	int             resolver_idx;
+	struct timespec start;
+} ResolveQuery;
+
+/* A single in-flight query of dns_lookup() */
+typedef struct {
+	DnsLookup      *lookup;
+	Resolver       *resolver;
+	struct timespec start;
+} LookupQuery;
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Resolvers configured by the user (none means the system resolver) */
+static char g_resolver_addrs[MAX_NUM_OF_RESOLVERS][MAX_SIZE_OF_IP_ADD];
+static int  g_num_of_resolver_addrs = 0;
+
+/* Statistics of the last resolution stage */
+static ConnStatResolverStats g_resolver_stats[MAX_NUM_OF_RESOLVERS];
+static int g_num_of_resolver_stats = 0;
+
+/* Resolved addresses in CURLOPT_RESOLVE format ("host:port:addr[,addr]") */
+static struct curl_slist *g_resolve_list = NULL;
+
+/* c-ares is initialized once, by connection_stats_init */
+static int g_ares_initialized = 0;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC parse_target(const char *url, ResolveTarget *target);
+static void lookup_done(void *arg, int status, int timeouts,
+						struct ares_addrinfo *result);
+static void query_done(void *arg, int status, int timeouts,
+					   struct ares_addrinfo *result);
+static double elapsed_since(const struct timespec *start);
+static RC drive_resolvers(Resolver *resolvers, int num_of_resolvers);
+static RC add_resolve_entry(const char *host, long port, const char *addrs);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Add a DNS server to be used (and measured) by connection_stats_resolve
+* @param  resolver	IPv4/IPv6 address of the DNS server
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_add_resolver(char* resolver) {
+	if ((resolver == NULL) || (resolver[0] == '\0') ||
+		(strlen(resolver) >= MAX_SIZE_OF_IP_ADD)) {
+		printf("connection_stats_add_resolver() fail with invalid resolver \n");
+		return RC_ERROR_IN_DNS;
+	}
+	if (g_num_of_resolver_addrs == MAX_NUM_OF_RESOLVERS) {
+		printf("connection_stats_add_resolver() supports up to %d resolvers \n",
+				MAX_NUM_OF_RESOLVERS);
+		return RC_ERROR_IN_DNS;
+	}
+
+	strcpy(g_resolver_addrs[g_num_of_resolver_addrs++], resolver);
+	return RC_OK;
+}
+
+/**
+* @desc   Resolve the hostnames of all targets concurrently
+* @param  http_req_data_arr	Targets to be resolved
+* @param  num_of_targets		Number of targets in http_req_data_arr
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_resolve(HttpReqData* http_req_data_arr, int num_of_targets) {
+	Resolver resolvers[MAX_NUM_OF_RESOLVERS];
+	int num_of_resolvers = (g_num_of_resolver_addrs > 0) ? g_num_of_resolver_addrs : 1;
+	ResolveTarget *targets;
+	ResolveQuery *queries;
+	struct ares_options options;
+	int optmask = 0;
+	long timeout_ms = 0;
+	int num_of_unique = 0;
+	int i, j, r;
+	RC rc = RC_OK;
+
+	if ((http_req_data_arr == NULL) || (num_of_targets <= 0)) {
+		printf("connection_stats_resolve() fail with no targets \n");
+		return RC_ERROR_IN_DNS;
+	}
+
+	targets = calloc(num_of_targets, sizeof(ResolveTarget));
+	queries = calloc((size_t)num_of_targets * num_of_resolvers, sizeof(ResolveQuery));
+	if ((targets == NULL) || (queries == NULL)) {
+		fprintf(stderr, "calloc() failed\n");
+		free(targets);
+		free(queries);
+		return RC_ERROR;
+	}
+
+	/* Collect unique host:port pairs */
+	for (i=0; i<num_of_targets; i++) {
+		ResolveTarget *target = &targets[num_of_unique];
+		rc = parse_target(http_req_data_arr[i].url, target);
+		if (rc != RC_OK) {
+			free(targets);
+			free(queries);
+			return rc;
+		}
+		for (j=0; j<num_of_unique; j++) {
+			if ((strcmp(targets[j].host, target->host) == 0) &&
+				(targets[j].port == target->port)) {
+				break;
+			}
+		}
+		if (j == num_of_unique) {
+			target->addrs_resolver_idx = -1;
+			num_of_unique++;
+		}
+
+		/* Name lookup is part of the connect phase (the longest one counts) */
+		long target_timeout_ms = (http_req_data_arr[i].connect_timeout_ms > 0) ?
+			http_req_data_arr[i].connect_timeout_ms : http_req_data_arr[i].timeout_ms;
+		if (target_timeout_ms > timeout_ms) {
+			timeout_ms = target_timeout_ms;
+		}
+	}
+
+	/* A query unanswered within the timeout fails (c-ares retries otherwise) */
+	memset(&options, 0, sizeof(options));
+	if (timeout_ms > 0) {
+		options.timeout = (int)timeout_ms;
+		options.tries   = 1;
+		optmask = ARES_OPT_TIMEOUTMS | ARES_OPT_TRIES;
+	}
+
+	if (!g_ares_initialized) {
+		printf("connection_stats_resolve() called before connection_stats_init() \n");
+		free(targets);
+		free(queries);
+		return RC_ERROR_IN_DNS;
+	}
+
+	/* Create a channel per resolver */
+	memset(resolvers, 0, sizeof(resolvers));
+	for (r=0; r<num_of_resolvers; r++) {
+		Resolver *resolver = &resolvers[r];
+		int status = ares_init_options(&resolver->channel, &options, optmask);
+		if ((status == ARES_SUCCESS) && (g_num_of_resolver_addrs > 0)) {
+			status = ares_set_servers_csv(resolver->channel, g_resolver_addrs[r]);
+			strcpy(resolver->stats.resolver, g_resolver_addrs[r]);
+		}
+		resolver->latency_arr = calloc(num_of_unique, sizeof(double));
+		if ((status != ARES_SUCCESS) || (resolver->latency_arr == NULL)) {
+			printf("connection_stats_resolve() fail to init resolver #%d: %s \n",
+					r, ares_strerror(status));
+			num_of_resolvers = r + 1;
+			rc = RC_ERROR_IN_DNS;
+			goto cleanup;
+		}
+		running_stats_reset(&resolver->latency_stats);
+	}
+
+	/* Fire all queries of all resolvers at once */
+	struct ares_addrinfo_hints hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	for (r=0; r<num_of_resolvers; r++) {
+		for (i=0; i<num_of_unique; i++) {
+			ResolveQuery *query = &queries[r * num_of_unique + i];
+			query->target       = &targets[i];
+			query->resolver     = &resolvers[r];
+			query->resolver_idx = r;
+			clock_gettime(CLOCK_MONOTONIC, &query->start);
+			resolvers[r].num_of_pending++;
+			resolvers[r].stats.num_of_queries++;
+			ares_getaddrinfo(resolvers[r].channel, targets[i].host, NULL,
+							 &hints, query_done, query);
+		}
+	}
+
+	rc = drive_resolvers(resolvers, num_of_resolvers);
+	if (rc != RC_OK) {
+		goto cleanup;
+	}
+
+	/* Keep the statistics of each resolver */
+	for (r=0; r<num_of_resolvers; r++) {
+		Resolver *resolver = &resolvers[r];
+		running_stats_finalize(&resolver->latency_stats, &resolver->stats.latency);
+		resolver->stats.latency.median = (resolver->num_of_success > 0) ?
+			get_median(resolver->latency_arr, resolver->num_of_success) : 0;
+		g_resolver_stats[r] = resolver->stats;
+	}
+	g_num_of_resolver_stats = num_of_resolvers;
+
+	/* Feed the results to the transfers (replacing previous results). Cached
+	   addresses go first, as libCURL lets a later entry of a host override */
+	curl_slist_free_all(g_resolve_list);
+	g_resolve_list = NULL;
+	dns_feed_cached();
+	for (i=0; i<num_of_unique; i++) {
+		if (targets[i].addrs_resolver_idx < 0) {
+			printf("connection_stats_resolve() could not resolve %s \n", targets[i].host);
+			continue;
+		}
+		add_resolve_entry(targets[i].host, targets[i].port, targets[i].addrs);
+		cache_note_dns(targets[i].host, targets[i].port, targets[i].addrs, targets[i].ttl);
+	}
+
+cleanup:
+	for (r=0; r<num_of_resolvers; r++) {
+		if (resolvers[r].channel != NULL) {
+			ares_destroy(resolvers[r].channel);
+		}
+		free(resolvers[r].latency_arr);
+	}
+	free(targets);
+	free(queries);
+
+	return rc;
+}
+
+/**
+* @desc   Get the statistics of every resolver used by the last resolution stage
+* @param  stats_arr         Statistics (allocated with MAX_NUM_OF_RESOLVERS entries)
+* @param  num_of_resolvers  Number of entries filled in stats_arr
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_get_resolver_stats(ConnStatResolverStats* stats_arr,
+									   int* num_of_resolvers) {
+	if (g_num_of_resolver_stats == 0) {
+		printf("ERROR: Resolver statistics requested before resolving \n");
+		*num_of_resolvers = 0;
+		return RC_RESULT_REQUESTED_BEFORE_TRIGGER;
+	}
+	memcpy(stats_arr, g_resolver_stats,
+		   g_num_of_resolver_stats * sizeof(ConnStatResolverStats));
+	*num_of_resolvers = g_num_of_resolver_stats;
+	return RC_OK;
+}
+
+/*
+ * Get the resolved addresses in CURLOPT_RESOLVE format (NULL if none)
+ */
+struct curl_slist* dns_get_resolve_list() {
+	return g_resolve_list;
+}
+
+/*
+ * Feed the addresses of the warm start cache to the transfers
+ */
+RC dns_feed_cached() {
+	return cache_for_each_dns(add_resolve_entry);
+}
+
+/*
+ * Initialize c-ares (once, until dns_reset)
+ */
+RC dns_init() {
+	if (g_ares_initialized) {
+		return RC_OK;
+	}
+	if (ares_library_init(ARES_LIB_INIT_ALL) != ARES_SUCCESS) {
+		printf("connection_stats_init() fail with ares_library_init() \n");
+		return RC_ERROR_IN_DNS;
+	}
+	g_ares_initialized = 1;
+	return RC_OK;
+}
+
+/*
+ * Look up hostnames concurrently (a query each, through the system's resolver
+ * configuration). A query unanswered within timeout_ms (0 means c-ares'
+ * default) fails, leaving its lookup unresolved
+ */
+RC dns_lookup(DnsLookup *lookups, int num_of_lookups, long timeout_ms) {
+	struct ares_addrinfo_hints hints;
+	struct ares_options options;
+	LookupQuery *queries;
+	Resolver resolver;
+	int optmask = 0;
+	int status, i;
+	RC rc;
+
+	if (!g_ares_initialized) {
+		printf("dns_lookup() called before connection_stats_init() \n");
+		return RC_ERROR_IN_DNS;
+	}
+	queries = calloc(num_of_lookups, sizeof(LookupQuery));
+	if (queries == NULL) {
+		fprintf(stderr, "calloc() failed\n");
+		return RC_ERROR;
+	}
+
+	memset(&options, 0, sizeof(options));
+	if (timeout_ms > 0) {
+		options.timeout = (int)timeout_ms;
+		options.tries   = 1;
+		optmask = ARES_OPT_TIMEOUTMS | ARES_OPT_TRIES;
+	}
+	memset(&resolver, 0, sizeof(resolver));
+	status = ares_init_options(&resolver.channel, &options, optmask);
+	if (status != ARES_SUCCESS) {
+		printf("dns_lookup() fail to init resolver: %s \n", ares_strerror(status));
+		free(queries);
+		return RC_ERROR_IN_DNS;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	for (i=0; i<num_of_lookups; i++) {
+		lookups[i].addr_len    = 0;
+		lookups[i].lookup_time = 0;
+		queries[i].lookup   = &lookups[i];
+		queries[i].resolver = &resolver;
+		clock_gettime(CLOCK_MONOTONIC, &queries[i].start);
+		resolver.num_of_pending++;
+		ares_getaddrinfo(resolver.channel, lookups[i].host, NULL, &hints,
+						 lookup_done, &queries[i]);
+	}
+	rc = drive_resolvers(&resolver, 1);
+
+	ares_destroy(resolver.channel);
+	free(queries);
+	return rc;
+}
+
+/*
+ * Forget all resolvers and resolved addresses, and clean c-ares up
+ */
+void dns_reset() {
+	curl_slist_free_all(g_resolve_list);
+	g_resolve_list = NULL;
+	g_num_of_resolver_addrs = 0;
+	g_num_of_resolver_stats = 0;
+	if (g_ares_initialized) {
+		ares_library_cleanup();
+		g_ares_initialized = 0;
+	}
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Extract host and port out of a target URL
+ */
+static RC parse_target(const char *url, ResolveTarget *target) {
+	CURLU *curlu = curl_url();
+	char *host = NULL;
+	char *port = NULL;
+	RC rc = RC_OK;
+
+	if (curlu == NULL) {
+		return RC_ERROR_IN_CURL;
+	}
+	if ((curl_url_set(curlu, CURLUPART_URL, url, CURLU_GUESS_SCHEME) != CURLUE_OK) ||
+		(curl_url_get(curlu, CURLUPART_HOST, &host, 0) != CURLUE_OK) ||
+		(curl_url_get(curlu, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) != CURLUE_OK) ||
+		(strlen(host) >= URL_MAX_LEN)) {
+		printf("connection_stats_resolve() fail with invalid url %s\n", url);
+		rc = RC_INVALID_URL;
+	} else {
+		strcpy(target->host, host);
+		target->port = atol(port);
+	}
+
+	curl_free(host);
+	curl_free(port);
+	curl_url_cleanup(curlu);
+	return rc;
+}
+
+/*
+ * c-ares completion callback of a single query of dns_lookup() (the first
+ * address of the answer is kept)
+ */
+static void lookup_done(void *arg, int status, int timeouts,
+						struct ares_addrinfo *result) {
+	LookupQuery *query = (LookupQuery *)arg;
+	DnsLookup *lookup = query->lookup;
+	(void)timeouts; /* prevent compiler warning */
+
+	query->resolver->num_of_pending--;
+	lookup->lookup_time = elapsed_since(&query->start);
+	if ((status == ARES_SUCCESS) && (result != NULL) && (result->nodes != NULL) &&
+		(result->nodes->ai_addrlen <= sizeof(lookup->addr))) {
+		memcpy(&lookup->addr, result->nodes->ai_addr, result->nodes->ai_addrlen);
+		lookup->addr_len = result->nodes->ai_addrlen;
+	}
+	ares_freeaddrinfo(result);
+}
+
+/*
+ * c-ares completion callback of a single query
+ */
+static void query_done(void *arg, int status, int timeouts,
+					   struct ares_addrinfo *result) {
+	ResolveQuery *query = (ResolveQuery *)arg;
+	Resolver *resolver = query->resolver;
+	ResolveTarget *target = query->target;
+	struct ares_addrinfo_node *node;
+	double latency = elapsed_since(&query->start);
+	(void)timeouts; /* prevent compiler warning */
+
+	resolver->num_of_pending--;
+
+	if ((status != ARES_SUCCESS) || (result == NULL) || (result->nodes == NULL)) {
+		resolver->stats.num_of_failures++;
+		ares_freeaddrinfo(result);
+		return;
+	}
+
+	running_stats_add(&resolver->latency_stats, latency);
+	resolver->latency_arr[resolver->num_of_success++] = latency;
+
+	/* Keep the answer of the first resolver that answered (the fastest) */
+	if (target->addrs_resolver_idx < 0) {
+		size_t len = 0;
+		target->addrs[0] = '\0';
+		target->ttl = 0;
+		for (node = result->nodes; node != NULL; node = node->ai_next) {
+			char addr[MAX_SIZE_OF_IP_ADD];
+			const void *src = (node->ai_family == AF_INET6) ?
+				(const void *)&((struct sockaddr_in6 *)node->ai_addr)->sin6_addr :
+				(const void *)&((struct sockaddr_in *)node->ai_addr)->sin_addr;
+			if (inet_ntop(node->ai_family, src, addr, sizeof(addr)) == NULL) {
+				continue;
+			}
+			/* IPv6 addresses are bracketed in CURLOPT_RESOLVE format */
+			int written = snprintf(target->addrs + len, sizeof(target->addrs) - len,
+								   (node->ai_family == AF_INET6) ? "%s[%s]" : "%s%s",
+								   (len > 0) ? "," : "", addr);
+			if ((written < 0) || (len + written >= sizeof(target->addrs))) {
+				/* No more room - keep the addresses written so far */
+				target->addrs[len] = '\0';
+				break;
+			}
+			len += written;
+			if ((target->ttl == 0) || (node->ai_ttl < target->ttl)) {
+				target->ttl = node->ai_ttl;
+			}
+		}
+		if (len > 0) {
+			target->addrs_resolver_idx = query->resolver_idx;
+		}
+	}
+
+	ares_freeaddrinfo(result);
+}
+
+/*
+ * Add addresses of host:port to the list fed to the transfers
+ */
+static RC add_resolve_entry(const char *host, long port, const char *addrs) {
+	char entry[MAX_SIZE_OF_RESOLVE_ENTRY];
+	struct curl_slist *list;
+
+	snprintf(entry, sizeof(entry), "%s:%ld:%s", host, port, addrs);
+	list = curl_slist_append(g_resolve_list, entry);
+	if (list == NULL) {
+		fprintf(stderr, "curl_slist_append() failed\n");
+		return RC_ERROR_IN_CURL;
+	}
+	g_resolve_list = list;
+	return RC_OK;
+}
+
+/*
+ * Seconds elapsed since start (monotonic clock)
+ */
+static double elapsed_since(const struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Drive all resolvers (in a single poll loop) until all queries are done
+ */
+static RC drive_resolvers(Resolver *resolvers, int num_of_resolvers) {
+	struct pollfd pfds[MAX_NUM_OF_POLL_FDS];
+	ares_channel pfd_channels[MAX_NUM_OF_POLL_FDS];
+	int r, i;
+
+	for (;;) {
+		int num_of_pending = 0;
+		int num_of_pfds = 0;
+		struct timeval max_tv = { 1, 0 };
+		struct timeval tv;
+		struct timeval *ptv = &max_tv;
+
+		for (r=0; r<num_of_resolvers; r++) {
+			ares_socket_t socks[ARES_GETSOCK_MAXNUM];
+			int bitmask;
+
+			if (resolvers[r].num_of_pending == 0) {
+				continue;
+			}
+			num_of_pending += resolvers[r].num_of_pending;
+			bitmask = ares_getsock(resolvers[r].channel, socks, ARES_GETSOCK_MAXNUM);
+			for (i=0; i<ARES_GETSOCK_MAXNUM; i++) {
+				short events = 0;
+				if (ARES_GETSOCK_READABLE(bitmask, i)) {
+					events |= POLLIN;
+				}
+				if (ARES_GETSOCK_WRITABLE(bitmask, i)) {
+					events |= POLLOUT;
+				}
+				if (events == 0) {
+					continue;
+				}
+				pfds[num_of_pfds].fd      = socks[i];
+				pfds[num_of_pfds].events  = events;
+				pfds[num_of_pfds].revents = 0;
+				pfd_channels[num_of_pfds] = resolvers[r].channel;
+				num_of_pfds++;
+			}
+			ptv = ares_timeout(resolvers[r].channel, ptv, &tv);
+		}
+
+		if (num_of_pending == 0) {
+			/* All queries are done */
+			break;
+		}
+
+		/* Note: with no sockets poll() simply waits for the next timeout */
+		if (poll(pfds, num_of_pfds, ptv->tv_sec * 1000 + ptv->tv_usec / 1000) < 0) {
+			perror("poll() failed");
+			return RC_ERROR_IN_DNS;
+		}
+
+		/* Process ready sockets, then timeouts of every channel */
+		for (i=0; i<num_of_pfds; i++) {
+			ares_process_fd(pfd_channels[i],
+				(pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) ? pfds[i].fd : ARES_SOCKET_BAD,
+				(pfds[i].revents & POLLOUT) ? pfds[i].fd : ARES_SOCKET_BAD);
+		}
+		for (r=0; r<num_of_resolvers; r++) {
+			if (resolvers[r].num_of_pending > 0) {
+				ares_process_fd(resolvers[r].channel, ARES_SOCKET_BAD, ARES_SOCKET_BAD);
+			}
+		}
+	}
+
+	return RC_OK;
+}
@@ -0,0 +1,278 @@
+/*
+ * connection_stats_headers.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * HTTP header profiles of the libconnstat library.
+ * A profile is a named set of headers (e.g. the auth headers of a single
+ * tenant) that is validated and turned into a libCURL header list once, when
+ * it is added. The list is never modified afterwards, so every target that
+ * names the profile (HttpReqData.header_profile) hands the very same list to
+ * its handles, and a run pays no per probe (or per target) header cost.
+ * Headers are validated a word (8 bytes) at a time: a single scan finds the
+ * ':' and rejects control characters (header injection) at once.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define SWAR_ONES               0x0101010101010101ULL
+#define SWAR_HIGHS              0x8080808080808080ULL
+/* Non zero if any byte of the word x is below n (n <= 128) */
+#define SWAR_HAS_LESS(x, n)     (((x) - SWAR_ONES * (n)) & ~(x) & SWAR_HIGHS)
+/* Non zero if any byte of the word x equals b */
+#define SWAR_HAS_BYTE(x, b)     SWAR_HAS_LESS((x) ^ (SWAR_ONES * (b)), 1)
+#define ASCII_DEL               0x7F
+
+
+/******************
+**  Structures   **
+******************/
+/* A named header profile (immutable once added) */
+struct HeaderProfile {
+	char               name[HEADER_PROFILE_NAME_MAX_LEN];
+	struct curl_slist *list;
+	int                num_of_refs;  /* The registry's, plus one per async run
+	                                    in progress that uses the profile */
+};
+
+
+/******************
+**  Global Vars  **
+******************/
+/* All added profiles */
+static HeaderProfile *g_profiles[MAX_NUM_OF_HEADER_PROFILES];
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static HeaderProfile* find_profile(const char *name);
+static RC scan_bytes(const char *http_header, size_t from, size_t to, long *p_colon);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Add a named HTTP header profile (see connection_stats.h)
+* @param  name				Profile name
+* @param  http_headers		Headers of the profile
+* @param  num_of_headers	Number of headers in http_headers
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_add_header_profile(const char* name, const char** http_headers,
+									   int num_of_headers) {
+	HeaderProfile *profile;
+	int free_idx = -1;
+	RC rc;
+
+	if ((name == NULL) || (name[0] == '\0') ||
+		(strnlen(name, HEADER_PROFILE_NAME_MAX_LEN) == HEADER_PROFILE_NAME_MAX_LEN) ||
+		(http_headers == NULL) || (num_of_headers <= 0)) {
+		printf("connection_stats_add_header_profile() fail with invalid profile [name=%s, "
+			   "num_of_headers=%d]\n", (name != NULL) ? name : "NULL", num_of_headers);
+		return RC_INVALID_HTTP_HEADER;
+	}
+	if (find_profile(name) != NULL) {
+		printf("connection_stats_add_header_profile() profile %s already exists \n", name);
+		return RC_ERROR;
+	}
+	for (int i=0; i<MAX_NUM_OF_HEADER_PROFILES; i++) {
+		if (g_profiles[i] == NULL) {
+			free_idx = i;
+			break;
+		}
+	}
+	if (free_idx == -1) {
+		printf("connection_stats_add_header_profile() too many profiles (max %d) \n",
+				MAX_NUM_OF_HEADER_PROFILES);
+		return RC_ERROR;
+	}
+
+	/* All headers are validated before anything is built */
+	for (int i=0; i<num_of_headers; i++) {
+		rc = headers_validate(http_headers[i]);
+		if (rc != RC_OK) {
+			return rc;
+		}
+	}
+
+	profile = calloc(1, sizeof(HeaderProfile));
+	if (profile == NULL) {
+		fprintf(stderr, "calloc() failed\n");
+		return RC_ERROR;
+	}
+	strcpy(profile->name, name);
+	for (int i=0; i<num_of_headers; i++) {
+		struct curl_slist *list = curl_slist_append(profile->list, http_headers[i]);
+		if (list == NULL) {
+			fprintf(stderr, "curl_slist_append() failed\n");
+			curl_slist_free_all(profile->list);
+			free(profile);
+			return RC_ERROR_IN_CURL;
+		}
+		profile->list = list;
+	}
+	profile->num_of_refs = 1;
+	g_profiles[free_idx] = profile;
+	return RC_OK;
+}
+
+/**
+* @desc   Remove a named HTTP header profile (see connection_stats.h)
+* @param  name		Profile name
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_remove_header_profile(const char* name) {
+	if (name == NULL) {
+		return RC_INVALID_HTTP_HEADER;
+	}
+	for (int i=0; i<MAX_NUM_OF_HEADER_PROFILES; i++) {
+		if ((g_profiles[i] != NULL) && (strcmp(g_profiles[i]->name, name) == 0)) {
+			HeaderProfile *profile = g_profiles[i];
+			g_profiles[i] = NULL;
+			headers_release(profile);
+			return RC_OK;
+		}
+	}
+	printf("connection_stats_remove_header_profile() unknown profile %s \n", name);
+	return RC_INVALID_HTTP_HEADER;
+}
+
+/*
+ * Validate a single header ("Header-name: Header-value"): length, a non
+ * empty name before the ':' and no control character but TAB
+ */
+RC headers_validate(const char *http_header) {
+	size_t len, i;
+	long colon = -1;
+
+	if (http_header == NULL) {
+		printf("Invalid HTTP header NULL \n");
+		return RC_INVALID_HTTP_HEADER;
+	}
+	len = strnlen(http_header, HTTP_HEADER_MAX_LEN + 1);
+	if ((len < HTTP_HEADER_MIN_LEN) || (len > HTTP_HEADER_MAX_LEN)) {
+		printf("Invalid HTTP header %.64s (length must be in range [%d:%d]) \n",
+				http_header, HTTP_HEADER_MIN_LEN, HTTP_HEADER_MAX_LEN);
+		return RC_INVALID_HTTP_HEADER;
+	}
+
+	/* Only words holding a ':' (until the first) or a control char are
+	   looked at byte by byte */
+	for (i=0; i+sizeof(uint64_t)<=len; i+=sizeof(uint64_t)) {
+		uint64_t word;
+
+		memcpy(&word, http_header + i, sizeof(word));
+		if (((colon == -1) && SWAR_HAS_BYTE(word, ':')) ||
+			SWAR_HAS_LESS(word, ' ') || SWAR_HAS_BYTE(word, ASCII_DEL)) {
+			if (scan_bytes(http_header, i, i + sizeof(word), &colon) != RC_OK) {
+				return RC_INVALID_HTTP_HEADER;
+			}
+		}
+	}
+	if (scan_bytes(http_header, i, len, &colon) != RC_OK) {
+		return RC_INVALID_HTTP_HEADER;
+	}
+
+	if (colon <= 0) {
+		printf("Invalid HTTP header %.64s (expected \"Header-name: Header-value\") \n",
+				http_header);
+		return RC_INVALID_HTTP_HEADER;
+	}
+	return RC_OK;
+}
+
+/*
+ * Get the (immutable) header list of a profile, NULL if there is no such
+ * profile
+ */
+struct curl_slist* headers_get_list(const char *name) {
+	HeaderProfile *profile = find_profile(name);
+
+	return (profile != NULL) ? profile->list : NULL;
+}
+
+/*
+ * Take a reference to a profile, so its list outlives the removal of the
+ * profile (NULL if there is no such profile)
+ */
+HeaderProfile* headers_acquire(const char *name) {
+	HeaderProfile *profile = find_profile(name);
+
+	if (profile != NULL) {
+		profile->num_of_refs++;
+	}
+	return profile;
+}
+
+/*
+ * Drop a reference to a profile (taken by headers_acquire), the last one
+ * frees it
+ */
+void headers_release(HeaderProfile *profile) {
+	if ((profile != NULL) && (--profile->num_of_refs == 0)) {
+		curl_slist_free_all(profile->list);
+		free(profile);
+	}
+}
+
+/*
+ * Remove all profiles
+ */
+void headers_reset() {
+	for (int i=0; i<MAX_NUM_OF_HEADER_PROFILES; i++) {
+		if (g_profiles[i] != NULL) {
+			headers_release(g_profiles[i]);
+			g_profiles[i] = NULL;
+		}
+	}
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Find a profile by name
+ */
+static HeaderProfile* find_profile(const char *name) {
+	for (int i=0; i<MAX_NUM_OF_HEADER_PROFILES; i++) {
+		if ((g_profiles[i] != NULL) && (strcmp(g_profiles[i]->name, name) == 0)) {
+			return g_profiles[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Check the bytes [from:to) of a header one by one: keep the position of
+ * the first ':' and fail on a control char (but TAB)
+ */
+static RC scan_bytes(const char *http_header, size_t from, size_t to, long *p_colon) {
+	for (size_t i=from; i<to; i++) {
+		unsigned char c = (unsigned char)http_header[i];
+
+		if ((c == ':') && (*p_colon == -1)) {
+			*p_colon = (long)i;
+		} else if (((c < ' ') && (c != '\t')) || (c == ASCII_DEL)) {
+			printf("Invalid HTTP header (control char 0x%02x at %zu) \n", c, i);
+			return RC_INVALID_HTTP_HEADER;
+		}
+	}
+	return RC_OK;
+}
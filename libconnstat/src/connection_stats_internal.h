@@ -0,0 +1,230 @@
+/*
+ * connection_stats_internal.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Internal (non exported) declarations shared between the source files
+ * of the libconnstat library.
+ * This file must NOT be included by users of the library - use
+ * connection_stats.h instead.
+ */
+
+#ifndef CONNECTIONSTATS_INTERNAL_H_
+#define CONNECTIONSTATS_INTERNAL_H_
+
+/******************
+**   Includes    **
+******************/
+#include <time.h>
+#include <sys/socket.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+
+
+/******************
+**    Defines    **
+******************/
+#define HTTP_ERROR_RESPONSE_CODE_MIN    400
+
+/* Histogram of microseconds: values below 16 have their own bucket, above that
+   every power of 2 is split into 16 linear sub-buckets (~3% resolution) */
+#define HIST_SUB_BUCKET_BITS    4
+#define HIST_SUB_BUCKETS        (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_MAX_EXPONENT       36  /* ~19 hours */
+#define HIST_NUM_OF_BUCKETS     (HIST_SUB_BUCKETS * (HIST_MAX_EXPONENT + 2))
+
+
+/******************
+**  Structures   **
+******************/
+/* Streaming (single pass, O(1) space) statistics of a single timing phase */
+typedef struct {
+	int    count;
+	double mean;
+	double m2;         /* Sum of squared distances from the mean (Welford) */
+	double min;
+	double max;
+	double prev;       /* Previous value, for jitter */
+	double jitter_sum; /* Sum of absolute differences between consecutive values */
+} RunningStats;
+
+/* A named HTTP header profile (see connection_stats_headers.c) */
+typedef struct HeaderProfile HeaderProfile;
+
+/* A hostname looked up by dns_lookup() */
+typedef struct {
+	const char              *host;
+	struct sockaddr_storage  addr;        /* First address of the answer (no port) */
+	socklen_t                addr_len;    /* 0 if the host could not be resolved */
+	double                   lookup_time; /* Seconds */
+} DnsLookup;
+
+/* Streaming log-linear histogram of a timing phase (mergeable by summing) */
+typedef struct {
+	int count;
+	int buckets[HIST_NUM_OF_BUCKETS];
+} LatencyHistogram;
+
+
+/******************
+**    Methods    **
+******************/
+
+/**
+* @desc   Validate that HTTP data request is legit
+* @param  p_http_req_data	Data as received by the user
+* @return Return Code (taken from RC enum)
+*/
+RC is_valid_http_data_req(HttpReqData *p_http_req_data);
+
+/**
+* @desc   Set all easy curl options required for a measurement on a handle
+* @param  curl             CURL easy handle to be configured
+* @param  p_http_req_data  Data as received by the user
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_setup_handle(CURL *curl, HttpReqData *p_http_req_data);
+
+/**
+* @desc   Collect all required timing info about the last transfer of a handle
+* @param  curl       CURL easy handle that completed a transfer
+* @param  result     Result of the transfer
+* @param  curl_info  Sample to be filled (marked as failed on any failure)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_collect(CURL *curl, CURLcode result, CurlInfo *curl_info);
+
+/**
+* @desc   Build the program's output string (see connection_stats_get_statistics)
+*         and the run's summary out of the gathered samples (single pass)
+* @param  curl_info_arr  Gathered samples (both successful and failed)
+* @param  arr_size       Number of samples in curl_info_arr
+* @param  output         Output string (at least MAX_SIZE_OF_PROG_OUTPUT)
+* @param  summary        Summary to be filled
+* @return Return Code (taken from RC enum). RC_ERROR_IN_CURL if no sample
+*         succeeded (output is left untouched, summary is still filled)
+*/
+RC connection_stats_build_output(CurlInfo *curl_info_arr, int arr_size, 
+								 char *output, ConnStatSummary *summary);
+
+/**
+* @desc   Get median of given arr (sized arr_size). Note: arr is reordered in place
+*/
+double get_median(double arr[], int arr_size);
+
+/**
+* @desc   Hand a collected sample to the caller's callback (if any, see
+*         connection_stats_set_sample_callback)
+*/
+void samples_notify(const HttpReqData *p_http_req_data, int sample_idx,
+					const CurlInfo *curl_info);
+
+/* connection_stats_mux.c */
+RC connection_stats_mux_perform(HttpReqData *p_http_req_data, 
+								CurlInfo *curl_info_arr);
+
+/* connection_stats_adaptive.c */
+RC connection_stats_adaptive_perform(CURL *curl, HttpReqData *p_http_req_data,
+									 CurlInfo *curl_info_arr, int *p_num_of_samples,
+									 ConnStatEstimate *estimate);
+void   histogram_add(LatencyHistogram *hist, double value);
+int    histogram_bucket(double value);
+double histogram_value_at_rank(const LatencyHistogram *hist, int rank);
+
+/* connection_stats_throughput.c */
+RC   connection_stats_throughput_perform(HttpReqData *p_http_req_data,
+										 CurlInfo *curl_info_arr);
+void throughput_reset();
+
+/* connection_stats_snapshot.c */
+void snapshot_publish(const char *url, RC rc, const char *stat_str,
+					  const ConnStatSummary *summary);
+void snapshot_reset();
+
+/* connection_stats_store.c */
+void store_append(const char *url, const CurlInfo *curl_info_arr, int arr_size,
+				  const ConnStatSummary *summary);
+void store_reset();
+
+/* connection_stats_sweep.c */
+RC   timeouts_setup(CURL *curl, HttpReqData *p_http_req_data);
+RC   timeouts_arm(CURL *curl, long timeout_ms, long remaining_ms);
+long deadline_remaining_ms(const struct timespec *start, long deadline_ms);
+void timeouts_mark_skipped(CurlInfo *curl_info);
+
+/* connection_stats_affinity.c */
+RC   affinity_setup_handle(CURL *curl);
+long affinity_get_nivcsw();
+void affinity_reset();
+
+/* connection_stats_headers.c */
+RC                 headers_validate(const char *http_header);
+struct curl_slist* headers_get_list(const char *name);
+HeaderProfile*     headers_acquire(const char *name);
+void               headers_release(HeaderProfile *profile);
+void               headers_reset();
+
+/* connection_stats_transport.c */
+int  transport_is_custom();
+RC   transport_perform(CURL *curl, HttpReqData *p_http_req_data, CurlInfo *curl_info);
+void transport_reset();
+
+/* connection_stats_aggregate.c */
+void aggregate_reset();
+
+/* connection_stats_summary.c */
+void running_stats_reset(RunningStats *running_stats);
+void running_stats_add(RunningStats *running_stats, double value);
+void running_stats_merge(RunningStats *dst, const RunningStats *src);
+void running_stats_finalize(const RunningStats *running_stats, 
+							ConnStatPhaseStats *phase_stats);
+int  connection_stats_is_success(const CurlInfo *curl_info);
+void connection_stats_add_error(ConnStatSummary *summary, 
+								const CurlInfo *curl_info);
+void connection_stats_build_groups(const CurlInfo *curl_info_arr, int arr_size,
+								   ConnStatSummary *summary);
+
+/* connection_stats_dns.c */
+RC                 dns_init();
+struct curl_slist* dns_get_resolve_list();
+RC                 dns_feed_cached();
+RC                 dns_lookup(DnsLookup *lookups, int num_of_lookups, long timeout_ms);
+void               dns_reset();
+
+/* connection_stats_cache.c */
+int                  cache_is_enabled();
+void                 cache_note_dns(const char *host, long port, const char *addrs,
+									long ttl_sec);
+void                 cache_note_transfer(CURL *curl);
+const char*          cache_get_dns(const char *host, long port);
+RC                   cache_for_each_dns(RC (*cb)(const char *host, long port,
+												 const char *addrs));
+void                 cache_note_tls(const char *ip, long port, const unsigned char *session,
+									size_t session_len, long ttl_sec);
+const unsigned char* cache_get_tls(const char *ip, long port, size_t *p_session_len);
+RC                   cache_save();
+void                 cache_reset();
+
+/* connection_stats_collector.c */
+void collector_send_run(const char *url, const CurlInfo *curl_info_arr, int arr_size);
+void collector_reset();
+
+/* connection_stats_trace.c (trace_write is in connection_stats.c) */
+int  trace_tail_is_enabled();
+#ifdef TRACE_ENA
+void trace_write(FILE *stream, curl_infotype type, char *data, size_t size,
+				 long long at_us);
+void trace_tail_append(CURL *curl, curl_infotype type, const char *data, size_t size,
+					   long long at_us);
+void trace_tail_sample_done(CURL *curl, const CurlInfo *curl_info);
+#endif
+void trace_tail_release(CURL *curl);
+void trace_tail_reset();
+
+/* connection_stats_ip_table.c */
+unsigned short ip_table_intern(const char *ip);
+const char*    ip_table_get(unsigned short ip_idx);
+void           ip_table_reset();
+
+#endif /* CONNECTIONSTATS_INTERNAL_H_ */
@@ -0,0 +1,200 @@
+/*
+ * connection_stats_ip_table.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Interned IP table of the libconnstat library.
+ * Every sample keeps the IP of the server that served it as a 2 bytes index
+ * into this table (instead of a MAX_SIZE_OF_IP_ADD string), so per sample
+ * endpoint tracking stays compact and grouping samples by IP is a simple
+ * integer comparison.
+ * The table is append-only (indexes stay valid until connection_stats_close)
+ * and grows (by doubling) up to MAX_NUM_OF_INTERNED_IPS, the limit of the 2
+ * bytes index, so long probes and sweeps keep tracking their IPs.
+ * It is not thread safe - it is only accessed from the measuring thread.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define IP_TABLE_INITIAL_SIZE   256  /* Must be a power of 2 */
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Interned IP strings (index 0 is reserved for IP_IDX_UNKNOWN) */
+static char (*g_ips)[MAX_SIZE_OF_IP_ADD] = NULL;
+static int  g_num_of_ips = 1;
+static int  g_size = 0;  /* Allocated entries of g_ips */
+
+/* Open addressing hash of indexes into g_ips (0 means empty slot), 2 x g_size */
+static unsigned short *g_slots = NULL;
+
+/* IPs that were not tracked since the table is full (reported once, and
+   counted until connection_stats_close) */
+static long g_num_of_untracked = 0;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static uint32_t hash_ip(const char *ip);
+static int grow();
+static unsigned short* find_slot(const char *ip);
+
+
+/******************
+**    Methods    **
+******************/
+/*
+ * Get the index of an IP string, adding it to the table if not there yet.
+ * Returns IP_IDX_UNKNOWN for an empty IP or when the table is full
+ */
+unsigned short ip_table_intern(const char *ip) {
+	unsigned short *slot;
+
+	if ((ip == NULL) || (ip[0] == '\0')) {
+		return IP_IDX_UNKNOWN;
+	}
+
+	slot = (g_size > 0) ? find_slot(ip) : NULL;
+	if ((slot != NULL) && (*slot != 0)) {
+		return *slot;
+	}
+
+	/* Not found - add it (the table is kept at most half full) */
+	if ((2 * g_num_of_ips >= g_size) && (g_size < MAX_NUM_OF_INTERNED_IPS + 1)) {
+		if (grow() != RC_OK) {
+			return IP_IDX_UNKNOWN;
+		}
+		slot = find_slot(ip);
+	}
+	if ((slot == NULL) || (g_num_of_ips == MAX_NUM_OF_INTERNED_IPS)) {
+		if (g_num_of_untracked++ == 0) {
+			printf("ip_table_intern() table is full (%d IPs), %s (and further IPs) "
+				   "is not tracked \n", MAX_NUM_OF_INTERNED_IPS - 1, ip);
+		}
+		return IP_IDX_UNKNOWN;
+	}
+	strncpy(g_ips[g_num_of_ips], ip, MAX_SIZE_OF_IP_ADD - 1);
+	*slot = (unsigned short)g_num_of_ips++;
+	return *slot;
+}
+
+/*
+ * Get the IP string of an index (empty string for unknown indexes)
+ */
+const char* ip_table_get(unsigned short ip_idx) {
+	if ((ip_idx == IP_IDX_UNKNOWN) || (ip_idx >= g_num_of_ips)) {
+		return "";
+	}
+	return g_ips[ip_idx];
+}
+
+/*
+ * Remove all IPs from the table
+ */
+void ip_table_reset() {
+	if (g_num_of_untracked > 0) {
+		printf("ip_table_intern() did not track %ld IPs (table is full) \n",
+			   g_num_of_untracked);
+	}
+	free(g_slots);
+	free(g_ips);
+	g_slots = NULL;
+	g_ips = NULL;
+	g_size = 0;
+	g_num_of_ips = 1;
+	g_num_of_untracked = 0;
+}
+
+/**
+* @desc   Get the IP string of an interned IP index (see CurlInfo.ip_idx)
+* @param  ip_idx     Interned IP index
+* @param  ip         IP string (allocated with at least MAX_SIZE_OF_IP_ADD)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_get_ip(unsigned short ip_idx, char* ip) {
+	if (ip_idx >= g_num_of_ips) {
+		ip[0] = '\0';
+		return RC_ERROR;
+	}
+	memcpy(ip, ip_table_get(ip_idx), strlen(ip_table_get(ip_idx)) + 1);
+	return RC_OK;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * FNV-1a hash of an IP string
+ */
+static uint32_t hash_ip(const char *ip) {
+	uint32_t hash = 2166136261u;
+
+	while (*ip) {
+		hash ^= (unsigned char)*ip++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * Get the slot of an IP: the slot holding it, or the empty slot it would be
+ * added to. NULL if neither (all slots are taken)
+ */
+static unsigned short* find_slot(const char *ip) {
+	int num_of_slots = 2 * g_size;
+	uint32_t hash = hash_ip(ip);
+
+	for (int i=0; i<num_of_slots; i++) {
+		unsigned short *slot = &g_slots[(hash + i) & (num_of_slots - 1)];
+		if ((*slot == 0) || (strcmp(g_ips[*slot], ip) == 0)) {
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Double the table (the first call allocates it) and rehash its IPs
+ */
+static int grow() {
+	int size = (g_size == 0) ? IP_TABLE_INITIAL_SIZE : 2 * g_size;
+	char (*ips)[MAX_SIZE_OF_IP_ADD];
+	unsigned short *slots;
+
+	ips = realloc(g_ips, size * sizeof(*g_ips));
+	if (ips == NULL) {
+		fprintf(stderr, "realloc() failed\n");
+		return RC_ERROR;
+	}
+	g_ips = ips;
+	slots = calloc(2 * size, sizeof(unsigned short));
+	if (slots == NULL) {
+		fprintf(stderr, "calloc() failed\n");
+		return RC_ERROR;
+	}
+	memset(g_ips[g_size], 0, (size - g_size) * sizeof(*g_ips));
+	free(g_slots);
+	g_slots = slots;
+	g_size = size;
+	for (int i=1; i<g_num_of_ips; i++) {
+		*find_slot(g_ips[i]) = (unsigned short)i;
+	}
+	return RC_OK;
+}
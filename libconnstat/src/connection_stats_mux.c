@@ -0,0 +1,184 @@
+/*
+ * connection_stats_mux.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Multiplexed probing mode of the libconnstat library.
+ * All samples of a run are started at once as concurrent streams over a
+ * single HTTP/2 (or HTTP/3) connection, the same way production clients
+ * talk to the service. It is using the libCURL 'multi' interface with
+ * CURLPIPE_MULTIPLEX and CURLOPT_PIPEWAIT, and limits the run to a single
+ * connection per host, so start_transfer_time of each sample is the time to
+ * first byte of its own stream.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <string.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define MUX_POLL_TIMEOUT_MS     1000
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC add_stream(CURLM *multi, CURL **p_curl, HttpReqData *p_http_req_data,
+					 CurlInfo *curl_info);
+static void cleanup_streams(CURLM *multi, CURL *curl_arr[], int num_of_streams);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Perform all samples of a run concurrently as streams over a single
+*         connection and collect them (in order of start)
+* @param  p_http_req_data	Data as received by the user (multiplex is set)
+* @param  curl_info_arr		Samples to be filled (num_of_http_req entries)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_mux_perform(HttpReqData *p_http_req_data,
+								CurlInfo *curl_info_arr) {
+	CURL *curl_arr[MAX_NUM_OF_SUPPORTED_CURL_OPER];
+	int num_of_streams = p_http_req_data->num_of_http_req;
+	int still_running = 0;
+	CURLMcode mres;
+	CURLMsg *msg;
+	int msgs_left;
+	int i;
+	RC rc;
+
+	memset(curl_arr, 0, sizeof(curl_arr));
+
+	CURLM *multi = curl_multi_init();
+	if (multi == NULL) {
+		printf("connection_stats_mux_perform() fail with curl_multi_init() \n");
+		return RC_ERROR_IN_CURL;
+	}
+
+	/* Multiplex streams, and never open a second connection to the host */
+	mres = curl_multi_setopt(multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+	if (mres == CURLM_OK) {
+		mres = curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 1L);
+	}
+	if (mres != CURLM_OK) {
+		fprintf(stderr, "curl_multi_setopt() failed: %s\n",
+				curl_multi_strerror(mres));
+		curl_multi_cleanup(multi);
+		return RC_ERROR_IN_CURL;
+	}
+
+	/* Start all streams at once */
+	for (i=0; i<num_of_streams; i++) {
+		rc = add_stream(multi, &curl_arr[i], p_http_req_data, &curl_info_arr[i]);
+		if (rc != RC_OK) {
+			cleanup_streams(multi, curl_arr, num_of_streams);
+			return rc;
+		}
+	}
+
+	/* Drive all streams to completion */
+	do {
+		mres = curl_multi_perform(multi, &still_running);
+		if ((mres == CURLM_OK) && still_running) {
+			mres = curl_multi_poll(multi, NULL, 0, MUX_POLL_TIMEOUT_MS, NULL);
+		}
+		if (mres != CURLM_OK) {
+			/* Streams that did not complete stay marked as failed */
+			fprintf(stderr, "curl_multi_perform() failed: %s\n",
+					curl_multi_strerror(mres));
+			break;
+		}
+
+		/* Collect every completed stream */
+		while ((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+			CurlInfo *curl_info;
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+			if (msg->data.result != CURLE_OK) {
+				/* Keep going - failures are classified by the analysis */
+				fprintf(stderr, "stream failed: %s\n",
+						curl_easy_strerror(msg->data.result));
+			}
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&curl_info);
+			connection_stats_collect(msg->easy_handle, msg->data.result, curl_info);
+			samples_notify(p_http_req_data, (int)(curl_info - curl_info_arr), curl_info);
+		}
+	} while (still_running);
+
+	cleanup_streams(multi, curl_arr, num_of_streams);
+	return RC_OK;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Create a single stream (easy handle) and add it to the multi handle
+ */
+static RC add_stream(CURLM *multi, CURL **p_curl, HttpReqData *p_http_req_data,
+					 CurlInfo *curl_info) {
+	CURLcode res;
+	RC rc;
+
+	/* Until collected, the sample is considered failed */
+	memset(curl_info, 0, sizeof(CurlInfo));
+	curl_info->curl_code = CURLE_FAILED_INIT;
+
+	*p_curl = curl_easy_init();
+	if (*p_curl == NULL) {
+		printf("connection_stats_mux_perform() fail with curl_easy_init() \n");
+		return RC_ERROR_IN_CURL;
+	}
+
+	rc = connection_stats_setup_handle(*p_curl, p_http_req_data);
+	if (rc != RC_OK) {
+		return rc;
+	}
+
+	/* Wait for the first connection to be established (and its protocol to
+	   be known) instead of opening a new connection per stream */
+	res = curl_easy_setopt(*p_curl, CURLOPT_PIPEWAIT, 1L);
+	if (res == CURLE_OK) {
+		res = curl_easy_setopt(*p_curl, CURLOPT_PRIVATE, curl_info);
+	}
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_setopt() failed: %s\n",
+				curl_easy_strerror(res));
+		return RC_ERROR_IN_CURL;
+	}
+
+	if (curl_multi_add_handle(multi, *p_curl) != CURLM_OK) {
+		printf("connection_stats_mux_perform() fail with curl_multi_add_handle() \n");
+		return RC_ERROR_IN_CURL;
+	}
+	return RC_OK;
+}
+
+/*
+ * Remove and release all streams and the multi handle
+ */
+static void cleanup_streams(CURLM *multi, CURL *curl_arr[], int num_of_streams) {
+	int i;
+
+	for (i=0; i<num_of_streams; i++) {
+		if (curl_arr[i] != NULL) {
+			curl_multi_remove_handle(multi, curl_arr[i]);
+			trace_tail_release(curl_arr[i]);
+			curl_easy_cleanup(curl_arr[i]);
+		}
+	}
+	curl_multi_cleanup(multi);
+}
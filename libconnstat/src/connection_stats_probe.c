@@ -0,0 +1,1059 @@
+/*
+ * connection_stats_probe.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Connect probe engine of the libconnstat library.
+ * A probe only opens a TCP connection to a target (and optionally completes
+ * a TLS handshake), without any HTTP transfer, so connect latency can be
+ * checked for many thousands of endpoints per second from a single core.
+ * Targets are resolved up front (hostnames concurrently through c-ares, each
+ * hostname once), then up to max_in_flight probes are kept in flight at once:
+ *   io_uring - connects (and the socket polls of TLS handshakes) are queued
+ *              in batches, every one linked to a timeout, so a whole batch
+ *              costs a single system call
+ *   epoll    - non blocking connects, for kernels (or sandboxes) without
+ *              io_uring
+ * liburing is not required - the rings are set up by the raw system calls.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#ifdef PROBE_TLS_ENA
+#include <openssl/ssl.h>
+#endif
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define PROBE_DEFAULT_TIMEOUT_MS    1000
+#define PROBE_DEFAULT_IN_FLIGHT     1024
+#define PROBE_MAX_IN_FLIGHT         8192
+#define PROBE_RESERVED_FDS          64    /* Left to the rest of the process */
+#define PROBE_UD_TIMEOUT            1ULL  /* user_data flag of linked timeouts */
+#define PROBE_RING_OPS_LEN          256   /* Opcodes asked of IORING_REGISTER_PROBE */
+#define NSEC_PER_SEC                1000000000LL
+#define NSEC_PER_MSEC               1000000LL
+
+
+/******************
+**  Structures   **
+******************/
+typedef enum {
+	PROBE_IDLE = 0,
+	PROBE_CONNECTING,
+	PROBE_HANDSHAKING
+} ProbeState;
+
+/* A target, resolved up front */
+typedef struct {
+	struct sockaddr_storage addr;
+	socklen_t   addr_len;          /* 0 if the target could not be resolved */
+	int         tls;               /* https:// targets */
+	long        port;
+	long        timeout_ms;        /* Whole probe (connect and handshake) */
+	char        host[URL_MAX_LEN]; /* For SNI (empty for IP literals) */
+	int         lookup_idx;        /* Its hostname's lookup (-1 if none) */
+} ProbeTarget;
+
+/* A probe in flight */
+typedef struct {
+	ProbeState  state;
+	int         target_idx;
+	int         fd;
+	long long   start_ns;          /* Connect issued (CLOCK_MONOTONIC) */
+	long long   deadline_ns;
+	struct __kernel_timespec timeout;  /* Of the linked timeout (io_uring) */
+#ifdef PROBE_TLS_ENA
+	SSL        *ssl;
+#endif
+} ProbeSlot;
+
+/* A whole probe run */
+typedef struct {
+	ProbeTarget *targets;
+	CurlInfo    *results;
+	int          num_of_targets;
+	int          next_target;      /* Next target to be probed */
+	int          max_in_flight;
+	int          num_in_flight;
+	ProbeSlot   *slots;
+	int         *free_slots;       /* Stack of idle slots */
+	int          num_of_free;
+#ifdef PROBE_TLS_ENA
+	SSL_CTX     *ssl_ctx;
+#endif
+} ProbeRun;
+
+/* An io_uring instance (mapped rings) */
+typedef struct {
+	int          fd;
+	unsigned    *sq_head;
+	unsigned    *sq_tail;
+	unsigned    *sq_mask;
+	unsigned    *sq_array;
+	unsigned     sq_local_tail;    /* Queued, not yet submitted, up to here */
+	unsigned     to_submit;
+	struct io_uring_sqe *sqes;
+	unsigned    *cq_head;
+	unsigned    *cq_tail;
+	unsigned    *cq_mask;
+	struct io_uring_cqe *cqes;
+	void        *sq_ptr;
+	size_t       sq_size;
+	void        *cq_ptr;
+	size_t       cq_size;
+	size_t       sqes_size;
+} IoUring;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC resolve_targets(HttpReqData *targets, ProbeRun *run);
+static RC lookup_hosts(ProbeRun *run, long timeout_ms);
+static int host_comp(const void *elem1, const void *elem2);
+static RC parse_target(const char *url, ProbeTarget *target);
+static int resolve_cached(ProbeTarget *target);
+static ProbeSlot* start_probe(ProbeRun *run, int nonblocking);
+static int  probe_connected(ProbeRun *run, ProbeSlot *slot, int curl_code, long long now);
+static void finish_probe(ProbeRun *run, ProbeSlot *slot, int curl_code, long long now);
+static void abort_probes(ProbeRun *run);
+#ifdef PROBE_TLS_ENA
+static int  probe_handshake(ProbeRun *run, ProbeSlot *slot);
+static long session_key(const ProbeTarget *target, char *ip);
+static void session_resume(const ProbeTarget *target, SSL *ssl);
+static void session_keep(const ProbeTarget *target, SSL *ssl);
+#endif
+static RC   run_io_uring(ProbeRun *run);
+static RC   run_epoll(ProbeRun *run);
+static RC   ring_init(IoUring *ring, unsigned entries);
+static int  ring_supports_ops(int ring_fd);
+static void ring_free(IoUring *ring);
+static struct io_uring_sqe* ring_get_sqe(IoUring *ring);
+static void ring_queue_timeout(IoUring *ring, ProbeSlot *slot, long long timeout_ns);
+static long long now_ns();
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Probe the connect (and TLS handshake) latency of many targets
+*         (see connection_stats.h)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_probe(HttpReqData* targets, int num_of_targets, int max_in_flight,
+						  ConnStatProbeEngine engine, CurlInfo* results) {
+	struct rlimit nofile;
+	long long start_ns;
+	ProbeRun run;
+	RC rc;
+
+	if ((targets == NULL) || (results == NULL) || (num_of_targets <= 0) ||
+		(max_in_flight < 0) || (engine < CONNSTAT_PROBE_ENGINE_AUTO) ||
+		(engine > CONNSTAT_PROBE_ENGINE_EPOLL)) {
+		printf("connection_stats_probe() fail with invalid arguments [num_of_targets=%d, "
+			   "max_in_flight=%d, engine=%d]\n", num_of_targets, max_in_flight, engine);
+		return RC_ERROR;
+	}
+
+	/* Every probe in flight holds a socket */
+	if (max_in_flight == 0) {
+		max_in_flight = PROBE_DEFAULT_IN_FLIGHT;
+	}
+	if (max_in_flight > PROBE_MAX_IN_FLIGHT) {
+		max_in_flight = PROBE_MAX_IN_FLIGHT;
+	}
+	if ((getrlimit(RLIMIT_NOFILE, &nofile) == 0) && (nofile.rlim_cur != RLIM_INFINITY) &&
+		((rlim_t)max_in_flight + PROBE_RESERVED_FDS > nofile.rlim_cur)) {
+		max_in_flight = (nofile.rlim_cur > 2 * PROBE_RESERVED_FDS) ?
+			(int)(nofile.rlim_cur - PROBE_RESERVED_FDS) : PROBE_RESERVED_FDS;
+	}
+	if (max_in_flight > num_of_targets) {
+		max_in_flight = num_of_targets;
+	}
+
+	memset(&run, 0, sizeof(run));
+	run.results        = results;
+	run.num_of_targets = num_of_targets;
+	run.max_in_flight  = max_in_flight;
+	run.targets    = calloc(num_of_targets, sizeof(ProbeTarget));
+	run.slots      = calloc(max_in_flight, sizeof(ProbeSlot));
+	run.free_slots = calloc(max_in_flight, sizeof(int));
+	if ((run.targets == NULL) || (run.slots == NULL) || (run.free_slots == NULL)) {
+		fprintf(stderr, "calloc() failed\n");
+		rc = RC_ERROR;
+		goto cleanup;
+	}
+	for (int i=0; i<max_in_flight; i++) {
+		run.free_slots[run.num_of_free++] = max_in_flight - 1 - i;
+	}
+
+	start_ns = now_ns();
+	rc = resolve_targets(targets, &run);
+	if (rc != RC_OK) {
+		goto cleanup;
+	}
+
+	if (engine != CONNSTAT_PROBE_ENGINE_EPOLL) {
+		rc = run_io_uring(&run);
+		if ((rc == RC_NOT_SUPPORTED) && (engine == CONNSTAT_PROBE_ENGINE_AUTO)) {
+			engine = CONNSTAT_PROBE_ENGINE_EPOLL;
+		} else {
+			engine = CONNSTAT_PROBE_ENGINE_IO_URING;
+		}
+	}
+	if (engine == CONNSTAT_PROBE_ENGINE_EPOLL) {
+		rc = run_epoll(&run);
+	}
+	if (rc == RC_OK) {
+		printf("connection_stats_probe() probed %d targets in %.0f ms (%s) \n",
+			   num_of_targets, (now_ns() - start_ns) / 1e6,
+			   (engine == CONNSTAT_PROBE_ENGINE_EPOLL) ? "epoll" : "io_uring");
+	}
+
+cleanup:
+#ifdef PROBE_TLS_ENA
+	if (run.ssl_ctx != NULL) {
+		SSL_CTX_free(run.ssl_ctx);
+	}
+#endif
+	free(run.targets);
+	free(run.slots);
+	free(run.free_slots);
+	return rc;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Resolve all targets: IP literals are taken as is, addresses of the warm
+ * start cache without any lookup, and the other hostnames are looked up
+ * concurrently, each once. Targets that can not be resolved are failed
+ * right away
+ */
+static RC resolve_targets(HttpReqData *targets, ProbeRun *run) {
+	long timeout_ms = 0;
+	RC rc;
+
+	for (int i=0; i<run->num_of_targets; i++) {
+		ProbeTarget *target = &run->targets[i];
+		CurlInfo *result = &run->results[i];
+		struct sockaddr_in  *addr4 = (struct sockaddr_in *)&target->addr;
+		struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&target->addr;
+		long long lookup_start_ns;
+
+		rc = parse_target(targets[i].url, target);
+		if (rc != RC_OK) {
+			return rc;
+		}
+		if ((targets[i].timeout_ms < 0) || (targets[i].connect_timeout_ms < 0)) {
+			printf("connection_stats_probe() fail with negative timeouts \n");
+			return RC_INVALID_TIMEOUT;
+		}
+		target->timeout_ms = (targets[i].connect_timeout_ms > 0) ? targets[i].connect_timeout_ms :
+							 (targets[i].timeout_ms > 0) ? targets[i].timeout_ms :
+							 PROBE_DEFAULT_TIMEOUT_MS;
+#ifdef PROBE_TLS_ENA
+		if (target->tls && (run->ssl_ctx == NULL)) {
+			/* Latency is measured, not trust - the peer is not verified */
+			run->ssl_ctx = SSL_CTX_new(TLS_client_method());
+			if (run->ssl_ctx == NULL) {
+				printf("connection_stats_probe() fail with SSL_CTX_new() \n");
+				return RC_ERROR;
+			}
+			SSL_CTX_set_verify(run->ssl_ctx, SSL_VERIFY_NONE, NULL);
+		}
+#endif
+
+		memset(result, 0, sizeof(CurlInfo));
+		target->lookup_idx = -1;
+		lookup_start_ns = now_ns();
+		if (inet_pton(AF_INET, target->host, &addr4->sin_addr) == 1) {
+			addr4->sin_family = AF_INET;
+			target->addr_len  = sizeof(struct sockaddr_in);
+			target->host[0]   = '\0';
+		} else if (inet_pton(AF_INET6, target->host, &addr6->sin6_addr) == 1) {
+			addr6->sin6_family = AF_INET6;
+			target->addr_len   = sizeof(struct sockaddr_in6);
+			target->host[0]    = '\0';
+		} else if (resolve_cached(target)) {
+			/* A warm start takes the cached address, without any lookup */
+			result->name_lookup_time = (now_ns() - lookup_start_ns) / 1e9;
+		} else {
+			target->lookup_idx = 0;  /* To be looked up */
+			if (target->timeout_ms > timeout_ms) {
+				timeout_ms = target->timeout_ms;
+			}
+		}
+	}
+
+	rc = lookup_hosts(run, timeout_ms);
+	if (rc != RC_OK) {
+		return rc;
+	}
+
+	for (int i=0; i<run->num_of_targets; i++) {
+		ProbeTarget *target = &run->targets[i];
+		CurlInfo *result = &run->results[i];
+		struct sockaddr_in  *addr4 = (struct sockaddr_in *)&target->addr;
+		struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&target->addr;
+		char ip[MAX_SIZE_OF_IP_ADD];
+
+		if (target->addr_len == 0) {
+			result->curl_code  = CURLE_COULDNT_RESOLVE_HOST;
+			result->total_time = result->name_lookup_time;
+			continue;
+		}
+		if (target->addr.ss_family == AF_INET) {
+			addr4->sin_port = htons((unsigned short)target->port);
+			inet_ntop(AF_INET, &addr4->sin_addr, ip, sizeof(ip));
+		} else {
+			addr6->sin6_port = htons((unsigned short)target->port);
+			inet_ntop(AF_INET6, &addr6->sin6_addr, ip, sizeof(ip));
+		}
+		result->ip_idx = ip_table_intern(ip);
+		if (target->host[0] != '\0') {
+			char addrs[MAX_SIZE_OF_IP_ADD + 2];
+			snprintf(addrs, sizeof(addrs),
+					 (target->addr.ss_family == AF_INET6) ? "[%s]" : "%s", ip);
+			cache_note_dns(target->host, target->port, addrs, 0);
+		}
+	}
+	return RC_OK;
+}
+
+/*
+ * Look up the hostnames of the targets marked for lookup (lookup_idx 0), a
+ * single lookup per hostname, all at once (c-ares), and fill the targets
+ * with their answers. The targets of a hostname share its name_lookup_time
+ */
+static RC lookup_hosts(ProbeRun *run, long timeout_ms) {
+	ProbeTarget **by_host;
+	DnsLookup *lookups;
+	int num_of_pending = 0;
+	int num_of_lookups = 0;
+	int i;
+	RC rc;
+
+	for (i=0; i<run->num_of_targets; i++) {
+		num_of_pending += (run->targets[i].lookup_idx == 0);
+	}
+	if (num_of_pending == 0) {
+		return RC_OK;
+	}
+	by_host = calloc(num_of_pending, sizeof(ProbeTarget *));
+	lookups = calloc(num_of_pending, sizeof(DnsLookup));
+	if ((by_host == NULL) || (lookups == NULL)) {
+		fprintf(stderr, "calloc() failed\n");
+		free(by_host);
+		free(lookups);
+		return RC_ERROR;
+	}
+
+	/* Sorted by hostname, the targets of a hostname are adjacent */
+	num_of_pending = 0;
+	for (i=0; i<run->num_of_targets; i++) {
+		if (run->targets[i].lookup_idx == 0) {
+			by_host[num_of_pending++] = &run->targets[i];
+		}
+	}
+	qsort(by_host, num_of_pending, sizeof(ProbeTarget *), host_comp);
+	for (i=0; i<num_of_pending; i++) {
+		if ((i == 0) || (strcmp(by_host[i]->host, by_host[i - 1]->host) != 0)) {
+			lookups[num_of_lookups++].host = by_host[i]->host;
+		}
+		by_host[i]->lookup_idx = num_of_lookups - 1;
+	}
+
+	rc = dns_lookup(lookups, num_of_lookups, timeout_ms);
+	if (rc == RC_OK) {
+		for (i=0; i<num_of_pending; i++) {
+			ProbeTarget *target = by_host[i];
+			DnsLookup *lookup = &lookups[target->lookup_idx];
+
+			memcpy(&target->addr, &lookup->addr, lookup->addr_len);
+			target->addr_len = lookup->addr_len;
+			run->results[target - run->targets].name_lookup_time = lookup->lookup_time;
+		}
+	}
+
+	free(by_host);
+	free(lookups);
+	return rc;
+}
+
+/*
+ * Hostname order of targets (for qsort)
+ */
+static int host_comp(const void *elem1, const void *elem2) {
+	const ProbeTarget *target1 = *(ProbeTarget * const *)elem1;
+	const ProbeTarget *target2 = *(ProbeTarget * const *)elem2;
+
+	return strcmp(target1->host, target2->host);
+}
+
+/*
+ * Take the (first) cached address of a target. Returns non zero if found
+ */
+static int resolve_cached(ProbeTarget *target) {
+	const char *addrs = cache_get_dns(target->host, target->port);
+	struct sockaddr_in  *addr4 = (struct sockaddr_in *)&target->addr;
+	struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&target->addr;
+	char ip[MAX_SIZE_OF_IP_ADD];
+	size_t len;
+
+	if (addrs == NULL) {
+		return 0;
+	}
+	/* CURLOPT_RESOLVE format: comma separated, IPv6 addresses bracketed */
+	if (addrs[0] == '[') {
+		addrs++;
+	}
+	len = strcspn(addrs, "],");
+	if (len >= sizeof(ip)) {
+		return 0;
+	}
+	memcpy(ip, addrs, len);
+	ip[len] = '\0';
+	if (inet_pton(AF_INET, ip, &addr4->sin_addr) == 1) {
+		addr4->sin_family = AF_INET;
+		target->addr_len  = sizeof(struct sockaddr_in);
+		return 1;
+	}
+	if (inet_pton(AF_INET6, ip, &addr6->sin6_addr) == 1) {
+		addr6->sin6_family = AF_INET6;
+		target->addr_len   = sizeof(struct sockaddr_in6);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Extract scheme, host and port out of a target URL
+ */
+static RC parse_target(const char *url, ProbeTarget *target) {
+	CURLU *curlu = curl_url();
+	char *scheme = NULL;
+	char *host = NULL;
+	char *port_str = NULL;
+	RC rc = RC_OK;
+
+	if (curlu == NULL) {
+		return RC_ERROR_IN_CURL;
+	}
+	if ((curl_url_set(curlu, CURLUPART_URL, url, CURLU_GUESS_SCHEME) != CURLUE_OK) ||
+		(curl_url_get(curlu, CURLUPART_SCHEME, &scheme, 0) != CURLUE_OK) ||
+		(curl_url_get(curlu, CURLUPART_HOST, &host, 0) != CURLUE_OK) ||
+		(curl_url_get(curlu, CURLUPART_PORT, &port_str, CURLU_DEFAULT_PORT) != CURLUE_OK) ||
+		(strlen(host) >= URL_MAX_LEN) ||
+		((strcmp(scheme, "http") != 0) && (strcmp(scheme, "https") != 0))) {
+		printf("connection_stats_probe() fail with invalid url %s\n", url);
+		rc = RC_INVALID_URL;
+	} else {
+		/* IPv6 literals come in brackets */
+		size_t host_len = strlen(host);
+		if ((host[0] == '[') && (host[host_len - 1] == ']')) {
+			memcpy(target->host, host + 1, host_len - 2);
+			target->host[host_len - 2] = '\0';
+		} else {
+			strcpy(target->host, host);
+		}
+		target->tls = (strcmp(scheme, "https") == 0);
+		target->port = atol(port_str);
+	}
+
+	curl_free(scheme);
+	curl_free(host);
+	curl_free(port_str);
+	curl_url_cleanup(curlu);
+	return rc;
+}
+
+/*
+ * Take the next resolved target into a free slot and open its socket.
+ * NULL if there is nothing left to probe (or no free slot)
+ */
+static ProbeSlot* start_probe(ProbeRun *run, int nonblocking) {
+	while ((run->num_of_free > 0) && (run->next_target < run->num_of_targets)) {
+		int target_idx = run->next_target++;
+		ProbeTarget *target = &run->targets[target_idx];
+		ProbeSlot *slot;
+		int fd;
+
+		if (target->addr_len == 0) {
+			continue;  /* Failed resolving */
+		}
+		fd = socket(target->addr.ss_family,
+					SOCK_STREAM | SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0), 0);
+		if (fd == -1) {
+			perror("socket()");
+			run->results[target_idx].curl_code  = CURLE_COULDNT_CONNECT;
+			run->results[target_idx].total_time = run->results[target_idx].name_lookup_time;
+			continue;
+		}
+
+		slot = &run->slots[run->free_slots[--run->num_of_free]];
+		memset(slot, 0, sizeof(ProbeSlot));
+		slot->state      = PROBE_CONNECTING;
+		slot->target_idx = target_idx;
+		slot->fd         = fd;
+		run->num_in_flight++;
+		return slot;
+	}
+	return NULL;
+}
+
+/*
+ * A connect completed (curl_code is 0 on success). Returns the poll events
+ * the TLS handshake waits for, 0 if the probe is done
+ */
+static int probe_connected(ProbeRun *run, ProbeSlot *slot, int curl_code, long long now) {
+	CurlInfo *result = &run->results[slot->target_idx];
+	ProbeTarget *target = &run->targets[slot->target_idx];
+
+	if (curl_code != CURLE_OK) {
+		finish_probe(run, slot, curl_code, now);
+		return 0;
+	}
+	result->connect_time = result->name_lookup_time + (now - slot->start_ns) / 1e9;
+	if (!target->tls) {
+		finish_probe(run, slot, CURLE_OK, now);
+		return 0;
+	}
+
+#ifdef PROBE_TLS_ENA
+	/* The handshake is driven by readiness, on a non blocking socket */
+	fcntl(slot->fd, F_SETFL, fcntl(slot->fd, F_GETFL) | O_NONBLOCK);
+	slot->ssl = SSL_new(run->ssl_ctx);
+	if ((slot->ssl == NULL) || (SSL_set_fd(slot->ssl, slot->fd) != 1) ||
+		((target->host[0] != '\0') && (SSL_set_tlsext_host_name(slot->ssl, target->host) != 1))) {
+		finish_probe(run, slot, CURLE_SSL_CONNECT_ERROR, now);
+		return 0;
+	}
+	session_resume(target, slot->ssl);
+	slot->state = PROBE_HANDSHAKING;
+	return probe_handshake(run, slot);
+#else
+	/* Built without TLS (PROBE_TLS=0): the connect is still measured */
+	finish_probe(run, slot, CURLE_NOT_BUILT_IN, now);
+	return 0;
+#endif
+}
+
+#ifdef PROBE_TLS_ENA
+/*
+ * Drive the TLS handshake of a probe. Returns the poll events it waits for,
+ * 0 if the probe is done (timed after SSL_connect, as its crypto may take
+ * a while)
+ */
+static int probe_handshake(ProbeRun *run, ProbeSlot *slot) {
+	int ret = SSL_connect(slot->ssl);
+
+	if (ret == 1) {
+		long long now = now_ns();
+		session_keep(&run->targets[slot->target_idx], slot->ssl);
+		finish_probe(run, slot, CURLE_OK, now);
+		return 0;
+	}
+	switch (SSL_get_error(slot->ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		return POLLIN;
+	case SSL_ERROR_WANT_WRITE:
+		return POLLOUT;
+	default:
+		finish_probe(run, slot, CURLE_SSL_CONNECT_ERROR, now_ns());
+		return 0;
+	}
+}
+#endif  // PROBE_TLS_ENA
+
+/*
+ * Fill the result of a probe and release its slot. total_time is the end of
+ * the probe (the connect, or the handshake of TLS targets). connect_time is
+ * kept once connected, even if the probe failed later (as libCURL's)
+ */
+static void finish_probe(ProbeRun *run, ProbeSlot *slot, int curl_code, long long now) {
+	CurlInfo *result = &run->results[slot->target_idx];
+	struct timespec wall;
+
+	result->curl_code       = curl_code;
+	result->num_of_connects = 1;
+	result->total_time      = result->name_lookup_time + (now - slot->start_ns) / 1e9;
+	clock_gettime(CLOCK_REALTIME, &wall);
+	result->timestamp_us = (long long)wall.tv_sec * 1000000 + wall.tv_nsec / 1000;
+
+#ifdef PROBE_TLS_ENA
+	if (slot->ssl != NULL) {
+		SSL_free(slot->ssl);
+		slot->ssl = NULL;
+	}
+#endif
+	close(slot->fd);
+	slot->state = PROBE_IDLE;
+	run->free_slots[run->num_of_free++] = (int)(slot - run->slots);
+	run->num_in_flight--;
+}
+
+/*
+ * Close the probes left in flight (when an engine fails), as timed out
+ */
+static void abort_probes(ProbeRun *run) {
+	for (int i=0; i<run->max_in_flight; i++) {
+		if (run->slots[i].state != PROBE_IDLE) {
+			finish_probe(run, &run->slots[i], CURLE_OPERATION_TIMEDOUT, now_ns());
+		}
+	}
+}
+
+#ifdef PROBE_TLS_ENA
+/*
+ * Get the key of a target's TLS session in the warm start cache: its IP
+ * (at least MAX_SIZE_OF_IP_ADD) and port (returned)
+ */
+static long session_key(const ProbeTarget *target, char *ip) {
+	const struct sockaddr_in  *addr4 = (const struct sockaddr_in *)&target->addr;
+	const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)&target->addr;
+
+	if (target->addr.ss_family == AF_INET) {
+		inet_ntop(AF_INET, &addr4->sin_addr, ip, MAX_SIZE_OF_IP_ADD);
+		return ntohs(addr4->sin_port);
+	}
+	inet_ntop(AF_INET6, &addr6->sin6_addr, ip, MAX_SIZE_OF_IP_ADD);
+	return ntohs(addr6->sin6_port);
+}
+
+/*
+ * Resume the cached TLS session of a target (if any)
+ */
+static void session_resume(const ProbeTarget *target, SSL *ssl) {
+	char ip[MAX_SIZE_OF_IP_ADD];
+	const unsigned char *der;
+	SSL_SESSION *session;
+	size_t der_len = 0;
+	long port;
+
+	if (!cache_is_enabled()) {
+		return;
+	}
+	port = session_key(target, ip);
+	der = cache_get_tls(ip, port, &der_len);
+	if (der == NULL) {
+		return;
+	}
+	session = d2i_SSL_SESSION(NULL, &der, (long)der_len);
+	if (session != NULL) {
+		SSL_set_session(ssl, session);
+		SSL_SESSION_free(session);
+	}
+}
+
+/*
+ * Cache the TLS session of a completed handshake, for the next process.
+ * Note: TLS 1.3 tickets arrive after the handshake, so only those already
+ * received are kept (the probe does not wait for them)
+ */
+static void session_keep(const ProbeTarget *target, SSL *ssl) {
+	SSL_SESSION *session = SSL_get0_session(ssl);
+	char ip[MAX_SIZE_OF_IP_ADD];
+	unsigned char *der;
+	unsigned char *p;
+	int der_len;
+	long port;
+
+	if (!cache_is_enabled() || (session == NULL) || SSL_session_reused(ssl) ||
+		!SSL_SESSION_is_resumable(session)) {
+		return;
+	}
+	der_len = i2d_SSL_SESSION(session, NULL);
+	if (der_len <= 0) {
+		return;
+	}
+	der = malloc(der_len);
+	if (der == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		return;
+	}
+	p = der;
+	i2d_SSL_SESSION(session, &p);
+	port = session_key(target, ip);
+	cache_note_tls(ip, port, der, der_len, SSL_SESSION_get_timeout(session));
+	free(der);
+}
+#endif  // PROBE_TLS_ENA
+
+/*
+ * io_uring engine: every round queues the connects of all free slots (and
+ * the polls of handshakes), each linked to the probe's timeout, submits them
+ * and waits for completions in a single io_uring_enter
+ */
+static RC run_io_uring(ProbeRun *run) {
+	IoUring ring;
+	int *new_slots;
+	RC rc;
+
+	/* Each probe in flight has up to 2 entries (operation and linked timeout) */
+	rc = ring_init(&ring, 2 * run->max_in_flight);
+	if (rc != RC_OK) {
+		return rc;
+	}
+	new_slots = calloc(run->max_in_flight, sizeof(int));
+	if (new_slots == NULL) {
+		fprintf(stderr, "calloc() failed\n");
+		ring_free(&ring);
+		return RC_ERROR;
+	}
+
+	for (;;) {
+		int num_of_new = 0;
+		ProbeSlot *slot;
+		long long now;
+
+		while ((slot = start_probe(run, 0)) != NULL) {
+			ProbeTarget *target = &run->targets[slot->target_idx];
+			struct io_uring_sqe *sqe = ring_get_sqe(&ring);
+
+			sqe->opcode    = IORING_OP_CONNECT;
+			sqe->fd        = slot->fd;
+			sqe->addr      = (unsigned long)&target->addr;
+			sqe->off       = target->addr_len;
+			sqe->flags     = IOSQE_IO_LINK;
+			sqe->user_data = (unsigned long long)(slot - run->slots) << 1;
+			ring_queue_timeout(&ring, slot, target->timeout_ms * NSEC_PER_MSEC);
+			new_slots[num_of_new++] = (int)(slot - run->slots);
+		}
+		if (run->num_in_flight == 0) {
+			break;
+		}
+
+		/* The connects of a round are issued by the same system call */
+		now = now_ns();
+		for (int i=0; i<num_of_new; i++) {
+			slot = &run->slots[new_slots[i]];
+			slot->start_ns    = now;
+			slot->deadline_ns = now + run->targets[slot->target_idx].timeout_ms * NSEC_PER_MSEC;
+		}
+
+		__atomic_store_n(ring.sq_tail, ring.sq_local_tail, __ATOMIC_RELEASE);
+		if ((syscall(__NR_io_uring_enter, ring.fd, ring.to_submit, 1,
+					 IORING_ENTER_GETEVENTS, NULL, 0) == -1) && (errno != EINTR)) {
+			perror("io_uring_enter()");
+			rc = RC_ERROR;
+			break;
+		}
+		ring.to_submit = 0;
+
+		/* Reap all completions */
+		unsigned head = *ring.cq_head;
+		unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+		now = now_ns();
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+			int events = 0;
+
+			if (cqe->user_data & PROBE_UD_TIMEOUT) {
+				continue;  /* The probe itself reports the timeout */
+			}
+			slot = &run->slots[cqe->user_data >> 1];
+			if (slot->state == PROBE_CONNECTING) {
+				events = probe_connected(run, slot, (cqe->res == 0) ? CURLE_OK :
+										 (cqe->res == -ECANCELED) ? CURLE_OPERATION_TIMEDOUT :
+										 CURLE_COULDNT_CONNECT, now);
+#ifdef PROBE_TLS_ENA
+			} else if (cqe->res == -ECANCELED) {
+				finish_probe(run, slot, CURLE_OPERATION_TIMEDOUT, now);
+				events = 0;
+			} else if (cqe->res < 0) {
+				finish_probe(run, slot, CURLE_SSL_CONNECT_ERROR, now);
+				events = 0;
+			} else {
+				events = probe_handshake(run, slot);
+#endif
+			}
+
+			/* Wait for the socket (within what is left of the timeout) */
+			if (events != 0) {
+				if (slot->deadline_ns <= now) {
+					finish_probe(run, slot, CURLE_OPERATION_TIMEDOUT, now);
+					continue;
+				}
+				struct io_uring_sqe *sqe = ring_get_sqe(&ring);
+				sqe->opcode        = IORING_OP_POLL_ADD;
+				sqe->fd            = slot->fd;
+				sqe->poll32_events = events;
+				sqe->flags         = IOSQE_IO_LINK;
+				sqe->user_data     = (unsigned long long)(slot - run->slots) << 1;
+				ring_queue_timeout(&ring, slot, slot->deadline_ns - now);
+			}
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	/* Closing the ring cancels its queued operations, before their probes go */
+	ring_free(&ring);
+	abort_probes(run);
+	free(new_slots);
+	return rc;
+}
+
+/*
+ * epoll engine: non blocking connects, timeouts are checked every round
+ */
+static RC run_epoll(ProbeRun *run) {
+	struct epoll_event *events_arr;
+	int epoll_fd;
+	RC rc = RC_OK;
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	events_arr = calloc(run->max_in_flight, sizeof(struct epoll_event));
+	if ((epoll_fd == -1) || (events_arr == NULL)) {
+		perror("epoll_create1()");
+		if (epoll_fd != -1) {
+			close(epoll_fd);
+		}
+		free(events_arr);
+		return RC_ERROR;
+	}
+
+	for (;;) {
+		long long now, next_deadline_ns = 0;
+		ProbeSlot *slot;
+		int num_of_events;
+
+		while ((slot = start_probe(run, 1)) != NULL) {
+			ProbeTarget *target = &run->targets[slot->target_idx];
+			struct epoll_event ev;
+			int events;
+
+			slot->start_ns    = now_ns();
+			slot->deadline_ns = slot->start_ns + target->timeout_ms * NSEC_PER_MSEC;
+			if (connect(slot->fd, (struct sockaddr *)&target->addr, target->addr_len) == 0) {
+				events = probe_connected(run, slot, CURLE_OK, now_ns());
+			} else if (errno == EINPROGRESS) {
+				events = POLLOUT;
+			} else {
+				events = probe_connected(run, slot, CURLE_COULDNT_CONNECT, now_ns());
+			}
+			if (events != 0) {
+				ev.events   = (events == POLLIN) ? EPOLLIN : EPOLLOUT;
+				ev.data.u32 = (uint32_t)(slot - run->slots);
+				epoll_ctl(epoll_fd, EPOLL_CTL_ADD, slot->fd, &ev);
+			}
+		}
+		if (run->num_in_flight == 0) {
+			break;
+		}
+
+		for (int i=0; i<run->max_in_flight; i++) {
+			if ((run->slots[i].state != PROBE_IDLE) &&
+				((next_deadline_ns == 0) || (run->slots[i].deadline_ns < next_deadline_ns))) {
+				next_deadline_ns = run->slots[i].deadline_ns;
+			}
+		}
+		now = now_ns();
+		num_of_events = epoll_wait(epoll_fd, events_arr, run->max_in_flight,
+			(next_deadline_ns > now) ?
+			(int)((next_deadline_ns - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC) : 0);
+		if ((num_of_events == -1) && (errno != EINTR)) {
+			perror("epoll_wait()");
+			rc = RC_ERROR;
+			break;
+		}
+
+		now = now_ns();
+		for (int i=0; i<num_of_events; i++) {
+			int events = 0;
+
+			slot = &run->slots[events_arr[i].data.u32];
+			if (slot->state == PROBE_CONNECTING) {
+				int err = 0;
+				socklen_t err_len = sizeof(err);
+				getsockopt(slot->fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+				events = probe_connected(run, slot, (err == 0) ? CURLE_OK :
+										 CURLE_COULDNT_CONNECT, now);
+#ifdef PROBE_TLS_ENA
+			} else {
+				events = probe_handshake(run, slot);
+#endif
+			}
+			if (events != 0) {
+				struct epoll_event ev;
+				ev.events   = (events == POLLIN) ? EPOLLIN : EPOLLOUT;
+				ev.data.u32 = events_arr[i].data.u32;
+				epoll_ctl(epoll_fd, EPOLL_CTL_MOD, slot->fd, &ev);
+			}
+		}
+
+		/* Expire probes over their timeout (close() also removes them from epoll) */
+		for (int i=0; i<run->max_in_flight; i++) {
+			if ((run->slots[i].state != PROBE_IDLE) && (run->slots[i].deadline_ns <= now)) {
+				finish_probe(run, &run->slots[i], CURLE_OPERATION_TIMEDOUT, now);
+			}
+		}
+	}
+
+	abort_probes(run);
+	close(epoll_fd);
+	free(events_arr);
+	return rc;
+}
+
+/*
+ * Set up an io_uring instance and map its rings. RC_NOT_SUPPORTED if the
+ * kernel does not support (or allow) io_uring, or any of the opcodes queued
+ * by the engine (the AUTO engine then falls back to epoll)
+ */
+static RC ring_init(IoUring *ring, unsigned entries) {
+	struct io_uring_params params;
+
+	memset(ring, 0, sizeof(IoUring));
+	memset(&params, 0, sizeof(params));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd == -1) {
+		return RC_NOT_SUPPORTED;
+	}
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !ring_supports_ops(ring->fd)) {
+		close(ring->fd);
+		return RC_NOT_SUPPORTED;
+	}
+
+	/* A single mapping holds both rings (IORING_FEAT_SINGLE_MMAP) */
+	ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (ring->cq_size > ring->sq_size) {
+		ring->sq_size = ring->cq_size;
+	}
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		close(ring->fd);
+		return RC_NOT_SUPPORTED;
+	}
+	ring->cq_ptr = ring->sq_ptr;
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		munmap(ring->sq_ptr, ring->sq_size);
+		close(ring->fd);
+		return RC_NOT_SUPPORTED;
+	}
+
+	ring->sq_head  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.head);
+	ring->sq_tail  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+	ring->sq_mask  = (unsigned *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+	ring->cq_head  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+	ring->cq_tail  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+	ring->cq_mask  = (unsigned *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+	ring->cqes     = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+	ring->sq_local_tail = *ring->sq_tail;
+	return RC_OK;
+}
+
+/*
+ * Check that the kernel supports every opcode the engine queues. Kernels
+ * (or seccomp filters) may allow io_uring, but not all of its operations.
+ * Returns non zero if all are supported
+ */
+static int ring_supports_ops(int ring_fd) {
+	static const int ops[] = { IORING_OP_CONNECT, IORING_OP_LINK_TIMEOUT,
+							   IORING_OP_POLL_ADD };
+	struct io_uring_probe *probe;
+	int supported = 1;
+
+	probe = calloc(1, sizeof(struct io_uring_probe) +
+					  PROBE_RING_OPS_LEN * sizeof(struct io_uring_probe_op));
+	if (probe == NULL) {
+		fprintf(stderr, "calloc() failed\n");
+		return 0;
+	}
+	/* IORING_REGISTER_PROBE itself is newer than some of the opcodes (5.6) */
+	if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe,
+				PROBE_RING_OPS_LEN) == -1) {
+		free(probe);
+		return 0;
+	}
+	for (size_t i=0; i<sizeof(ops) / sizeof(ops[0]); i++) {
+		if ((ops[i] > probe->last_op) || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+			printf("connection_stats_probe() io_uring does not support opcode %d \n", ops[i]);
+			supported = 0;
+		}
+	}
+	free(probe);
+	return supported;
+}
+
+/*
+ * Unmap the rings and close an io_uring instance
+ */
+static void ring_free(IoUring *ring) {
+	munmap(ring->sqes, ring->sqes_size);
+	munmap(ring->sq_ptr, ring->sq_size);
+	close(ring->fd);
+}
+
+/*
+ * Get a cleared submission queue entry. The ring is sized for 2 entries per
+ * slot, and all entries are submitted every round, so one is always free
+ */
+static struct io_uring_sqe* ring_get_sqe(IoUring *ring) {
+	unsigned idx = ring->sq_local_tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+	ring->sq_array[idx] = idx;
+	ring->sq_local_tail++;
+	ring->to_submit++;
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	return sqe;
+}
+
+/*
+ * Queue the timeout linked to the last queued operation of a slot
+ */
+static void ring_queue_timeout(IoUring *ring, ProbeSlot *slot, long long timeout_ns) {
+	struct io_uring_sqe *sqe = ring_get_sqe(ring);
+
+	slot->timeout.tv_sec  = timeout_ns / NSEC_PER_SEC;
+	slot->timeout.tv_nsec = timeout_ns % NSEC_PER_SEC;
+	sqe->opcode    = IORING_OP_LINK_TIMEOUT;
+	sqe->fd        = -1;
+	sqe->addr      = (unsigned long)&slot->timeout;
+	sqe->len       = 1;
+	sqe->user_data = PROBE_UD_TIMEOUT;
+}
+
+/*
+ * CLOCK_MONOTONIC in nanoseconds
+ */
+static long long now_ns() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
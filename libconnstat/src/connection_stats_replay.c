@@ -0,0 +1,548 @@
+/*
+ * connection_stats_replay.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Trace replay of the libconnstat library.
+ * A trace (trace/trace.out or trace/tail.out of the debug variant) records
+ * every exchange of a run: the request, then the response headers and data,
+ * each event stamped with the time it was traced (at=). Replay serves the
+ * recorded responses from a local HTTP/1.1 server, in their recorded order,
+ * and keeps their server side timing: the gap between the end of the request
+ * and the response headers, and the gaps between the chunks of data. A
+ * production incident can then be measured again offline, as many times as
+ * needed, and library changes benchmarked against real traffic shapes.
+ * Response headers are replayed as traced. Data is replayed by size only
+ * (traces keep its printable characters only), so the framing headers are
+ * rewritten: the body is sent with a Content-Length of the traced data, and
+ * without its original Transfer-Encoding and Content-Encoding. TLS is not
+ * replayed - the server is plain HTTP.
+ */
+
+/******************
+**   Includes    **
+******************/
+#define _GNU_SOURCE         // strcasestr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define REPLAY_MAX_LINE_LEN         1024
+#define REPLAY_MAX_REQUEST_SIZE     16384
+#define REPLAY_POLL_MS              100   /* Serving checks stop this often */
+#define REPLAY_FILLER_SIZE          4096
+
+
+/******************
+**  Structures   **
+******************/
+/* A chunk of response data */
+typedef struct {
+	long long delay_us;   /* Since the previous response event */
+	size_t    size;
+} ReplayChunk;
+
+/* A single recorded exchange */
+typedef struct {
+	long long    request_at_us;  /* Last request event (while parsing) */
+	long long    last_at_us;     /* Last response event (while parsing) */
+	long long    headers_delay_us; /* From the end of the request */
+	char        *headers;        /* Rewritten response headers */
+	size_t       headers_len;
+	int          close;          /* Connection: close was recorded */
+	ReplayChunk *chunks;
+	int          num_of_chunks;
+	size_t       body_size;
+} ReplayExchange;
+
+/* State of a replay server */
+typedef struct {
+	ReplayExchange *exchanges;
+	int             num_of_exchanges;
+	int             next_exchange;   /* Round robin, under lock */
+	int             num_of_active;   /* Connections served, under lock */
+	pthread_mutex_t lock;
+	volatile int   *stop;
+} ReplayServer;
+
+/* A connection being served */
+typedef struct {
+	ReplayServer *server;
+	int           sock;
+} ReplayConnection;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC load_trace(const char *trace_path, ReplayServer *server);
+static RC finish_exchange(ReplayServer *server, ReplayExchange *exchange);
+static RC append_header(ReplayExchange *exchange, const char *line, size_t len);
+static RC append_raw(ReplayExchange *exchange, const char *data, size_t len);
+static long long parse_at(const char *line);
+static void free_exchanges(ReplayServer *server);
+static void* serve_connection(void *arg);
+static int read_request(ReplayConnection *connection, char *buf, size_t *p_len);
+static int send_all(int sock, const char *data, size_t len);
+static void sleep_us(long long usec);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Replay the responses of a trace from a local server
+*         (see connection_stats.h)
+* @param  trace_path	Trace to be replayed
+* @param  port			Port to be served on 127.0.0.1
+* @param  stop			Serving ends once *stop is set
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_replay_serve(const char* trace_path, int port, volatile int* stop) {
+	struct timeval tv = { 0, REPLAY_POLL_MS * 1000 };
+	struct sockaddr_in addr;
+	ReplayServer server;
+	int reuse = 1;
+	int sock;
+	RC rc;
+
+	if ((trace_path == NULL) || (stop == NULL) || (port <= 0) || (port > 65535)) {
+		printf("connection_stats_replay_serve() fail with invalid args \n");
+		return RC_ERROR;
+	}
+	memset(&server, 0, sizeof(server));
+	server.stop = stop;
+	rc = load_trace(trace_path, &server);
+	if (rc != RC_OK) {
+		return rc;
+	}
+
+	sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock == -1) {
+		perror("socket() replay");
+		free_exchanges(&server);
+		return RC_ERROR;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = htons(port);
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	if ((setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) ||
+		(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) ||
+		(listen(sock, 64) == -1)) {
+		perror("bind() replay");
+		close(sock);
+		free_exchanges(&server);
+		return RC_ERROR;
+	}
+	pthread_mutex_init(&server.lock, NULL);
+	printf("connection_stats_replay_serve() replaying %d exchanges of %s on "
+		   "http://127.0.0.1:%d/ \n", server.num_of_exchanges, trace_path, port);
+
+	/* A thread per connection, so parallel transfers keep their timing */
+	while (!*stop) {
+		ReplayConnection *connection;
+		pthread_t thread;
+		int conn_sock = accept(sock, NULL, NULL);
+
+		if (conn_sock == -1) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+				continue;  /* Idle - check stop */
+			}
+			perror("accept() replay");
+			rc = RC_ERROR;
+			break;
+		}
+		connection = malloc(sizeof(ReplayConnection));
+		if (connection == NULL) {
+			fprintf(stderr, "malloc() failed\n");
+			close(conn_sock);
+			continue;
+		}
+		/* Chunks go out at their recorded time (not held by Nagle) */
+		setsockopt(conn_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(conn_sock, IPPROTO_TCP, TCP_NODELAY, &reuse, sizeof(reuse));
+		connection->server = &server;
+		connection->sock = conn_sock;
+		pthread_mutex_lock(&server.lock);
+		server.num_of_active++;
+		pthread_mutex_unlock(&server.lock);
+		if (pthread_create(&thread, NULL, serve_connection, connection) != 0) {
+			fprintf(stderr, "pthread_create() failed\n");
+			pthread_mutex_lock(&server.lock);
+			server.num_of_active--;
+			pthread_mutex_unlock(&server.lock);
+			close(conn_sock);
+			free(connection);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+	close(sock);
+
+	/* Connections notice stop within REPLAY_POLL_MS (or their current gap) */
+	for (;;) {
+		pthread_mutex_lock(&server.lock);
+		int num_of_active = server.num_of_active;
+		pthread_mutex_unlock(&server.lock);
+		if (num_of_active == 0) {
+			break;
+		}
+		sleep_us(REPLAY_POLL_MS * 1000);
+	}
+	pthread_mutex_destroy(&server.lock);
+	printf("connection_stats_replay_serve() served %d responses \n", server.next_exchange);
+	free_exchanges(&server);
+	return rc;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Parse a trace into its exchanges. An exchange starts with a request
+ * (=> Send header); exchanges without a response (e.g. failed) are dropped
+ */
+static RC load_trace(const char *trace_path, ReplayServer *server) {
+	char line[REPLAY_MAX_LINE_LEN];
+	char header[REPLAY_MAX_LINE_LEN];
+	size_t header_len = 0;
+	size_t header_size = 0;
+	int in_header = 0;   /* Dump lines of a response header follow */
+	ReplayExchange exchange;
+	FILE *file;
+	RC rc = RC_OK;
+
+	file = fopen(trace_path, "r");
+	if (file == NULL) {
+		printf("connection_stats_replay_serve() fail to open %s \n", trace_path);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	memset(&exchange, 0, sizeof(exchange));
+
+	while ((rc == RC_OK) && (fgets(line, sizeof(line), file) != NULL)) {
+		size_t len = strcspn(line, "\n");
+		line[len] = '\0';
+
+		/* Dump line: "0000: <printable characters>" */
+		if ((len >= 6) && (line[4] == ':') && (line[5] == ' ') &&
+			(strspn(line, "0123456789abcdef") == 4)) {
+			if (in_header) {
+				size_t n = len - 6;
+				if (header_len + n >= sizeof(header)) {
+					n = sizeof(header) - 1 - header_len;
+				}
+				memcpy(header + header_len, line + 6, n);
+				header_len += n;
+			}
+			continue;
+		}
+
+		/* Any other line ends the header being dumped */
+		if (in_header) {
+			/* The dump drops the CRLF that ends every header line */
+			if (header_len + 2 <= header_size) {
+				header[header_len++] = '\r';
+				header[header_len++] = '\n';
+			}
+			rc = append_header(&exchange, header, header_len);
+			in_header = 0;
+			if (rc != RC_OK) {
+				break;
+			}
+		}
+
+		if ((strncmp(line, "=> Send header", 14) == 0) ||
+			(strncmp(line, "=> Send data", 12) == 0)) {
+			/* A request after a response starts the next exchange */
+			if ((line[8] == 'h') && (exchange.headers != NULL)) {
+				rc = finish_exchange(server, &exchange);
+			}
+			exchange.request_at_us = parse_at(line);
+		} else if (strncmp(line, "<= Recv header", 14) == 0) {
+			long long at_us = parse_at(line);
+			if (exchange.headers == NULL) {
+				exchange.headers_delay_us = (at_us > exchange.request_at_us) ?
+											at_us - exchange.request_at_us : 0;
+			}
+			exchange.last_at_us = at_us;
+			header_size = strtoul(line + 16, NULL, 10);
+			header_len = 0;
+			in_header = 1;
+		} else if ((strncmp(line, "<= Recv data", 12) == 0) && (exchange.headers != NULL)) {
+			long long at_us = parse_at(line);
+			ReplayChunk *chunks = realloc(exchange.chunks, (exchange.num_of_chunks + 1) *
+										  sizeof(ReplayChunk));
+			if (chunks == NULL) {
+				fprintf(stderr, "realloc() failed\n");
+				rc = RC_ERROR;
+				break;
+			}
+			exchange.chunks = chunks;
+			chunks[exchange.num_of_chunks].delay_us = (at_us > exchange.last_at_us) ?
+													  at_us - exchange.last_at_us : 0;
+			chunks[exchange.num_of_chunks].size = strtoul(line + 14, NULL, 10);
+			exchange.body_size += chunks[exchange.num_of_chunks].size;
+			exchange.num_of_chunks++;
+			exchange.last_at_us = at_us;
+		}
+	}
+	if (in_header && (rc == RC_OK)) {
+		rc = append_header(&exchange, header, header_len);
+	}
+	if ((rc == RC_OK) && (exchange.headers != NULL)) {
+		rc = finish_exchange(server, &exchange);
+	}
+	fclose(file);
+	free(exchange.headers);
+	free(exchange.chunks);
+
+	if ((rc == RC_OK) && (server->num_of_exchanges == 0)) {
+		printf("connection_stats_replay_serve() no responses in %s \n", trace_path);
+		rc = RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	if (rc != RC_OK) {
+		free_exchanges(server);
+	}
+	return rc;
+}
+
+/*
+ * Add the parsed exchange to the server (once its headers end) and start
+ * over. The exchange's memory moves to the server
+ */
+static RC finish_exchange(ReplayServer *server, ReplayExchange *exchange) {
+	ReplayExchange *exchanges;
+	char length[64];
+	size_t len = exchange->headers_len;
+
+	/* The headers end with an empty line, Content-Length goes before it
+	   (a trace cut before the empty line is completed) */
+	if ((len >= 4) && (strcmp(exchange->headers + len - 4, "\r\n\r\n") == 0)) {
+		exchange->headers_len -= 2;
+	} else if ((len < 2) || (strcmp(exchange->headers + len - 2, "\r\n") != 0)) {
+		if (append_raw(exchange, "\r\n", 2) != RC_OK) {
+			return RC_ERROR;
+		}
+	}
+	snprintf(length, sizeof(length), "Content-Length: %zu\r\n\r\n", exchange->body_size);
+	if (append_raw(exchange, length, strlen(length)) != RC_OK) {
+		return RC_ERROR;
+	}
+
+	exchanges = realloc(server->exchanges, (server->num_of_exchanges + 1) *
+						sizeof(ReplayExchange));
+	if (exchanges == NULL) {
+		fprintf(stderr, "realloc() failed\n");
+		return RC_ERROR;
+	}
+	server->exchanges = exchanges;
+	exchanges[server->num_of_exchanges++] = *exchange;
+	memset(exchange, 0, sizeof(ReplayExchange));
+	return RC_OK;
+}
+
+/*
+ * Append a response header line (CRLF included) to an exchange, rewritten
+ * for replay
+ */
+static RC append_header(ReplayExchange *exchange, const char *line, size_t len) {
+	/* The body is framed by Content-Length (added once the headers end) */
+	if ((strncasecmp(line, "Content-Length:", 15) == 0) ||
+		(strncasecmp(line, "Transfer-Encoding:", 18) == 0) ||
+		(strncasecmp(line, "Content-Encoding:", 17) == 0)) {
+		return RC_OK;
+	}
+	if ((strncasecmp(line, "Connection:", 11) == 0) && (len > 11) &&
+		(strncasecmp(line + 11 + strspn(line + 11, " "), "close", 5) == 0)) {
+		exchange->close = 1;
+	}
+
+	/* A new status line (e.g. after 100 Continue) starts the headers over */
+	if (strncmp(line, "HTTP/", 5) == 0) {
+		const char *reason = strchr(line, ' ');
+		if (reason == NULL) {
+			return RC_OK;
+		}
+		exchange->headers_len = 0;
+		/* Served as HTTP/1.1 (the trace may be of HTTP/2 or 3) */
+		if (append_raw(exchange, "HTTP/1.1", 8) != RC_OK) {
+			return RC_ERROR;
+		}
+		len -= reason - line;
+		line = reason;
+	}
+	return append_raw(exchange, line, len);
+}
+
+/*
+ * Append data to the response headers of an exchange (kept NUL terminated)
+ */
+static RC append_raw(ReplayExchange *exchange, const char *data, size_t len) {
+	char *headers = realloc(exchange->headers, exchange->headers_len + len + 1);
+	if (headers == NULL) {
+		fprintf(stderr, "realloc() failed\n");
+		return RC_ERROR;
+	}
+	memcpy(headers + exchange->headers_len, data, len);
+	exchange->headers = headers;
+	exchange->headers_len += len;
+	headers[exchange->headers_len] = '\0';
+	return RC_OK;
+}
+
+/*
+ * Time of a traced event (usec since the epoch), 0 if not traced
+ */
+static long long parse_at(const char *line) {
+	const char *at = strstr(line, " at=");
+	return (at != NULL) ? atoll(at + 4) : 0;
+}
+
+/*
+ * Release the exchanges of a server
+ */
+static void free_exchanges(ReplayServer *server) {
+	for (int i=0; i<server->num_of_exchanges; i++) {
+		free(server->exchanges[i].headers);
+		free(server->exchanges[i].chunks);
+	}
+	free(server->exchanges);
+	server->exchanges = NULL;
+	server->num_of_exchanges = 0;
+}
+
+/*
+ * Serve the requests of a connection, each with the next recorded exchange
+ */
+static void* serve_connection(void *arg) {
+	static const char filler[REPLAY_FILLER_SIZE] = { 0 };
+	ReplayConnection *connection = arg;
+	ReplayServer *server = connection->server;
+	char request[REPLAY_MAX_REQUEST_SIZE];
+	size_t request_len = 0;
+
+	while (read_request(connection, request, &request_len)) {
+		const ReplayExchange *exchange;
+		int ok;
+
+		pthread_mutex_lock(&server->lock);
+		exchange = &server->exchanges[server->next_exchange++ % server->num_of_exchanges];
+		pthread_mutex_unlock(&server->lock);
+
+		sleep_us(exchange->headers_delay_us);
+		ok = send_all(connection->sock, exchange->headers, exchange->headers_len);
+		for (int i=0; ok && (i<exchange->num_of_chunks) && !*server->stop; i++) {
+			size_t left = exchange->chunks[i].size;
+
+			sleep_us(exchange->chunks[i].delay_us);
+			while (ok && (left > 0)) {
+				size_t n = (left < sizeof(filler)) ? left : sizeof(filler);
+				ok = send_all(connection->sock, filler, n);
+				left -= n;
+			}
+		}
+		if (!ok || exchange->close) {
+			break;
+		}
+	}
+
+	close(connection->sock);
+	pthread_mutex_lock(&server->lock);
+	server->num_of_active--;
+	pthread_mutex_unlock(&server->lock);
+	free(connection);
+	return NULL;
+}
+
+/*
+ * Read the next request of a connection (headers, and the body if it has a
+ * Content-Length). Bytes past the request are kept in buf for the next one.
+ * Returns 0 once the connection is closed (or serving stops)
+ */
+static int read_request(ReplayConnection *connection, char *buf, size_t *p_len) {
+	size_t len = *p_len;
+	char *end;
+
+	for (;;) {
+		buf[len] = '\0';
+		end = strstr(buf, "\r\n\r\n");
+		if (end != NULL) {
+			const char *content_length = strcasestr(buf, "\r\nContent-Length:");
+			size_t request_len = (end + 4) - buf;
+
+			if ((content_length != NULL) && (content_length < end)) {
+				request_len += strtoul(content_length + 17, NULL, 10);
+			}
+			if (request_len <= len) {
+				memmove(buf, buf + request_len, len - request_len);
+				*p_len = len - request_len;
+				return 1;
+			}
+		}
+		if (len == REPLAY_MAX_REQUEST_SIZE - 1) {
+			return 0;  /* Too large to be replayed */
+		}
+
+		ssize_t n = recv(connection->sock, buf + len, REPLAY_MAX_REQUEST_SIZE - 1 - len, 0);
+		if (n > 0) {
+			len += n;
+		} else if ((n == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+								 (errno == EINTR)) && !*connection->server->stop) {
+			continue;
+		} else {
+			return 0;
+		}
+	}
+}
+
+/*
+ * Send all of data. Returns 0 on failure
+ */
+static int send_all(int sock, const char *data, size_t len) {
+	while (len > 0) {
+		ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+		if (n <= 0) {
+			if ((n == -1) && (errno == EINTR)) {
+				continue;
+			}
+			return 0;
+		}
+		data += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/*
+ * Sleep for a recorded gap
+ */
+static void sleep_us(long long usec) {
+	struct timespec ts = { usec / 1000000, (usec % 1000000) * 1000 };
+
+	if (usec <= 0) {
+		return;
+	}
+	while ((nanosleep(&ts, &ts) == -1) && (errno == EINTR)) {
+		;
+	}
+}
@@ -0,0 +1,316 @@
+/*
+ * connection_stats_snapshot.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Snapshot (fan-out) API of the libconnstat library.
+ * The result of every run is published into a named POSIX shared memory
+ * region, so any number of local readers get the latest result of a URL
+ * without triggering a measurement of their own.
+ * Every URL has 2 buffers, each guarded by a sequence counter (seqlock):
+ * the writer fills the buffer that is not the latest one (its counter is odd
+ * meanwhile) and only then moves the URL's generation to it. Readers copy
+ * the latest buffer and retry if its counter changed during the copy, which
+ * only happens if the writer published twice meanwhile. So the writer never
+ * waits and readers never take a lock.
+ * The region outlives the publishing process (the last results stay
+ * readable until another publisher opens it); it is not removed by the library.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <fcntl.h>      // O_* constants
+#include <unistd.h>     // ftruncate, close
+#include <sys/mman.h>   // shm_open, mmap
+#include <sys/stat.h>   // fstat
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define SNAPSHOT_MAGIC              0x5441545354534E43ULL  /* "CNSTSTAT" */
+#define SNAPSHOT_LAYOUT_VERSION     1
+#define SNAPSHOT_MAX_READ_RETRIES   1000
+
+
+/******************
+**  Structures   **
+******************/
+/* A single buffer of a URL */
+typedef struct {
+	_Atomic uint64_t seq;       /* Odd while the writer fills the buffer */
+	ConnStatSnapshot snapshot;
+} SnapshotSlot;
+
+/* All results of a single URL */
+typedef struct {
+	char             url[URL_MAX_LEN];  /* Set once, before num_of_targets covers it */
+	_Atomic uint64_t generation;        /* Latest publication (in slots[generation & 1]) */
+	SnapshotSlot     slots[2];
+} SnapshotTarget;
+
+/* Layout of the shared memory region */
+typedef struct {
+	_Atomic uint64_t magic;             /* Set last, once the region is initialized */
+	uint32_t         layout_version;
+	uint32_t         size;
+	_Atomic int      num_of_targets;
+	SnapshotTarget   targets[MAX_NUM_OF_SNAPSHOT_TARGETS];
+} SnapshotRegion;
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Region this process publishes to (if any) */
+static SnapshotRegion *g_pub_region = NULL;
+
+/* Region this process reads from (if attached) */
+static SnapshotRegion *g_read_region = NULL;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static SnapshotTarget* find_target(SnapshotRegion *region, const char *url);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Publish the result of every following run into a shared memory region
+* @param  name	Region name (shm_open style, e.g. "/connstat"), NULL to stop
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_publish(const char* name) {
+	SnapshotRegion *region;
+	int fd;
+
+	/* Stop publishing to the previous region (if any) */
+	snapshot_reset();
+	if (name == NULL) {
+		return RC_OK;
+	}
+
+	fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd == -1) {
+		perror("shm_open");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	if (ftruncate(fd, sizeof(SnapshotRegion)) == -1) {
+		perror("ftruncate");
+		close(fd);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	region = mmap(NULL, sizeof(SnapshotRegion), PROT_READ | PROT_WRITE,
+				  MAP_SHARED, fd, 0);
+	close(fd);
+	if (region == MAP_FAILED) {
+		perror("mmap");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+
+	/* Start over (results of a previous publisher are dropped). Readers that
+	   are still attached see every URL as not published yet */
+	atomic_store_explicit(&region->magic, 0, memory_order_relaxed);
+	memset((char *)region + sizeof(region->magic), 0,
+		   sizeof(SnapshotRegion) - sizeof(region->magic));
+	region->layout_version = SNAPSHOT_LAYOUT_VERSION;
+	region->size           = sizeof(SnapshotRegion);
+	atomic_store_explicit(&region->magic, SNAPSHOT_MAGIC, memory_order_release);
+
+	g_pub_region = region;
+	return RC_OK;
+}
+
+/**
+* @desc   Attach (read only) to a region published by connection_stats_publish
+* @param  name	Region name
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_snapshot_attach(const char* name) {
+	SnapshotRegion *region;
+	struct stat st;
+	int fd;
+
+	if (g_read_region != NULL) {
+		printf("connection_stats_snapshot_attach() already attached \n");
+		return RC_ERROR;
+	}
+	if (name == NULL) {
+		return RC_ERROR;
+	}
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1) {
+		perror("shm_open");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	if ((fstat(fd, &st) == -1) || (st.st_size != sizeof(SnapshotRegion))) {
+		printf("connection_stats_snapshot_attach() %s is not a snapshot region \n", name);
+		close(fd);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	region = mmap(NULL, sizeof(SnapshotRegion), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (region == MAP_FAILED) {
+		perror("mmap");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+
+	if ((atomic_load_explicit(&region->magic, memory_order_acquire) != SNAPSHOT_MAGIC) ||
+		(region->layout_version != SNAPSHOT_LAYOUT_VERSION)) {
+		printf("connection_stats_snapshot_attach() %s has an unknown layout \n", name);
+		munmap(region, sizeof(SnapshotRegion));
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+
+	g_read_region = region;
+	return RC_OK;
+}
+
+/**
+* @desc   Get a consistent copy of the latest result published for a URL
+* @param  url		URL as given in HttpReqData
+* @param  snapshot	Snapshot to be filled
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_snapshot_read(const char* url, ConnStatSnapshot* snapshot) {
+	SnapshotTarget *target;
+	int retries;
+
+	if (g_read_region == NULL) {
+		printf("connection_stats_snapshot_read() called before attach \n");
+		return RC_ERROR;
+	}
+
+	target = find_target(g_read_region, url);
+	if (target == NULL) {
+		return RC_RESULT_REQUESTED_BEFORE_TRIGGER;
+	}
+
+	for (retries=0; retries<SNAPSHOT_MAX_READ_RETRIES; retries++) {
+		uint64_t generation = atomic_load_explicit(&target->generation,
+												   memory_order_acquire);
+		if (generation == 0) {
+			return RC_RESULT_REQUESTED_BEFORE_TRIGGER;
+		}
+
+		SnapshotSlot *slot = &target->slots[generation & 1];
+		uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		if (seq & 1) {
+			/* Being overwritten - a newer generation is on its way */
+			continue;
+		}
+		memcpy(snapshot, &slot->snapshot, sizeof(ConnStatSnapshot));
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) {
+			return RC_OK;
+		}
+	}
+
+	printf("connection_stats_snapshot_read() gave up after %d retries \n", retries);
+	return RC_ERROR;
+}
+
+/**
+* @desc   Detach from the region attached by connection_stats_snapshot_attach
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_snapshot_detach() {
+	if (g_read_region != NULL) {
+		munmap(g_read_region, sizeof(SnapshotRegion));
+		g_read_region = NULL;
+	}
+	return RC_OK;
+}
+
+/*
+ * Publish the result of a run (no-op if not publishing)
+ */
+void snapshot_publish(const char *url, RC rc, const char *stat_str,
+					  const ConnStatSummary *summary) {
+	SnapshotTarget *target;
+	SnapshotSlot *slot;
+	struct timespec now;
+	uint64_t generation, seq;
+	int num_of_targets;
+
+	if (g_pub_region == NULL) {
+		return;
+	}
+
+	/* Add the URL on its first publication (this process is the only writer) */
+	target = find_target(g_pub_region, url);
+	if (target == NULL) {
+		num_of_targets = atomic_load_explicit(&g_pub_region->num_of_targets,
+											  memory_order_relaxed);
+		if (num_of_targets == MAX_NUM_OF_SNAPSHOT_TARGETS) {
+			printf("snapshot_publish() region is full, %s is not published \n", url);
+			return;
+		}
+		target = &g_pub_region->targets[num_of_targets];
+		strncpy(target->url, url, URL_MAX_LEN - 1);
+		atomic_store_explicit(&g_pub_region->num_of_targets, num_of_targets + 1,
+							  memory_order_release);
+	}
+
+	/* Fill the buffer that readers are not directed to */
+	generation = atomic_load_explicit(&target->generation, memory_order_relaxed) + 1;
+	slot = &target->slots[generation & 1];
+	seq  = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	slot->snapshot.generation   = generation;
+	slot->snapshot.published_ns = (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+	memcpy(slot->snapshot.url, target->url, URL_MAX_LEN);
+	slot->snapshot.rc           = rc;
+	memcpy(slot->snapshot.stat_str, stat_str, MAX_SIZE_OF_PROG_OUTPUT);
+	slot->snapshot.summary      = *summary;
+
+	/* Then direct readers to it */
+	atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+	atomic_store_explicit(&target->generation, generation, memory_order_release);
+}
+
+/*
+ * Stop publishing (the region itself is kept for its readers)
+ */
+void snapshot_reset() {
+	if (g_pub_region != NULL) {
+		munmap(g_pub_region, sizeof(SnapshotRegion));
+		g_pub_region = NULL;
+	}
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Find the target of a URL (NULL if it was never published)
+ */
+static SnapshotTarget* find_target(SnapshotRegion *region, const char *url) {
+	int num_of_targets = atomic_load_explicit(&region->num_of_targets,
+											  memory_order_acquire);
+	int i;
+
+	for (i=0; i<num_of_targets; i++) {
+		if (strncmp(region->targets[i].url, url, URL_MAX_LEN) == 0) {
+			return &region->targets[i];
+		}
+	}
+	return NULL;
+}
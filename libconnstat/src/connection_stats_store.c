@@ -0,0 +1,744 @@
+/*
+ * connection_stats_store.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Persistent result store of the libconnstat library.
+ * Every URL has its own chain of fixed size segment files
+ * (<dir>/<url hash>.<segment idx>.seg) that are memory mapped while appended.
+ * A segment holds a bit stream of records, one per sample (and one per run,
+ * holding the run's medians), compressed the Gorilla way:
+ *   - Timestamps (usec) are delta-of-delta encoded: '0' for an unchanged
+ *     delta, otherwise a prefix and a 7/9/20 (or 64) bits difference.
+ *   - Every phase timing is XORed with the previous value of the same phase
+ *     and only the meaningful bits are written. Timings are rounded to whole
+ *     microseconds first (libCURL's resolution), so values have many trailing
+ *     zero bits in common.
+ * The segment header keeps the compressor state, so appending continues
+ * after a restart. Records are counted in the header only once written (the
+ * count is published with a release store, and read with an acquire load), so
+ * a reader (or a crash) never sees a partial record. A query counts the
+ * records of every segment once, and decodes only those, so records appended
+ * while it runs are simply not reported.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>      // open
+#include <unistd.h>     // ftruncate, close
+#include <sys/mman.h>   // mmap
+#include <sys/stat.h>   // fstat
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define STORE_MAGIC                 0x47455354534E4E43ULL  /* "CNNSTSEG" */
+#define STORE_LAYOUT_VERSION        1
+#define SEGMENT_SIZE                (1 << 20)
+#define SEGMENT_HEADER_SIZE         4096
+#define SEGMENT_DATA_BITS           ((uint64_t)(SEGMENT_SIZE - SEGMENT_HEADER_SIZE) * 8)
+#define MAX_RECORD_BITS             512     /* Worst case record is 378 bits */
+#define MAX_SIZE_OF_SEGMENT_PATH    (STORE_DIR_MAX_LEN + 32)
+#define NUM_OF_PHASES               4
+
+/* Record kinds (2 bits) */
+#define RECORD_SAMPLE_OK            0
+#define RECORD_SAMPLE_FAILED        1
+#define RECORD_RUN                  2       /* Medians of a run */
+
+#define DEFAULT_QUERY_PERCENTILE    0.5
+
+
+/******************
+**  Structures   **
+******************/
+/* Compressor (and decompressor) state of a segment's bit stream */
+typedef struct {
+	uint64_t num_of_records;
+	uint64_t num_of_bits;
+	int64_t  prev_us;
+	int64_t  prev_delta;
+	uint64_t prev_value[NUM_OF_PHASES];
+	int      prev_leading[NUM_OF_PHASES];
+	int      prev_trailing[NUM_OF_PHASES];
+} StreamState;
+
+/* First SEGMENT_HEADER_SIZE bytes of a segment */
+typedef struct {
+	uint64_t    magic;
+	uint32_t    layout_version;
+	uint32_t    segment_idx;
+	char        url[URL_MAX_LEN];
+	int64_t     first_us;
+	int64_t     last_us;
+	StreamState state;      /* Covers only complete records */
+} SegmentHeader;
+
+/* A decoded record */
+typedef struct {
+	int     kind;
+	int64_t timestamp_us;
+	double  value[NUM_OF_PHASES];
+} StoreRecord;
+
+/* Segment being appended by this process (one per URL) */
+typedef struct {
+	char           url[URL_MAX_LEN];
+	uint64_t       url_hash;
+	uint8_t       *map;
+	uint32_t       segment_idx;
+} StoreTarget;
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Store this process appends to (empty if none) */
+static char g_store_dir[STORE_DIR_MAX_LEN];
+
+/* Segments being appended */
+static StoreTarget g_targets[MAX_NUM_OF_STORE_TARGETS];
+static int g_num_of_targets = 0;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static StoreTarget* get_target(const char *url);
+static RC map_segment(const char *dir, uint64_t url_hash, uint32_t segment_idx,
+					  int writable, uint8_t **p_map);
+static void append_record(StoreTarget *target, const StoreRecord *record);
+static void encode_record(uint8_t *data, StreamState *state, const StoreRecord *record);
+static void decode_record(const uint8_t *data, StreamState *state, StoreRecord *record);
+static void write_bits(uint8_t *data, uint64_t *pos, uint64_t value, int num_of_bits);
+static uint64_t read_bits(const uint8_t *data, uint64_t *pos, int num_of_bits);
+static uint64_t hash_url(const char *url);
+static int double_comp(const void* elem1, const void* elem2);
+static double get_percentile(double arr[], int arr_size, double percentile);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Append the samples of every following run to the store in dir
+* @param  dir	Store directory, NULL to stop appending
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_store_open(const char* dir) {
+	struct stat st;
+
+	/* Stop appending to the previous store (if any) */
+	store_reset();
+	if (dir == NULL) {
+		return RC_OK;
+	}
+
+	if ((strlen(dir) >= STORE_DIR_MAX_LEN) || (stat(dir, &st) == -1) ||
+		!S_ISDIR(st.st_mode)) {
+		printf("connection_stats_store_open() fail with invalid dir %s \n", dir);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+
+	strncpy(g_store_dir, dir, STORE_DIR_MAX_LEN - 1);
+	return RC_OK;
+}
+
+/**
+* @desc   Get the percentile series of a URL over a time range
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_store_query(const char* dir, const char* url,
+								long long from_us, long long to_us,
+								long long step_us, double percentile,
+								ConnStatSeriesPoint* points, int max_points,
+								int* num_of_points) {
+	uint64_t url_hash = hash_url(url);
+	long long num_of_steps;
+	int num_of_buckets;
+	int *bucket_size;
+	int *bucket_fill;
+	double *values[NUM_OF_PHASES];
+	uint64_t *segment_records = NULL;  /* Records of every segment, as counted */
+	uint32_t num_of_segments = 0;
+	int total = 0;
+	int pass, i, p;
+	uint32_t segment_idx;
+	RC rc = RC_OK;
+
+	*num_of_points = 0;
+	if ((to_us <= from_us) || (step_us < 0) || (max_points <= 0) ||
+		(percentile < 0) || (percentile > 1)) {
+		printf("connection_stats_store_query() fail with invalid range \n");
+		return RC_ERROR;
+	}
+	if (step_us == 0) {
+		step_us = to_us - from_us;
+	}
+	if (percentile == 0) {
+		percentile = DEFAULT_QUERY_PERCENTILE;
+	}
+	/* Counted wide, a long range of short steps does not fit an int */
+	num_of_steps = (to_us - from_us - 1) / step_us + 1;
+	if (num_of_steps > max_points) {
+		/* Only the first max_points buckets are reported */
+		num_of_steps = max_points;
+		to_us = from_us + step_us * max_points;
+	}
+	num_of_buckets = (int)num_of_steps;
+
+	bucket_size = calloc(num_of_buckets, sizeof(int));
+	bucket_fill = calloc(num_of_buckets, sizeof(int));
+	memset(values, 0, sizeof(values));
+	if ((bucket_size == NULL) || (bucket_fill == NULL)) {
+		fprintf(stderr, "calloc() failed\n");
+		rc = RC_ERROR;
+		goto cleanup;
+	}
+
+	/* 2 passes over all segments of the URL: count the samples per bucket,
+	   then copy them (so every bucket is allocated once, exactly). Another
+	   process may append meanwhile, so the copy pass decodes exactly the
+	   segments and records the count pass saw */
+	for (pass=0; pass<2; pass++) {
+		for (segment_idx=0; (pass == 0) || (segment_idx < num_of_segments); segment_idx++) {
+			const SegmentHeader *header;
+			StreamState state;
+			StoreRecord record;
+			uint64_t num_of_records;
+			uint8_t *map;
+			uint64_t r;
+
+			if ((pass == 1) && (segment_records[segment_idx] == 0)) {
+				continue;  /* Out of the range (or empty) when counted */
+			}
+			if (map_segment(dir, url_hash, segment_idx, 0, &map) != RC_OK) {
+				break;  /* No more segments */
+			}
+			header = (const SegmentHeader *)map;
+			if ((__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != STORE_MAGIC) ||
+				(header->layout_version != STORE_LAYOUT_VERSION) ||
+				(strncmp(header->url, url, URL_MAX_LEN) != 0)) {
+				printf("connection_stats_store_query() segment %u of %s is not valid \n",
+					   segment_idx, url);
+				munmap(map, SEGMENT_SIZE);
+				break;
+			}
+
+			if (pass == 1) {
+				num_of_records = segment_records[segment_idx];
+			} else {
+				uint64_t *grown = realloc(segment_records,
+										  (num_of_segments + 1) * sizeof(uint64_t));
+				if (grown == NULL) {
+					fprintf(stderr, "realloc() failed\n");
+					munmap(map, SEGMENT_SIZE);
+					rc = RC_ERROR;
+					goto cleanup;
+				}
+				segment_records = grown;
+				num_of_segments++;
+
+				/* Records (and the range) appended before the count was published */
+				num_of_records = __atomic_load_n(&header->state.num_of_records,
+												 __ATOMIC_ACQUIRE);
+
+				/* Skip segments out of the range */
+				if ((header->last_us < from_us) || (header->first_us >= to_us)) {
+					num_of_records = 0;
+				}
+				segment_records[segment_idx] = num_of_records;
+			}
+
+			memset(&state, 0, sizeof(state));
+			for (r=0; r<num_of_records; r++) {
+				decode_record(map + SEGMENT_HEADER_SIZE, &state, &record);
+				if ((record.kind != RECORD_SAMPLE_OK) ||
+					(record.timestamp_us < from_us) || (record.timestamp_us >= to_us)) {
+					continue;
+				}
+				int bucket = (int)((record.timestamp_us - from_us) / step_us);
+				if (pass == 0) {
+					bucket_size[bucket]++;
+					continue;
+				}
+				int idx = bucket_fill[bucket]++;
+				for (p=0; p<NUM_OF_PHASES; p++) {
+					values[p][idx] = record.value[p];
+				}
+			}
+			munmap(map, SEGMENT_SIZE);
+		}
+
+		if (pass == 0) {
+			/* Bucket b owns values[p][offset(b) : offset(b) + bucket_size[b]) */
+			for (i=0; i<num_of_buckets; i++) {
+				bucket_fill[i] = total;
+				total += bucket_size[i];
+			}
+			for (p=0; p<NUM_OF_PHASES; p++) {
+				values[p] = malloc((total > 0 ? total : 1) * sizeof(double));
+				if (values[p] == NULL) {
+					fprintf(stderr, "malloc() failed\n");
+					rc = RC_ERROR;
+					goto cleanup;
+				}
+			}
+		}
+	}
+
+	/* A point per non empty bucket */
+	for (i=0; i<num_of_buckets; i++) {
+		int offset;
+		if (bucket_size[i] == 0) {
+			continue;
+		}
+		offset = bucket_fill[i] - bucket_size[i];
+		ConnStatSeriesPoint *point = &points[(*num_of_points)++];
+		point->start_us       = from_us + step_us * i;
+		point->num_of_samples = bucket_size[i];
+		point->name_lookup    = get_percentile(&values[0][offset], bucket_size[i], percentile);
+		point->connect        = get_percentile(&values[1][offset], bucket_size[i], percentile);
+		point->start_transfer = get_percentile(&values[2][offset], bucket_size[i], percentile);
+		point->total          = get_percentile(&values[3][offset], bucket_size[i], percentile);
+	}
+
+cleanup:
+	for (p=0; p<NUM_OF_PHASES; p++) {
+		free(values[p]);
+	}
+	free(segment_records);
+	free(bucket_size);
+	free(bucket_fill);
+	return rc;
+}
+
+/*
+ * Append the samples of a run and the run's medians (no-op if no store is open)
+ */
+void store_append(const char *url, const CurlInfo *curl_info_arr, int arr_size,
+				  const ConnStatSummary *summary) {
+	StoreTarget *target;
+	StoreRecord record;
+	struct timespec now;
+	int i;
+
+	if (g_store_dir[0] == '\0') {
+		return;
+	}
+	target = get_target(url);
+	if (target == NULL) {
+		return;
+	}
+
+	for (i=0; i<arr_size; i++) {
+		const CurlInfo *curl_info = &curl_info_arr[i];
+		record.kind = connection_stats_is_success(curl_info) ?
+					  RECORD_SAMPLE_OK : RECORD_SAMPLE_FAILED;
+		record.timestamp_us = curl_info->timestamp_us;
+		record.value[0] = curl_info->name_lookup_time;
+		record.value[1] = curl_info->connect_time;
+		record.value[2] = curl_info->start_transfer_time;
+		record.value[3] = curl_info->total_time;
+		append_record(target, &record);
+	}
+
+	if (summary->num_of_success > 0) {
+		clock_gettime(CLOCK_REALTIME, &now);
+		record.kind = RECORD_RUN;
+		record.timestamp_us = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+		record.value[0] = summary->name_lookup.median;
+		record.value[1] = summary->connect.median;
+		record.value[2] = summary->start_transfer.median;
+		record.value[3] = summary->total.median;
+		append_record(target, &record);
+	}
+}
+
+/*
+ * Stop appending (unmap all segments)
+ */
+void store_reset() {
+	int i;
+
+	for (i=0; i<g_num_of_targets; i++) {
+		munmap(g_targets[i].map, SEGMENT_SIZE);
+	}
+	memset(g_targets, 0, sizeof(g_targets));
+	g_num_of_targets = 0;
+	g_store_dir[0] = '\0';
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Get the segment a URL is appended to, mapping its last segment on first use
+ */
+static StoreTarget* get_target(const char *url) {
+	StoreTarget *target;
+	uint64_t url_hash = hash_url(url);
+	uint32_t segment_idx = 0;
+	uint8_t *map;
+	int i;
+
+	for (i=0; i<g_num_of_targets; i++) {
+		if (strncmp(g_targets[i].url, url, URL_MAX_LEN) == 0) {
+			return &g_targets[i];
+		}
+	}
+	if (g_num_of_targets == MAX_NUM_OF_STORE_TARGETS) {
+		printf("store_append() too many targets, %s is not stored \n", url);
+		return NULL;
+	}
+
+	/* Continue the last existing segment of the URL */
+	while (map_segment(g_store_dir, url_hash, segment_idx + 1, 0, &map) == RC_OK) {
+		munmap(map, SEGMENT_SIZE);
+		segment_idx++;
+	}
+	if (map_segment(g_store_dir, url_hash, segment_idx, 1, &map) != RC_OK) {
+		return NULL;
+	}
+	SegmentHeader *header = (SegmentHeader *)map;
+	if (header->magic != STORE_MAGIC) {
+		/* New segment */
+		memset(header, 0, sizeof(SegmentHeader));
+		header->layout_version = STORE_LAYOUT_VERSION;
+		header->segment_idx    = segment_idx;
+		strncpy(header->url, url, URL_MAX_LEN - 1);
+		__atomic_store_n(&header->magic, STORE_MAGIC, __ATOMIC_RELEASE);
+	} else if ((header->layout_version != STORE_LAYOUT_VERSION) ||
+			   (strncmp(header->url, url, URL_MAX_LEN) != 0)) {
+		printf("store_append() segment of %s is not valid, it is not stored \n", url);
+		munmap(map, SEGMENT_SIZE);
+		return NULL;
+	}
+
+	target = &g_targets[g_num_of_targets++];
+	strncpy(target->url, url, URL_MAX_LEN - 1);
+	target->url_hash    = url_hash;
+	target->map         = map;
+	target->segment_idx = segment_idx;
+	return target;
+}
+
+/*
+ * Map a segment (created if writable and missing)
+ */
+static RC map_segment(const char *dir, uint64_t url_hash, uint32_t segment_idx,
+					  int writable, uint8_t **p_map) {
+	char path[MAX_SIZE_OF_SEGMENT_PATH];
+	struct stat st;
+	void *map;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%016llx.%04u.seg", dir,
+			 (unsigned long long)url_hash, segment_idx);
+	fd = writable ? open(path, O_RDWR | O_CREAT, 0644) : open(path, O_RDONLY);
+	if (fd == -1) {
+		if (writable) {
+			perror("open");
+		}
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	if (writable && (ftruncate(fd, SEGMENT_SIZE) == -1)) {
+		perror("ftruncate");
+		close(fd);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	if ((fstat(fd, &st) == -1) || (st.st_size != SEGMENT_SIZE)) {
+		close(fd);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+
+	map = mmap(NULL, SEGMENT_SIZE, writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+			   MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	*p_map = map;
+	return RC_OK;
+}
+
+/*
+ * Append a record to the target's segment (moving to a new segment when full)
+ */
+static void append_record(StoreTarget *target, const StoreRecord *record) {
+	SegmentHeader *header = (SegmentHeader *)target->map;
+	StreamState state;
+	uint64_t num_of_records;
+
+	if (header->state.num_of_bits + MAX_RECORD_BITS > SEGMENT_DATA_BITS) {
+		uint8_t *map;
+		if (map_segment(g_store_dir, target->url_hash, target->segment_idx + 1,
+						1, &map) != RC_OK) {
+			return;
+		}
+		munmap(target->map, SEGMENT_SIZE);
+		target->map = map;
+		target->segment_idx++;
+		header = (SegmentHeader *)map;
+		memset(header, 0, sizeof(SegmentHeader));
+		header->layout_version = STORE_LAYOUT_VERSION;
+		header->segment_idx    = target->segment_idx;
+		strncpy(header->url, target->url, URL_MAX_LEN - 1);
+		__atomic_store_n(&header->magic, STORE_MAGIC, __ATOMIC_RELEASE);
+	}
+
+	/* Encode on a copy of the state, so the header only ever covers complete
+	   records */
+	state = header->state;
+	encode_record(target->map + SEGMENT_HEADER_SIZE, &state, record);
+	if (state.num_of_records == 1) {
+		header->first_us = record->timestamp_us;
+	}
+	if (record->timestamp_us > header->last_us) {
+		header->last_us = record->timestamp_us;
+	}
+	/* The count goes last: its release store publishes the record (the rest
+	   of the state is only read by this process) */
+	num_of_records = state.num_of_records;
+	state.num_of_records = header->state.num_of_records;
+	header->state = state;
+	__atomic_store_n(&header->state.num_of_records, num_of_records, __ATOMIC_RELEASE);
+}
+
+/*
+ * Gorilla encoding of a record (see file header)
+ */
+static void encode_record(uint8_t *data, StreamState *state, const StoreRecord *record) {
+	uint64_t *pos = &state->num_of_bits;
+	int first = (state->num_of_records == 0);
+	int p;
+
+	write_bits(data, pos, record->kind, 2);
+
+	/* Timestamp - delta of delta */
+	if (first) {
+		write_bits(data, pos, (uint64_t)record->timestamp_us, 64);
+		state->prev_delta = 0;
+	} else {
+		int64_t delta = record->timestamp_us - state->prev_us;
+		int64_t dod   = delta - state->prev_delta;
+		if (dod == 0) {
+			write_bits(data, pos, 0x0, 1);
+		} else if ((dod >= -64) && (dod <= 63)) {
+			write_bits(data, pos, 0x2, 2);
+			write_bits(data, pos, (uint64_t)dod, 7);
+		} else if ((dod >= -256) && (dod <= 255)) {
+			write_bits(data, pos, 0x6, 3);
+			write_bits(data, pos, (uint64_t)dod, 9);
+		} else if ((dod >= -524288) && (dod <= 524287)) {
+			write_bits(data, pos, 0xE, 4);
+			write_bits(data, pos, (uint64_t)dod, 20);
+		} else {
+			write_bits(data, pos, 0xF, 4);
+			write_bits(data, pos, (uint64_t)dod, 64);
+		}
+		state->prev_delta = delta;
+	}
+	state->prev_us = record->timestamp_us;
+
+	/* Timings - XOR with the previous value of the same phase */
+	for (p=0; p<NUM_OF_PHASES; p++) {
+		double rounded = round(record->value[p] * 1e6);
+		uint64_t value;
+		memcpy(&value, &rounded, sizeof(value));
+
+		if (first) {
+			write_bits(data, pos, value, 64);
+			state->prev_leading[p]  = -1;  /* No window yet */
+			state->prev_trailing[p] = 0;
+		} else {
+			uint64_t xor = value ^ state->prev_value[p];
+			if (xor == 0) {
+				write_bits(data, pos, 0x0, 1);
+			} else {
+				int leading  = __builtin_clzll(xor);
+				int trailing = __builtin_ctzll(xor);
+				if (leading > 31) {
+					leading = 31;
+				}
+				if ((state->prev_leading[p] >= 0) &&
+					(leading >= state->prev_leading[p]) &&
+					(trailing >= state->prev_trailing[p])) {
+					/* Fits the previous window */
+					int length = 64 - state->prev_leading[p] - state->prev_trailing[p];
+					write_bits(data, pos, 0x2, 2);
+					write_bits(data, pos, xor >> state->prev_trailing[p], length);
+				} else {
+					int length = 64 - leading - trailing;
+					write_bits(data, pos, 0x3, 2);
+					write_bits(data, pos, leading, 5);
+					write_bits(data, pos, length & 0x3F, 6); /* 64 is written as 0 */
+					write_bits(data, pos, xor >> trailing, length);
+					state->prev_leading[p]  = leading;
+					state->prev_trailing[p] = trailing;
+				}
+			}
+		}
+		state->prev_value[p] = value;
+	}
+
+	state->num_of_records++;
+}
+
+/*
+ * Gorilla decoding of a record (mirrors encode_record)
+ */
+static void decode_record(const uint8_t *data, StreamState *state, StoreRecord *record) {
+	uint64_t *pos = &state->num_of_bits;
+	int first = (state->num_of_records == 0);
+	int p;
+
+	record->kind = (int)read_bits(data, pos, 2);
+
+	if (first) {
+		record->timestamp_us = (int64_t)read_bits(data, pos, 64);
+		state->prev_delta = 0;
+	} else {
+		int64_t dod;
+		int num_of_bits = 0;
+		if (read_bits(data, pos, 1) == 0) {
+			dod = 0;
+		} else if (read_bits(data, pos, 1) == 0) {
+			num_of_bits = 7;
+		} else if (read_bits(data, pos, 1) == 0) {
+			num_of_bits = 9;
+		} else if (read_bits(data, pos, 1) == 0) {
+			num_of_bits = 20;
+		} else {
+			num_of_bits = 64;
+		}
+		if (num_of_bits > 0) {
+			uint64_t raw = read_bits(data, pos, num_of_bits);
+			/* Sign extend */
+			if ((num_of_bits < 64) && (raw & (1ULL << (num_of_bits - 1)))) {
+				raw |= ~0ULL << num_of_bits;
+			}
+			dod = (int64_t)raw;
+		}
+		state->prev_delta += dod;
+		record->timestamp_us = state->prev_us + state->prev_delta;
+	}
+	state->prev_us = record->timestamp_us;
+
+	for (p=0; p<NUM_OF_PHASES; p++) {
+		uint64_t value;
+		double rounded;
+
+		if (first) {
+			value = read_bits(data, pos, 64);
+			state->prev_leading[p]  = -1;
+			state->prev_trailing[p] = 0;
+		} else if (read_bits(data, pos, 1) == 0) {
+			value = state->prev_value[p];
+		} else if (read_bits(data, pos, 1) == 0) {
+			int length = 64 - state->prev_leading[p] - state->prev_trailing[p];
+			value = state->prev_value[p] ^
+					(read_bits(data, pos, length) << state->prev_trailing[p]);
+		} else {
+			int leading = (int)read_bits(data, pos, 5);
+			int length  = (int)read_bits(data, pos, 6);
+			if (length == 0) {
+				length = 64;
+			}
+			state->prev_leading[p]  = leading;
+			state->prev_trailing[p] = 64 - leading - length;
+			value = state->prev_value[p] ^
+					(read_bits(data, pos, length) << state->prev_trailing[p]);
+		}
+		state->prev_value[p] = value;
+		memcpy(&rounded, &value, sizeof(rounded));
+		record->value[p] = rounded / 1e6;
+	}
+
+	state->num_of_records++;
+}
+
+/*
+ * Write the num_of_bits low bits of value at bit position pos (MSB first)
+ */
+static void write_bits(uint8_t *data, uint64_t *pos, uint64_t value, int num_of_bits) {
+	while (num_of_bits > 0) {
+		int bit_in_byte = (int)(*pos & 7);
+		int chunk = 8 - bit_in_byte;
+		if (chunk > num_of_bits) {
+			chunk = num_of_bits;
+		}
+		uint8_t bits = (uint8_t)((value >> (num_of_bits - chunk)) & ((1u << chunk) - 1));
+		uint8_t *byte = &data[*pos >> 3];
+		int shift = 8 - bit_in_byte - chunk;
+		*byte = (uint8_t)((*byte & ~(((1u << chunk) - 1) << shift)) | (bits << shift));
+		*pos += chunk;
+		num_of_bits -= chunk;
+	}
+}
+
+/*
+ * Read num_of_bits bits at bit position pos (MSB first)
+ */
+static uint64_t read_bits(const uint8_t *data, uint64_t *pos, int num_of_bits) {
+	uint64_t value = 0;
+
+	while (num_of_bits > 0) {
+		int bit_in_byte = (int)(*pos & 7);
+		int chunk = 8 - bit_in_byte;
+		if (chunk > num_of_bits) {
+			chunk = num_of_bits;
+		}
+		int shift = 8 - bit_in_byte - chunk;
+		value = (value << chunk) | ((data[*pos >> 3] >> shift) & ((1u << chunk) - 1));
+		*pos += chunk;
+		num_of_bits -= chunk;
+	}
+	return value;
+}
+
+/*
+ * FNV-1a 64 bits hash of a URL (names its segment files)
+ */
+static uint64_t hash_url(const char *url) {
+	uint64_t hash = 14695981039346656037ULL;
+
+	while (*url) {
+		hash ^= (unsigned char)*url++;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*
+ * Comparison function between 2 doubles
+ */
+static int double_comp(const void* elem1, const void* elem2)
+{
+    if (*(const double*)elem1 < *(const double*)elem2)
+        return -1;
+    return *(const double*)elem1 > *(const double*)elem2;
+}
+
+/*
+ * Get the (nearest rank) percentile of arr. Note: arr is sorted in place
+ */
+static double get_percentile(double arr[], int arr_size, double percentile) {
+	int rank = (int)ceil(percentile * arr_size);
+
+	qsort(arr, arr_size, sizeof(double), double_comp);
+	return arr[(rank < 1) ? 0 : rank - 1];
+}
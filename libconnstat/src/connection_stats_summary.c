@@ -0,0 +1,226 @@
+/*
+ * connection_stats_summary.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Streaming statistics of the libconnstat library.
+ * All statistics beside the median (mean, stddev, jitter, min, max and the
+ * error classification) are accumulated in a single pass with O(1) space,
+ * so failed samples never abort a run - they are simply classified.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <math.h>
+#include <string.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**    Methods    **
+******************/
+/*
+ * Reset running statistics before a new run
+ */
+void running_stats_reset(RunningStats *running_stats) {
+	memset(running_stats, 0, sizeof(RunningStats));
+}
+
+/*
+ * Add a single value to running statistics (Welford's online algorithm)
+ */
+void running_stats_add(RunningStats *running_stats, double value) {
+	double delta;
+
+	if (running_stats->count == 0) {
+		running_stats->min = value;
+		running_stats->max = value;
+	} else {
+		running_stats->jitter_sum += fabs(value - running_stats->prev);
+		if (value < running_stats->min) {
+			running_stats->min = value;
+		}
+		if (value > running_stats->max) {
+			running_stats->max = value;
+		}
+	}
+	running_stats->prev = value;
+	running_stats->count++;
+
+	delta = value - running_stats->mean;
+	running_stats->mean += delta / running_stats->count;
+	running_stats->m2   += delta * (value - running_stats->mean);
+}
+
+/*
+ * Merge running statistics of disjoint samples into dst (Chan et al.).
+ * Jitter sums are added, the last value is taken from src
+ */
+void running_stats_merge(RunningStats *dst, const RunningStats *src) {
+	int count;
+	double delta;
+
+	if (src->count == 0) {
+		return;
+	}
+	if (dst->count == 0) {
+		*dst = *src;
+		return;
+	}
+
+	count = dst->count + src->count;
+	delta = src->mean - dst->mean;
+	dst->mean += delta * src->count / count;
+	dst->m2   += src->m2 + delta * delta * ((double)dst->count * src->count / count);
+	if (src->min < dst->min) {
+		dst->min = src->min;
+	}
+	if (src->max > dst->max) {
+		dst->max = src->max;
+	}
+	dst->jitter_sum += src->jitter_sum;
+	dst->prev        = src->prev;
+	dst->count       = count;
+}
+
+/*
+ * Fill phase statistics out of running statistics (median is not touched)
+ */
+void running_stats_finalize(const RunningStats *running_stats,
+							ConnStatPhaseStats *phase_stats) {
+	int count = running_stats->count;
+
+	phase_stats->mean   = running_stats->mean;
+	phase_stats->min    = running_stats->min;
+	phase_stats->max    = running_stats->max;
+	/* Sample (n-1) standard deviation and jitter need at least 2 values */
+	phase_stats->stddev = (count > 1) ? sqrt(running_stats->m2 / (count - 1)) : 0;
+	phase_stats->jitter = (count > 1) ? running_stats->jitter_sum / (count - 1) : 0;
+}
+
+/*
+ * A sample is successful if the transfer completed with no HTTP error
+ */
+int connection_stats_is_success(const CurlInfo *curl_info) {
+	return (curl_info->curl_code == CURLE_OK) &&
+		   (curl_info->response_code < HTTP_ERROR_RESPONSE_CODE_MIN);
+}
+
+/*
+ * Classify a failed sample by its CURLcode and HTTP response code
+ */
+void connection_stats_add_error(ConnStatSummary *summary,
+								const CurlInfo *curl_info) {
+	int i;
+
+	for (i=0; i<summary->num_of_error_classes; i++) {
+		if ((summary->error_classes[i].curl_code == curl_info->curl_code) &&
+			(summary->error_classes[i].response_code == curl_info->response_code)) {
+			summary->error_classes[i].count++;
+			return;
+		}
+	}
+
+	if (summary->num_of_error_classes == MAX_NUM_OF_ERROR_CLASSES) {
+		summary->num_of_unclassified_errors++;
+		return;
+	}
+
+	ConnStatErrorClass *error_class =
+		&summary->error_classes[summary->num_of_error_classes++];
+	error_class->curl_code     = curl_info->curl_code;
+	error_class->response_code = curl_info->response_code;
+	error_class->count         = 1;
+}
+
+/*
+ * Group all samples that got an HTTP response by IP and response code and
+ * compute per group statistics (so a slow backend stands out)
+ */
+void connection_stats_build_groups(const CurlInfo *curl_info_arr, int arr_size,
+								   ConnStatSummary *summary) {
+	int i, group;
+	int sample_group[arr_size];
+	unsigned short group_ip_idx[MAX_NUM_OF_GROUPS];
+	double name_lookup_time_arr[arr_size];
+	double connect_time_arr[arr_size];
+	double start_transfer_time_arr[arr_size];
+	double total_time_arr[arr_size];
+
+	summary->num_of_groups = 0;
+	summary->num_of_ungrouped_samples = 0;
+
+	/* Assign each sample to a group (-1 if it got no response) */
+	for (i=0; i<arr_size; i++) {
+		const CurlInfo *curl_info = &curl_info_arr[i];
+		sample_group[i] = -1;
+		if (curl_info->curl_code != CURLE_OK) {
+			continue;
+		}
+		for (group=0; group<summary->num_of_groups; group++) {
+			if ((group_ip_idx[group] == curl_info->ip_idx) &&
+				(summary->groups[group].response_code == curl_info->response_code)) {
+				break;
+			}
+		}
+		if (group == summary->num_of_groups) {
+			if (group == MAX_NUM_OF_GROUPS) {
+				summary->num_of_ungrouped_samples++;
+				continue;
+			}
+			/* New group */
+			ConnStatGroup *new_group = &summary->groups[summary->num_of_groups++];
+			memset(new_group, 0, sizeof(ConnStatGroup));
+			strncpy(new_group->ip, ip_table_get(curl_info->ip_idx), 
+					MAX_SIZE_OF_IP_ADD - 1);
+			new_group->response_code = curl_info->response_code;
+			group_ip_idx[group] = curl_info->ip_idx;
+		}
+		sample_group[i] = group;
+	}
+
+	/* Compute the statistics of each group */
+	for (group=0; group<summary->num_of_groups; group++) {
+		ConnStatGroup *p_group = &summary->groups[group];
+		RunningStats name_lookup_stats;
+		RunningStats connect_stats;
+		RunningStats start_transfer_stats;
+		RunningStats total_stats;
+		int count = 0;
+
+		running_stats_reset(&name_lookup_stats);
+		running_stats_reset(&connect_stats);
+		running_stats_reset(&start_transfer_stats);
+		running_stats_reset(&total_stats);
+
+		for (i=0; i<arr_size; i++) {
+			if (sample_group[i] != group) {
+				continue;
+			}
+			const CurlInfo *curl_info = &curl_info_arr[i];
+			name_lookup_time_arr[count]    = curl_info->name_lookup_time;
+			connect_time_arr[count]        = curl_info->connect_time;
+			start_transfer_time_arr[count] = curl_info->start_transfer_time;
+			total_time_arr[count]          = curl_info->total_time;
+			count++;
+
+			running_stats_add(&name_lookup_stats,    curl_info->name_lookup_time);
+			running_stats_add(&connect_stats,        curl_info->connect_time);
+			running_stats_add(&start_transfer_stats, curl_info->start_transfer_time);
+			running_stats_add(&total_stats,          curl_info->total_time);
+		}
+
+		p_group->num_of_samples = count;
+		running_stats_finalize(&name_lookup_stats,    &p_group->name_lookup);
+		running_stats_finalize(&connect_stats,        &p_group->connect);
+		running_stats_finalize(&start_transfer_stats, &p_group->start_transfer);
+		running_stats_finalize(&total_stats,          &p_group->total);
+		p_group->name_lookup.median    = get_median(name_lookup_time_arr, count);
+		p_group->connect.median        = get_median(connect_time_arr, count);
+		p_group->start_transfer.median = get_median(start_transfer_time_arr, count);
+		p_group->total.median          = get_median(total_time_arr, count);
+	}
+}
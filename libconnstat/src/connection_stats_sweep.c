@@ -0,0 +1,294 @@
+/*
+ * connection_stats_sweep.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Timeouts, run deadlines and sweeps of the libconnstat library.
+ * Every handle gets the per phase timeouts of its target (connect phase,
+ * transfer stall and whole sample), so a hung target never blocks a run:
+ * its samples simply time out and are classified as such.
+ * A run deadline caps every sample by the time left to the deadline, and
+ * samples that could not start in time are timed out without a transfer.
+ * A sweep samples several targets under a single deadline. Its scheduler
+ * always serves the target that is the furthest behind, among the targets
+ * whose next sample is expected to end before the deadline, so the budget
+ * is shared evenly and cheap targets still complete when slow ones do not.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+/* Weight of the last sample in the expected duration of a target */
+#define SWEEP_EWMA_WEIGHT       0.3
+
+
+/******************
+**  Structures   **
+******************/
+/* A single target of a sweep */
+typedef struct {
+	HttpReqData *p_http_req_data;
+	CURL        *curl;
+	CurlInfo     curl_info_arr[MAX_NUM_OF_SUPPORTED_CURL_OPER];
+	int          num_of_samples;    /* Samples taken so far */
+	double       expected_ms;       /* Expected duration of the next sample */
+} SweepTarget;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static SweepTarget* next_target(SweepTarget *targets, int num_of_targets,
+								long remaining_ms);
+static double elapsed_ms(const struct timespec *start);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Sample several targets within a single time budget
+*         (see connection_stats.h)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_sweep(HttpReqData* targets, int num_of_targets,
+						  long deadline_ms, ConnStatSweepResult* results) {
+	SweepTarget *sweep_targets;
+	SweepTarget *target;
+	struct timespec start;
+	RC rc = RC_OK;
+	int t, i;
+
+	if ((targets == NULL) || (results == NULL) || (num_of_targets <= 0) ||
+		(num_of_targets > MAX_NUM_OF_SWEEP_TARGETS) || (deadline_ms < 0)) {
+		printf("connection_stats_sweep() fail with invalid targets [num_of_targets=%d "
+			   "(max %d), deadline_ms=%ld]\n", num_of_targets, MAX_NUM_OF_SWEEP_TARGETS,
+				deadline_ms);
+		return RC_ERROR;
+	}
+	for (t=0; t<num_of_targets; t++) {
+		rc = is_valid_http_data_req(&targets[t]);
+		if (rc != RC_OK) {
+			return rc;
+		}
+		if (targets[t].multiplex || (targets[t].mode != CONNSTAT_MODE_LATENCY) ||
+			(targets[t].ci_width > 0)) {
+			printf("connection_stats_sweep() supports sequential latency targets only \n");
+			return RC_NOT_SUPPORTED;
+		}
+	}
+
+	sweep_targets = calloc(num_of_targets, sizeof(SweepTarget));
+	if (sweep_targets == NULL) {
+		fprintf(stderr, "calloc() failed\n");
+		return RC_ERROR;
+	}
+
+	/* A handle per target, so connections are reused per target */
+	for (t=0; t<num_of_targets; t++) {
+		sweep_targets[t].p_http_req_data = &targets[t];
+		sweep_targets[t].curl = curl_easy_init();
+		if (sweep_targets[t].curl == NULL) {
+			printf("connection_stats_sweep() fail with curl_easy_init() \n");
+			rc = RC_ERROR_IN_CURL;
+			goto cleanup;
+		}
+		rc = connection_stats_setup_handle(sweep_targets[t].curl, &targets[t]);
+		if (rc != RC_OK) {
+			goto cleanup;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		long remaining_ms = deadline_remaining_ms(&start, deadline_ms);
+		struct timespec sample_start;
+		double sample_ms;
+
+		target = next_target(sweep_targets, num_of_targets, remaining_ms);
+		if (target == NULL) {
+			break;  /* Done, or nothing fits the budget any more */
+		}
+
+		timeouts_arm(target->curl, target->p_http_req_data->timeout_ms, remaining_ms);
+		clock_gettime(CLOCK_MONOTONIC, &sample_start);
+		long nivcsw = affinity_get_nivcsw();
+		CurlInfo *curl_info = &target->curl_info_arr[target->num_of_samples++];
+		transport_perform(target->curl, target->p_http_req_data, curl_info);
+		curl_info->involuntary_ctx_switches = affinity_get_nivcsw() - nivcsw;
+		samples_notify(target->p_http_req_data, target->num_of_samples - 1, curl_info);
+
+		/* Failed samples count as well - a target that times out is expensive */
+		sample_ms = elapsed_ms(&sample_start);
+		target->expected_ms = (target->num_of_samples == 1) ? sample_ms :
+			(1 - SWEEP_EWMA_WEIGHT) * target->expected_ms + SWEEP_EWMA_WEIGHT * sample_ms;
+	}
+
+	/* Samples left are timed out, then every target is analyzed */
+	for (t=0; t<num_of_targets; t++) {
+		target = &sweep_targets[t];
+		int num_of_http_req = target->p_http_req_data->num_of_http_req;
+		for (i=target->num_of_samples; i<num_of_http_req; i++) {
+			timeouts_mark_skipped(&target->curl_info_arr[i]);
+			samples_notify(target->p_http_req_data, i, &target->curl_info_arr[i]);
+		}
+
+		memset(&results[t], 0, sizeof(ConnStatSweepResult));
+		results[t].rc = connection_stats_build_output(target->curl_info_arr,
+													  num_of_http_req,
+													  results[t].stat_str,
+													  &results[t].summary);
+		for (i=0; i<num_of_http_req; i++) {
+			connection_stats_record(target->p_http_req_data->url,
+									&target->curl_info_arr[i]);
+		}
+		store_append(target->p_http_req_data->url, target->curl_info_arr,
+					 num_of_http_req, &results[t].summary);
+		collector_send_run(target->p_http_req_data->url, target->curl_info_arr,
+						   num_of_http_req);
+		snapshot_publish(target->p_http_req_data->url, results[t].rc,
+						 results[t].stat_str, &results[t].summary);
+	}
+	printf("connection_stats_sweep() swept %d targets in %.0f ms \n",
+		   num_of_targets, elapsed_ms(&start));
+
+cleanup:
+	for (t=0; t<num_of_targets; t++) {
+		if (sweep_targets[t].curl != NULL) {
+			trace_tail_release(sweep_targets[t].curl);
+			curl_easy_cleanup(sweep_targets[t].curl);
+		}
+	}
+	free(sweep_targets);
+	return rc;
+}
+
+/*
+ * Set the timeouts of a target on a handle (the deadline caps the whole
+ * sample as well, in case the caller does not re-arm it per sample)
+ */
+RC timeouts_setup(CURL *curl, HttpReqData *p_http_req_data) {
+	CURLcode res;
+
+	/* 0 clears a timeout left by a previous run on the same handle */
+	res = curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+						   p_http_req_data->connect_timeout_ms);
+	if (res == CURLE_OK) {
+		res = curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT,
+							   p_http_req_data->low_speed_limit);
+	}
+	if (res == CURLE_OK) {
+		res = curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME,
+							   p_http_req_data->low_speed_time);
+	}
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_setopt() failed: %s\n", curl_easy_strerror(res));
+		return RC_ERROR_IN_CURL;
+	}
+	return timeouts_arm(curl, p_http_req_data->timeout_ms,
+						(p_http_req_data->deadline_ms > 0) ?
+						p_http_req_data->deadline_ms : LONG_MAX);
+}
+
+/*
+ * Limit the next sample of a handle to timeout_ms (0 means none) and to the
+ * time left to the deadline
+ */
+RC timeouts_arm(CURL *curl, long timeout_ms, long remaining_ms) {
+	CURLcode res;
+
+	if ((remaining_ms != LONG_MAX) && ((timeout_ms == 0) || (remaining_ms < timeout_ms))) {
+		timeout_ms = (remaining_ms > 0) ? remaining_ms : 1;
+	}
+	res = curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_setopt() failed CURLOPT_TIMEOUT_MS: %s\n",
+				curl_easy_strerror(res));
+		return RC_ERROR_IN_CURL;
+	}
+	return RC_OK;
+}
+
+/*
+ * Get the time (ms) left to a run's deadline (LONG_MAX if it has none)
+ */
+long deadline_remaining_ms(const struct timespec *start, long deadline_ms) {
+	if (deadline_ms <= 0) {
+		return LONG_MAX;
+	}
+	return deadline_ms - (long)elapsed_ms(start);
+}
+
+/*
+ * Mark a sample that could not start before the deadline as timed out
+ */
+void timeouts_mark_skipped(CurlInfo *curl_info) {
+	struct timespec now;
+
+	memset(curl_info, 0, sizeof(CurlInfo));
+	curl_info->curl_code = CURLE_OPERATION_TIMEDOUT;
+	clock_gettime(CLOCK_REALTIME, &now);
+	curl_info->timestamp_us = (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Pick the target to sample next: the furthest behind (relative to its
+ * num_of_http_req) of the targets whose next sample fits the remaining time,
+ * the cheaper one on a tie. NULL if there is none
+ */
+static SweepTarget* next_target(SweepTarget *targets, int num_of_targets,
+								long remaining_ms) {
+	SweepTarget *best = NULL;
+	double best_progress = 0;
+	int t;
+
+	if (remaining_ms <= 0) {
+		return NULL;
+	}
+	for (t=0; t<num_of_targets; t++) {
+		SweepTarget *target = &targets[t];
+		int num_of_http_req = target->p_http_req_data->num_of_http_req;
+		double progress;
+
+		if ((target->num_of_samples == num_of_http_req) ||
+			(target->expected_ms > remaining_ms)) {
+			continue;
+		}
+		progress = (double)target->num_of_samples / num_of_http_req;
+		if ((best == NULL) || (progress < best_progress) ||
+			((progress == best_progress) && (target->expected_ms < best->expected_ms))) {
+			best = target;
+			best_progress = progress;
+		}
+	}
+	return best;
+}
+
+/*
+ * Milliseconds since start (CLOCK_MONOTONIC)
+ */
+static double elapsed_ms(const struct timespec *start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0 +
+		   (now.tv_nsec - start->tv_nsec) / 1e6;
+}
@@ -0,0 +1,370 @@
+/*
+ * connection_stats_throughput.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Throughput (goodput) measurement mode of the libconnstat library.
+ * Payloads are downloaded through a discard sink (nothing is written to
+ * disk) by up to num_of_streams parallel transfers, to saturate the link.
+ * Besides the per download CURLINFO_SPEED_DOWNLOAD_T/SIZE_DOWNLOAD_T
+ * statistics, a time sliced throughput curve of all streams together is
+ * sampled from the progress callback.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define THROUGHPUT_POLL_TIMEOUT_MS  1000
+#define MAX_SIZE_OF_RANGE           32
+
+
+/******************
+**  Structures   **
+******************/
+/* A single parallel stream (reused for consecutive downloads) */
+typedef struct {
+	CURL       *curl;
+	CurlInfo   *curl_info;   /* Sample currently being downloaded */
+	curl_off_t  last_dlnow;  /* Bytes already accounted in the curve */
+} ThroughputStream;
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Throughput of the last run (valid if g_has_throughput) */
+static ConnStatThroughput g_throughput;
+static int g_has_throughput = 0;
+
+/* Throughput curve being sampled (bytes per slice) */
+static struct timespec g_start;
+static long long g_slice_bytes[MAX_NUM_OF_THROUGHPUT_SLICES];
+static int g_slice_ms;
+static int g_num_of_slices;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC setup_stream(ThroughputStream *stream, HttpReqData *p_http_req_data);
+static RC start_download(CURLM *multi, ThroughputStream *stream, CurlInfo *curl_info);
+static size_t discard_data(void *ptr, size_t size, size_t nmemb, void *userp);
+static int progress_func(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
+						 curl_off_t ultotal, curl_off_t ulnow);
+static void add_to_curve(ThroughputStream *stream, curl_off_t dlnow);
+static double elapsed_ms();
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Perform all downloads of a run (up to num_of_streams in parallel),
+*         collect them and compute the run's throughput
+* @param  p_http_req_data	Data as received by the user (throughput mode)
+* @param  curl_info_arr		Samples to be filled (num_of_http_req entries)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_throughput_perform(HttpReqData *p_http_req_data,
+									   CurlInfo *curl_info_arr) {
+	ThroughputStream streams[MAX_NUM_OF_THROUGHPUT_STREAMS];
+	double speed_arr[MAX_NUM_OF_SUPPORTED_CURL_OPER];
+	double size_arr[MAX_NUM_OF_SUPPORTED_CURL_OPER];
+	RunningStats speed_stats;
+	RunningStats size_stats;
+	int num_of_downloads = p_http_req_data->num_of_http_req;
+	int num_of_streams = (p_http_req_data->num_of_streams > 0) ?
+						  p_http_req_data->num_of_streams : 1;
+	int num_of_started = 0;
+	int num_of_done = 0;
+	int num_of_success = 0;
+	int still_running = 0;
+	CURLMcode mres;
+	CURLMsg *msg;
+	int msgs_left;
+	int i;
+	RC rc = RC_OK;
+
+	if (num_of_streams > num_of_downloads) {
+		num_of_streams = num_of_downloads;
+	}
+	memset(streams, 0, sizeof(streams));
+	memset(&g_throughput, 0, sizeof(g_throughput));
+	memset(g_slice_bytes, 0, sizeof(g_slice_bytes));
+	running_stats_reset(&speed_stats);
+	running_stats_reset(&size_stats);
+	g_slice_ms = (p_http_req_data->slice_ms > 0) ?
+				  p_http_req_data->slice_ms : DEFAULT_THROUGHPUT_SLICE_MS;
+	g_num_of_slices = 0;
+
+	CURLM *multi = curl_multi_init();
+	if (multi == NULL) {
+		printf("connection_stats_throughput_perform() fail with curl_multi_init() \n");
+		return RC_ERROR_IN_CURL;
+	}
+
+	/* Until collected, every sample is considered failed */
+	for (i=0; i<num_of_downloads; i++) {
+		memset(&curl_info_arr[i], 0, sizeof(CurlInfo));
+		curl_info_arr[i].curl_code = CURLE_FAILED_INIT;
+	}
+
+	/* Start the first download of every stream */
+	clock_gettime(CLOCK_MONOTONIC, &g_start);
+	for (i=0; (i<num_of_streams) && (rc == RC_OK); i++) {
+		rc = setup_stream(&streams[i], p_http_req_data);
+		if (rc == RC_OK) {
+			rc = start_download(multi, &streams[i], &curl_info_arr[num_of_started++]);
+		}
+	}
+
+	/* Drive all streams, starting the next download once a stream is free */
+	while (rc == RC_OK) {
+		mres = curl_multi_perform(multi, &still_running);
+		if ((mres == CURLM_OK) && still_running) {
+			mres = curl_multi_poll(multi, NULL, 0, THROUGHPUT_POLL_TIMEOUT_MS, NULL);
+		}
+		if (mres != CURLM_OK) {
+			/* Downloads that did not complete stay marked as failed */
+			fprintf(stderr, "curl_multi_perform() failed: %s\n",
+					curl_multi_strerror(mres));
+			break;
+		}
+
+		while ((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+			ThroughputStream *stream;
+			CURL *curl = msg->easy_handle;
+			CURLcode result = msg->data.result;
+			curl_off_t speed = 0;
+			curl_off_t size = 0;
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+			curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&stream);
+			curl_multi_remove_handle(multi, curl);
+			num_of_done++;
+
+			/* Collect statistics (a failure marks the sample as failed) */
+			connection_stats_collect(curl, result, stream->curl_info);
+			samples_notify(p_http_req_data, (int)(stream->curl_info - curl_info_arr),
+						   stream->curl_info);
+			curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+			curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &size);
+			add_to_curve(stream, size);
+			if (connection_stats_is_success(stream->curl_info)) {
+				g_throughput.total_bytes += size;
+				speed_arr[num_of_success] = (double)speed;
+				size_arr[num_of_success]  = (double)size;
+				running_stats_add(&speed_stats, (double)speed);
+				running_stats_add(&size_stats, (double)size);
+				num_of_success++;
+			} else {
+				/* Not goodput (an error page or a cut download) */
+				g_throughput.failed_bytes += size;
+				if (stream->curl_info->curl_code != CURLE_OK) {
+					fprintf(stderr, "download failed: %s\n",
+							curl_easy_strerror(stream->curl_info->curl_code));
+				} else {
+					fprintf(stderr, "download failed: HTTP response code %ld\n",
+							stream->curl_info->response_code);
+				}
+			}
+
+			if (num_of_started < num_of_downloads) {
+				rc = start_download(multi, stream, &curl_info_arr[num_of_started++]);
+			}
+		}
+
+		if (num_of_done == num_of_downloads) {
+			break;
+		}
+	}
+
+	/* Compute the run's throughput */
+	g_throughput.num_of_streams = num_of_streams;
+	g_throughput.duration = elapsed_ms() / 1000;
+	g_throughput.goodput = (g_throughput.duration > 0) ?
+		g_throughput.total_bytes / g_throughput.duration : 0;
+	running_stats_finalize(&speed_stats, &g_throughput.speed);
+	running_stats_finalize(&size_stats, &g_throughput.size);
+	g_throughput.speed.median = (num_of_success > 0) ? get_median(speed_arr, num_of_success) : 0;
+	g_throughput.size.median  = (num_of_success > 0) ? get_median(size_arr, num_of_success) : 0;
+	g_throughput.slice_ms      = g_slice_ms;
+	g_throughput.num_of_slices = g_num_of_slices;
+	for (i=0; i<g_num_of_slices; i++) {
+		g_throughput.curve[i] = g_slice_bytes[i] * 1000.0 / g_slice_ms;
+	}
+	g_has_throughput = 1;
+
+	for (i=0; i<num_of_streams; i++) {
+		if (streams[i].curl != NULL) {
+			curl_multi_remove_handle(multi, streams[i].curl);
+			trace_tail_release(streams[i].curl);
+			curl_easy_cleanup(streams[i].curl);
+		}
+	}
+	curl_multi_cleanup(multi);
+
+	return rc;
+}
+
+/**
+* @desc   Get the throughput of the last run (throughput mode only)
+* @param  throughput    Throughput to be filled
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_get_throughput(ConnStatThroughput* throughput) {
+	if (!g_has_throughput) {
+		printf("ERROR: Throughput requested before triggereing a throughput run \n");
+		return RC_RESULT_REQUESTED_BEFORE_TRIGGER;
+	}
+	*throughput = g_throughput;
+	return RC_OK;
+}
+
+/*
+ * Forget the throughput of the last run
+ */
+void throughput_reset() {
+	g_has_throughput = 0;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Create the easy handle of a stream: regular setup, but with a discard
+ * sink and a progress callback feeding the curve
+ */
+static RC setup_stream(ThroughputStream *stream, HttpReqData *p_http_req_data) {
+	char range[MAX_SIZE_OF_RANGE];
+	CURLcode res;
+	RC rc;
+
+	stream->curl = curl_easy_init();
+	if (stream->curl == NULL) {
+		printf("connection_stats_throughput_perform() fail with curl_easy_init() \n");
+		return RC_ERROR_IN_CURL;
+	}
+
+	rc = connection_stats_setup_handle(stream->curl, p_http_req_data);
+	if (rc != RC_OK) {
+		return rc;
+	}
+
+	res = curl_easy_setopt(stream->curl, CURLOPT_WRITEFUNCTION, discard_data);
+	if (res == CURLE_OK) {
+		res = curl_easy_setopt(stream->curl, CURLOPT_WRITEDATA, NULL);
+	}
+	if (res == CURLE_OK) {
+		res = curl_easy_setopt(stream->curl, CURLOPT_XFERINFOFUNCTION, progress_func);
+	}
+	if (res == CURLE_OK) {
+		res = curl_easy_setopt(stream->curl, CURLOPT_XFERINFODATA, stream);
+	}
+	if (res == CURLE_OK) {
+		res = curl_easy_setopt(stream->curl, CURLOPT_NOPROGRESS, 0L);
+	}
+	if (res == CURLE_OK) {
+		res = curl_easy_setopt(stream->curl, CURLOPT_PRIVATE, stream);
+	}
+	if ((res == CURLE_OK) && (p_http_req_data->payload_bytes > 0)) {
+		snprintf(range, sizeof(range), "0-%ld", p_http_req_data->payload_bytes - 1);
+		res = curl_easy_setopt(stream->curl, CURLOPT_RANGE, range);
+	}
+	if (res != CURLE_OK) {
+		fprintf(stderr, "curl_easy_setopt() failed: %s\n", curl_easy_strerror(res));
+		return RC_ERROR_IN_CURL;
+	}
+	return RC_OK;
+}
+
+/*
+ * Start the next download on a (free) stream
+ */
+static RC start_download(CURLM *multi, ThroughputStream *stream, CurlInfo *curl_info) {
+	stream->curl_info  = curl_info;
+	stream->last_dlnow = 0;
+
+	if (curl_multi_add_handle(multi, stream->curl) != CURLM_OK) {
+		printf("connection_stats_throughput_perform() fail with curl_multi_add_handle() \n");
+		return RC_ERROR_IN_CURL;
+	}
+	return RC_OK;
+}
+
+/*
+ * Discard sink - the body is only counted (by libcurl), never stored
+ */
+static size_t discard_data(void *ptr, size_t size, size_t nmemb, void *userp) {
+	(void)ptr;   /* prevent compiler warning */
+	(void)userp; /* prevent compiler warning */
+	return size * nmemb;
+}
+
+/*
+ * libCURL progress callback - feed the throughput curve
+ */
+static int progress_func(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
+						 curl_off_t ultotal, curl_off_t ulnow) {
+	(void)dltotal; /* prevent compiler warning */
+	(void)ultotal; /* prevent compiler warning */
+	(void)ulnow;   /* prevent compiler warning */
+
+	add_to_curve((ThroughputStream *)clientp, dlnow);
+	return 0;
+}
+
+/*
+ * Account the bytes a stream received since its last report in the current
+ * slice. If the run outgrows the curve, slices are merged in pairs (so the
+ * curve always covers the whole run with up to MAX_NUM_OF_THROUGHPUT_SLICES)
+ */
+static void add_to_curve(ThroughputStream *stream, curl_off_t dlnow) {
+	int slice, i;
+
+	if (dlnow <= stream->last_dlnow) {
+		return;
+	}
+
+	slice = (int)(elapsed_ms() / g_slice_ms);
+	while (slice >= MAX_NUM_OF_THROUGHPUT_SLICES) {
+		for (i=0; i<MAX_NUM_OF_THROUGHPUT_SLICES/2; i++) {
+			g_slice_bytes[i] = g_slice_bytes[2*i] + g_slice_bytes[2*i + 1];
+		}
+		memset(&g_slice_bytes[MAX_NUM_OF_THROUGHPUT_SLICES/2], 0,
+			   sizeof(g_slice_bytes) / 2);
+		g_slice_ms *= 2;
+		g_num_of_slices = (g_num_of_slices + 1) / 2;
+		slice = (int)(elapsed_ms() / g_slice_ms);
+	}
+
+	g_slice_bytes[slice] += dlnow - stream->last_dlnow;
+	stream->last_dlnow = dlnow;
+	if (slice >= g_num_of_slices) {
+		g_num_of_slices = slice + 1;
+	}
+}
+
+/*
+ * Milliseconds elapsed since the run started (monotonic clock)
+ */
+static double elapsed_ms() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - g_start.tv_sec) * 1000.0 +
+		   (now.tv_nsec - g_start.tv_nsec) / 1e6;
+}
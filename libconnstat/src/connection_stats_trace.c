@@ -0,0 +1,320 @@
+/*
+ * connection_stats_trace.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Tail based tracing of the libconnstat library (debug variant only).
+ * Full tracing writes every event of every transfer to trace/trace.out,
+ * while the interesting traces are those of the few slow or failed samples.
+ * With tail tracing the events of a sample are kept in memory, in a buffer
+ * of its handle, until the sample is collected. Only then it is known whether
+ * the sample is an outlier - it failed, or its total time is above a live
+ * percentile of the total times of the successful samples so far - and only
+ * outliers are formatted and appended to trace/tail.out. Other buffers are
+ * simply reused, so the common sample costs a memcpy per event, and a buffer
+ * is released with its handle.
+ * In the lean variant nothing is traced, and the entry points are stubs.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+#ifdef TRACE_ENA
+/******************
+**   Defines     **
+******************/
+#define TRACE_MAX_BUFFERS       256        /* Handles traced at the same time */
+#define TRACE_BUFFER_SIZE       (64 * 1024) /* Events kept per sample */
+#define TRACE_MIN_SAMPLES       20         /* Before the threshold is trusted */
+#define TRACE_TAIL_FILE_NAME    "trace/tail.out"
+
+
+/******************
+**  Structures   **
+******************/
+/* A single event in a buffer (followed by size bytes of data) */
+typedef struct {
+	int64_t  at_us;  /* When it was traced (usec since the epoch) */
+	uint32_t type;   /* curl_infotype */
+	uint32_t size;
+} TraceEvent;
+
+/* Events of the sample in progress on a handle */
+typedef struct {
+	CURL          *curl;
+	size_t         len;
+	int            truncated;  /* Events were dropped (buffer is full) */
+	unsigned char *data;
+} TraceBuffer;
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Percentile of the threshold (0 if tail tracing is off) */
+static double g_percentile = 0;
+
+/* Total times of the successful samples so far (the live threshold) */
+static LatencyHistogram g_hist;
+
+static TraceBuffer g_buffers[TRACE_MAX_BUFFERS];
+static int g_num_of_buffers = 0;
+static int g_full_warned = 0;
+
+static FILE *g_tail_file = NULL;
+
+/* Samples seen and kept (printed on close) */
+static long g_num_of_samples = 0;
+static long g_num_of_kept = 0;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static TraceBuffer* get_buffer(CURL *curl);
+static TraceBuffer* find_buffer(CURL *curl);
+static void persist(const TraceBuffer *buffer, const CurlInfo *curl_info,
+					double threshold, const char *reason);
+#endif // TRACE_ENA
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Keep the traces of outliers only (see connection_stats.h)
+* @param  percentile	Percentile of the threshold (0 for full tracing)
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_set_tail_tracing(double percentile) {
+#ifdef TRACE_ENA
+	if ((percentile < 0) || (percentile >= 1)) {
+		printf("connection_stats_set_tail_tracing() fail with invalid percentile %f \n",
+			   percentile);
+		return RC_ERROR;
+	}
+	trace_tail_reset();
+	if (percentile == 0) {
+		return RC_OK;
+	}
+
+	/* Appended, so outliers of earlier processes are kept as well */
+	g_tail_file = fopen(TRACE_TAIL_FILE_NAME, "ab");
+	if (g_tail_file == NULL) {
+		printf("connection_stats_set_tail_tracing() fail to open %s \n",
+			   TRACE_TAIL_FILE_NAME);
+		return RC_ERROR_IN_FILE_OR_FOLDER;
+	}
+	g_percentile = percentile;
+	return RC_OK;
+#else
+	(void)percentile; /* prevent compiler warning */
+	printf("connection_stats_set_tail_tracing() requires the debug variant \n");
+	return RC_NOT_SUPPORTED;
+#endif
+}
+
+#ifdef TRACE_ENA
+/*
+ * Non zero if events are to be buffered (rather than written right away)
+ */
+int trace_tail_is_enabled() {
+	return (g_percentile > 0);
+}
+
+/*
+ * Keep an event of the sample in progress on a handle
+ */
+void trace_tail_append(CURL *curl, curl_infotype type, const char *data, size_t size,
+					   long long at_us) {
+	TraceBuffer *buffer = get_buffer(curl);
+	TraceEvent event;
+
+	if ((buffer == NULL) || buffer->truncated) {
+		return;
+	}
+	if (buffer->len + sizeof(TraceEvent) + size > TRACE_BUFFER_SIZE) {
+		buffer->truncated = 1;
+		return;
+	}
+	event.at_us = at_us;
+	event.type = type;
+	event.size = (uint32_t)size;
+	memcpy(buffer->data + buffer->len, &event, sizeof(TraceEvent));
+	memcpy(buffer->data + buffer->len + sizeof(TraceEvent), data, size);
+	buffer->len += sizeof(TraceEvent) + size;
+}
+
+/*
+ * The sample in progress on a handle was collected: persist its events if
+ * it is an outlier, then start over
+ */
+void trace_tail_sample_done(CURL *curl, const CurlInfo *curl_info) {
+	TraceBuffer *buffer = get_buffer(curl);
+	double threshold = 0;
+	const char *reason = NULL;
+
+	if (buffer == NULL) {
+		return;
+	}
+	g_num_of_samples++;
+
+	if (!connection_stats_is_success(curl_info)) {
+		reason = "failed";
+	} else {
+		/* Compared against the samples before it, then added */
+		if (g_hist.count >= TRACE_MIN_SAMPLES) {
+			int rank = (int)(g_percentile * g_hist.count + 0.5);
+			threshold = histogram_value_at_rank(&g_hist, (rank < 1) ? 1 : rank);
+			if (curl_info->total_time > threshold) {
+				reason = "slow";
+			}
+		}
+		histogram_add(&g_hist, curl_info->total_time);
+	}
+
+	if (reason != NULL) {
+		persist(buffer, curl_info, threshold, reason);
+		g_num_of_kept++;
+	}
+	buffer->len = 0;
+	buffer->truncated = 0;
+}
+
+/*
+ * Release the buffer of a handle (before the handle is cleaned up, so a
+ * later handle at the same address does not inherit it)
+ */
+void trace_tail_release(CURL *curl) {
+	TraceBuffer *buffer = find_buffer(curl);
+
+	if (buffer == NULL) {
+		return;
+	}
+	free(buffer->data);
+	*buffer = g_buffers[--g_num_of_buffers];
+	memset(&g_buffers[g_num_of_buffers], 0, sizeof(TraceBuffer));
+}
+
+/*
+ * Stop tail tracing and release the buffers
+ */
+void trace_tail_reset() {
+	if (g_tail_file != NULL) {
+		printf("connection_stats tail tracing kept %ld of %ld sample traces (%s) \n",
+			   g_num_of_kept, g_num_of_samples, TRACE_TAIL_FILE_NAME);
+		fclose(g_tail_file);
+		g_tail_file = NULL;
+	}
+	for (int i=0; i<g_num_of_buffers; i++) {
+		free(g_buffers[i].data);
+	}
+	memset(g_buffers, 0, sizeof(g_buffers));
+	memset(&g_hist, 0, sizeof(g_hist));
+	g_num_of_buffers = 0;
+	g_full_warned = 0;
+	g_num_of_samples = 0;
+	g_num_of_kept = 0;
+	g_percentile = 0;
+}
+#else
+/*
+ * Lean variant stubs - nothing is traced
+ */
+int trace_tail_is_enabled() {
+	return 0;
+}
+
+void trace_tail_release(CURL *curl) {
+	(void)curl; /* prevent compiler warning */
+}
+
+void trace_tail_reset() {
+}
+#endif // TRACE_ENA
+
+/***********************
+** Supporting Methods **
+***********************/
+#ifdef TRACE_ENA
+/*
+ * Get the buffer of a handle (allocated on its first event). NULL if there
+ * are too many handles
+ */
+static TraceBuffer* get_buffer(CURL *curl) {
+	TraceBuffer *buffer = find_buffer(curl);
+
+	if (buffer != NULL) {
+		return buffer;
+	}
+	if (g_num_of_buffers == TRACE_MAX_BUFFERS) {
+		if (!g_full_warned) {
+			printf("connection_stats tail tracing: too many handles, some samples "
+				   "are not traced \n");
+			g_full_warned = 1;
+		}
+		return NULL;
+	}
+	buffer = &g_buffers[g_num_of_buffers];
+	buffer->data = malloc(TRACE_BUFFER_SIZE);
+	if (buffer->data == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		return NULL;
+	}
+	buffer->curl = curl;
+	buffer->len = 0;
+	buffer->truncated = 0;
+	g_num_of_buffers++;
+	return buffer;
+}
+
+/*
+ * Get the buffer of a handle, NULL if it has none
+ */
+static TraceBuffer* find_buffer(CURL *curl) {
+	for (int i=0; i<g_num_of_buffers; i++) {
+		if (g_buffers[i].curl == curl) {
+			return &g_buffers[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Append the events of a sample to the tail file, in the format of
+ * trace/trace.out, after a line that tells why the sample was kept
+ */
+static void persist(const TraceBuffer *buffer, const CurlInfo *curl_info,
+					double threshold, const char *reason) {
+	size_t pos = 0;
+
+	fprintf(g_tail_file, "==== Sample %s: timestamp_us=%lld ip=%s curl_code=%d "
+			"response_code=%ld total_time=%.6f threshold=%.6f (p%.0f)\n", reason,
+			curl_info->timestamp_us, ip_table_get(curl_info->ip_idx), curl_info->curl_code,
+			curl_info->response_code, curl_info->total_time, threshold, g_percentile * 100);
+	while (pos < buffer->len) {
+		TraceEvent event;
+
+		memcpy(&event, buffer->data + pos, sizeof(TraceEvent));
+		pos += sizeof(TraceEvent);
+		trace_write(g_tail_file, (curl_infotype)event.type,
+					(char *)buffer->data + pos, event.size, event.at_us);
+		pos += event.size;
+	}
+	if (buffer->truncated) {
+		fprintf(g_tail_file, "==== Sample trace truncated (over %d bytes)\n",
+				TRACE_BUFFER_SIZE);
+	}
+	fflush(g_tail_file);
+}
+#endif // TRACE_ENA
@@ -0,0 +1,299 @@
+/*
+ * connection_stats_transport.c
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Omri Ravid
+ *
+ * Transport layer of the libconnstat library.
+ * Sequential runs (including adaptive runs and sweeps) take every sample
+ * through the transport: by default libCURL performs the request and the
+ * sample is collected out of its handle, while a caller set transport fills
+ * the sample by itself.
+ * The fake transport is such a transport: it draws the phase timings of a
+ * sample from configurable distributions (xoshiro256** generator) without
+ * any I/O, so tests need no network, failures and edge cases are easily
+ * simulated, and millions of samples per second can be pushed through the
+ * statistics, aggregation and output layers.
+ */
+
+/******************
+**   Includes    **
+******************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "../inc/connection_stats.h"
+#include "connection_stats_internal.h"
+
+
+/******************
+**   Defines     **
+******************/
+#define FAKE_DEFAULT_IP             "127.0.0.1"
+#define FAKE_DEFAULT_RESPONSE_CODE  200
+#define FAKE_DEFAULT_FAILURE_CODE   CURLE_COULDNT_CONNECT
+
+
+/******************
+**  Global Vars  **
+******************/
+/* Caller set transport (NULL for libCURL) */
+static const ConnStatTransport *g_transport = NULL;
+
+
+/*************************
+** Methods Declerations **
+*************************/
+static RC fake_perform(const HttpReqData *http_req_data, CurlInfo *curl_info,
+					   void *transport_data);
+static double fake_draw(ConnStatFakeTransport *fake, const ConnStatDistribution *dist);
+static double fake_uniform(ConnStatFakeTransport *fake);
+static uint64_t fake_next(ConnStatFakeTransport *fake);
+static RC validate_distribution(const ConnStatDistribution *dist);
+
+
+/******************
+**    Methods    **
+******************/
+/**
+* @desc   Take the samples of following runs through a transport
+*         (see connection_stats.h)
+* @param  transport		Transport to be used, NULL for libCURL
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_set_transport(const ConnStatTransport* transport) {
+	if ((transport != NULL) && (transport->perform == NULL)) {
+		printf("connection_stats_set_transport() fail with missing perform \n");
+		return RC_ERROR;
+	}
+	g_transport = transport;
+	return RC_OK;
+}
+
+/**
+* @desc   Initialize a fake transport (see connection_stats.h)
+* @param  fake		Fake transport to be initialized
+* @param  config	Distributions and failures of the samples
+* @return Return Code (taken from RC enum)
+*/
+RC connection_stats_fake_transport_init(ConnStatFakeTransport* fake,
+										const ConnStatFakeConfig* config) {
+	uint64_t seed;
+	RC rc;
+
+	if ((fake == NULL) || (config == NULL) ||
+		(config->failure_ratio < 0) || (config->failure_ratio > 1)) {
+		printf("connection_stats_fake_transport_init() fail with invalid config \n");
+		return RC_ERROR;
+	}
+	rc = validate_distribution(&config->name_lookup);
+	if (rc == RC_OK) {
+		rc = validate_distribution(&config->connect);
+	}
+	if (rc == RC_OK) {
+		rc = validate_distribution(&config->start_transfer);
+	}
+	if (rc == RC_OK) {
+		rc = validate_distribution(&config->transfer);
+	}
+	if (rc != RC_OK) {
+		return rc;
+	}
+
+	memset(fake, 0, sizeof(ConnStatFakeTransport));
+	fake->config = *config;
+	fake->config.ip[MAX_SIZE_OF_IP_ADD - 1] = '\0';
+	if (fake->config.ip[0] == '\0') {
+		strcpy(fake->config.ip, FAKE_DEFAULT_IP);
+	}
+	if (fake->config.response_code == 0) {
+		fake->config.response_code = FAKE_DEFAULT_RESPONSE_CODE;
+	}
+	if (fake->config.failure_curl_code == 0) {
+		fake->config.failure_curl_code = FAKE_DEFAULT_FAILURE_CODE;
+	}
+
+	/* Seed the generator state with splitmix64 (never all zeros) */
+	seed = config->seed;
+	for (int i=0; i<4; i++) {
+		uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		fake->rng[i] = z ^ (z >> 31);
+	}
+
+	fake->transport.perform        = fake_perform;
+	fake->transport.transport_data = fake;
+	return RC_OK;
+}
+
+/*
+ * Non zero if following samples are taken by a caller set transport
+ */
+int transport_is_custom() {
+	return (g_transport != NULL);
+}
+
+/*
+ * Take a single sample of a target (curl is the target's configured handle,
+ * used by the libCURL transport only)
+ */
+RC transport_perform(CURL *curl, HttpReqData *p_http_req_data, CurlInfo *curl_info) {
+	CURLcode res;
+
+	if (g_transport != NULL) {
+		return g_transport->perform(p_http_req_data, curl_info,
+									g_transport->transport_data);
+	}
+
+	/* Perform the curl request */
+	res = curl_easy_perform(curl);
+	if (res != CURLE_OK) {
+		/* Keep going - failures are classified by the analysis */
+		fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	}
+
+	/* Collect statistics (a failure marks the sample as failed) */
+	return connection_stats_collect(curl, res, curl_info);
+}
+
+/*
+ * Back to the libCURL transport
+ */
+void transport_reset() {
+	g_transport = NULL;
+}
+
+/***********************
+** Supporting Methods **
+***********************/
+
+/*
+ * Fake a single sample: draw every phase, then apply the failures and the
+ * timeouts of the target (a sample over timeout_ms is cut at timeout_ms)
+ */
+static RC fake_perform(const HttpReqData *http_req_data, CurlInfo *curl_info,
+					   void *transport_data) {
+	ConnStatFakeTransport *fake = transport_data;
+	const ConnStatFakeConfig *config = &fake->config;
+	struct timespec now;
+
+	memset(curl_info, 0, sizeof(CurlInfo));
+	clock_gettime(CLOCK_REALTIME, &now);
+	curl_info->timestamp_us = (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+	curl_info->ip_idx = ip_table_intern(config->ip);
+	curl_info->num_of_connects = 1;
+
+	/* libCURL's timings are cumulative (all measured from the start) */
+	curl_info->name_lookup_time    = fake_draw(fake, &config->name_lookup);
+	curl_info->connect_time        = curl_info->name_lookup_time +
+									 fake_draw(fake, &config->connect);
+	curl_info->start_transfer_time = curl_info->connect_time +
+									 fake_draw(fake, &config->start_transfer);
+	curl_info->total_time          = curl_info->start_transfer_time +
+									 fake_draw(fake, &config->transfer);
+
+	if ((config->failure_ratio > 0) && (fake_uniform(fake) < config->failure_ratio)) {
+		curl_info->curl_code = config->failure_curl_code;
+		curl_info->connect_time = curl_info->start_transfer_time = 0;
+		curl_info->total_time = curl_info->name_lookup_time;
+		return RC_OK;
+	}
+
+	if ((http_req_data->connect_timeout_ms > 0) &&
+		(curl_info->connect_time * 1000 > http_req_data->connect_timeout_ms)) {
+		curl_info->curl_code = CURLE_OPERATION_TIMEDOUT;
+		curl_info->connect_time = curl_info->start_transfer_time = 0;
+		curl_info->total_time = http_req_data->connect_timeout_ms / 1000.0;
+		return RC_OK;
+	}
+	if ((http_req_data->timeout_ms > 0) &&
+		(curl_info->total_time * 1000 > http_req_data->timeout_ms)) {
+		curl_info->curl_code = CURLE_OPERATION_TIMEDOUT;
+		curl_info->total_time = http_req_data->timeout_ms / 1000.0;
+		if (curl_info->start_transfer_time > curl_info->total_time) {
+			curl_info->start_transfer_time = 0;
+		}
+		return RC_OK;
+	}
+
+	curl_info->response_code = config->response_code;
+	return RC_OK;
+}
+
+/*
+ * Draw a phase duration (negative draws count as 0)
+ */
+static double fake_draw(ConnStatFakeTransport *fake, const ConnStatDistribution *dist) {
+	double value;
+
+	switch (dist->type) {
+	case CONNSTAT_DIST_UNIFORM:
+		value = dist->a + (dist->b - dist->a) * fake_uniform(fake);
+		break;
+	case CONNSTAT_DIST_NORMAL:
+	case CONNSTAT_DIST_LOGNORMAL: {
+		/* Box-Muller (1 - u keeps log() away from 0) */
+		double u1 = 1.0 - fake_uniform(fake);
+		double u2 = fake_uniform(fake);
+		double z  = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+		value = dist->a + dist->b * z;
+		if (dist->type == CONNSTAT_DIST_LOGNORMAL) {
+			value = exp(value);
+		}
+		break;
+	}
+	case CONNSTAT_DIST_EXPONENTIAL:
+		value = dist->a - dist->b * log(1.0 - fake_uniform(fake));
+		break;
+	case CONNSTAT_DIST_CONSTANT:
+	default:
+		value = dist->a;
+		break;
+	}
+	return (value > 0) ? value : 0;
+}
+
+/*
+ * Uniform double in [0:1)
+ */
+static double fake_uniform(ConnStatFakeTransport *fake) {
+	return (fake_next(fake) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * xoshiro256** (Blackman & Vigna)
+ */
+static uint64_t fake_next(ConnStatFakeTransport *fake) {
+	uint64_t *s = (uint64_t *)fake->rng;
+	uint64_t x = s[1] * 5;
+	uint64_t result = ((x << 7) | (x >> 57)) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 45) | (s[3] >> 19);
+	return result;
+}
+
+/*
+ * Validate a distribution of the fake transport
+ */
+static RC validate_distribution(const ConnStatDistribution *dist) {
+	if ((dist->type < CONNSTAT_DIST_CONSTANT) || (dist->type > CONNSTAT_DIST_EXPONENTIAL) ||
+		!isfinite(dist->a) || !isfinite(dist->b) ||
+		((dist->type == CONNSTAT_DIST_UNIFORM) && (dist->b < dist->a)) ||
+		((dist->type != CONNSTAT_DIST_UNIFORM) && (dist->b < 0))) {
+		printf("connection_stats_fake_transport_init() fail with invalid distribution "
+			   "[type=%d, a=%f, b=%f]\n", dist->type, dist->a, dist->b);
+		return RC_ERROR;
+	}
+	return RC_OK;
+}